@@ -12,12 +12,30 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include "esp_timer.h"
+#include "midiHelper.h"
+#include "bleMidiPacket.h"
+#include "bleLzss.h"
+#include "bleLinkPolicy.h"
+#include "inputEventBus.h"
 
 
 #define LOG_TAG "bleGattClient"
 #define SUCCESS 0
 #define FAIL    1
 #define CONNECTION_MAX_RETRIES 10
+#define ATT_WRITE_HEADER_NUM_BYTES 3        //ATT opcode + attribute handle
+#define BLE_MIDI_STREAM_LOOKAHEAD_MS 40     //How far ahead of the playhead events are sent
+#define BLE_MIDI_MAX_PACKET_NUM_BYTES 512
+#define BLE_SYNC_PACKET_NUM_BYTES 10        //flags + opcode + 8 byte payload
+#define BLE_RESYNC_REQUEST_OPCODE 0x05      //Sent by the base unit when its project checksum disagrees
+#define BLE_TX_HEADER_NUM_BYTES 2           //flags + opcode
+#define BLE_TX_MAX_DATA_NUM_BYTES 510
+#define BLE_TX_FLAG_COMPRESSED 0b00000001   //Packet data is LZSS compressed, otherwise raw (see bleLzss.h)
+#define BLE_COMPRESS_FILE_UPLOADS true
+#define MIDI_NUM_CHANNELS 16
+#define MIDI_CC_ALL_NOTES_OFF 123
+#define BLE_NOTES_OFF_MAX_RETRIES 10        //Ticks to wait for controller buffers before giving up
 
 static char * addr_str(const void *addr);
 static void blecent_scan(void);
@@ -27,6 +45,8 @@ static void blecent_on_reset(int reason);
 static int gapEventHander(struct ble_gap_event *event, void *arg);
 static void connectIfTargetFound(const struct ble_gap_disc_desc *disc);
 static void discoveryProcessComplete(const struct peer *peer, int status, void *arg);
+static uint16_t getMaxMidiPacketNumBytes(void);
+static void sendAllNotesOff(void);
 
 void ble_store_config_init(void);
 
@@ -51,6 +71,9 @@ QueueHandle_t g_BleToHostQueueHandle;
 volatile bool isConnectedToTargetDevice = false;
 volatile bool Var = false;
 
+//Kept out of the task stack, the encoders hash table is 2KB
+static BleLzssEncoder g_lzssEncoder;
+
 
 //*********************************
 //This is the BLE central RTOS task
@@ -62,19 +85,134 @@ void blecent_host_task(void *param)
     nimble_port_freertos_deinit();
 }
 
+//Upload packets are built directly in an mbuf, this
+//header is followed by up to 510 bytes of packet data
 typedef struct{
     uint8_t flags;
     uint8_t opcode;
-    uint8_t data[510];
-}bleTXwrapper_t;
+}bleTXheader_t;
+
+//Upload transfer statistics, reset at the start of each upload
+static BleTxStats g_txStats;
+static int64_t g_txPacketStartMicros;
+
+//Set when the base unit rejects an upload packet. Every packet is compressed
+//against the data before it, so the rest of the file can't be decoded by the
+//base unit once one is lost, the upload has to be abandoned.
+static volatile bool g_isUploadWriteRejected = false;
 
 
 int bleDoneISR(uint16_t conn_handle, const struct ble_gatt_error *error, struct ble_gatt_attr *attr, void *arg)
 {
+    uint32_t latencyMicros = (uint32_t)(esp_timer_get_time() - g_txPacketStartMicros);
+
+    g_txStats.lastPacketLatencyMicros = latencyMicros;
+    g_txStats.totalPacketLatencyMicros += latencyMicros;
+    if(latencyMicros > g_txStats.maxPacketLatencyMicros) g_txStats.maxPacketLatencyMicros = latencyMicros;
+    if((error != NULL) && (error->status != 0))
+    {
+        ++g_txStats.numWriteErrors;
+        g_isUploadWriteRejected = true;
+    }
+
     Var = true;
     return 0;
 }
 
+
+//---- Public
+void bleCentAPI_getTxStats(BleTxStats * statsPtr)
+{
+    assert(statsPtr != NULL);
+    memcpy(statsPtr, &g_txStats, sizeof(BleTxStats));
+}
+
+
+static struct os_mbuf * buildUploadPacketMbuf(const bleTXheader_t * headerPtr, const uint8_t * srcPtr, uint32_t srcNumBytes, uint32_t * numBytesSentPtr)
+{
+    //Builds the next packet of a file upload directly in an mbuf, rather than
+    //assembling it on the stack and having NimBLE copy it again. Raw data is
+    //appended straight from the PSRAM file buffer (one copy), compressed data
+    //is written by the encoder in place (no copy). A compressed upload sends
+    //any packet that doesn't compress raw, with the compressed flag cleared.
+    //'numBytesSentPtr' tracks how much of the (uncompressed) file is done.
+
+    //RETURNS: The packet mbuf, or NULL if the mbuf pool is exhausted.
+
+    int64_t buildStartMicros = esp_timer_get_time();
+    struct os_mbuf * packetMbufPtr = ble_hs_mbuf_att_pkt();
+    uint16_t payloadNumBytes = 0;
+    uint16_t groupNumBytes;
+    uint8_t * groupPtr;
+    uint32_t packetSrcStartIdx = *numBytesSentPtr;
+    uint32_t rawNumBytes;
+    uint8_t rawFlags;
+
+    if(packetMbufPtr == NULL) return NULL;
+
+    if(os_mbuf_append(packetMbufPtr, headerPtr, BLE_TX_HEADER_NUM_BYTES) != 0)
+    {
+        os_mbuf_free_chain(packetMbufPtr);
+        return NULL;
+    }
+    g_txStats.numCopyBytes += BLE_TX_HEADER_NUM_BYTES;
+
+    if(headerPtr->flags & BLE_TX_FLAG_COMPRESSED)
+    {
+        //Space for one whole group is reserved at the tail of the mbuf,
+        //the encoder writes into it and any unused space is trimmed off.
+        while(((payloadNumBytes + BLE_LZSS_MAX_GROUP_NUM_BYTES) <= BLE_TX_MAX_DATA_NUM_BYTES) && (g_lzssEncoder.srcIdx < srcNumBytes))
+        {
+            groupPtr = os_mbuf_extend(packetMbufPtr, BLE_LZSS_MAX_GROUP_NUM_BYTES);
+            if(groupPtr == NULL)
+            {
+                os_mbuf_free_chain(packetMbufPtr);
+                return NULL;
+            }
+            groupNumBytes = bleLzss_encodeChunk(&g_lzssEncoder, groupPtr, BLE_LZSS_MAX_GROUP_NUM_BYTES);
+            os_mbuf_adj(packetMbufPtr, -(int)(BLE_LZSS_MAX_GROUP_NUM_BYTES - groupNumBytes));
+            payloadNumBytes += groupNumBytes;
+        }
+
+        //If compressing didn't pay off for this packet, send it raw instead
+        rawNumBytes = srcNumBytes - packetSrcStartIdx;
+        if(rawNumBytes > BLE_TX_MAX_DATA_NUM_BYTES) rawNumBytes = BLE_TX_MAX_DATA_NUM_BYTES;
+        if(bleLzss_isRawPacketBetter(payloadNumBytes, (g_lzssEncoder.srcIdx - packetSrcStartIdx), rawNumBytes))
+        {
+            rawFlags = headerPtr->flags & ~BLE_TX_FLAG_COMPRESSED;
+            os_mbuf_adj(packetMbufPtr, -(int)payloadNumBytes);
+            if((os_mbuf_copyinto(packetMbufPtr, 0, &rawFlags, 1) != 0) ||
+               (os_mbuf_append(packetMbufPtr, srcPtr + packetSrcStartIdx, rawNumBytes) != 0))
+            {
+                os_mbuf_free_chain(packetMbufPtr);
+                return NULL;
+            }
+            g_txStats.numCopyBytes += rawNumBytes;
+            ++g_txStats.numRawPackets;
+            payloadNumBytes = rawNumBytes;
+            bleLzss_skipTo(&g_lzssEncoder, packetSrcStartIdx + rawNumBytes);
+        }
+        *numBytesSentPtr = g_lzssEncoder.srcIdx;
+    }
+    else
+    {
+        payloadNumBytes = BLE_TX_MAX_DATA_NUM_BYTES;
+        if((srcNumBytes - *numBytesSentPtr) < payloadNumBytes) payloadNumBytes = (srcNumBytes - *numBytesSentPtr);
+        if(os_mbuf_append(packetMbufPtr, srcPtr + *numBytesSentPtr, payloadNumBytes) != 0)
+        {
+            os_mbuf_free_chain(packetMbufPtr);
+            return NULL;
+        }
+        g_txStats.numCopyBytes += payloadNumBytes;
+        *numBytesSentPtr += payloadNumBytes;
+    }
+
+    ++g_txStats.numPackets;
+    g_txStats.numPayloadBytes += payloadNumBytes;
+    g_txStats.totalBuildMicros += (uint32_t)(esp_timer_get_time() - buildStartMicros);
+    return packetMbufPtr;
+}
+
 //*************************************
 //This is the BLE runtime API RTOS task
 //used to communicate with BLE Central
@@ -86,13 +224,30 @@ void bleCentAPI_task(void * param)
     uint32_t localDataLength = 0;
 
     uint32_t numBytesSent = 0;
-    bleTXwrapper_t bleTXpayload;
+    int retVal;
+    bleTXheader_t bleTXheader = {0};
+    struct os_mbuf * packetMbufPtr = NULL;
+    bool isUploadAborted = false;
+
+    //Used while streaming a compiled playback event list
+    const MidiPlaybackEvent * eventListPtr = NULL;
+    uint32_t eventListNumEvents = 0;
+    uint32_t eventListNextIdx = 0;
+    uint32_t numEventsEncoded = 0;
+    uint32_t streamStartTimeMs = 0;
+    uint32_t sendBeforeMs = 0;
+    uint16_t midiPacketNumBytes = 0;
+    uint16_t maxPacketNumBytes = 0;
+    uint8_t midiPacket[BLE_MIDI_MAX_PACKET_NUM_BYTES];
+
+    //Used for small single packet sync messages (edit deltas / checksums)
+    uint8_t syncPacket[BLE_SYNC_PACKET_NUM_BYTES];
 
 
     //Used for ALL app to BLE comms
     HostToBleQueueItem g_HostToBleQueueHandleItem;
 
-    uint8_t responseForApp;
+    uint8_t responseForApp = bleTaskStarted;
 
     //SEND QUEUE ITEM TO APP
     //TO INDICATE BLE IS READY
@@ -105,11 +260,14 @@ void bleCentAPI_task(void * param)
         ESP_LOGE(LOG_TAG, "Failure adding item to g_BleToHostQueueHandle - ble task startup failed, deleting task");
         vTaskDelete(NULL); //Delete *this* task
     }
+    inputEventBus_wake(inputBusSystem);
 
     while(1)
     {
 
-        if(uxQueueMessagesWaiting(g_HostToBleQueueHandle))
+        //Queue items are left waiting while a long write is in progress,
+        //so that sync messages are never interleaved with a file transfer
+        if((state != 2) && uxQueueMessagesWaiting(g_HostToBleQueueHandle))
         {
             //Receieve from queue - dont wait for data to become available
             if(xQueueReceive(g_HostToBleQueueHandle, &g_HostToBleQueueHandleItem, 0) == 1)
@@ -119,8 +277,65 @@ void bleCentAPI_task(void * param)
                 if(g_HostToBleQueueHandleItem.opcode == 0x55)
                 {
                     ESP_LOGI(LOG_TAG, "File playback requested");
+                    //An upload replaces a running event stream, stop
+                    //it cleanly so no notes are left hanging
+                    if(state == 5) sendAllNotesOff();
                     state = 1;
                 }
+                else if(g_HostToBleQueueHandleItem.opcode == startPlayback)
+                {
+                    ESP_LOGI(LOG_TAG, "Event stream playback requested");
+                    if(state == 5) sendAllNotesOff();
+                    state = 4;
+                }
+                else if(g_HostToBleQueueHandleItem.opcode == stopPlayback)
+                {
+                    ESP_LOGI(LOG_TAG, "Event stream stop requested");
+                    if(state == 5) state = 6;
+                }
+                else if(((g_HostToBleQueueHandleItem.opcode == sendGridEditDelta) || (g_HostToBleQueueHandleItem.opcode == sendGridChecksum)) &&
+                        (characteristic_0 == NULL))
+                {
+                    //Lost the connection since the item was queued, the base
+                    //unit will ask for a resync once it is back
+                    ESP_LOGW(LOG_TAG, "Not connected, sync message dropped");
+                }
+                else if(g_HostToBleQueueHandleItem.opcode == sendGridEditDelta)
+                {
+                    //A single edit fits within one small packet, so rather
+                    //than re-sending the whole file the base unit applies
+                    //the edit to its own copy of the project.
+                    syncPacket[0] = 0b00110000;  //First & last packet
+                    syncPacket[1] = 0x03;
+                    syncPacket[2] = g_HostToBleQueueHandleItem.editDelta.editType;
+                    syncPacket[3] = (uint8_t)(g_HostToBleQueueHandleItem.editDelta.gridColumn & 0xFF);
+                    syncPacket[4] = (uint8_t)(g_HostToBleQueueHandleItem.editDelta.gridColumn >> 8);
+                    syncPacket[5] = g_HostToBleQueueHandleItem.editDelta.gridRow;
+                    syncPacket[6] = g_HostToBleQueueHandleItem.editDelta.statusByte;
+                    syncPacket[7] = g_HostToBleQueueHandleItem.editDelta.dataBytes[0];
+                    syncPacket[8] = g_HostToBleQueueHandleItem.editDelta.dataBytes[1];
+                    syncPacket[9] = g_HostToBleQueueHandleItem.editDelta.durationInSteps;
+                    if(ble_gattc_write_flat(connectionHandle, characteristic_0->chr.val_handle, syncPacket, BLE_SYNC_PACKET_NUM_BYTES, NULL, NULL) != 0)
+                    {
+                        ESP_LOGE(LOG_TAG, "Error: Failed to send grid edit delta");
+                    }
+                }
+                else if(g_HostToBleQueueHandleItem.opcode == sendGridChecksum)
+                {
+                    //The base unit compares this against a checksum of its own
+                    //copy of the project, if they differ it requests a resync
+                    syncPacket[0] = 0b00110000;  //First & last packet
+                    syncPacket[1] = 0x04;
+                    for(uint8_t idx = 0; idx < 4; ++idx)
+                    {
+                        syncPacket[2 + idx] = (uint8_t)(g_HostToBleQueueHandleItem.dataLength >> (idx * 8));
+                        syncPacket[6 + idx] = (uint8_t)(g_HostToBleQueueHandleItem.gridChecksum >> (idx * 8));
+                    }
+                    if(ble_gattc_write_flat(connectionHandle, characteristic_0->chr.val_handle, syncPacket, BLE_SYNC_PACKET_NUM_BYTES, NULL, NULL) != 0)
+                    {
+                        ESP_LOGE(LOG_TAG, "Error: Failed to send grid checksum");
+                    }
+                }
             }
         }
 
@@ -132,37 +347,172 @@ void bleCentAPI_task(void * param)
 
             case 1: //Starting new playback stream
                 ESP_LOGI(LOG_TAG, "Playback first packet (TOTAL bytes: %ld", g_HostToBleQueueHandleItem.dataLength);
-                bleTXpayload.flags = 0b00100000;
-                bleTXpayload.opcode = 0x01;
+                bleTXheader.flags = 0b00100000;
+                bleTXheader.opcode = 0x01;
                 localDataPtr = g_HostToBleQueueHandleItem.dataPtr;
                 localDataLength = g_HostToBleQueueHandleItem.dataLength;
-                memcpy(bleTXpayload.data, localDataPtr, 510);
-                Var = false;
-                ble_gattc_write_flat(connectionHandle, characteristic_0->chr.val_handle, &bleTXpayload, 512, bleDoneISR, NULL);
-                numBytesSent = 510;
+                numBytesSent = 0;
+                isUploadAborted = false;
+                g_isUploadWriteRejected = false;
+                memset(&g_txStats, 0, sizeof(g_txStats));
+                bleLinkPolicy_setMode(connectionHandle, bleLinkModeBulkUpload);
+
+                if(BLE_COMPRESS_FILE_UPLOADS)
+                {
+                    //The file is compressed as it is chunked, so only
+                    //the encoder state is needed rather than a copy
+                    bleLzss_initEncoder(&g_lzssEncoder, localDataPtr, localDataLength);
+                    bleTXheader.flags |= BLE_TX_FLAG_COMPRESSED;
+                }
+                //First packet is sent by the ongoing state
+                Var = true;
                 state++;
                 break;
 
             case 2: //Ongoing playback stream
                 if(Var == true)
                 {
-                    ESP_LOGI(LOG_TAG, "Ongoing packet..");
-                    bleTXpayload.flags = 0b00010000;
-                    bleTXpayload.opcode = 0x02;
-                    memcpy(bleTXpayload.data, localDataPtr + numBytesSent, 510);
-                    Var = false;
-                    ble_gattc_write_flat(connectionHandle, characteristic_0->chr.val_handle, &bleTXpayload, 512, bleDoneISR, NULL);
-                    numBytesSent += 510;
+                    if(g_isUploadWriteRejected)
+                    {
+                        //Resending just this packet wouldn't help if the base unit
+                        //has already dropped the transfer, the system sends the
+                        //whole file again from the first packet instead
+                        ESP_LOGE(LOG_TAG, "Error: Upload packet rejected by the base unit, upload aborted");
+                        isUploadAborted = true;
+                        state = 3;
+                        break;
+                    }
+
+                    //The last packet could still be rejected, so the upload
+                    //isn't finished until the base unit has answered it
                     if(numBytesSent >= localDataLength)
                     {
                         ESP_LOGI(LOG_TAG, "final num bytes sent: %ld", numBytesSent);
-                        state++;
+                        state = 3;
+                        break;
+                    }
+
+                    if(characteristic_0 == NULL)
+                    {
+                        ESP_LOGE(LOG_TAG, "Error: Not connected, upload aborted");
+                        isUploadAborted = true;
+                        state = 3;
+                        break;
                     }
+
+                    packetMbufPtr = buildUploadPacketMbuf(&bleTXheader, localDataPtr, localDataLength, &numBytesSent);
+                    if(packetMbufPtr == NULL)
+                    {
+                        ESP_LOGE(LOG_TAG, "Error: No mbufs available, upload aborted");
+                        isUploadAborted = true;
+                        state = 3;
+                        break;
+                    }
+
+                    //NimBLE takes ownership of the mbuf, even on failure
+                    Var = false;
+                    g_txPacketStartMicros = esp_timer_get_time();
+                    retVal = ble_gattc_write(connectionHandle, characteristic_0->chr.val_handle, packetMbufPtr, bleDoneISR, NULL);
+                    if(retVal != 0)
+                    {
+                        //'bleDoneISR' is never called for a write that wasn't
+                        //issued, so waiting for it would stall the task here
+                        ++g_txStats.numWriteErrors;
+                        ESP_LOGE(LOG_TAG, "Error: Upload packet write failed (%d), upload aborted", retVal);
+                        isUploadAborted = true;
+                        state = 3;
+                        break;
+                    }
+
+                    //All packets after the first are 'ongoing' packets
+                    bleTXheader.flags = (bleTXheader.flags & BLE_TX_FLAG_COMPRESSED) | 0b00010000;
+                    bleTXheader.opcode = 0x02;
                 }
                 break;
 
             case 3: 
                 ESP_LOGI(LOG_TAG, "Finished playback stream");
+                bleLinkPolicy_setMode(connectionHandle, bleLinkModeLivePlayback);
+
+                //The encoder reads the file as it goes, so the system has to
+                //leave the file buffer alone until it hears the upload is over
+                responseForApp = (isUploadAborted) ? bleUploadFailed : bleUploadFinished;
+                xQueueSend(g_BleToHostQueueHandle, &responseForApp, portMAX_DELAY);
+                inputEventBus_wake(inputBusSystem);
+
+                ESP_LOGI(LOG_TAG, "Packets: %ld (%ld raw), payload bytes: %ld, copied bytes: %ld, write errors: %ld", g_txStats.numPackets, 
+                                    g_txStats.numRawPackets, g_txStats.numPayloadBytes, g_txStats.numCopyBytes, g_txStats.numWriteErrors);
+                ESP_LOGI(LOG_TAG, "Packet build time: %ld us, latency max: %ld us, avg: %ld us", g_txStats.totalBuildMicros, g_txStats.maxPacketLatencyMicros,
+                                    (g_txStats.numPackets) ? (uint32_t)(g_txStats.totalPacketLatencyMicros / g_txStats.numPackets) : 0);
+                state = 0;
+                break;
+
+            case 4: //Starting new event stream
+                //Rather than transfer a whole midi file before playback can begin,
+                //the compiled event list is streamed as timestamped BLE-MIDI packets
+                //a short time ahead of the playhead. The peripheral only needs a small
+                //jitter buffer, as it schedules each event using its timestamp.
+                if(!isConnectedToTargetDevice || (characteristic_1 == NULL))
+                {
+                    ESP_LOGW(LOG_TAG, "Not connected, event stream not started");
+                    state = 0;
+                    break;
+                }
+                eventListPtr = (const MidiPlaybackEvent *)g_HostToBleQueueHandleItem.dataPtr;
+                eventListNumEvents = g_HostToBleQueueHandleItem.dataLength / sizeof(MidiPlaybackEvent);
+                eventListNextIdx = 0;
+                //The sequence starts one lookahead window from now, so even
+                //the first events reach the peripheral ahead of their time
+                streamStartTimeMs = (uint32_t)(esp_timer_get_time() / 1000) + BLE_MIDI_STREAM_LOOKAHEAD_MS;
+                bleLinkPolicy_setMode(connectionHandle, bleLinkModeLivePlayback);
+                ESP_LOGI(LOG_TAG, "Event stream started (TOTAL events: %ld)", eventListNumEvents);
+                state++;
+                break;
+
+            case 5: //Ongoing event stream
+                if(eventListNextIdx >= eventListNumEvents)
+                {
+                    ESP_LOGI(LOG_TAG, "Finished event stream");
+                    state = 0;
+                    break;
+                }
+
+                if(!isConnectedToTargetDevice || (characteristic_1 == NULL))
+                {
+                    //Nothing to send notes off to, the peripheral
+                    //is expected to silence itself on disconnect
+                    ESP_LOGW(LOG_TAG, "Connection lost, event stream abandoned");
+                    state = 0;
+                    break;
+                }
+
+                //Sequence time up to which events are due to be sent
+                sendBeforeMs = ((uint32_t)(esp_timer_get_time() / 1000) + BLE_MIDI_STREAM_LOOKAHEAD_MS) - streamStartTimeMs;
+                maxPacketNumBytes = getMaxMidiPacketNumBytes();
+
+                //Send as many packets as are needed to cover the lookahead window,
+                //each packet holds as many due events as the current MTU allows
+                do
+                {
+                    midiPacketNumBytes = bleMidi_encodeEventPacket(midiPacket, maxPacketNumBytes,
+                                                    &eventListPtr[eventListNextIdx], (eventListNumEvents - eventListNextIdx),
+                                                    streamStartTimeMs, sendBeforeMs, &numEventsEncoded);
+                    if(midiPacketNumBytes == 0) break;
+
+                    if(ble_gattc_write_no_rsp_flat(connectionHandle, characteristic_1->chr.val_handle, midiPacket, midiPacketNumBytes) != 0)
+                    {
+                        //Controller buffers are full, retry on the next pass
+                        break;
+                    }
+                    eventListNextIdx += numEventsEncoded;
+
+                } while(eventListNextIdx < eventListNumEvents);
+                break;
+
+            case 6: //Event stream stopped early
+                //Make sure no notes are left hanging on the peripheral
+                sendAllNotesOff();
+                ESP_LOGI(LOG_TAG, "Event stream stopped");
                 state = 0;
                 break;
 
@@ -190,6 +540,75 @@ void bleCentAPI_task(void * param)
 
 
 
+//---- Private
+static uint16_t getMaxMidiPacketNumBytes(void)
+{
+    //Packets can't exceed the negotiated MTU (less the ATT header)
+    //RETURNS: Zero while there is no MTU (not connected)
+
+    BleLinkState linkState;
+    uint16_t maxPacketNumBytes;
+
+    bleLinkPolicy_getLinkState(&linkState);
+    if(linkState.mtu <= ATT_WRITE_HEADER_NUM_BYTES) return 0;
+
+    maxPacketNumBytes = linkState.mtu - ATT_WRITE_HEADER_NUM_BYTES;
+    if(maxPacketNumBytes > BLE_MIDI_MAX_PACKET_NUM_BYTES) maxPacketNumBytes = BLE_MIDI_MAX_PACKET_NUM_BYTES;
+    return maxPacketNumBytes;
+}
+
+
+//---- Private
+static void sendAllNotesOff(void)
+{
+    //Sends an 'all notes off' control change on every midi channel, as the
+    //stream may have started notes on any of them. The messages share one
+    //timestamp, so they are packed by the event packet encoder like any
+    //other events, a small MTU just means more than one packet.
+
+    MidiPlaybackEvent notesOffEvents[MIDI_NUM_CHANNELS];
+    uint8_t packet[1 + (MIDI_NUM_CHANNELS * BLE_MIDI_MAX_EVENT_NUM_BYTES)];
+    uint16_t maxPacketNumBytes = getMaxMidiPacketNumBytes();
+    uint16_t packetNumBytes;
+    uint32_t nowMs = (uint32_t)(esp_timer_get_time() / 1000);
+    uint32_t nextChannel = 0;
+    uint32_t numEncoded;
+    uint8_t numRetries = 0;
+
+    if(!isConnectedToTargetDevice || (characteristic_1 == NULL) || (maxPacketNumBytes == 0)) return;
+    if(maxPacketNumBytes > sizeof(packet)) maxPacketNumBytes = sizeof(packet);
+
+    for(uint8_t channel = 0; channel < MIDI_NUM_CHANNELS; ++channel)
+    {
+        notesOffEvents[channel].timestampMs = 0;
+        notesOffEvents[channel].statusByte = 0xB0 | channel;
+        notesOffEvents[channel].dataBytes[0] = MIDI_CC_ALL_NOTES_OFF;
+        notesOffEvents[channel].dataBytes[1] = 0x00;
+    }
+
+    while(nextChannel < MIDI_NUM_CHANNELS)
+    {
+        packetNumBytes = bleMidi_encodeEventPacket(packet, maxPacketNumBytes, &notesOffEvents[nextChannel],
+                                                   (MIDI_NUM_CHANNELS - nextChannel), nowMs, 1, &numEncoded);
+        if(packetNumBytes == 0) break;
+
+        if((characteristic_1 == NULL) || (ble_gattc_write_no_rsp_flat(connectionHandle, characteristic_1->chr.val_handle, packet, packetNumBytes) != 0))
+        {
+            //Controller buffers are full, give them a tick to drain
+            if(++numRetries > BLE_NOTES_OFF_MAX_RETRIES)
+            {
+                ESP_LOGE(LOG_TAG, "Error: Failed to send all notes off from channel %ld", nextChannel);
+                return;
+            }
+            vTaskDelay(1);
+            continue;
+        }
+        nextChannel += numEncoded;
+    }
+}
+
+
+
 
 static uint8_t initNimBle(void)
 {
@@ -440,11 +859,8 @@ static int gapEventHander(struct ble_gap_event *event, void *arg)
                     return 0;
                 }
 
-                //IMPORTANT
-                //Increase default mtu (23)
-                //to maximum allowed by esp32 (517)
-                ble_att_set_preferred_mtu(517);
-                ble_gattc_exchange_mtu(event->connect.conn_handle, NULL, NULL);
+                //Request MTU, connection params, data length and PHY
+                bleLinkPolicy_onConnect(event->connect.conn_handle);
             } 
             else 
             {
@@ -460,6 +876,11 @@ static int gapEventHander(struct ble_gap_event *event, void *arg)
             //print_conn_desc(&event->disconnect.conn);
             MODLOG_DFLT(INFO, "\n");
 
+            //The characteristics belong to the peer, which is about to be freed
+            isConnectedToTargetDevice = false;
+            characteristic_0 = NULL;
+            characteristic_1 = NULL;
+            bleLinkPolicy_onDisconnect();
             peer_delete(event->disconnect.conn.conn_handle);
             blecent_scan();
             return 0;
@@ -486,6 +907,18 @@ static int gapEventHander(struct ble_gap_event *event, void *arg)
 
             /* Attribute data is contained in event->notify_rx.om. Use
             * `os_mbuf_copydata` to copy the data received in notification mbuf */
+            {
+                uint8_t notifyOpcode = 0;
+                uint8_t responseForApp = bleResyncRequested;
+                if((os_mbuf_copydata(event->notify_rx.om, 0, 1, &notifyOpcode) == 0) && (notifyOpcode == BLE_RESYNC_REQUEST_OPCODE))
+                {
+                    //Base unit has detected its copy of the project has drifted,
+                    //let the system know a full file transfer is required.
+                    //The system task blocks on its input bus, so wake it.
+                    xQueueSend(g_BleToHostQueueHandle, &responseForApp, 0);
+                    inputEventBus_wake(inputBusSystem);
+                }
+            }
             return 0;
 
         case BLE_GAP_EVENT_MTU:
@@ -493,6 +926,20 @@ static int gapEventHander(struct ble_gap_event *event, void *arg)
                         event->mtu.conn_handle,
                         event->mtu.channel_id,
                         event->mtu.value);
+            bleLinkPolicy_onMtuUpdated(event->mtu.value);
+            return 0;
+
+        case BLE_GAP_EVENT_CONN_UPDATE:
+            if(event->conn_update.status == 0) bleLinkPolicy_onConnParamsUpdated(event->conn_update.conn_handle);
+            return 0;
+
+        case BLE_GAP_EVENT_PHY_UPDATE_COMPLETE:
+            if(event->phy_updated.status == 0) bleLinkPolicy_onPhyUpdated(event->phy_updated.tx_phy, event->phy_updated.rx_phy);
+            return 0;
+
+        case BLE_GAP_EVENT_DATA_LEN_CHG:
+            bleLinkPolicy_onDataLenChanged(event->data_len_chg.max_tx_octets, event->data_len_chg.max_tx_time,
+                                           event->data_len_chg.max_rx_octets, event->data_len_chg.max_rx_time);
             return 0;
 
         case BLE_GAP_EVENT_REPEAT_PAIRING:
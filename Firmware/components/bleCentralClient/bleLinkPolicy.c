@@ -0,0 +1,246 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "host/ble_hs.h"
+#include "bleLinkPolicy.h"
+
+#define LOG_TAG "bleLinkPolicy"
+#define BLE_DEFAULT_ATT_MTU 23
+
+
+//This module decides how the BLE link should be configured for
+//the current operation and keeps a record of what the peer agreed.
+
+//Bulk uploads want as many bytes per connection event as possible,
+//a longer interval lets the controller pack more packets into each
+//event. Live playback wants events to reach the base unit quickly,
+//so the shortest interval is used. Both use the 2M PHY and the
+//maximum data length, which cuts airtime per packet in either case.
+
+//The MTU can only be exchanged once per connection, so the largest
+//supported MTU is requested on connect regardless of mode.
+
+//The link state is written from the NimBLE host task (GAP events) and
+//read from the BLE client task, every access is made under a spinlock.
+//Only copies are made while it is held, never any GAP calls.
+
+static const BleLinkParams g_linkParamsBulkUpload = {
+    .connIntervalMin = BLE_CONN_INTERVAL_US_TO_UNITS(15000),
+    .connIntervalMax = BLE_CONN_INTERVAL_US_TO_UNITS(30000),
+    .peripheralLatency = 0,
+    .supervisionTimeout = BLE_SUPERVISION_TIMEOUT_MS_TO_UNITS(4000),
+    .dataLenTxOctets = BLE_LINK_MAX_TX_OCTETS,
+    .dataLenTxTimeUs = BLE_LINK_MAX_TX_TIME_US,
+    .preferredPhyMask = BLE_GAP_LE_PHY_2M_MASK
+};
+
+static const BleLinkParams g_linkParamsLivePlayback = {
+    .connIntervalMin = BLE_CONN_INTERVAL_US_TO_UNITS(7500),
+    .connIntervalMax = BLE_CONN_INTERVAL_US_TO_UNITS(7500),
+    .peripheralLatency = 0,
+    .supervisionTimeout = BLE_SUPERVISION_TIMEOUT_MS_TO_UNITS(2000),
+    .dataLenTxOctets = BLE_LINK_MAX_TX_OCTETS,
+    .dataLenTxTimeUs = BLE_LINK_MAX_TX_TIME_US,
+    .preferredPhyMask = BLE_GAP_LE_PHY_2M_MASK
+};
+
+static BleLinkState g_linkState;
+static portMUX_TYPE g_linkStateLock = portMUX_INITIALIZER_UNLOCKED;
+
+//The mode last asked for, which differs from 'g_linkState.linkMode'
+//until the peer has been sent every request for it
+static uint8_t g_wantedLinkMode = bleLinkModeNone;
+
+
+
+//---- Public
+const BleLinkParams * bleLinkPolicy_selectParams(uint8_t linkMode)
+{
+    //Pure selection, no BLE stack calls are made here.
+    //RETURNS: The parameters to request for the given mode, NULL for 'none'.
+
+    switch(linkMode)
+    {
+        case bleLinkModeBulkUpload:
+            return &g_linkParamsBulkUpload;
+
+        case bleLinkModeLivePlayback:
+            return &g_linkParamsLivePlayback;
+
+        default:
+            return NULL;
+    }
+}
+
+
+
+//---- Public
+void bleLinkPolicy_onConnect(uint16_t connHandle)
+{
+    taskENTER_CRITICAL(&g_linkStateLock);
+    memset(&g_linkState, 0, sizeof(g_linkState));
+    g_linkState.mtu = BLE_DEFAULT_ATT_MTU;
+    taskEXIT_CRITICAL(&g_linkStateLock);
+    g_wantedLinkMode = bleLinkModeNone;
+
+    //IMPORTANT
+    //Increase default mtu (23)
+    //to maximum allowed by esp32 (517)
+    ble_att_set_preferred_mtu(BLE_LINK_MAX_MTU);
+    ble_gattc_exchange_mtu(connHandle, NULL, NULL);
+
+    //Until told otherwise the link is kept responsive for editing
+    bleLinkPolicy_setMode(connHandle, bleLinkModeLivePlayback);
+}
+
+
+
+//---- Public
+void bleLinkPolicy_onDisconnect(void)
+{
+    taskENTER_CRITICAL(&g_linkStateLock);
+    memset(&g_linkState, 0, sizeof(g_linkState));
+    taskEXIT_CRITICAL(&g_linkStateLock);
+    g_wantedLinkMode = bleLinkModeNone;
+}
+
+
+
+//---- Public
+void bleLinkPolicy_setMode(uint16_t connHandle, uint8_t linkMode)
+{
+    //Requests the parameters for the given mode from the peer, the
+    //agreed values are recorded as the GAP update events arrive.
+    //Nothing is requested if the link is already in this mode.
+    //The mode is only recorded once every request has been accepted,
+    //if one is refused (typically as an earlier connection update is
+    //still in progress) it is retried when that update completes.
+
+    const BleLinkParams * paramsPtr = bleLinkPolicy_selectParams(linkMode);
+    struct ble_gap_upd_params updateParams;
+    bool isAccepted = true;
+    uint8_t currentLinkMode;
+    int retVal;
+
+    if(paramsPtr == NULL) return;
+    g_wantedLinkMode = linkMode;
+
+    taskENTER_CRITICAL(&g_linkStateLock);
+    currentLinkMode = g_linkState.linkMode;
+    taskEXIT_CRITICAL(&g_linkStateLock);
+    if(currentLinkMode == linkMode) return;
+
+    updateParams.itvl_min = paramsPtr->connIntervalMin;
+    updateParams.itvl_max = paramsPtr->connIntervalMax;
+    updateParams.latency = paramsPtr->peripheralLatency;
+    updateParams.supervision_timeout = paramsPtr->supervisionTimeout;
+    updateParams.min_ce_len = 0;
+    updateParams.max_ce_len = 0;
+
+    retVal = ble_gap_update_params(connHandle, &updateParams);
+    if(retVal != 0)
+    {
+        ESP_LOGE(LOG_TAG, "Error: Connection parameter update request failed (%d)", retVal);
+        isAccepted = false;
+    }
+
+    retVal = ble_gap_set_data_len(connHandle, paramsPtr->dataLenTxOctets, paramsPtr->dataLenTxTimeUs);
+    if(retVal != 0)
+    {
+        ESP_LOGE(LOG_TAG, "Error: Data length request failed (%d)", retVal);
+        isAccepted = false;
+    }
+
+    retVal = ble_gap_set_prefered_le_phy(connHandle, paramsPtr->preferredPhyMask, paramsPtr->preferredPhyMask, BLE_GAP_LE_PHY_CODED_ANY);
+    if(retVal != 0)
+    {
+        ESP_LOGE(LOG_TAG, "Error: PHY update request failed (%d)", retVal);
+        isAccepted = false;
+    }
+
+    if(!isAccepted) return;
+
+    taskENTER_CRITICAL(&g_linkStateLock);
+    g_linkState.linkMode = linkMode;
+    taskEXIT_CRITICAL(&g_linkStateLock);
+    ESP_LOGI(LOG_TAG, "Link mode %d requested", linkMode);
+}
+
+
+
+//---- Public
+void bleLinkPolicy_onConnParamsUpdated(uint16_t connHandle)
+{
+    struct ble_gap_conn_desc connDesc;
+
+    uint8_t currentLinkMode;
+
+    if(ble_gap_conn_find(connHandle, &connDesc) != 0) return;
+
+    taskENTER_CRITICAL(&g_linkStateLock);
+    g_linkState.connInterval = connDesc.conn_itvl;
+    g_linkState.peripheralLatency = connDesc.conn_latency;
+    g_linkState.supervisionTimeout = connDesc.supervision_timeout;
+    currentLinkMode = g_linkState.linkMode;
+    taskEXIT_CRITICAL(&g_linkStateLock);
+    ESP_LOGI(LOG_TAG, "Connection params: interval %d, latency %d, timeout %d",
+                        connDesc.conn_itvl, connDesc.conn_latency, connDesc.supervision_timeout);
+
+    //The update that got in the way of a mode change is done, try it again
+    if((g_wantedLinkMode != bleLinkModeNone) && (g_wantedLinkMode != currentLinkMode)) bleLinkPolicy_setMode(connHandle, g_wantedLinkMode);
+}
+
+
+
+//---- Public
+void bleLinkPolicy_onPhyUpdated(uint8_t txPhy, uint8_t rxPhy)
+{
+    taskENTER_CRITICAL(&g_linkStateLock);
+    g_linkState.txPhy = txPhy;
+    g_linkState.rxPhy = rxPhy;
+    taskEXIT_CRITICAL(&g_linkStateLock);
+    ESP_LOGI(LOG_TAG, "PHY: tx %d, rx %d", txPhy, rxPhy);
+}
+
+
+
+//---- Public
+void bleLinkPolicy_onMtuUpdated(uint16_t mtu)
+{
+    taskENTER_CRITICAL(&g_linkStateLock);
+    g_linkState.mtu = mtu;
+    taskEXIT_CRITICAL(&g_linkStateLock);
+}
+
+
+
+//---- Public
+void bleLinkPolicy_onDataLenChanged(uint16_t txOctets, uint16_t txTimeUs, uint16_t rxOctets, uint16_t rxTimeUs)
+{
+    //The controllers agree on data length between themselves,
+    //this is the result, which limits the bytes per LL packet
+    taskENTER_CRITICAL(&g_linkStateLock);
+    g_linkState.dataLenTxOctets = txOctets;
+    g_linkState.dataLenTxTimeUs = txTimeUs;
+    g_linkState.dataLenRxOctets = rxOctets;
+    g_linkState.dataLenRxTimeUs = rxTimeUs;
+    taskEXIT_CRITICAL(&g_linkStateLock);
+    ESP_LOGI(LOG_TAG, "Data length: tx %d octets / %d us, rx %d octets / %d us", txOctets, txTimeUs, rxOctets, rxTimeUs);
+}
+
+
+
+//---- Public
+void bleLinkPolicy_getLinkState(BleLinkState * linkStatePtr)
+{
+    assert(linkStatePtr != NULL);
+
+    taskENTER_CRITICAL(&g_linkStateLock);
+    memcpy(linkStatePtr, &g_linkState, sizeof(BleLinkState));
+    taskEXIT_CRITICAL(&g_linkStateLock);
+}
@@ -0,0 +1,61 @@
+
+//Connection interval and supervision timeout units are
+//as used by the controller (1.25ms and 10ms respectively),
+//intervals are given in microseconds to keep them integer
+#define BLE_CONN_INTERVAL_UNIT_US           1250
+#define BLE_CONN_INTERVAL_US_TO_UNITS(X)    ((X) / BLE_CONN_INTERVAL_UNIT_US)
+#define BLE_SUPERVISION_TIMEOUT_MS_TO_UNITS(X) ((X) / 10)
+
+#define BLE_LINK_MAX_MTU            517
+#define BLE_LINK_MAX_TX_OCTETS      251
+#define BLE_LINK_MAX_TX_TIME_US     2120
+
+
+//The link is tuned for the current operation
+enum
+{
+    bleLinkModeNone,
+    bleLinkModeBulkUpload,      //Full file transfers, favours throughput
+    bleLinkModeLivePlayback     //Event streaming / edit deltas, favours latency
+};
+
+
+//Parameters requested from the peer for each link mode
+typedef struct
+{
+    uint16_t connIntervalMin;
+    uint16_t connIntervalMax;
+    uint16_t peripheralLatency;
+    uint16_t supervisionTimeout;
+    uint16_t dataLenTxOctets;
+    uint16_t dataLenTxTimeUs;
+    uint8_t  preferredPhyMask;
+} BleLinkParams;
+
+
+//What was actually agreed with the peer, updated from GAP events
+typedef struct
+{
+    uint8_t  linkMode;
+    uint16_t connInterval;
+    uint16_t peripheralLatency;
+    uint16_t supervisionTimeout;
+    uint16_t mtu;
+    uint8_t  txPhy;
+    uint8_t  rxPhy;
+    uint16_t dataLenTxOctets;
+    uint16_t dataLenTxTimeUs;
+    uint16_t dataLenRxOctets;
+    uint16_t dataLenRxTimeUs;
+} BleLinkState;
+
+
+const BleLinkParams * bleLinkPolicy_selectParams(uint8_t linkMode);
+void bleLinkPolicy_onConnect(uint16_t connHandle);
+void bleLinkPolicy_onDisconnect(void);
+void bleLinkPolicy_setMode(uint16_t connHandle, uint8_t linkMode);
+void bleLinkPolicy_onConnParamsUpdated(uint16_t connHandle);
+void bleLinkPolicy_onPhyUpdated(uint8_t txPhy, uint8_t rxPhy);
+void bleLinkPolicy_onMtuUpdated(uint16_t mtu);
+void bleLinkPolicy_onDataLenChanged(uint16_t txOctets, uint16_t txTimeUs, uint16_t rxOctets, uint16_t rxTimeUs);
+void bleLinkPolicy_getLinkState(BleLinkState * linkStatePtr);
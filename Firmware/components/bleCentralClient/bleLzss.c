@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include "bleLzss.h"
+
+
+//---- Private ----//
+static inline uint32_t hashThreeBytes(const uint8_t * bytePtr);
+
+
+//This module compresses a project file as it is chunked into
+//BLE packets for a full upload. Midi files contain many repeated
+//runs (delta-time + note on/off pairs) which LZSS handles well.
+
+//Only a single hash table probe is made per input position, so
+//the encoder trades a little ratio for a fixed cost per byte.
+//Any position older than the window is treated as a miss.
+
+//Like 'bleMidiPacket' it has no dependency on the BLE stack.
+
+
+//---- Public
+void bleLzss_initEncoder(BleLzssEncoder * encoderPtr, const uint8_t * srcPtr, uint32_t srcNumBytes)
+{
+    assert(encoderPtr != NULL);
+    assert(srcPtr != NULL);
+
+    encoderPtr->srcPtr = srcPtr;
+    encoderPtr->srcNumBytes = srcNumBytes;
+    encoderPtr->srcIdx = 0;
+
+    //0xFF.. marks an empty slot, it can never fall within the window
+    memset(encoderPtr->hashTable, 0xFF, sizeof(encoderPtr->hashTable));
+}
+
+
+
+//---- Public
+uint16_t bleLzss_encodeChunk(BleLzssEncoder * encoderPtr, uint8_t * dstPtr, uint16_t dstMaxNumBytes)
+{
+    //Compresses as much of the remaining source as will fit into
+    //the destination buffer, only whole groups are written.
+    //Progress is kept in the encoder, so calling this again continues
+    //the same stream (matches may reference earlier chunks).
+
+    //RETURNS: The number of bytes written to the destination buffer,
+    //zero once the whole source has been consumed.
+
+    assert(encoderPtr != NULL);
+    assert(dstPtr != NULL);
+
+    const uint8_t * const srcPtr = encoderPtr->srcPtr;
+    const uint32_t srcNumBytes = encoderPtr->srcNumBytes;
+    uint32_t srcIdx = encoderPtr->srcIdx;
+    uint16_t dstIdx = 0;
+    uint16_t flagByteIdx;
+    uint32_t hashIdx;
+    uint32_t candidateIdx;
+    uint32_t matchOffset;
+    uint32_t matchLength;
+    uint32_t maxMatchLength;
+
+    while((srcIdx < srcNumBytes) && ((dstIdx + BLE_LZSS_MAX_GROUP_NUM_BYTES) <= dstMaxNumBytes))
+    {
+        //Start a new group, its flag byte is filled in as items are added
+        flagByteIdx = dstIdx++;
+        dstPtr[flagByteIdx] = 0;
+
+        for(uint8_t item = 0; (item < BLE_LZSS_ITEMS_PER_GROUP) && (srcIdx < srcNumBytes); ++item)
+        {
+            matchLength = 0;
+            maxMatchLength = srcNumBytes - srcIdx;
+            if(maxMatchLength > BLE_LZSS_MAX_MATCH_NUM_BYTES) maxMatchLength = BLE_LZSS_MAX_MATCH_NUM_BYTES;
+
+            if(maxMatchLength >= BLE_LZSS_MIN_MATCH_NUM_BYTES)
+            {
+                hashIdx = hashThreeBytes(&srcPtr[srcIdx]);
+                candidateIdx = encoderPtr->hashTable[hashIdx];
+                encoderPtr->hashTable[hashIdx] = srcIdx;
+
+                if((candidateIdx < srcIdx) && ((srcIdx - candidateIdx) <= BLE_LZSS_WINDOW_NUM_BYTES))
+                {
+                    while((matchLength < maxMatchLength) && (srcPtr[candidateIdx + matchLength] == srcPtr[srcIdx + matchLength]))
+                    {
+                        ++matchLength;
+                    }
+                }
+            }
+
+            if(matchLength >= BLE_LZSS_MIN_MATCH_NUM_BYTES)
+            {
+                matchOffset = (srcIdx - candidateIdx) - 1;
+                dstPtr[dstIdx++] = (uint8_t)(matchOffset >> BLE_LZSS_OFFSET_HIGH_SHIFT);
+                dstPtr[dstIdx++] = (uint8_t)((matchOffset << BLE_LZSS_OFFSET_LOW_SHIFT) | ((matchLength - BLE_LZSS_MIN_MATCH_NUM_BYTES) & BLE_LZSS_LENGTH_MASK));
+                srcIdx += matchLength;
+            }
+            else
+            {
+                dstPtr[flagByteIdx] |= (1 << item);
+                dstPtr[dstIdx++] = srcPtr[srcIdx++];
+            }
+        }
+    }
+
+    encoderPtr->srcIdx = srcIdx;
+    return dstIdx;
+}
+
+
+
+//---- Public
+void bleLzss_skipTo(BleLzssEncoder * encoderPtr, uint32_t srcIdx)
+{
+    //Continues the stream from 'srcIdx', used when the source up to that
+    //point has been sent raw instead. The hash table is left alone, every
+    //position in it is still part of the decoders history.
+
+    assert(encoderPtr != NULL);
+    assert(srcIdx <= encoderPtr->srcNumBytes);
+
+    encoderPtr->srcIdx = srcIdx;
+}
+
+
+
+//---- Public
+bool bleLzss_isRawPacketBetter(uint16_t compressedNumBytes, uint32_t compressedSrcNumBytes, uint32_t rawSrcNumBytes)
+{
+    //Data that doesn't compress (already compressed, random) comes out up to
+    //1/8 larger than it went in, this picks whichever form of the packet moves
+    //more of the source. On a tie the raw packet wins if it is no larger.
+    //'compressedSrcNumBytes' is the source consumed by the compressed packet,
+    //'rawSrcNumBytes' is what a raw packet could carry from the same point.
+
+    if(rawSrcNumBytes != compressedSrcNumBytes) return (rawSrcNumBytes > compressedSrcNumBytes);
+    return (rawSrcNumBytes <= compressedNumBytes);
+}
+
+
+
+
+//---- Private
+static inline uint32_t hashThreeBytes(const uint8_t * bytePtr)
+{
+    uint32_t value = ((uint32_t)bytePtr[0] << 16) | ((uint32_t)bytePtr[1] << 8) | bytePtr[2];
+    return ((uint32_t)(value * 2654435761UL)) >> (32 - BLE_LZSS_HASH_TABLE_NUM_BITS);
+}
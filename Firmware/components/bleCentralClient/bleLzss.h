@@ -0,0 +1,41 @@
+
+//Compressed stream format (LZSS)
+//The stream is made up of groups, each group is a flag byte followed by up to
+//eight items. Flag bit n (LSB first) describes item n of the group:
+//  1 -> literal : one byte, copied straight to the output
+//  0 -> match   : two bytes -> 0booooooo oollllll
+//                 o = (offset - 1), 10 bits, offset back into the last 1KB of output
+//                 l = (length - 3),  6 bits, match length of 3 -> 66 bytes
+//A group is never split across packets, the decoder stops when the packet
+//payload is exhausted. The 1KB history window carries over between packets.
+//Packets without the compressed flag carry raw bytes, sent when compressing
+//them would not help (see 'bleLzss_isRawPacketBetter'). Raw bytes are part
+//of the stream all the same, they join the history window like any others.
+
+#define BLE_LZSS_WINDOW_NUM_BYTES       1024
+#define BLE_LZSS_MIN_MATCH_NUM_BYTES    3
+#define BLE_LZSS_MAX_MATCH_NUM_BYTES    66
+#define BLE_LZSS_OFFSET_HIGH_SHIFT      2
+#define BLE_LZSS_OFFSET_LOW_SHIFT       6
+#define BLE_LZSS_LENGTH_MASK            0x3F
+#define BLE_LZSS_ITEMS_PER_GROUP        8
+#define BLE_LZSS_MAX_GROUP_NUM_BYTES    (1 + (BLE_LZSS_ITEMS_PER_GROUP * 2))
+#define BLE_LZSS_HASH_TABLE_NUM_BITS    9
+#define BLE_LZSS_HASH_TABLE_SIZE        (1 << BLE_LZSS_HASH_TABLE_NUM_BITS)
+
+
+//The source buffer is read in place, only the hash table (2KB)
+//is held by the encoder, so it is kept in internal RAM.
+typedef struct
+{
+    const uint8_t * srcPtr;
+    uint32_t srcNumBytes;
+    uint32_t srcIdx;
+    uint32_t hashTable[BLE_LZSS_HASH_TABLE_SIZE];
+} BleLzssEncoder;
+
+
+void bleLzss_initEncoder(BleLzssEncoder * encoderPtr, const uint8_t * srcPtr, uint32_t srcNumBytes);
+uint16_t bleLzss_encodeChunk(BleLzssEncoder * encoderPtr, uint8_t * dstPtr, uint16_t dstMaxNumBytes);
+void bleLzss_skipTo(BleLzssEncoder * encoderPtr, uint32_t srcIdx);
+bool bleLzss_isRawPacketBetter(uint16_t compressedNumBytes, uint32_t compressedSrcNumBytes, uint32_t rawSrcNumBytes);
@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+#include "midiHelper.h"
+#include "bleMidiPacket.h"
+
+
+//---- Private ----//
+static inline uint8_t getNumDataBytesForStatus(uint8_t statusByte);
+
+
+//This module packs compiled playback events into BLE-MIDI packets.
+//It has no dependency on the BLE stack so it can be built and
+//exercised without a radio.
+
+//Several events can share a single packet, which is what allows the
+//playback stream to keep up at high event rates, the number of events
+//per packet is only limited by the size of the packet (ATT MTU - 3).
+//All events placed in one packet share the same header byte, so a
+//packet is closed early if the upper timestamp bits would change.
+
+
+//---- Public
+uint16_t bleMidi_encodeEventPacket(uint8_t * packetPtr, uint16_t maxPacketNumBytes, const MidiPlaybackEvent * eventsPtr, 
+                                   uint32_t numEvents, uint32_t timeBaseMs, uint32_t sendBeforeMs, uint32_t * numEventsEncodedPtr)
+{
+    //'timeBaseMs' is the senders clock value at the start of the sequence,
+    //event timestamps are offset by this value before being encoded.
+    //Only events with a timestamp earlier than 'sendBeforeMs' (sequence time)
+    //are encoded, which allows the caller to stream just ahead of the playhead.
+
+    //RETURNS: The total number of bytes written to the packet buffer, zero if
+    //no events are due. The number of events consumed is written to 'numEventsEncodedPtr'.
+
+    assert(packetPtr != NULL);
+    assert(eventsPtr != NULL);
+    assert(numEventsEncodedPtr != NULL);
+
+    uint16_t packetIdx = 0;
+    uint16_t eventTimestamp;
+    uint8_t headerTimestampBits = 0;
+    uint8_t numDataBytes;
+    uint32_t eventIdx = 0;
+
+    *numEventsEncodedPtr = 0;
+
+    //Header byte plus at least one full event must fit
+    if(maxPacketNumBytes < (1 + BLE_MIDI_MAX_EVENT_NUM_BYTES)) return 0;
+
+    while(eventIdx < numEvents)
+    {
+        if(eventsPtr[eventIdx].timestampMs >= sendBeforeMs) break;
+
+        numDataBytes = getNumDataBytesForStatus(eventsPtr[eventIdx].statusByte);
+        if((packetIdx + 2 + numDataBytes) > maxPacketNumBytes) break;
+
+        eventTimestamp = (uint16_t)((timeBaseMs + eventsPtr[eventIdx].timestampMs) & BLE_MIDI_TIMESTAMP_MASK);
+
+        if(packetIdx == 0)
+        {
+            headerTimestampBits = (eventTimestamp >> BLE_MIDI_TIMESTAMP_HIGH_SHIFT) & BLE_MIDI_TIMESTAMP_HIGH_MASK;
+            packetPtr[packetIdx++] = BLE_MIDI_HEADER_BYTE_FLAG | headerTimestampBits;
+        }
+        else if(((eventTimestamp >> BLE_MIDI_TIMESTAMP_HIGH_SHIFT) & BLE_MIDI_TIMESTAMP_HIGH_MASK) != headerTimestampBits)
+        {
+            break; //Event belongs in the next packet
+        }
+
+        packetPtr[packetIdx++] = BLE_MIDI_TIMESTAMP_BYTE_FLAG | (eventTimestamp & BLE_MIDI_TIMESTAMP_LOW_MASK);
+        packetPtr[packetIdx++] = eventsPtr[eventIdx].statusByte;
+        for(uint8_t a = 0; a < numDataBytes; ++a)
+        {
+            packetPtr[packetIdx++] = eventsPtr[eventIdx].dataBytes[a];
+        }
+
+        ++eventIdx;
+    }
+
+    *numEventsEncodedPtr = eventIdx;
+    return packetIdx;
+}
+
+
+//---- Private
+static inline uint8_t getNumDataBytesForStatus(uint8_t statusByte)
+{
+    //Program change and channel pressure
+    //messages only carry a single data byte
+    switch(statusByte & 0xF0)
+    {
+        case 0xC0:
+        case 0xD0:
+            return 1;
+
+        default:
+            return 2;
+    }
+}
@@ -0,0 +1,18 @@
+
+//BLE-MIDI packet format (see 'Specification for MIDI over Bluetooth Low Energy')
+//packet[0]       : Header byte       -> 0b10hhhhhh, h = timestamp bits 12 -> 7
+//packet[1]       : Timestamp byte    -> 0b1lllllll, l = timestamp bits 6 -> 0
+//packet[2 -> n]  : Midi message (status byte + data bytes)
+//A timestamp byte + midi message pair is repeated for each event in the packet.
+
+#define BLE_MIDI_HEADER_BYTE_FLAG       0x80
+#define BLE_MIDI_TIMESTAMP_BYTE_FLAG    0x80
+#define BLE_MIDI_TIMESTAMP_MASK         0x1FFF
+#define BLE_MIDI_TIMESTAMP_HIGH_SHIFT   7
+#define BLE_MIDI_TIMESTAMP_HIGH_MASK    0x3F
+#define BLE_MIDI_TIMESTAMP_LOW_MASK     0x7F
+#define BLE_MIDI_MAX_EVENT_NUM_BYTES    4   //Timestamp byte + status byte + two data bytes
+
+
+uint16_t bleMidi_encodeEventPacket(uint8_t * packetPtr, uint16_t maxPacketNumBytes, const MidiPlaybackEvent * eventsPtr, 
+                                   uint32_t numEvents, uint32_t timeBaseMs, uint32_t sendBeforeMs, uint32_t * numEventsEncodedPtr);
@@ -6,19 +6,73 @@ enum
     readFromPeripheral,
     shutdownBle,
     stopPlayback,
-    startPlayback
+    startPlayback,
+    sendGridEditDelta,
+    sendGridChecksum
 };
 
+//Use this for ALL queue items sent from bt to app
+enum
+{
+    bleTaskFailed,
+    bleTaskStarted,
+    bleResyncRequested,
+    bleUploadFinished,      //A file upload (0x55) has completed, its buffer is free again
+    bleUploadFailed         //A file upload (0x55) was aborted part way, its buffer is free again but the base unit doesn't have the file
+};
+
+//Grid edit types carried by a delta record, the values are sent to the base
+//unit as is. Notes can't be deleted from the controller, so 1 (remove) is
+//left unused rather than renumbering update.
+enum
+{
+    gridEditAdd = 0,
+    gridEditUpdate = 2
+};
+
+//A single grid edit, mirrors the fields of the grid managers
+//MidiEventParams so the base unit can apply the same edit to
+//its own copy of the project without a full file transfer.
+typedef struct {
+    uint8_t  editType;
+    uint16_t gridColumn;
+    uint8_t  gridRow;
+    uint8_t  statusByte;
+    uint8_t  dataBytes[2];
+    uint8_t  durationInSteps;
+} GridEditDelta;
+
 //Use this for ALL queue items sent from app to bt
 //if we want to do a long data transfer the data section
-//will hold a pointer to psram allocated byte array
+//will hold a pointer to psram allocated byte array.
+//Small messages (edit deltas / checksums) are carried
+//within the queue item itself.
 typedef struct {
     uint8_t opcode;
     uint32_t dataLength;
     uint8_t * dataPtr;
+    GridEditDelta editDelta;    //Only used with 'sendGridEditDelta'
+    uint32_t gridChecksum;      //Only used with 'sendGridChecksum' (dataLength holds num events)
 } HostToBleQueueItem;
 
+//File upload statistics, reset at the start of each upload.
+//Latency is measured from a packet write being issued to the
+//peripherals write response, copy bytes count every byte
+//memcpy'd by the CPU while building packets.
+typedef struct {
+    uint32_t numPackets;
+    uint32_t numRawPackets;         //Compressed uploads only, packets sent raw as they didn't compress
+    uint32_t numPayloadBytes;
+    uint32_t numCopyBytes;
+    uint32_t numWriteErrors;
+    uint32_t totalBuildMicros;
+    uint32_t lastPacketLatencyMicros;
+    uint32_t maxPacketLatencyMicros;
+    uint64_t totalPacketLatencyMicros;
+} BleTxStats;
+
 void bleCentAPI_task(void * param);
+void bleCentAPI_getTxStats(BleTxStats * statsPtr);
 
 extern volatile bool isConnectedToTargetDevice;
 
@@ -1,16 +1,36 @@
 
 
-#define MENU_QUEUE_ITEM_PAYLOAD_SIZE 10
+//Messages between the menu and system tasks are passed as input events,
+//the menu posts to 'inputBusSystem' (source 'inputSourceMenu') and the
+//system posts to 'inputBusMenu' (source 'inputSourceSystem'). The
+//opcode is carried in 'eventType', its data in 'payload'.
 
-typedef struct {
-    uint8_t eventOpcode;
-    uint8_t payload[MENU_QUEUE_ITEM_PAYLOAD_SIZE];
-} MenuQueueItem;
+//Menu -> system commands
+enum {
+    menuCmdNone,
+    menuCmdSaveProject,
+    menuCmdSetNoteVelocity,     //payload[0] = velocity, latest value wins within a batch
+    menuCmdSetNoteDuration,     //payload[0] = duration in steps, latest value wins within a batch
+    menuCmdNewProject,
+    menuCmdLoadProject,
+    menuCmdStartPlayback,
+    menuCmdStopPlayback
+};
+
+//System -> menu messages
+enum {
+    systemMsgNone,
+    systemMsgNoteParams         //Grid note selected, see payload layout below
+};
+
+//'systemMsgNoteParams' payload layout
+#define NOTE_PARAMS_STATUS_IDX          0
+#define NOTE_PARAMS_NOTE_NUM_IDX        1
+#define NOTE_PARAMS_VELOCITY_IDX        2
+#define NOTE_PARAMS_DURATION_IDX        3
+#define NOTE_PARAMS_MAX_DURATION_IDX    4
 
 //Public Interface
 //void guiMenu_init(const char * fileNamesPtr[], const uint8_t * const numFilesOnSystem);
 
-extern QueueHandle_t g_MenuToSystemQueueHandle;
-extern QueueHandle_t g_SystemToMenuQueueHandle;
-
-void guiMenu_entryPoint(void * params);
\ No newline at end of file
+void guiMenu_entryPoint(void * params);
@@ -2,12 +2,13 @@
 #include <esp_log.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/queue.h"
+#include "esp_timer.h"
 #include "private/menuData.h"
 #include "include/guiMenu.h"
 #include "fileSys.h"
 #include "ipsDisplay.h"
 #include "rotaryEncoders.h"
+#include "inputEventBus.h"
 
 #define LOG_TAG "menuSystem"
 #define MAX_PROJECT_NAME_LENGTH     8
@@ -20,13 +21,18 @@ static void updateMenuPage(void);
 static void moveSelectionIndicator(bool isUpOrDown);
 static void resetMenuIndicator(void);
 static void processMenuUserInput(uint8_t eventByte);
+static void processSystemMessage(const InputEvent * messagePtr);
+static bool takeEditInputEvents(uint8_t exitSwitchEvent);
+static void sendMessageToSystem(uint8_t opcode, uint8_t value);
+static void processMenuEncoderDelta(int32_t delta, uint8_t cwEvent, uint8_t ccwEvent);
+static int32_t clampToRange(int32_t value, int32_t minValue, int32_t maxValue);
 static void editMenuItemParam(menuParamType_t paramType);
 static void editNumericSelectionParam(MenuParamSelection *paramPtr);
 static void editStringSelectionParam(MenuParamSelection *paramPtr);
 static void editNumericParam(MenuParam *paramPtr);
 static void editStringParam(MenuParam *paramPtr);
 static uint8_t createDefaultProjectName(void * unusedParam);
-static inline void sleepTask(void);
+static inline void waitForInput(void);
 
 
 //This struct type holds all data relating the to the menu
@@ -88,14 +94,17 @@ static const char ** g_fileNamesPtr = NULL; //points to an array of strings, whi
 static char g_projectNameArr[MAX_PROJECT_NAME_LENGTH + 1]; //Add one for string termination
 
 
-QueueHandle_t g_MenuToSystemQueueHandle;
-QueueHandle_t g_SystemToMenuQueueHandle;
+//All menu input arrives on the menu tasks input event bus: encoder switch presses
+//and messages from the system task, while encoder rotation only wakes the task.
+//A message from the system that arrives while a parameter is being edited is
+//held here and handled once the edit is finished (only the latest is kept).
+static InputEvent g_deferredSystemMessage;
+static bool g_hasDeferredSystemMessage = false;
 
 //---- Public
 void guiMenu_entryPoint(void * params)
 {
-    uint8_t rxEncoderEvent;
-    MenuQueueItem rxQueueItem = {0};
+    InputEvent rxEvent;
 
 
     //The menu module needs access to the current
@@ -112,44 +121,27 @@ void guiMenu_entryPoint(void * params)
     //TODO: Refine callback assignment once system defined
     menuManagerPtr[0].funcPtr = createDefaultProjectName;
 
+    inputEventBus_setConsumer(inputBusMenu);
+
     while(1)
     {
-
-        if(uxQueueMessagesWaiting(g_EncodersQueueHandle))
+        //Handle everything posted since the last pass
+        while(inputEventBus_take(inputBusMenu, &rxEvent))
         {
-            xQueueReceive(g_EncodersQueueHandle, &rxEncoderEvent, 0);
-            processMenuUserInput(rxEncoderEvent);
+            if(rxEvent.source == inputSourceEncoders) processMenuUserInput(rxEvent.eventType);
+            else if(rxEvent.source == inputSourceSystem) processSystemMessage(&rxEvent);
         }
 
-
-        if(uxQueueMessagesWaiting(g_SystemToMenuQueueHandle))
+        if(g_hasDeferredSystemMessage)
         {
-            xQueueReceive(g_SystemToMenuQueueHandle, &rxQueueItem, 0);
-            switch(rxQueueItem.eventOpcode)
-            {
-                case 0:
-                    break;
+            g_hasDeferredSystemMessage = false;
+            processSystemMessage(&g_deferredSystemMessage);
+        }
 
-                case 5:
-                    //This is just temp code we wont 
-                    //have to search each time in final
-                    uint8_t idx = 0;;
-                    while(menuManagerPtr[idx].menuPageCode != state_note_edit) ++idx;
+        //Rotation is read as the number of detents since the last pass
+        processMenuEncoderDelta(rotaryEncoders_takeDelta(encoder0_event), encoder0_cw, encoder0_ccw);
+        processMenuEncoderDelta(rotaryEncoders_takeDelta(encoder1_event), encoder1_cw, encoder1_ccw);
 
-                    *(uint8_t*)(*(MenuParam*)menuManagerPtr[idx++].paramPtr).valuePtr = rxQueueItem.payload[1];
-                    *(uint8_t*)(*(MenuParam*)menuManagerPtr[idx++].paramPtr).valuePtr = rxQueueItem.payload[2];
-                    *(uint8_t*)(*(MenuParam*)menuManagerPtr[idx].paramPtr).valuePtr = rxQueueItem.payload[3];
-                    (*(MenuParam*)menuManagerPtr[idx].paramPtr).valMax = rxQueueItem.payload[4];
-
-                    g_MenuData.pageCode = state_note_edit;
-                    g_MenuData.updateMenuPageFlag = true;
-                    break;
-
-                default:
-                    assert(0);
-                    break;
-            }
-        }
 
         //This flag is set TRUE on system start, after that it is set locally as
         //a result by 'processMenuUserInput' if the gui needs to be updated
@@ -161,7 +153,7 @@ void guiMenu_entryPoint(void * params)
             resetMenuIndicator();
         }
 
-        sleepTask();
+        waitForInput();
     }
 
     assert(0);
@@ -170,9 +162,93 @@ void guiMenu_entryPoint(void * params)
 
 
 //---- Private
-static inline void sleepTask(void)
+static inline void waitForInput(void)
+{
+    //Everything drawn since the last wait goes to the display
+    //in one flush, then block until an event is posted to
+    //the menu or an encoder is turned
+    IPSDisplay_flush();
+    inputEventBus_wait(inputBusMenu, portMAX_DELAY);
+}
+
+
+//---- Private
+static void processSystemMessage(const InputEvent * messagePtr)
+{
+    switch(messagePtr->eventType)
+    {
+        case systemMsgNone:
+            break;
+
+        case systemMsgNoteParams:
+            //This is just temp code we wont 
+            //have to search each time in final
+            uint8_t idx = 0;;
+            while(menuManagerPtr[idx].menuPageCode != state_note_edit) ++idx;
+
+            *(uint8_t*)(*(MenuParam*)menuManagerPtr[idx++].paramPtr).valuePtr = messagePtr->payload[NOTE_PARAMS_NOTE_NUM_IDX];
+            *(uint8_t*)(*(MenuParam*)menuManagerPtr[idx++].paramPtr).valuePtr = messagePtr->payload[NOTE_PARAMS_VELOCITY_IDX];
+            *(uint8_t*)(*(MenuParam*)menuManagerPtr[idx].paramPtr).valuePtr = messagePtr->payload[NOTE_PARAMS_DURATION_IDX];
+            (*(MenuParam*)menuManagerPtr[idx].paramPtr).valMax = messagePtr->payload[NOTE_PARAMS_MAX_DURATION_IDX];
+
+            g_MenuData.pageCode = state_note_edit;
+            g_MenuData.updateMenuPageFlag = true;
+            break;
+
+        default:
+            assert(0);
+            break;
+    }
+}
+
+
+//---- Private
+static bool takeEditInputEvents(uint8_t exitSwitchEvent)
+{
+    //Used by the parameter edit loops. Takes everything posted to the menu,
+    //other encoder switch presses are ignored while editing, and system
+    //messages are deferred until the edit is finished.
+    //RETURNS: true if 'exitSwitchEvent' was pressed
+
+    InputEvent rxEvent;
+    bool isExitPressed = false;
+
+    while(inputEventBus_take(inputBusMenu, &rxEvent))
+    {
+        if(rxEvent.source == inputSourceEncoders)
+        {
+            if(rxEvent.eventType == exitSwitchEvent) isExitPressed = true;
+        }
+        else if(rxEvent.source == inputSourceSystem)
+        {
+            g_deferredSystemMessage = rxEvent;
+            g_hasDeferredSystemMessage = true;
+        }
+    }
+
+    return isExitPressed;
+}
+
+
+//---- Private
+static void processMenuEncoderDelta(int32_t delta, uint8_t cwEvent, uint8_t ccwEvent)
+{
+    //Page navigation moves one item per detent, a page never has
+    //more than 'MAX_MENU_DATA_ITEMS' items so larger counts are clamped
+
+    delta = clampToRange(delta, -MAX_MENU_DATA_ITEMS, MAX_MENU_DATA_ITEMS);
+
+    for(; delta > 0; --delta) processMenuUserInput(cwEvent);
+    for(; delta < 0; ++delta) processMenuUserInput(ccwEvent);
+}
+
+
+//---- Private
+static int32_t clampToRange(int32_t value, int32_t minValue, int32_t maxValue)
 {
-    vTaskDelay(pdMS_TO_TICKS(30));
+    if(value < minValue) return minValue;
+    if(value > maxValue) return maxValue;
+    return value;
 }
 
 
@@ -225,6 +301,8 @@ static void processMenuUserInput(uint8_t eventByte)
                 if(menuManagerPtr[g_MenuData.menuPageBaseIdx + g_MenuData.selectionIndicator.currentItem].paramPtr == NULL) break;
                 //Need to engage editing for a string parameter.
                 editMenuItemParam(paramType);
+                //Numeric edits call the callback live with every change, the latest value has already been sent
+                if(paramType == param_numeric) callItemFuncPtr = false;
             }
             else
             {
@@ -427,15 +505,16 @@ void editNumericSelectionParam(MenuParamSelection *paramPtr)
 {
 
     //This function allows the user to edit a numeric selection, which is a pre-defined selection of numeric values.
-    //The selection edit process loop is driven by queued user input events, sent from the 'RotaryEncoders' component.
+    //The selection edit process loop is driven by user input events, sent from the 'RotaryEncoders' component.
     assert(paramPtr != NULL);
     assert(paramPtr->valuePtr != NULL);
     assert(paramPtr->numItems > 0);
 
     char stringCharArray[MAX_STRING_CHARS]; //Used to construct temp strings 
     int8_t previousValue = 0;     //Holds previous selection value so it can be erased from display
-    uint8_t receivedQueueItem;    //Used to store receieved event queue item 
     uint16_t stringLen;           //Used to store calculated string lengths
+    int32_t encoderDelta;         //Detents turned since last pass
+    uint8_t newIdx;
 
     struct {    //Flags used by process
         uint8_t exitEditProcess : 1;            //Set when user exists numeric edit process
@@ -453,44 +532,18 @@ void editNumericSelectionParam(MenuParamSelection *paramPtr)
         //Encoder1 (sw) is used to exit the numeric edit process once editing is complete.
         //Encoder1 (cw,ccw) (increment, decrement) used to modify value of numeric param.
 
-        //If user input event has occured a new
-        //queue item will appear in this queue.. 
-        if (uxQueueMessagesWaiting(g_EncodersQueueHandle))
-        {
-            //Get the next item in the queue, put in 'menuInputBuffer'
-            xQueueReceive(g_EncodersQueueHandle, &receivedQueueItem, 0);
-
-            switch (receivedQueueItem)
-            {
-                //Switch event
-                case encoder1_sw:
-                    flags.exitEditProcess = 1;
-                    break;
-
-                //Clockwise event
-                case encoder1_cw:
-                    //Check to make sure selection pointer 
-                    //remains within bounds of selectable values
-                    if (paramPtr->currIdx < (paramPtr->numItems - 1))
-                    {
-                        flags.selectionHasBeenModified = 1;
-                        previousValue = ((uint8_t*)paramPtr->valuePtr)[paramPtr->currIdx];
-                        paramPtr->currIdx++;
-                    }
-                    break;
+        //Encoder1 switch press ends the edit
+        if (takeEditInputEvents(encoder1_sw)) flags.exitEditProcess = 1;
 
-                //Counter-clockwise event
-                case encoder1_ccw:
-                    //Check to make sure selection pointer 
-                    //remains within bounds of selectable values
-                    if (paramPtr->currIdx > 0)
-                    {
-                        flags.selectionHasBeenModified = 1;
-                        previousValue = ((uint8_t*)paramPtr->valuePtr)[paramPtr->currIdx];
-                        paramPtr->currIdx--;
-                    }
-                    break;
-            }
+        //Encoder1 rotation (cw increments), moves through the selection by
+        //the number of detents turned, kept within bounds of selectable values
+        encoderDelta = rotaryEncoders_takeAcceleratedDelta(encoder1_event);
+        newIdx = (uint8_t)clampToRange((int32_t)paramPtr->currIdx + encoderDelta, 0, (paramPtr->numItems - 1));
+        if (newIdx != paramPtr->currIdx)
+        {
+            flags.selectionHasBeenModified = 1;
+            previousValue = ((uint8_t*)paramPtr->valuePtr)[paramPtr->currIdx];
+            paramPtr->currIdx = newIdx;
         }
 
         if (flags.selectionHasBeenModified)
@@ -512,7 +565,7 @@ void editNumericSelectionParam(MenuParamSelection *paramPtr)
 
         if(flags.exitEditProcess) break;
 
-        sleepTask();
+        waitForInput();
     }
 }
 
@@ -522,14 +575,15 @@ void editStringSelectionParam(MenuParamSelection *paramPtr)
 {
     
     //This function allows the user to edit a string selection, which is a pre-defined selection of strings.
-    //The selection edit process loop is driven by queued user input events, sent from the 'RotaryEncoders' component.
+    //The selection edit process loop is driven by user input events, sent from the 'RotaryEncoders' component.
     assert(paramPtr != NULL);
     assert(paramPtr->valuePtr != NULL);
     assert(paramPtr->numItems > 0);
 
     char *previousStringPtr = NULL;     //Stores address of previous selection so it can be erased from display
-    uint8_t receivedQueueItem;          //Used to store receieved event queue item 
     uint16_t stringLen;                 //Used to store calculated string lengths
+    int32_t encoderDelta;               //Detents turned since last pass
+    uint8_t newIdx;
 
     struct {    //Flags used by process
         uint8_t exitEditProcess : 1;            //Set when user exists numeric edit process
@@ -547,44 +601,18 @@ void editStringSelectionParam(MenuParamSelection *paramPtr)
         //Encoder1 (sw) is used to exit the selection edit process once editing is complete.
         //Encoder1 (cw,ccw) used to scroll through the available values in the selection.
 
-        //If user input event has occured a new
-        //queue item will appear in this queue.. 
-        if (uxQueueMessagesWaiting(g_EncodersQueueHandle))
-        {
-            //Get the next item in the queue, put in 'menuInputBuffer'
-            xQueueReceive(g_EncodersQueueHandle, &receivedQueueItem, 0);
-
-            switch (receivedQueueItem)
-            {
-                //Switch event
-                case encoder1_sw:
-                    flags.exitEditProcess = 1;
-                    break;
+        //Encoder1 switch press ends the edit
+        if (takeEditInputEvents(encoder1_sw)) flags.exitEditProcess = 1;
 
-                //Clockwise event
-                case encoder1_cw:
-                    //Check to make sure selection pointer 
-                    //remains within bounds of selectable values
-                    if (paramPtr->currIdx < (paramPtr->numItems - 1))
-                    {
-                        flags.selectionHasBeenModified = 1;
-                        previousStringPtr = ((char**)paramPtr->valuePtr)[paramPtr->currIdx];
-                        paramPtr->currIdx++;
-                    }
-                    break;
-
-                //Counter-clockwise event
-                case encoder1_ccw:
-                    //Check to make sure selection pointer 
-                    //remains within bounds of selectable values
-                    if (paramPtr->currIdx > 0)
-                    {
-                        flags.selectionHasBeenModified = 1;
-                        previousStringPtr = ((char**)paramPtr->valuePtr)[paramPtr->currIdx];
-                        paramPtr->currIdx--;
-                    }
-                    break;
-            }
+        //Encoder1 rotation (cw increments), moves through the selection by
+        //the number of detents turned, kept within bounds of selectable values
+        encoderDelta = rotaryEncoders_takeAcceleratedDelta(encoder1_event);
+        newIdx = (uint8_t)clampToRange((int32_t)paramPtr->currIdx + encoderDelta, 0, (paramPtr->numItems - 1));
+        if (newIdx != paramPtr->currIdx)
+        {
+            flags.selectionHasBeenModified = 1;
+            previousStringPtr = ((char**)paramPtr->valuePtr)[paramPtr->currIdx];
+            paramPtr->currIdx = newIdx;
         }
 
         if (flags.selectionHasBeenModified)
@@ -607,7 +635,7 @@ void editStringSelectionParam(MenuParamSelection *paramPtr)
 
         if (flags.exitEditProcess) break;
 
-        sleepTask();
+        waitForInput();
     }
 }
 
@@ -616,14 +644,19 @@ void editStringSelectionParam(MenuParamSelection *paramPtr)
 void editNumericParam(MenuParam *paramPtr)
 {
     //This function handles editing of a menu numeric parameter, such that the used can dial in integer values.
-    //The numeric edit process loop is driven by queued user input events, sent from the 'RotaryEncoders' component.
+    //The numeric edit process loop is driven by user input events, sent from the 'RotaryEncoders' component.
     assert(paramPtr != NULL);
     assert(paramPtr->valuePtr != NULL);
 
     char stringCharArray[MAX_STRING_CHARS];   //Used to construct temp strings 
     uint8_t previousParamValue = 0; //Used to erase previous value from display
-    uint8_t receivedQueueItem;      //Used to store receieved event queue item
     uint16_t stringLen;             //Used to store calculated string lengths
+    int32_t encoderDelta;           //Detents turned since last pass
+    uint8_t newValue;
+    //Callback of the item being edited, called as the value changes so the system follows
+    //along while the user scrubs (it only applies the latest value of each batch). As the
+    //final value has been sent by the time the edit ends, it isn't called again on exit.
+    uint8_t (*itemFuncPtr)(void *) = menuManagerPtr[g_MenuData.menuPageBaseIdx + g_MenuData.selectionIndicator.currentItem].funcPtr;
 
     struct {    //Flags used by process
         uint8_t exitNumericEditProcess : 1; //Set when user exists numeric edit process
@@ -641,44 +674,18 @@ void editNumericParam(MenuParam *paramPtr)
         //Encoder1 (sw) is used to exit the numeric edit process once editing is complete.
         //Encoder1 (cw,ccw) (increment, decrement) used to modify value of numeric param.
 
-        //If user input event has occured a new
-        //queue item will appear in this queue.. 
-        if (uxQueueMessagesWaiting(g_EncodersQueueHandle))
-        {
-            //Get the next item in the queue, put in 'menuInputBuffer'
-            xQueueReceive(g_EncodersQueueHandle, &receivedQueueItem, 0);
-
-            switch (receivedQueueItem)
-            {
-                //Switch event
-                case encoder1_sw:
-                    flags.exitNumericEditProcess = 1;
-                    break;
-
-                //Clockwise event
-                case encoder1_cw:
-                    //Check to make sure value remains within bounds
-                    if (*(uint8_t *)paramPtr->valuePtr < paramPtr->valMax)
-                    {
-                        flags.numericHasBeenEdited = 1;
-                        previousParamValue = *(uint8_t *)paramPtr->valuePtr;
-                        //Value is within bounds so increment..
-                        (*(uint8_t *)paramPtr->valuePtr)++;
-                    }
-                    break;
+        //Encoder1 switch press ends the edit
+        if (takeEditInputEvents(encoder1_sw)) flags.exitNumericEditProcess = 1;
 
-                //Counter-clockwise event
-                case encoder1_ccw:
-                    //Check to make sure value remains within bounds
-                    if (*(uint8_t *)paramPtr->valuePtr > paramPtr->valMin)
-                    {
-                        flags.numericHasBeenEdited = 1;
-                        previousParamValue = *(uint8_t *)paramPtr->valuePtr;
-                        //Value is within bounds to decrement..
-                        (*(uint8_t *)paramPtr->valuePtr)--;
-                    }
-                    break;
-            }
+        //Encoder1 rotation (cw increments), the value moves by the number of
+        //detents turned (faster when spun quickly), kept within bounds
+        encoderDelta = rotaryEncoders_takeAcceleratedDelta(encoder1_event);
+        newValue = (uint8_t)clampToRange((int32_t)(*(uint8_t *)paramPtr->valuePtr) + encoderDelta, paramPtr->valMin, paramPtr->valMax);
+        if (newValue != *(uint8_t *)paramPtr->valuePtr)
+        {
+            flags.numericHasBeenEdited = 1;
+            previousParamValue = *(uint8_t *)paramPtr->valuePtr;
+            *(uint8_t *)paramPtr->valuePtr = newValue;
         }
 
         if(flags.numericHasBeenEdited)
@@ -696,11 +703,13 @@ void editNumericParam(MenuParam *paramPtr)
             stringLen = snprintf(stringCharArray, MAX_STRING_CHARS, "%d", (*(uint8_t *)paramPtr->valuePtr));
             //Draw the new value on display in foreground colour
             IPSDisplay_drawLineOfTextToScreen(stringCharArray, stringLen, paramPtr->posX, paramPtr->posY, screenColourWhite);
+
+            if (itemFuncPtr != NULL) itemFuncPtr(paramPtr->valuePtr);
         }
 
         if (flags.exitNumericEditProcess) break;
 
-        sleepTask();
+        waitForInput();
     }
 }
 
@@ -709,7 +718,7 @@ void editNumericParam(MenuParam *paramPtr)
 void editStringParam(MenuParam *paramPtr)
 {
     //This function handles editing of a menu string parameter, such that the user can enter/edit project names etc. 
-    //The string edit process loop is driven by queued user input events, sent from the 'RotaryEncoders' component.
+    //The string edit process loop is driven by user input events, sent from the 'RotaryEncoders' component.
     assert(paramPtr != NULL);
     assert(paramPtr->valuePtr != NULL);
 
@@ -717,8 +726,9 @@ void editStringParam(MenuParam *paramPtr)
     uint8_t characterSetIdx = 0;                //Used to index the available system character set
     uint8_t editStringIdx = 0;                  //Used to store index of character selected for edit within string param
     uint16_t editMarkerPosXOffset = 0;          //X offset in pixels, used to place selected character underline
-    uint8_t receivedInputEvent = 0;             //Used to store receieved event queue item
     uint16_t stringLen;                         //Used as a store for calculated string lengths   
+    int32_t cursorDelta;                        //Encoder0 detents turned since last pass
+    int32_t characterDelta;                     //Encoder1 detents turned since last pass
 
     struct {    //Flags used by process
         uint8_t exitStringEditProcess : 1;      //Set when user exists the string edit process
@@ -756,96 +766,79 @@ void editStringParam(MenuParam *paramPtr)
         //Encoder1 (cw,ccw) is used to scroll through the character set, for the character selected for edit by encoder0.
         //Encoder1 (sw) is used to exit the string edit process once editing is complete.
 
-        //If user input event has occured a new
-        //queue item will appear in this queue.. 
-        if (uxQueueMessagesWaiting(g_EncodersQueueHandle))
-        {
-            //Grab the new item from the queue so it can be processed
-            xQueueReceive(g_EncodersQueueHandle, &receivedInputEvent, 0);
+        //Encoder1 switch press, user has exited
+        //string edit process, so set exit flag
+        if (takeEditInputEvents(encoder1_sw)) flags.exitStringEditProcess = true;
+
+        //Rotation is read as the number of detents turned since the last pass
+        cursorDelta = clampToRange(rotaryEncoders_takeDelta(encoder0_event), -MAX_PROJECT_NAME_LENGTH, MAX_PROJECT_NAME_LENGTH);
+        characterDelta = rotaryEncoders_takeAcceleratedDelta(encoder1_event);
 
-            switch (receivedInputEvent)
+        //Encoder0 clockwise, moves the character selection right one place per detent.
+        //Stops once a new character is appended, so it is filled before moving on.
+        for(; (cursorDelta > 0) && !flags.stringHasBeenModified; --cursorDelta)
+        {
+            //Get the current length of string being edited
+            stringLen = strlen((char*)paramPtr->valuePtr);
+            //The if statement below will allow one extra character to be appended at
+            //a time, up to a maximum of 'MENU_STRING_MAX_CHARS' characters in length
+            if(editStringIdx < (MAX_PROJECT_NAME_LENGTH-1))
             {
-                //Clockwise event
-                case encoder0_cw: 
-                    //Get the current length of string being edited
-                    stringLen = strlen((char*)paramPtr->valuePtr);
-                    //The if statement below will allow one extra character to be appended at
-                    //a time, up to a maximum of 'MENU_STRING_MAX_CHARS' characters in length
-                    if(editStringIdx < (MAX_PROJECT_NAME_LENGTH-1))
-                    {
-                        //erase present character selection underline
-                        IPSDisplay_drawHorizontalLineToScreen(editMarkerPosXOffset, 
-                            editMarkerPosXOffset + IPSDisplay_getCharWidthInPixels(*((char *)paramPtr->valuePtr + (sizeof(char) * editStringIdx))), 
-                            paramPtr->posY + IPSDisplay_getCharHeightInPixels(), 2, screenColourBlack);
-
-
-                        //Update X offset for the placement of the underline to its new selection position
-                        editMarkerPosXOffset += IPSDisplay_getCharWidthInPixels(*((char *)paramPtr->valuePtr + (sizeof(char) * editStringIdx))) + 1;
-                        editStringIdx++; //Update the index of character currently being edited to new selection
-
-                        //Draw new character selection underline
-                        if((uint8_t)(*((char *)paramPtr->valuePtr + (sizeof(char) * editStringIdx))) == 0)
-                        {
-                            characterSetIdx = 0;
-                            flags.stringHasBeenModified = true;   
-                        }
-                        
-                        IPSDisplay_drawHorizontalLineToScreen(editMarkerPosXOffset, 
-                            editMarkerPosXOffset + IPSDisplay_getCharWidthInPixels(*((char *)paramPtr->valuePtr + (sizeof(char) * editStringIdx))), 
-                            paramPtr->posY + IPSDisplay_getCharHeightInPixels(), 2, screenColourWhite);
-                    }
-                    break;
+                //erase present character selection underline
+                IPSDisplay_drawHorizontalLineToScreen(editMarkerPosXOffset, 
+                    editMarkerPosXOffset + IPSDisplay_getCharWidthInPixels(*((char *)paramPtr->valuePtr + (sizeof(char) * editStringIdx))), 
+                    paramPtr->posY + IPSDisplay_getCharHeightInPixels(), 2, screenColourBlack);
 
-                //Counter-clockwise event
-                case encoder0_ccw:
-                    //If index of currently selected string parameter
-                    //is greater than zero, it can be decremented
-                    if(editStringIdx > 0)
-                    {
-                        //erase present character selection underline
-                        IPSDisplay_drawHorizontalLineToScreen(editMarkerPosXOffset, 
-                            editMarkerPosXOffset + IPSDisplay_getCharWidthInPixels(*((char *)paramPtr->valuePtr + (sizeof(char) * editStringIdx))), 
-                            paramPtr->posY + IPSDisplay_getCharHeightInPixels(), 2, screenColourBlack);
-
-                        editStringIdx--; //Update the index of charcter currently being edited to new selection
-                        //Update X offset for the placement of the underline to its new selection position
-                        editMarkerPosXOffset -= IPSDisplay_getCharWidthInPixels(*((char *)paramPtr->valuePtr + (sizeof(char) * editStringIdx))) + 1;
-
-                        //Draw new character selection underline
-                        IPSDisplay_drawHorizontalLineToScreen(editMarkerPosXOffset, 
-                            editMarkerPosXOffset + IPSDisplay_getCharWidthInPixels(*((char *)paramPtr->valuePtr + (sizeof(char) * editStringIdx))), 
-                            paramPtr->posY + IPSDisplay_getCharHeightInPixels(), 2, screenColourWhite);
-                    } 
-                    break;
 
-                //Switch event
-                case encoder1_sw:   
-                    //User has exited string edit process, so set exit flag
-                    flags.exitStringEditProcess = true;
-                    break;
+                //Update X offset for the placement of the underline to its new selection position
+                editMarkerPosXOffset += IPSDisplay_getCharWidthInPixels(*((char *)paramPtr->valuePtr + (sizeof(char) * editStringIdx))) + 1;
+                editStringIdx++; //Update the index of character currently being edited to new selection
 
-                //Clockwise event 
-                case encoder1_cw:   
-                    //String will now be edited, so set flag so display is updated
+                //Draw new character selection underline
+                if((uint8_t)(*((char *)paramPtr->valuePtr + (sizeof(char) * editStringIdx))) == 0)
+                {
+                    characterSetIdx = 0;
                     flags.stringHasBeenModified = true;   
-                    //If the character set index is within the allowed
-                    //maximum then increment, otherwise wrap back to base index
-                    if(characterSetIdx < (CHARACTER_SET_NUM_CHARS - 1)) characterSetIdx++;
-                    else characterSetIdx = 0;
-                    break;
-
-                //Counter-clockwise event
-                case encoder1_ccw:  
-                    //String will now be edited, so set flag so display is updated
-                    flags.stringHasBeenModified = true;
-                    //If the charcter set index is within the allowed
-                    //maximum then increment, otherwise wrap to max idx
-                    if(characterSetIdx > 0) characterSetIdx--;
-                    else characterSetIdx = (CHARACTER_SET_NUM_CHARS - 1);
-                    break;
+                }
+                
+                IPSDisplay_drawHorizontalLineToScreen(editMarkerPosXOffset, 
+                    editMarkerPosXOffset + IPSDisplay_getCharWidthInPixels(*((char *)paramPtr->valuePtr + (sizeof(char) * editStringIdx))), 
+                    paramPtr->posY + IPSDisplay_getCharHeightInPixels(), 2, screenColourWhite);
             }
         }
 
+        //Encoder0 counter-clockwise, moves the character selection left one place per detent
+        for(; cursorDelta < 0; ++cursorDelta)
+        {
+            //If index of currently selected string parameter
+            //is greater than zero, it can be decremented
+            if(editStringIdx > 0)
+            {
+                //erase present character selection underline
+                IPSDisplay_drawHorizontalLineToScreen(editMarkerPosXOffset, 
+                    editMarkerPosXOffset + IPSDisplay_getCharWidthInPixels(*((char *)paramPtr->valuePtr + (sizeof(char) * editStringIdx))), 
+                    paramPtr->posY + IPSDisplay_getCharHeightInPixels(), 2, screenColourBlack);
+
+                editStringIdx--; //Update the index of charcter currently being edited to new selection
+                //Update X offset for the placement of the underline to its new selection position
+                editMarkerPosXOffset -= IPSDisplay_getCharWidthInPixels(*((char *)paramPtr->valuePtr + (sizeof(char) * editStringIdx))) + 1;
+
+                //Draw new character selection underline
+                IPSDisplay_drawHorizontalLineToScreen(editMarkerPosXOffset, 
+                    editMarkerPosXOffset + IPSDisplay_getCharWidthInPixels(*((char *)paramPtr->valuePtr + (sizeof(char) * editStringIdx))), 
+                    paramPtr->posY + IPSDisplay_getCharHeightInPixels(), 2, screenColourWhite);
+            } 
+        }
+
+        //Encoder1 scrolls through the character set by the number of detents
+        //turned, wrapping around at either end of the character set
+        if (characterDelta != 0)
+        {
+            //String will now be edited, so set flag so display is updated
+            flags.stringHasBeenModified = true;
+            characterSetIdx = (uint8_t)((((int32_t)characterSetIdx + characterDelta) % CHARACTER_SET_NUM_CHARS + CHARACTER_SET_NUM_CHARS) % CHARACTER_SET_NUM_CHARS);
+        }
+
 
         if (flags.stringHasBeenModified)  //Set to true when a character in string has been changed
         {
@@ -899,7 +892,7 @@ void editStringParam(MenuParam *paramPtr)
             break; //---- EXIT STRING EDIT PROCESS LOOP ----
         } 
 
-        sleepTask();
+        waitForInput();
     }
 }
 
@@ -1022,6 +1015,22 @@ void resetMenuIndicator(void)
 
 
 
+//---- Private
+static void sendMessageToSystem(uint8_t opcode, uint8_t value)
+{
+    InputEvent txMessage = {
+        .source = inputSourceMenu,
+        .eventType = opcode,
+        .timestampMicros = (uint32_t)esp_timer_get_time(),
+        .payload[0] = value
+    };
+
+    if(!inputEventBus_post(inputBusSystem, &txMessage)) ESP_LOGE(LOG_TAG, "Error: System input bus full, message %d dropped", opcode);
+}
+
+
+
+
 //MENU CALLBACKS - ONLY FOR TESTING ATM
 
 
@@ -1029,10 +1038,7 @@ uint8_t createNewProjectFileCallback(void * param)
 {
     if(param != NULL)
     {
-        MenuQueueItem queueItem = {
-            .eventOpcode = 4,
-            .payload[0] = *(uint8_t*)param
-        };
+        //sendMessageToSystem(menuCmdNewProject, *(uint8_t*)param);
     }
     return 0;
 }
@@ -1042,11 +1048,7 @@ uint8_t updateNoteVelocity(void * param)
 {
     if(param != NULL)
     {
-        MenuQueueItem queueItem = {
-            .eventOpcode = 2,
-            .payload[0] = *(uint8_t*)param
-        };
-        xQueueSend(g_MenuToSystemQueueHandle, &queueItem, 0);
+        sendMessageToSystem(menuCmdSetNoteVelocity, *(uint8_t*)param);
     }
     return 0;
 }
@@ -1056,11 +1058,21 @@ uint8_t updateNoteDuration(void * param)
 {
     if(param != NULL)
     {
-        MenuQueueItem queueItem = {
-            .eventOpcode = 3,
-            .payload[0] = *(uint8_t*)param
-        };
-        xQueueSend(g_MenuToSystemQueueHandle, &queueItem, 0);
+        sendMessageToSystem(menuCmdSetNoteDuration, *(uint8_t*)param);
     }
     return 0;
-}
\ No newline at end of file
+}
+
+
+uint8_t startPlaybackCallback(void * param)
+{
+    sendMessageToSystem(menuCmdStartPlayback, 0);
+    return 0;
+}
+
+
+uint8_t stopPlaybackCallback(void * param)
+{
+    sendMessageToSystem(menuCmdStopPlayback, 0);
+    return 0;
+}
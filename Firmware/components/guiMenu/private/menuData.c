@@ -6,6 +6,8 @@ static char dispTxt_newProj[]     = "NEW PROJECT";
 static char dispTxt_loadProj[]    = "LOAD PROJECT";
 static char dispTxt_system[]      = "SYSTEM CONFIG";
 static char dispTxt_disk[]        = "DISK OPERATIONS";
+static char dispTxt_play[]        = "PLAY";
+static char dispTxt_stop[]        = "STOP";
 //
 static char dispTxt_projName[]    = "NAME: ";
 static char dispTxt_projTempo[]   = "TEMPO: ";
@@ -78,6 +80,26 @@ menuData_t menuDataArr[] =
       NULL
     },
 
+    { 
+      state_base,
+      dispTxt_play,
+      param_none,
+      NULL,
+      0,
+      0,
+      startPlaybackCallback
+    },
+
+    { 
+      state_base,
+      dispTxt_stop,
+      param_none,
+      NULL,
+      0,
+      0,
+      stopPlaybackCallback
+    },
+
     //-------------------------------------------------
     //--------- NEW PROJECT MENU LAYER ENTRIES --------
     //-------------------------------------------------
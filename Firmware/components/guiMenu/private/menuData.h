@@ -68,4 +68,6 @@ extern menuData_t * const menuManagerPtr;
 
 uint8_t createNewProjectFileCallback(void * param);
 uint8_t updateNoteVelocity(void * param);
-uint8_t updateNoteDuration(void * param);
\ No newline at end of file
+uint8_t updateNoteDuration(void * param);
+uint8_t startPlaybackCallback(void * param);
+uint8_t stopPlaybackCallback(void * param);
\ No newline at end of file
@@ -0,0 +1,28 @@
+#include <stdint.h>
+
+//The event type carried by the input event bus, see 'inputEventBus.h'.
+//Nothing here depends on the IDF, so it can be built and run on a host.
+
+#define INPUT_EVENT_PAYLOAD_SIZE    10
+
+//Where an event came from, sets the meaning of 'eventType'
+enum {
+    inputSourceSwitchMatrix,    //eventType is 'switchMatrixPressEvent' etc, see 'switchMatrix'
+    inputSourceEncoders,        //eventType is 'encoder0_sw' or 'encoder1_sw'
+    inputSourceMenu,            //eventType is a menu -> system opcode
+    inputSourceSystem           //eventType is a system -> menu opcode
+};
+
+typedef struct {
+    uint8_t source;
+    uint8_t eventType;
+    uint32_t timestampMicros;       //When the input happened (esp_timer time base)
+    union {
+        struct {
+            uint8_t column;
+            uint8_t row;
+            uint32_t heldMicros;    //Release and hold events, how long the switch has been held
+        } switchMatrix;
+        uint8_t payload[INPUT_EVENT_PAYLOAD_SIZE];  //Menu and system messages
+    };
+} InputEvent;
@@ -0,0 +1,24 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "inputEvent.h"
+
+//Every input to the menu and system tasks arrives as an 'InputEvent' on that tasks bus.
+//Producers post from any task or ISR, the consumer blocks in 'inputEventBus_wait'
+//until something is posted, then takes events until the bus is empty.
+
+//Bus for each consuming task
+enum {
+    inputBusSystem,
+    inputBusMenu,
+    NUM_INPUT_BUSES
+};
+
+void inputEventBus_init(void);
+void inputEventBus_setConsumer(uint8_t busId);
+bool inputEventBus_post(uint8_t busId, const InputEvent * eventPtr);
+bool inputEventBus_postFromISR(uint8_t busId, const InputEvent * eventPtr, BaseType_t * taskWokenPtr);
+void inputEventBus_wake(uint8_t busId);
+void inputEventBus_wakeFromISR(uint8_t busId, BaseType_t * taskWokenPtr);
+bool inputEventBus_take(uint8_t busId, InputEvent * eventPtr);
+void inputEventBus_wait(uint8_t busId, TickType_t timeoutTicks);
+uint32_t inputEventBus_getNumDropped(uint8_t busId);
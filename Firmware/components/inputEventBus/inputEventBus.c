@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+#include "esp_attr.h"
+#include "include/inputEventBus.h"
+#include "inputEventRing.h"
+
+
+//This module replaces the per-module queues that used to carry user input. Each
+//consuming task (system, menu) has one bus, and every producer posts to it:
+//switch matrix events, encoder switch presses, and the messages passed between
+//the menu and system tasks. The events are timestamped at source and typed by
+//'source' / 'eventType', see 'inputEvent.h'.
+
+//Each bus is a lock-free ring (see 'inputEventRing.h') plus the consumer tasks
+//notification. Posting wakes the consumer, which takes every event on the bus
+//before blocking again, so a task with nothing to do uses no CPU at all and
+//input is handled as soon as it arrives rather than on the next poll.
+
+//Inputs that aren't events (encoder rotation, the playback tick) call
+//'inputEventBus_wake' so the consumer goes and reads them.
+
+typedef struct
+{
+    InputEventRing ring;
+    TaskHandle_t volatile consumerTaskHandle;
+} InputEventBus;
+
+static InputEventBus g_inputEventBuses[NUM_INPUT_BUSES];
+
+
+
+//---- Public
+void inputEventBus_init(void)
+{
+    //Must be called before any producer posts
+
+    for(uint8_t busId = 0; busId < NUM_INPUT_BUSES; ++busId)
+    {
+        inputEventRing_init(&g_inputEventBuses[busId].ring);
+        g_inputEventBuses[busId].consumerTaskHandle = NULL;
+    }
+}
+
+
+
+//---- Public
+void inputEventBus_setConsumer(uint8_t busId)
+{
+    //Called by the consuming task itself. Events posted
+    //before this are kept and read on the tasks first pass.
+
+    assert(busId < NUM_INPUT_BUSES);
+    g_inputEventBuses[busId].consumerTaskHandle = xTaskGetCurrentTaskHandle();
+}
+
+
+
+//---- Public
+bool inputEventBus_post(uint8_t busId, const InputEvent * eventPtr)
+{
+    //RETURNS: false if the bus was full and the event was dropped
+
+    assert(busId < NUM_INPUT_BUSES);
+    assert(eventPtr != NULL);
+
+    if(!inputEventRing_push(&g_inputEventBuses[busId].ring, eventPtr)) return false;
+
+    inputEventBus_wake(busId);
+    return true;
+}
+
+
+
+//---- Public
+bool IRAM_ATTR inputEventBus_postFromISR(uint8_t busId, const InputEvent * eventPtr, BaseType_t * taskWokenPtr)
+{
+    //As 'inputEventBus_post', 'taskWokenPtr' is set if the
+    //consumer should run once the ISR returns (portYIELD_FROM_ISR)
+
+    if(!inputEventRing_push(&g_inputEventBuses[busId].ring, eventPtr)) return false;
+
+    inputEventBus_wakeFromISR(busId, taskWokenPtr);
+    return true;
+}
+
+
+
+//---- Public
+void inputEventBus_wake(uint8_t busId)
+{
+    TaskHandle_t consumerTaskHandle = g_inputEventBuses[busId].consumerTaskHandle;
+
+    if(consumerTaskHandle != NULL) xTaskNotifyGive(consumerTaskHandle);
+}
+
+
+
+//---- Public
+void IRAM_ATTR inputEventBus_wakeFromISR(uint8_t busId, BaseType_t * taskWokenPtr)
+{
+    TaskHandle_t consumerTaskHandle = g_inputEventBuses[busId].consumerTaskHandle;
+
+    if(consumerTaskHandle != NULL) vTaskNotifyGiveFromISR(consumerTaskHandle, taskWokenPtr);
+}
+
+
+
+//---- Public
+bool inputEventBus_take(uint8_t busId, InputEvent * eventPtr)
+{
+    //Consumer task only.
+    //RETURNS: false once the bus is empty
+
+    assert(busId < NUM_INPUT_BUSES);
+    assert(eventPtr != NULL);
+
+    return inputEventRing_pop(&g_inputEventBuses[busId].ring, eventPtr);
+}
+
+
+
+//---- Public
+void inputEventBus_wait(uint8_t busId, TickType_t timeoutTicks)
+{
+    //Consumer task only, blocks until something is posted or the bus is woken.
+    //Take every event before waiting, anything posted since the last wait
+    //returns straight away, so nothing is missed between the two.
+
+    assert(g_inputEventBuses[busId].consumerTaskHandle == xTaskGetCurrentTaskHandle());
+    ulTaskNotifyTake(pdTRUE, timeoutTicks);
+}
+
+
+
+//---- Public
+uint32_t inputEventBus_getNumDropped(uint8_t busId)
+{
+    //RETURNS: The number of events lost to a full bus since startup
+
+    assert(busId < NUM_INPUT_BUSES);
+    return atomic_load_explicit(&g_inputEventBuses[busId].ring.numDropped, memory_order_relaxed);
+}
@@ -0,0 +1,109 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+//A lock-free bounded multi producer / single consumer ring of input events.
+
+//Every slot carries a sequence number that says whose turn it is. A producer
+//claims a slot by advancing the shared write position with a compare-exchange,
+//copies the event in and then releases the slot by bumping its sequence. The
+//consumer only takes a slot once its sequence shows it has been released, and
+//hands it back to the producers (one lap on) once the event has been copied out.
+//Producers never wait on each other, so an ISR can post while a task is part way
+//through posting on the same core. If the ring is full the new event is counted
+//and dropped, the oldest events are kept.
+
+//Nothing here depends on the IDF, so it can be built and run on a host.
+//'inputEvent.h' must be included first.
+
+//Must be a power of two
+#define INPUT_EVENT_RING_NUM_ITEMS  64
+
+typedef struct
+{
+    atomic_uint sequence;
+    InputEvent event;
+} InputEventRingSlot;
+
+typedef struct
+{
+    InputEventRingSlot slots[INPUT_EVENT_RING_NUM_ITEMS];
+    atomic_uint writePos;       //Next slot to claim, shared by all producers
+    unsigned int readPos;       //Next slot to read, consumer only
+    atomic_uint numDropped;     //Events lost to a full ring
+} InputEventRing;
+
+
+
+//---- Public
+static inline void inputEventRing_init(InputEventRing * ringPtr)
+{
+    for(unsigned int idx = 0; idx < INPUT_EVENT_RING_NUM_ITEMS; ++idx)
+    {
+        atomic_init(&ringPtr->slots[idx].sequence, idx);
+    }
+
+    atomic_init(&ringPtr->writePos, 0);
+    ringPtr->readPos = 0;
+    atomic_init(&ringPtr->numDropped, 0);
+}
+
+
+
+//---- Public
+static inline __attribute__((always_inline)) bool inputEventRing_push(InputEventRing * ringPtr, const InputEvent * eventPtr)
+{
+    //Producer side, safe to call from any number of tasks and ISRs.
+    //Always inlined so it is safe to call from an IRAM ISR.
+    //RETURNS: false if the ring was full and the event was dropped.
+
+    unsigned int pos = atomic_load_explicit(&ringPtr->writePos, memory_order_relaxed);
+    InputEventRingSlot * slotPtr;
+    int lag;
+
+    while(1)
+    {
+        slotPtr = &ringPtr->slots[pos & (INPUT_EVENT_RING_NUM_ITEMS - 1)];
+        lag = (int)(atomic_load_explicit(&slotPtr->sequence, memory_order_acquire) - pos);
+
+        if(lag == 0)
+        {
+            //Slot is free, try to claim it. On failure 'pos' is
+            //updated to the current write position and we retry
+            if(atomic_compare_exchange_weak_explicit(&ringPtr->writePos, &pos, pos + 1,
+                                                     memory_order_relaxed, memory_order_relaxed)) break;
+        }
+        else if(lag < 0)
+        {
+            //Slot still holds an event from the previous lap
+            atomic_fetch_add_explicit(&ringPtr->numDropped, 1, memory_order_relaxed);
+            return false;
+        }
+        else pos = atomic_load_explicit(&ringPtr->writePos, memory_order_relaxed);
+    }
+
+    slotPtr->event = *eventPtr;
+    atomic_store_explicit(&slotPtr->sequence, pos + 1, memory_order_release);
+    return true;
+}
+
+
+
+//---- Public
+static inline bool inputEventRing_pop(InputEventRing * ringPtr, InputEvent * eventPtr)
+{
+    //Consumer side, one task only.
+    //RETURNS: false if there is no released event, otherwise
+    //the oldest event is copied to 'eventPtr'.
+
+    InputEventRingSlot * slotPtr = &ringPtr->slots[ringPtr->readPos & (INPUT_EVENT_RING_NUM_ITEMS - 1)];
+
+    //A slot claimed but not yet released by a producer reads as empty,
+    //that producer will wake the consumer once it has released it
+    if(atomic_load_explicit(&slotPtr->sequence, memory_order_acquire) != (ringPtr->readPos + 1)) return false;
+
+    *eventPtr = slotPtr->event;
+    atomic_store_explicit(&slotPtr->sequence, ringPtr->readPos + INPUT_EVENT_RING_NUM_ITEMS, memory_order_release);
+    ++ringPtr->readPos;
+    return true;
+}
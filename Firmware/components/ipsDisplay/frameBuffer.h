@@ -0,0 +1,323 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+//A whole screen RGB565 framebuffer, plus a short list of the areas drawn to since the last flush.
+
+//Drawing only ever writes to the framebuffer, every write marks the area it touched
+//as dirty. Dirty rectangles that overlap, touch or sit close together are merged as
+//they are added, so a line of text ends up as one rectangle rather than one per
+//character. The flush then only has to send each remaining rectangle, one address
+//window per rectangle rather than one per draw call.
+
+//Deciding whether to merge weighs the pixels a merged rectangle would send for no
+//reason against the cost of a separate address window. If the list fills up, the
+//new rectangle is merged into whichever existing one grows the least.
+
+//Rectangles filled with a single colour are kept solid, the flush can then send the
+//colour repeated from a small buffer instead of copying pixels out of the framebuffer.
+//A solid rectangle is never merged with its neighbours (only swallowed by a later
+//rectangle that covers it), as that would lose the fill and often grow it a lot,
+//think of a page of text drawn over a cleared screen. Drawing over part of a solid
+//rectangle leaves it solid, so the order they are flushed in matters. Solid rectangles
+//are taken first, oldest first, then the rest, which are sent from the framebuffer
+//and so always carry the final pixels for their area.
+
+//Pixels are held in the order they are sent over SPI (RGB565 big endian), so a
+//flush is a straight copy. All rectangle coordinates are inclusive.
+
+//Nothing here depends on the IDF, so it can be built and run on a host.
+
+#define FRAME_BUFFER_MAX_DIRTY_RECTS    8
+//Bytes sent to set the address window before each rectangle, CASET, RASET
+//and RAMWR commands (one byte each) plus the CASET/RASET payloads (4 bytes each)
+#define FRAME_BUFFER_WINDOW_NUM_BYTES   11
+//A separate address window takes roughly as long as sending this many pixels,
+//merging is worth it as long as it sends no more redundant pixels than this
+#define FRAME_BUFFER_RECT_COST_PIXELS   256
+
+typedef struct
+{
+    uint16_t xStart;
+    uint16_t yStart;
+    uint16_t xEnd;
+    uint16_t yEnd;
+} FrameBufferRect;
+
+typedef struct
+{
+    FrameBufferRect rect;
+    bool isSolid;               //Every pixel in the rectangle was last drawn in 'solidColour'
+    uint16_t solidColour;       //Wire order, as held in the framebuffer
+} FrameBufferDirtyRect;
+
+typedef struct
+{
+    uint16_t * pixels;          //width * height pixels, row major
+    uint16_t width;
+    uint16_t height;
+    FrameBufferDirtyRect dirtyRects[FRAME_BUFFER_MAX_DIRTY_RECTS];     //Oldest first
+    uint8_t numDirtyRects;
+} FrameBuffer;
+
+
+
+//---- Public
+static inline uint16_t frameBuffer_toWireOrder(uint16_t colour)
+{
+    return (uint16_t)((colour >> 8) | (colour << 8));
+}
+
+
+
+//---- Public
+static inline uint32_t frameBuffer_getRectNumPixels(const FrameBufferRect * rectPtr)
+{
+    return (uint32_t)(rectPtr->xEnd - rectPtr->xStart + 1) * (uint32_t)(rectPtr->yEnd - rectPtr->yStart + 1);
+}
+
+
+
+//---- Public
+static inline uint32_t frameBuffer_getRectNumSPIBytes(const FrameBufferRect * rectPtr)
+{
+    //Everything sent over SPI to flush the rectangle
+    return FRAME_BUFFER_WINDOW_NUM_BYTES + (frameBuffer_getRectNumPixels(rectPtr) * sizeof(uint16_t));
+}
+
+
+
+//---- Public
+static inline void frameBuffer_init(FrameBuffer * frameBufferPtr, uint16_t * pixelsPtr, uint16_t width, uint16_t height)
+{
+    frameBufferPtr->pixels = pixelsPtr;
+    frameBufferPtr->width = width;
+    frameBufferPtr->height = height;
+    frameBufferPtr->numDirtyRects = 0;
+}
+
+
+
+//---- Public
+static inline bool frameBuffer_clipRect(const FrameBuffer * frameBufferPtr, FrameBufferRect * rectPtr)
+{
+    //Trims the rectangle to the screen.
+    //RETURNS: false if nothing of it is left on screen.
+
+    if((rectPtr->xStart > rectPtr->xEnd) || (rectPtr->yStart > rectPtr->yEnd)) return false;
+    if((rectPtr->xStart >= frameBufferPtr->width) || (rectPtr->yStart >= frameBufferPtr->height)) return false;
+    if(rectPtr->xEnd >= frameBufferPtr->width) rectPtr->xEnd = frameBufferPtr->width - 1;
+    if(rectPtr->yEnd >= frameBufferPtr->height) rectPtr->yEnd = frameBufferPtr->height - 1;
+    return true;
+}
+
+
+
+//---- Private
+static inline FrameBufferRect frameBuffer_unionRect(const FrameBufferRect * aPtr, const FrameBufferRect * bPtr)
+{
+    FrameBufferRect result;
+    result.xStart = (aPtr->xStart < bPtr->xStart) ? aPtr->xStart : bPtr->xStart;
+    result.yStart = (aPtr->yStart < bPtr->yStart) ? aPtr->yStart : bPtr->yStart;
+    result.xEnd = (aPtr->xEnd > bPtr->xEnd) ? aPtr->xEnd : bPtr->xEnd;
+    result.yEnd = (aPtr->yEnd > bPtr->yEnd) ? aPtr->yEnd : bPtr->yEnd;
+    return result;
+}
+
+
+
+//---- Private
+static inline bool frameBuffer_rectContains(const FrameBufferRect * outerPtr, const FrameBufferRect * innerPtr)
+{
+    return ((outerPtr->xStart <= innerPtr->xStart) && (outerPtr->yStart <= innerPtr->yStart) &&
+            (outerPtr->xEnd >= innerPtr->xEnd) && (outerPtr->yEnd >= innerPtr->yEnd));
+}
+
+
+
+//---- Private
+static inline void frameBuffer_removeDirtyRect(FrameBuffer * frameBufferPtr, uint8_t idx)
+{
+    //Shuffles the rest down, so the list stays oldest first
+    memmove(&frameBufferPtr->dirtyRects[idx], &frameBufferPtr->dirtyRects[idx + 1],
+            (frameBufferPtr->numDirtyRects - idx - 1) * sizeof(FrameBufferDirtyRect));
+    --frameBufferPtr->numDirtyRects;
+}
+
+
+
+//---- Private
+static inline void frameBuffer_addDirtyRect(FrameBuffer * frameBufferPtr, FrameBufferDirtyRect newDirtyRect)
+{
+    FrameBufferDirtyRect * existingPtr;
+    FrameBufferRect merged;
+    uint32_t growth;
+    uint32_t leastGrowth;
+    uint8_t leastGrowthIdx;
+    uint8_t idx = 0;
+
+    //Merging can grow the rectangle into others already in the
+    //list, so keep going until it no longer merges with any
+    while(idx < frameBufferPtr->numDirtyRects)
+    {
+        existingPtr = &frameBufferPtr->dirtyRects[idx];
+
+        if(frameBuffer_rectContains(&newDirtyRect.rect, &existingPtr->rect))
+        {
+            //Drawn over completely, the new rectangle replaces it
+            frameBuffer_removeDirtyRect(frameBufferPtr, idx);
+            idx = 0;
+            continue;
+        }
+
+        if(!existingPtr->isSolid && frameBuffer_rectContains(&existingPtr->rect, &newDirtyRect.rect))
+        {
+            //Will already be sent, with the new pixels, from the framebuffer
+            return;
+        }
+
+        merged = frameBuffer_unionRect(&newDirtyRect.rect, &existingPtr->rect);
+        if(!newDirtyRect.isSolid && !existingPtr->isSolid &&
+           (frameBuffer_getRectNumPixels(&merged) <= (frameBuffer_getRectNumPixels(&newDirtyRect.rect) + frameBuffer_getRectNumPixels(&existingPtr->rect) + FRAME_BUFFER_RECT_COST_PIXELS)))
+        {
+            //Take the merged rectangle out of the list and start over with it
+            newDirtyRect.rect = merged;
+            frameBuffer_removeDirtyRect(frameBufferPtr, idx);
+            idx = 0;
+            continue;
+        }
+
+        ++idx;
+    }
+
+    if(frameBufferPtr->numDirtyRects < FRAME_BUFFER_MAX_DIRTY_RECTS)
+    {
+        frameBufferPtr->dirtyRects[frameBufferPtr->numDirtyRects++] = newDirtyRect;
+        return;
+    }
+
+    //List is full, fold it into the rectangle that grows the
+    //least, which then has to be sent from the framebuffer
+    leastGrowth = UINT32_MAX;
+    leastGrowthIdx = 0;
+    for(idx = 0; idx < FRAME_BUFFER_MAX_DIRTY_RECTS; ++idx)
+    {
+        merged = frameBuffer_unionRect(&newDirtyRect.rect, &frameBufferPtr->dirtyRects[idx].rect);
+        growth = frameBuffer_getRectNumPixels(&merged) - frameBuffer_getRectNumPixels(&frameBufferPtr->dirtyRects[idx].rect);
+        if(growth < leastGrowth)
+        {
+            leastGrowth = growth;
+            leastGrowthIdx = idx;
+        }
+    }
+
+    existingPtr = &frameBufferPtr->dirtyRects[leastGrowthIdx];
+    existingPtr->rect = frameBuffer_unionRect(&newDirtyRect.rect, &existingPtr->rect);
+    existingPtr->isSolid = false;
+}
+
+
+
+//---- Public
+static inline void frameBuffer_markDirty(FrameBuffer * frameBufferPtr, const FrameBufferRect * rectPtr)
+{
+    //'rectPtr' must already be clipped to the screen
+    FrameBufferDirtyRect newDirtyRect = {.rect = *rectPtr, .isSolid = false, .solidColour = 0};
+    frameBuffer_addDirtyRect(frameBufferPtr, newDirtyRect);
+}
+
+
+
+//---- Public
+static inline void frameBuffer_markDirtySolid(FrameBuffer * frameBufferPtr, const FrameBufferRect * rectPtr, uint16_t wireColour)
+{
+    //As 'frameBuffer_markDirty', for an area just filled with 'wireColour'
+    FrameBufferDirtyRect newDirtyRect = {.rect = *rectPtr, .isSolid = true, .solidColour = wireColour};
+    frameBuffer_addDirtyRect(frameBufferPtr, newDirtyRect);
+}
+
+
+
+//---- Public
+static inline bool frameBuffer_takeDirtyRect(FrameBuffer * frameBufferPtr, FrameBufferDirtyRect * dirtyRectPtr)
+{
+    //Solid rectangles come out first, oldest first, then the rest.
+    //RETURNS: false once there are no dirty rectangles left,
+    //otherwise one is removed from the list and copied to 'dirtyRectPtr'.
+
+    uint8_t idx = 0;
+
+    if(frameBufferPtr->numDirtyRects == 0) return false;
+
+    while((idx < frameBufferPtr->numDirtyRects) && !frameBufferPtr->dirtyRects[idx].isSolid) ++idx;
+    if(idx == frameBufferPtr->numDirtyRects) idx = 0;
+
+    *dirtyRectPtr = frameBufferPtr->dirtyRects[idx];
+    frameBuffer_removeDirtyRect(frameBufferPtr, idx);
+    return true;
+}
+
+
+
+//---- Public
+static inline uint16_t * frameBuffer_getPixelPtr(FrameBuffer * frameBufferPtr, uint16_t x, uint16_t y)
+{
+    return &frameBufferPtr->pixels[((uint32_t)y * frameBufferPtr->width) + x];
+}
+
+
+
+//---- Public
+static inline void frameBuffer_fillRect(FrameBuffer * frameBufferPtr, const FrameBufferRect * rectPtr, uint16_t colour)
+{
+    //Fills the rectangle (clipped to the screen) with 'colour', and marks it dirty as solid
+
+    FrameBufferRect fillArea = *rectPtr;
+    uint16_t wireColour = frameBuffer_toWireOrder(colour);
+    uint16_t * rowPtr;
+
+    if(!frameBuffer_clipRect(frameBufferPtr, &fillArea)) return;
+
+    for(uint16_t y = fillArea.yStart; y <= fillArea.yEnd; ++y)
+    {
+        rowPtr = frameBuffer_getPixelPtr(frameBufferPtr, fillArea.xStart, y);
+        for(uint16_t x = fillArea.xStart; x <= fillArea.xEnd; ++x) *rowPtr++ = wireColour;
+    }
+
+    frameBuffer_markDirtySolid(frameBufferPtr, &fillArea, wireColour);
+}
+
+
+
+#ifndef ESP_PLATFORM
+#include <stdio.h>
+
+//---- Public
+static inline bool frameBuffer_writePPM(const FrameBuffer * frameBufferPtr, const char * filePath)
+{
+    //Host builds only, writes the framebuffer out as a binary PPM image so
+    //what has been drawn can be checked without the display. The panel runs
+    //with inverted colours (see 'ScreenColour'), so the image is inverted to match.
+    //RETURNS: false if the file could not be written.
+
+    FILE * filePtr = fopen(filePath, "wb");
+    uint16_t colour;
+    uint8_t rgb[3];
+
+    if(filePtr == NULL) return false;
+
+    fprintf(filePtr, "P6\n%d %d\n255\n", frameBufferPtr->width, frameBufferPtr->height);
+
+    for(uint32_t idx = 0; idx < ((uint32_t)frameBufferPtr->width * frameBufferPtr->height); ++idx)
+    {
+        colour = ~frameBuffer_toWireOrder(frameBufferPtr->pixels[idx]);
+        rgb[0] = ((colour >> 11) & 0x1F) << 3;
+        rgb[1] = ((colour >> 5) & 0x3F) << 2;
+        rgb[2] = (colour & 0x1F) << 3;
+        fwrite(rgb, 1, sizeof(rgb), filePtr);
+    }
+
+    fclose(filePtr);
+    return true;
+}
+#endif
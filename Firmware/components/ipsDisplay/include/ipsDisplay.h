@@ -38,4 +38,8 @@ void IPSDisplay_drawHorizontalLineToScreen(uint16_t xStart, uint16_t xEnd, uint1
 void IPSDisplay_drawVerticalLineToScreen(uint16_t yStart, uint16_t yEnd, uint16_t xPos, LineThickness lineThicknessPx, ScreenColour colour);
 uint8_t IPSDisplay_getCharWidthInPixels(char charToCheck);
 uint8_t IPSDisplay_getCharHeightInPixels(void);
-void IPSDisplay_fillScreenWithColour(ScreenColour colour);
\ No newline at end of file
+void IPSDisplay_fillScreenWithColour(ScreenColour colour);
+
+//Drawing only updates the framebuffer, nothing
+//reaches the display until it is flushed
+void IPSDisplay_flush(void);
\ No newline at end of file
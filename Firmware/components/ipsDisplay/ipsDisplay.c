@@ -1,5 +1,6 @@
 #include "esp_log.h"
 #include "esp_attr.h"
+#include "esp_heap_caps.h"
 #include "include/ipsDisplay.h"
 #include "systemTextFont/include/Font16.h"
 #include "systemTextFont/include/Font32.h"
@@ -9,6 +10,7 @@
 #include "freertos/task.h"
 #include "freertos/semphr.h"
 #include "ipsDisplayPrivate.h"
+#include "frameBuffer.h"
 
 
 #define LOG_TAG "IPSDisplay"
@@ -19,21 +21,46 @@
 #define DISPLAY_DATA_CMD_IO          11
 #define DISPLAY_nRESET_LINE_IO       9
 #define NUM_BITS_IN_BYTE             8
-#define PIXEL_BUFFER_SIZE            1024
 #define MAX_CHARS_IN_STRING          20
+#define FLUSH_CHUNK_NUM_PIXELS       4096   //Pixels sent per DMA transfer during a flush, must hold at least one screen row
+#define NUM_FLUSH_CHUNK_BUFFERS      2
+#define NUM_FLUSH_TRANS_DESCRIPTORS  16     //Also the depth of the SPI device transaction queue
 #define DISPLAY_IO_CONFIG_MASK ((1ULL << DISPLAY_DATA_CMD_IO) | (1ULL << DISPLAY_nRESET_LINE_IO) | (1ULL << DISPLAY_BACKLIGHT_SW_IO))
 
 
-static void spiDrawToScreenLowLevel(uint32_t numPixelsToDraw, ScreenPositionData_t * screenPosData);
-static void drawToScreen(ScreenPositionData_t *screenPosData, ScreenColour colour);
+static void flushRect(const FrameBufferRect * rectPtr);
+static void flushSolidRect(const FrameBufferRect * rectPtr, uint16_t wireColour);
+static void queueDrawWindow(const FrameBufferRect * rectPtr);
+static spi_transaction_t * getFreeTransDescriptor(void);
+static void queueTrans(spi_transaction_t * transPtr);
+static void waitForTransDone(uint32_t numTrans);
 static void displayPreTransferSPICallback(spi_transaction_t * param);
 static inline void configureSPI(void);
 static void waitForScreenBusy(void);
 
 
-DMA_ATTR static uint16_t pixelBuffer16Bit[PIXEL_BUFFER_SIZE];
 static spi_device_handle_t g_displaySPIHandle;
 
+//Everything is drawn into the framebuffer (allocated from PSRAM at init),
+//'IPSDisplay_flush' then sends the areas that have changed to the display.
+static FrameBuffer g_frameBuffer;
+
+//The SPI DMA can't read the PSRAM framebuffer directly, so a flush copies
+//the rows being sent into these chunk buffers. One is filled while the
+//other is being sent. A solid fill instead fills one buffer with the
+//colour and sends that same buffer as many times as it takes.
+DMA_ATTR static uint16_t g_flushChunkBuffers[NUM_FLUSH_CHUNK_BUFFERS][FLUSH_CHUNK_NUM_PIXELS];
+static uint32_t g_flushChunkBufferTransNum[NUM_FLUSH_CHUNK_BUFFERS];    //Transaction that last sent each buffer
+static uint8_t g_nextFlushChunkBuffer = 0;
+
+//Transactions are queued without waiting on each one, their descriptors
+//must stay untouched until the transaction has completed. Descriptors are
+//handed out in turn, and counting transactions queued and completed tells
+//us when each one is free again (the SPI driver completes them in order).
+static spi_transaction_t g_flushTrans[NUM_FLUSH_TRANS_DESCRIPTORS];
+static uint32_t g_numTransQueued = 0;
+static uint32_t g_numTransDone = 0;
+
 const char characterSet[CHARACTER_SET_NUM_CHARS] = {
     'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n', 'o', 'p', 'q', 'r', 's', 't', 'u', 'v', 'w', 'x', 'y', 'z',
     '0', '1', '2', '3', '4', '5', '6', '7', '8', '9',
@@ -88,6 +115,10 @@ void IPSDisplay_init(void)
     //------------------------------------
     configureSPI();
 
+    uint16_t * frameBufferPixelsPtr = heap_caps_malloc(SCREEN_NUM_X_PIXELS * SCREEN_NUM_Y_PIXELS * sizeof(uint16_t), MALLOC_CAP_SPIRAM);
+    assert(frameBufferPixelsPtr != NULL);
+    frameBuffer_init(&g_frameBuffer, frameBufferPixelsPtr, SCREEN_NUM_X_PIXELS, SCREEN_NUM_Y_PIXELS);
+
     //------------------------------------
     //------- Initialize Display ---------
     //------------------------------------
@@ -133,6 +164,7 @@ void IPSDisplay_init(void)
     
     vTaskDelay(pdMS_TO_TICKS(50));
     IPSDisplay_fillScreenWithColour(screenColourBlack);
+    IPSDisplay_flush();
     vTaskDelay(pdMS_TO_TICKS(50));
     gpio_set_level(DISPLAY_BACKLIGHT_SW_IO, true);
 }
@@ -164,18 +196,20 @@ uint16_t IPSDisplay_drawLineOfTextToScreen(char *textData, uint16_t numCharsInSt
     assert(yStart < SCREEN_NUM_Y_PIXELS);
     assert(numCharsInString < MAX_CHARS_IN_STRING);
 
-    bool isPixelSet;
+    uint16_t pixelColour;
     uint8_t rlePixelMapIdx;
     uint8_t runLength;
     uint8_t widthInPixels;
     uint8_t charTableIdx;
     uint16_t totalPixelsForCurrentChar;
-    uint16_t pixelDataBufferIdx;
+    uint16_t pixelIdx;
+    uint16_t charColumn;
+    uint16_t charRow;
     uint16_t totalStringLengthInPixels = 0;
-    ScreenPositionData_t drawArea;
+    FrameBufferRect drawArea;
 
-    //In this initial version we write to the display character by character,
-    //in order to cut down the required buffer size for the pixel data.
+    //Characters are drawn one by one into the framebuffer, each marks its own area
+    //dirty and the areas of neighbouring characters merge into one for the flush.
     for (uint16_t currentChar = 0; currentChar < numCharsInString; ++currentChar)
     {
         //First step is determining the number of pixels
@@ -184,7 +218,9 @@ uint16_t IPSDisplay_drawLineOfTextToScreen(char *textData, uint16_t numCharsInSt
         widthInPixels = widtbl_f32[charTableIdx];
         totalPixelsForCurrentChar = widthInPixels * chr_hgt_f32;
 
-        pixelDataBufferIdx = 0; 
+        pixelIdx = 0;
+        charColumn = 0;
+        charRow = 0;
         rlePixelMapIdx = 0;
 
         do
@@ -200,32 +236,41 @@ uint16_t IPSDisplay_drawLineOfTextToScreen(char *textData, uint16_t numCharsInSt
             //bits 6->0 should not be visible (drawn in background colour).
 
             //Check if MSBIT of RLE byte is SET or CLEAR
-            if (chrtbl_f32[charTableIdx][rlePixelMapIdx] & 0x80) isPixelSet = true;
-            else isPixelSet = false;
+            if (chrtbl_f32[charTableIdx][rlePixelMapIdx] & 0x80) pixelColour = frameBuffer_toWireOrder(colour);
+            else pixelColour = frameBuffer_toWireOrder(screenColourBlack);
 
             //Get the run length from bits 6->0 of RLE byte
             runLength = chrtbl_f32[charTableIdx][rlePixelMapIdx] & 0x7F;
 
             //For the number of pixels specified by the run length, 
             //either draw pixels to foreground (visible) or background.
-            for(uint8_t pixelNum = 0; pixelNum <= runLength; ++pixelNum)
+            //The pixel map runs left to right, top to bottom, anything
+            //falling off the edge of the screen is skipped.
+            for(uint8_t pixelNum = 0; (pixelNum <= runLength) && (pixelIdx < totalPixelsForCurrentChar); ++pixelNum)
             {
-                assert(pixelDataBufferIdx < PIXEL_BUFFER_SIZE);
-                if (isPixelSet == true) pixelBuffer16Bit[pixelDataBufferIdx] = colour;
-                else pixelBuffer16Bit[pixelDataBufferIdx] = screenColourBlack;
-                ++pixelDataBufferIdx;
+                if (((xStart + charColumn) < SCREEN_NUM_X_PIXELS) && ((yStart + charRow) < SCREEN_NUM_Y_PIXELS))
+                {
+                    *frameBuffer_getPixelPtr(&g_frameBuffer, (xStart + charColumn), (yStart + charRow)) = pixelColour;
+                }
+
+                ++pixelIdx;
+                if (++charColumn == widthInPixels)
+                {
+                    charColumn = 0;
+                    ++charRow;
+                }
             }
                 
             ++rlePixelMapIdx; //Increment idx onto next RLE byte
 
-        }while(pixelDataBufferIdx < totalPixelsForCurrentChar);
+        }while(pixelIdx < totalPixelsForCurrentChar);
 
         drawArea.xStart = xStart;
         drawArea.xEnd = (xStart + (widthInPixels - 1));
         drawArea.yStart = yStart;
         drawArea.yEnd = (yStart + (chr_hgt_f32 - 1));
 
-        spiDrawToScreenLowLevel(totalPixelsForCurrentChar, &drawArea);
+        if (frameBuffer_clipRect(&g_frameBuffer, &drawArea)) frameBuffer_markDirty(&g_frameBuffer, &drawArea);
 
         //We update the xStart coordinate so the next character
         //written to display doesnt overlap the one just written
@@ -242,13 +287,13 @@ uint16_t IPSDisplay_drawLineOfTextToScreen(char *textData, uint16_t numCharsInSt
 //---- Public
 void IPSDisplay_fillScreenWithColour(ScreenColour colour)
 {
-    ScreenPositionData_t screenDat;
+    FrameBufferRect screenDat;
 
     screenDat.yStart = 0;
-    screenDat.yEnd = SCREEN_NUM_Y_PIXELS;
+    screenDat.yEnd = SCREEN_NUM_Y_PIXELS - 1;
     screenDat.xStart = 0;
-    screenDat.xEnd = SCREEN_NUM_X_PIXELS;
-    drawToScreen(&screenDat, colour);
+    screenDat.xEnd = SCREEN_NUM_X_PIXELS - 1;
+    frameBuffer_fillRect(&g_frameBuffer, &screenDat, colour);
 }
 
 
@@ -274,13 +319,13 @@ void IPSDisplay_drawHorizontalLineToScreen(uint16_t xStart, uint16_t xEnd, uint1
     assert(xStart < xEnd);
     assert(yPos < SCREEN_NUM_Y_PIXELS);
 
-    ScreenPositionData_t screenDat;
+    FrameBufferRect screenDat;
 
     screenDat.yStart = yPos;
     screenDat.yEnd = yPos + (lineThicknessPx - 1);
     screenDat.xStart = xStart;
     screenDat.xEnd = xEnd;
-    drawToScreen(&screenDat, colour);
+    frameBuffer_fillRect(&g_frameBuffer, &screenDat, colour);
 }
 
 
@@ -291,131 +336,225 @@ void IPSDisplay_drawVerticalLineToScreen(uint16_t yStart, uint16_t yEnd, uint16_
     assert(yStart < yEnd);
     assert(xPos < SCREEN_NUM_X_PIXELS);
 
-    ScreenPositionData_t screenDat;
+    FrameBufferRect screenDat;
 
     screenDat.yStart = yStart;
     screenDat.yEnd = yEnd;
     screenDat.xStart = xPos;
     screenDat.xEnd = xPos + (lineThicknessPx - 1);
-    drawToScreen(&screenDat, colour);
+    frameBuffer_fillRect(&g_frameBuffer, &screenDat, colour);
 }
 
 
-//---- Private
-static void drawToScreen(ScreenPositionData_t *screenPosData, ScreenColour colour)
+//---- Public
+void IPSDisplay_flush(void)
 {
-    //This function handles drawing of lines
+    //Sends everything drawn since the last flush to the display. Each dirty
+    //rectangle gets one address window, then its pixels are streamed in
+    //DMA sized chunks, copying the next chunk while the last is being sent.
 
-    assert(screenPosData != NULL);
+    //This returns as soon as the last transfers are queued, the caller can
+    //carry on drawing into the framebuffer while they go out. Anything that
+    //still needs the chunk buffers or descriptors waits for them when it
+    //comes to reuse them.
 
-    uint16_t yPos;
-    uint32_t numPixelsToDraw = 0;
-    ScreenPositionData_t drawArea;
+    FrameBufferDirtyRect dirtyRect;
+    uint32_t numBytesFlushed = 0;
+    uint8_t numRectsFlushed = 0;
 
-    //We have a finite pixel buffer so currently drawing one pixel row at a time
-    for (uint16_t idx = 0; idx < (screenPosData->xEnd - screenPosData->xStart); idx++)
+    while (frameBuffer_takeDirtyRect(&g_frameBuffer, &dirtyRect))
     {
-        assert(numPixelsToDraw < PIXEL_BUFFER_SIZE);
-        pixelBuffer16Bit[idx] = colour;
-        numPixelsToDraw++;
+        if (dirtyRect.isSolid) flushSolidRect(&dirtyRect.rect, dirtyRect.solidColour);
+        else flushRect(&dirtyRect.rect);
+        numBytesFlushed += frameBuffer_getRectNumSPIBytes(&dirtyRect.rect);
+        ++numRectsFlushed;
     }
 
-    yPos = screenPosData->yStart;
-    while (yPos < screenPosData->yEnd)
+    if (numRectsFlushed > 0) ESP_LOGD(LOG_TAG, "Flushed %d rects, %ld SPI bytes", numRectsFlushed, numBytesFlushed);
+}
+
+
+//---- Private
+static void flushRect(const FrameBufferRect * rectPtr)
+{
+    assert(rectPtr != NULL);
+
+    uint16_t rowWidth = (rectPtr->xEnd - rectPtr->xStart) + 1;
+    uint16_t rowsPerChunk = FLUSH_CHUNK_NUM_PIXELS / rowWidth;
+    uint16_t numRowsInChunk;
+    uint16_t * chunkBufferPtr;
+    spi_transaction_t * transPtr;
+
+    queueDrawWindow(rectPtr);
+
+    //Every pixel after RAMWR is written into the window in turn, so the
+    //rows can be split across as many data transactions as needed
+    for (uint16_t yPos = rectPtr->yStart; yPos <= rectPtr->yEnd; yPos += numRowsInChunk)
     {
-        drawArea.xStart = screenPosData->xStart;
-        drawArea.xEnd = screenPosData->xEnd;
-        drawArea.yStart = yPos;
-        drawArea.yEnd = (yPos+1);
-        
-        spiDrawToScreenLowLevel(numPixelsToDraw, &drawArea);
-        yPos++;
+        numRowsInChunk = ((rectPtr->yEnd - yPos) + 1);
+        if (numRowsInChunk > rowsPerChunk) numRowsInChunk = rowsPerChunk;
+
+        //Wait for the buffer to finish its last transfer before refilling it
+        waitForTransDone(g_flushChunkBufferTransNum[g_nextFlushChunkBuffer]);
+        chunkBufferPtr = g_flushChunkBuffers[g_nextFlushChunkBuffer];
+
+        for (uint16_t row = 0; row < numRowsInChunk; ++row)
+        {
+            memcpy(&chunkBufferPtr[row * rowWidth], frameBuffer_getPixelPtr(&g_frameBuffer, rectPtr->xStart, (yPos + row)), rowWidth * sizeof(uint16_t));
+        }
+
+        transPtr = getFreeTransDescriptor();
+        transPtr->tx_buffer = chunkBufferPtr;
+        transPtr->length = (numRowsInChunk * rowWidth) * sizeof(uint16_t) * NUM_BITS_IN_BYTE;
+        transPtr->flags = SPI_TRANS_USE_TX_BUFFER;
+        transPtr->user = SET_DC_PIN_HIGH;
+        queueTrans(transPtr);
+
+        g_flushChunkBufferTransNum[g_nextFlushChunkBuffer] = g_numTransQueued;
+        g_nextFlushChunkBuffer = (g_nextFlushChunkBuffer + 1) % NUM_FLUSH_CHUNK_BUFFERS;
     }
 }
 
 
 //---- Private
-static void spiDrawToScreenLowLevel(uint32_t numPixelsToDraw, ScreenPositionData_t * drawArea)
+static void flushSolidRect(const FrameBufferRect * rectPtr, uint16_t wireColour)
 {
-    assert(numPixelsToDraw < PIXEL_BUFFER_SIZE);
-    assert(drawArea != NULL);
+    //Every pixel is the same colour, so there is nothing to copy out of the
+    //framebuffer. Clearing the whole screen is the address window plus a
+    //few full size chunks, all sent from the one buffer.
+
+    assert(rectPtr != NULL);
+
+    uint32_t numPixelsRemaining = frameBuffer_getRectNumPixels(rectPtr);
+    uint32_t numPixelsInChunk;
+    uint16_t * colourBufferPtr;
+    spi_transaction_t * transPtr;
+
+    queueDrawWindow(rectPtr);
+
+    waitForTransDone(g_flushChunkBufferTransNum[g_nextFlushChunkBuffer]);
+    colourBufferPtr = g_flushChunkBuffers[g_nextFlushChunkBuffer];
+
+    numPixelsInChunk = (numPixelsRemaining < FLUSH_CHUNK_NUM_PIXELS) ? numPixelsRemaining : FLUSH_CHUNK_NUM_PIXELS;
+    for (uint32_t idx = 0; idx < numPixelsInChunk; ++idx) colourBufferPtr[idx] = wireColour;
+
+    while (numPixelsRemaining > 0)
+    {
+        numPixelsInChunk = (numPixelsRemaining < FLUSH_CHUNK_NUM_PIXELS) ? numPixelsRemaining : FLUSH_CHUNK_NUM_PIXELS;
+
+        transPtr = getFreeTransDescriptor();
+        transPtr->tx_buffer = colourBufferPtr;
+        transPtr->length = numPixelsInChunk * sizeof(uint16_t) * NUM_BITS_IN_BYTE;
+        transPtr->flags = SPI_TRANS_USE_TX_BUFFER;
+        transPtr->user = SET_DC_PIN_HIGH;
+        queueTrans(transPtr);
 
+        numPixelsRemaining -= numPixelsInChunk;
+    }
+
+    g_flushChunkBufferTransNum[g_nextFlushChunkBuffer] = g_numTransQueued;
+    g_nextFlushChunkBuffer = (g_nextFlushChunkBuffer + 1) % NUM_FLUSH_CHUNK_BUFFERS;
+}
+
+
+//---- Private
+static void queueDrawWindow(const FrameBufferRect * rectPtr)
+{
     //NOTE: The ESP-IDF provided interface to the spi peripheral as a horrible mess.
     //Rather than set a few registers transactions are defined via descriptor objects.
 
     //The current display uses a four-wire interface. SPI lines for CLK, MOSI, CS
-    //and an additional D/C line which the display driver uses to determine 
+    //and an additional D/C line which the display driver uses to determine
     //whether an SPI transaction data should be treated as DATA or COMMAND.
 
-    //Each transaction requires a transaction descriptor, which will will be 
-    //referenced by the IDF framework in the background during spi transmission.
-    //The transaction descriptors need to be made static, as the transactions
-    //will be queued and continue to execute after this function has finished.
-    static spi_transaction_t trans[NUM_SPI_TRANS_FOR_DRAW_TO_SCREEN];
-    spi_transaction_t * transResult;
-    
-    //In order to draw to screen we will need to perform
-    //the following SIX spi write operations. We have to
-    //break them into seperate transactions in order to 
-    //automate control of the D/C pin - which is controlled
-    //via a callback which sets the pin to the value specified
-    //by the '.user' member of the spi transaction descriptor.
-
-    //trans[0] : CASET CMD (D/C pin LOW)
-    trans[0].tx_data[0] = CASET_REG_ADDR;
-    trans[0].length = NUM_BITS_IN_BYTE;
-    trans[0].flags = SPI_TRANS_USE_TXDATA;
-    trans[0].user = SET_DC_PIN_LOW;
-    //trans[1] : CASET WRITE PAYLOAD (D/C pin HIGH)
-    trans[1].tx_data[0] = (drawArea->xStart >> 8);     //Col START addr MSB
-    trans[1].tx_data[1] = drawArea->xStart;            //Col START addr LSB
-    trans[1].tx_data[2] = (drawArea->xEnd >> 8);       //Col END addr MSB
-    trans[1].tx_data[3] = drawArea->xEnd;              //Col END addr LSB
-    trans[1].length = CASET_PAYLOAD_SIZE_IN_BITS;
-    trans[1].flags = SPI_TRANS_USE_TXDATA;
-    trans[1].user = SET_DC_PIN_HIGH;
-    //trans[2] : RASET CMD (D/C pin LOW)
-    trans[2].tx_data[0] = RASET_REG_ADDR;
-    trans[2].length = NUM_BITS_IN_BYTE;
-    trans[2].flags = SPI_TRANS_USE_TXDATA;
-    trans[2].user = SET_DC_PIN_LOW;
-    //trans[3] : RASET WRITE PAYLOAD (D/C pin HIGH)
-    trans[3].tx_data[0] = (drawArea->yStart >> 8);      //Row START addr MSB
-    trans[3].tx_data[1] = drawArea->yStart;             //Row START addr LSB
-    trans[3].tx_data[2] = (drawArea->yEnd >> 8);        //Row END addr MSB
-    trans[3].tx_data[3] = drawArea->yEnd;               //Row END addr LSB
-    trans[3].length = RASET_PAYLOAD_SIZE_IN_BITS;
-    trans[3].flags = SPI_TRANS_USE_TXDATA;
-    trans[3].user = SET_DC_PIN_HIGH;
-    //trans[4] : RAMWR CMD (D/C pin LOW)
-    trans[4].tx_data[0] = RAMWR_REG_ADDR;
-    trans[4].length = NUM_BITS_IN_BYTE;
-    trans[4].flags = SPI_TRANS_USE_TXDATA;
-    trans[4].user = SET_DC_PIN_LOW;
-    //trans[5] : RAMWR WRITE PAYLOAD (D/C pin HIGH)
-    trans[5].tx_buffer = pixelBuffer16Bit;
-    trans[5].length = numPixelsToDraw * sizeof(*pixelBuffer16Bit) * NUM_BITS_IN_BYTE;
-    trans[5].flags = SPI_TRANS_USE_TX_BUFFER;
-    trans[5].user = SET_DC_PIN_HIGH;
-    trans[5].rxlength = 0;
-
-    //Queue SPI transactions, to be processed immediately by peripheral
-    for(uint8_t idx = 0; idx < NUM_SPI_TRANS_FOR_DRAW_TO_SCREEN; idx++)
+    //In order to set the area being drawn to we need the following
+    //FIVE spi write operations. We have to break them into seperate
+    //transactions in order to automate control of the D/C pin - which
+    //is controlled via a callback which sets the pin to the value
+    //specified by the '.user' member of the spi transaction descriptor.
+    //The pixel data then follows as one or more RAMWR payload transactions.
+
+    spi_transaction_t * transPtr;
+
+    //CASET CMD (D/C pin LOW)
+    transPtr = getFreeTransDescriptor();
+    transPtr->tx_data[0] = CASET_REG_ADDR;
+    transPtr->length = NUM_BITS_IN_BYTE;
+    transPtr->flags = SPI_TRANS_USE_TXDATA;
+    transPtr->user = SET_DC_PIN_LOW;
+    queueTrans(transPtr);
+    //CASET WRITE PAYLOAD (D/C pin HIGH)
+    transPtr = getFreeTransDescriptor();
+    transPtr->tx_data[0] = (rectPtr->xStart >> 8);     //Col START addr MSB
+    transPtr->tx_data[1] = rectPtr->xStart;            //Col START addr LSB
+    transPtr->tx_data[2] = (rectPtr->xEnd >> 8);       //Col END addr MSB
+    transPtr->tx_data[3] = rectPtr->xEnd;              //Col END addr LSB
+    transPtr->length = CASET_PAYLOAD_SIZE_IN_BITS;
+    transPtr->flags = SPI_TRANS_USE_TXDATA;
+    transPtr->user = SET_DC_PIN_HIGH;
+    queueTrans(transPtr);
+    //RASET CMD (D/C pin LOW)
+    transPtr = getFreeTransDescriptor();
+    transPtr->tx_data[0] = RASET_REG_ADDR;
+    transPtr->length = NUM_BITS_IN_BYTE;
+    transPtr->flags = SPI_TRANS_USE_TXDATA;
+    transPtr->user = SET_DC_PIN_LOW;
+    queueTrans(transPtr);
+    //RASET WRITE PAYLOAD (D/C pin HIGH)
+    transPtr = getFreeTransDescriptor();
+    transPtr->tx_data[0] = (rectPtr->yStart >> 8);      //Row START addr MSB
+    transPtr->tx_data[1] = rectPtr->yStart;             //Row START addr LSB
+    transPtr->tx_data[2] = (rectPtr->yEnd >> 8);        //Row END addr MSB
+    transPtr->tx_data[3] = rectPtr->yEnd;               //Row END addr LSB
+    transPtr->length = RASET_PAYLOAD_SIZE_IN_BITS;
+    transPtr->flags = SPI_TRANS_USE_TXDATA;
+    transPtr->user = SET_DC_PIN_HIGH;
+    queueTrans(transPtr);
+    //RAMWR CMD (D/C pin LOW)
+    transPtr = getFreeTransDescriptor();
+    transPtr->tx_data[0] = RAMWR_REG_ADDR;
+    transPtr->length = NUM_BITS_IN_BYTE;
+    transPtr->flags = SPI_TRANS_USE_TXDATA;
+    transPtr->user = SET_DC_PIN_LOW;
+    queueTrans(transPtr);
+}
+
+
+//---- Private
+static spi_transaction_t * getFreeTransDescriptor(void)
+{
+    //The descriptor handed out was last used 'NUM_FLUSH_TRANS_DESCRIPTORS'
+    //transactions ago, wait for that transaction if it is still in flight
+    if ((g_numTransQueued - g_numTransDone) >= NUM_FLUSH_TRANS_DESCRIPTORS)
     {
-        assert(spi_device_queue_trans(g_displaySPIHandle, &trans[idx], portMAX_DELAY) == ESP_OK);
+        waitForTransDone((g_numTransQueued - NUM_FLUSH_TRANS_DESCRIPTORS) + 1);
     }
 
-    //Horrible but necessary. 
-    //Multiple spi transactions are required during a typical
-    //display draw operation. Without this the next batch of 
-    //transactions may be added to queue before the first batch
-    //has finished, which causes data corruption. 
-    // Wait for all 6 transactions to be done and get back the results.
-    for (int x = 0; x < NUM_SPI_TRANS_FOR_DRAW_TO_SCREEN; x++)
+    spi_transaction_t * transPtr = &g_flushTrans[g_numTransQueued % NUM_FLUSH_TRANS_DESCRIPTORS];
+    memset(transPtr, 0, sizeof(spi_transaction_t));
+    return transPtr;
+}
+
+
+//---- Private
+static void queueTrans(spi_transaction_t * transPtr)
+{
+    //Queued to be processed by the peripheral in the background
+    assert(spi_device_queue_trans(g_displaySPIHandle, transPtr, portMAX_DELAY) == ESP_OK);
+    ++g_numTransQueued;
+}
+
+
+//---- Private
+static void waitForTransDone(uint32_t numTrans)
+{
+    //Blocks until the first 'numTrans' transactions ever queued have completed
+    spi_transaction_t * transResult;
+
+    while ((int32_t)(g_numTransDone - numTrans) < 0)
     {
-        // The IDF provides a way to check that a previously queued spi
-        // transaction has completed - try to replace this with callbacks later
         assert(spi_device_get_trans_result(g_displaySPIHandle, &transResult, portMAX_DELAY) == ESP_OK);
+        ++g_numTransDone;
     }
 }
 
@@ -439,13 +578,13 @@ static inline void configureSPI(void)
     UIg_displaySPIHandle_conf.sclk_io_num = DISPLAY_SPI_SCK_IO;
     UIg_displaySPIHandle_conf.quadwp_io_num = -1;
     UIg_displaySPIHandle_conf.quadhd_io_num = -1;
-    UIg_displaySPIHandle_conf.max_transfer_sz = PIXEL_BUFFER_SIZE;
+    UIg_displaySPIHandle_conf.max_transfer_sz = FLUSH_CHUNK_NUM_PIXELS * sizeof(uint16_t);
     spi_bus_initialize(SCREEN_USING_SPI_INSTANCE, &UIg_displaySPIHandle_conf, SPI_DMA_CH_AUTO);
 
     UIg_displaySPIHandle_interface_conf.clock_speed_hz = 10 * 1000 * 1000;
     UIg_displaySPIHandle_interface_conf.mode = 0;
     UIg_displaySPIHandle_interface_conf.spics_io_num = DISPLAY_SPI_CS_IO;
-    UIg_displaySPIHandle_interface_conf.queue_size = 6;
+    UIg_displaySPIHandle_interface_conf.queue_size = NUM_FLUSH_TRANS_DESCRIPTORS;
     UIg_displaySPIHandle_interface_conf.pre_cb = displayPreTransferSPICallback;
     spi_bus_add_device(SCREEN_USING_SPI_INSTANCE, &UIg_displaySPIHandle_interface_conf, &g_displaySPIHandle);
 }
@@ -29,8 +29,6 @@
 
 #define END_OF_INITIALIZATION 0
 
-#define NUM_SPI_TRANS_FOR_DRAW_TO_SCREEN 6
-
 #define SET_DC_PIN_LOW ((void*)0)
 #define SET_DC_PIN_HIGH ((void*)1)
 #define SPI_TRANS_USE_TX_BUFFER 0 
@@ -43,13 +41,4 @@ typedef struct
     uint8_t registerAddr;
     uint8_t writePayload[16];
     uint8_t numBytesInPayload;
-} ScreenInitCommand_t;
-
-
-typedef struct
-{
-    uint16_t xStart;
-    uint16_t xEnd;
-    uint16_t yStart;
-    uint16_t yEnd;
-} ScreenPositionData_t;
\ No newline at end of file
+} ScreenInitCommand_t;
\ No newline at end of file
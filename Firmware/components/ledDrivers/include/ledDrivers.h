@@ -6,6 +6,10 @@
 #define SYSTEM_NUM_ROWS 6
 #define SYSTEM_NUM_COLUMNS 8
 
+//The LED refresh task only ever holds the most recent
+//frame, a new frame overwrites one not yet written
+#define LED_FRAME_QUEUE_NUM_ITEMS 1
+
 //*******************************************************
 //The 'rgbLedColour_t' enumerations are used to store
 //the values that will be loaded into the PWM registers for 
@@ -24,6 +28,25 @@ typedef enum {
     rgb_pink   = 0x00FFC0CB
 } rgbLedColour_t;
 
+//Pass as 'icNum' to apply a setting to all driver ICs at once
+#define LED_DRIVER_ALL_ICS 0xFF
+
+//I2C bus activity counters, see 'ledDrivers_getBusStats'
+typedef struct {
+    uint32_t numFrames;         //Calls to 'ledDrivers_writeEntireGrid'
+    uint32_t numTransactions;   //I2C write transactions
+    uint32_t numBytes;          //Bytes on the bus, including both address bytes
+    uint32_t numLatches;        //Latch pin toggles
+    uint32_t busyMicros;        //Time spent in I2C write transactions
+} ledDriverBusStats_t;
+
+//A complete grid frame, as passed to 'ledDrivers_writeEntireGrid'
+typedef struct {
+    rgbLedColour_t colours[SYSTEM_NUM_ROWS * SYSTEM_NUM_COLUMNS];
+} ledDriverFrame_t;
+
+extern QueueHandle_t g_LedFrameQueueHandle;
+
 //---- Module interface ----//
 uint8_t ledDrivers_init(void);
 uint8_t ledDrivers_writeSingleLed(uint8_t columnNum, uint8_t rowNum, rgbLedColour_t rgbColourCode);
@@ -31,6 +54,14 @@ uint8_t ledDrivers_writeSingleGridColumn(uint8_t columnNum, rgbLedColour_t * col
 uint8_t ledDrivers_writeEntireGrid(rgbLedColour_t * rgbGridColours);
 void ledDrivers_gridTestDemo(void);
 void ledDrivers_blankOutEntireGrid(void);
+void ledDrivers_getBusStats(ledDriverBusStats_t * statsPtr);
+void ledDrivers_dumpBusProfile(void);
+void ledDrivers_resetBusProfile(void);
+void ledDrivers_submitFrame(rgbLedColour_t * rgbGridColours);
+uint8_t ledDrivers_setGlobalBrightness(uint8_t brightness);
+uint8_t ledDrivers_setColourCurrents(uint8_t icNum, uint8_t redCurrent, uint8_t greenCurrent, uint8_t blueCurrent);
+void ledDrivers_generateFadeCurve(uint8_t * curvePtr, uint16_t numSteps, uint8_t startBrightness, uint8_t endBrightness);
+void ledDrivers_refreshTaskEntryPoint(void * taskParams);
 
 
 
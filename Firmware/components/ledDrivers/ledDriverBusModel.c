@@ -0,0 +1,62 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <assert.h>
+#include "ledDriverBusModel.h"
+
+
+//This module predicts how long a set of I2C writes to the LED drivers will
+//take, so a batching scheme (per LED, per column, per IC etc) can be costed
+//before it is tried on hardware. As the ESP32S3 I2C peripheral is blocking,
+//this is also the time the writing task is stalled for.
+
+//It has no dependency on the IDF, so can be built and run on a host.
+
+
+//---- Public
+uint32_t ledDriverBusModel_transactionMicros(uint32_t busFreqHz, uint16_t numDataBytes)
+{
+    //RETURNS: The predicted time (in micro seconds, rounded up) for
+    //a single write of 'numDataBytes' register bytes, including the
+    //start/stop conditions, both address bytes and the fixed overhead.
+
+    assert(busFreqHz != 0);
+
+    uint32_t numBits = BUS_MODEL_START_STOP_NUM_BITS;
+    numBits += (uint32_t)(numDataBytes + BUS_MODEL_ADDRESS_NUM_BYTES) * BUS_MODEL_BITS_PER_BYTE;
+
+    return (uint32_t)((((uint64_t)numBits * 1000000) + (busFreqHz - 1)) / busFreqHz) + BUS_MODEL_TRANSACTION_OVERHEAD_US;
+}
+
+
+
+//---- Public
+uint32_t ledDriverBusModel_schemeMicros(uint32_t busFreqHz, const uint16_t * transactionNumBytesPtr, uint16_t numTransactions, uint16_t numLatches)
+{
+    //'transactionNumBytesPtr' lists the number of register bytes
+    //written by each transaction in the scheme.
+    //RETURNS: The predicted time for the whole scheme.
+
+    assert((transactionNumBytesPtr != NULL) || (numTransactions == 0));
+
+    uint32_t totalMicros = numLatches * BUS_MODEL_LATCH_OVERHEAD_US;
+
+    for(uint16_t idx = 0; idx < numTransactions; ++idx)
+    {
+        totalMicros += ledDriverBusModel_transactionMicros(busFreqHz, transactionNumBytesPtr[idx]);
+    }
+
+    return totalMicros;
+}
+
+
+
+//---- Public
+uint32_t ledDriverBusModel_uniformSchemeMicros(uint32_t busFreqHz, uint16_t numTransactions, uint16_t numDataBytesPerTransaction, uint16_t numLatches)
+{
+    //As above, for schemes where every transaction is the same size.
+    //For example a full grid frame is 48 x 3 bytes written per LED,
+    //8 x 18 bytes per column, or 4 x 36 bytes per driver IC.
+
+    return (numTransactions * ledDriverBusModel_transactionMicros(busFreqHz, numDataBytesPerTransaction))
+            + (numLatches * BUS_MODEL_LATCH_OVERHEAD_US);
+}
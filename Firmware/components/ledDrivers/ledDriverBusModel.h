@@ -0,0 +1,23 @@
+
+//Timing model for I2C writes to the LP5862 drivers, see 'ledDriverBusModel.c'
+
+//Each byte on the bus is 8 data bits plus the ACK bit
+#define BUS_MODEL_BITS_PER_BYTE             9
+
+//Start and stop conditions, roughly a bit time each
+#define BUS_MODEL_START_STOP_NUM_BITS       2
+
+//Both chip/register address bytes sent ahead of the data
+#define BUS_MODEL_ADDRESS_NUM_BYTES         2
+
+//Time spent outside of clocking bits for each transaction
+//(building the IDF command link, driver/ISR handling). This is
+//an estimate, compare against the profiler dump to calibrate.
+#define BUS_MODEL_TRANSACTION_OVERHEAD_US   40
+
+//Time to toggle the latch pin once a frame has been written
+#define BUS_MODEL_LATCH_OVERHEAD_US         2
+
+uint32_t ledDriverBusModel_transactionMicros(uint32_t busFreqHz, uint16_t numDataBytes);
+uint32_t ledDriverBusModel_schemeMicros(uint32_t busFreqHz, const uint16_t * transactionNumBytesPtr, uint16_t numTransactions, uint16_t numLatches);
+uint32_t ledDriverBusModel_uniformSchemeMicros(uint32_t busFreqHz, uint16_t numTransactions, uint16_t numDataBytesPerTransaction, uint16_t numLatches);
@@ -4,6 +4,8 @@
 
 #define NUM_8BIT_PWM_REGISTES_PER_LED 3
 #define NUM_8BIT_PWM_REGISTERS_PER_COLUMN 18
+#define NUM_8BIT_PWM_REGISTERS_PER_IC 36
+#define PWM_REGISTERS_BASE_ADDR 0x200
 
 #define CHIP_ENABLE_REG_ADDR    0x000
 #define DEV_INITIAL_REG_ADDR    0x001
@@ -11,6 +13,14 @@
 #define DEV_CONFIG2_REG_ADDR    0x003
 #define DEV_CONFIG4_REG_ADDR    0x004
 #define GLOBAL_BRI_REG_ADDR     0x005
+#define GROUP0_BRI_REG_ADDR     0x006
+#define GROUP1_BRI_REG_ADDR     0x007
+#define GROUP2_BRI_REG_ADDR     0x008
+#define R_CURRENT_SET_REG_ADDR  0x009
+#define G_CURRENT_SET_REG_ADDR  0x00A
+#define B_CURRENT_SET_REG_ADDR  0x00B
+
+#define COLOUR_CURRENT_MAX      0x7F    //Current set registers are 7 bit
 
 
 //----------------------------------------------
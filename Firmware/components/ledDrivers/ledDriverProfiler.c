@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <inttypes.h>
+#include "esp_log.h"
+#include "ledDriverProfiler.h"
+#include "ledDriverBusModel.h"
+
+#define LOG_TAG "LP5862Profiler"
+
+static uint8_t getHistogramBin(uint32_t durationMicros);
+
+
+//This module records every I2C write made to the LED drivers, tagged with
+//the function that made it. Running totals are kept per call site, and
+//the most recent transactions are kept in a ring so a histogram of write
+//durations can be dumped over the log on demand.
+
+//Recording is a handful of stores, so it is left on at all times. Callers
+//are expected to serialise calls (the ledDrivers I2C write mutex does this).
+
+static const char * const g_callSiteNames[NUM_I2C_CALL_SITES] = {
+    "config",
+    "singleLed",
+    "singleColumn",
+    "frame",
+    "brightness",
+    "colourCurrents"
+};
+
+static i2cCallSiteTotals_t g_callSiteTotals[NUM_I2C_CALL_SITES];
+static i2cProfileRecord_t g_profileRing[I2C_PROFILE_RING_NUM_RECORDS];
+static uint16_t g_profileRingWriteIdx = 0;
+static uint16_t g_profileRingNumRecords = 0;
+
+
+
+//---- Public
+void ledDriverProfiler_record(uint8_t callSite, uint16_t numDataBytes, uint32_t durationMicros)
+{
+    assert(callSite < NUM_I2C_CALL_SITES);
+
+    i2cCallSiteTotals_t * totalsPtr = &g_callSiteTotals[callSite];
+    i2cProfileRecord_t * recordPtr = &g_profileRing[g_profileRingWriteIdx];
+
+    ++totalsPtr->numTransactions;
+    totalsPtr->numDataBytes += numDataBytes;
+    totalsPtr->busyMicros += durationMicros;
+    if(durationMicros > totalsPtr->maxMicros) totalsPtr->maxMicros = durationMicros;
+
+    //Oldest record is overwritten once the ring is full
+    recordPtr->durationMicros = (durationMicros > UINT16_MAX) ? UINT16_MAX : (uint16_t)durationMicros;
+    recordPtr->numDataBytes = (uint8_t)numDataBytes;
+    recordPtr->callSite = callSite;
+
+    g_profileRingWriteIdx = (g_profileRingWriteIdx + 1) % I2C_PROFILE_RING_NUM_RECORDS;
+    if(g_profileRingNumRecords < I2C_PROFILE_RING_NUM_RECORDS) ++g_profileRingNumRecords;
+}
+
+
+
+//---- Public
+void ledDriverProfiler_dump(uint32_t busFreqHz)
+{
+    //Logs the totals for each call site that has made a write, along with
+    //the time the bus model predicts for the average sized write (a large
+    //gap between the two means the model overhead needs calibrating), and
+    //a histogram of durations for the transactions still in the ring.
+
+    uint16_t histogram[I2C_PROFILE_NUM_HISTOGRAM_BINS];
+    i2cCallSiteTotals_t * totalsPtr;
+    uint32_t meanMicros;
+    uint32_t meanDataBytes;
+
+    ESP_LOGI(LOG_TAG, "I2C profile, %d of last %d transactions in ring", g_profileRingNumRecords, I2C_PROFILE_RING_NUM_RECORDS);
+
+    for(uint8_t callSite = 0; callSite < NUM_I2C_CALL_SITES; ++callSite)
+    {
+        totalsPtr = &g_callSiteTotals[callSite];
+        if(totalsPtr->numTransactions == 0) continue;
+
+        meanMicros = totalsPtr->busyMicros / totalsPtr->numTransactions;
+        meanDataBytes = totalsPtr->numDataBytes / totalsPtr->numTransactions;
+
+        ESP_LOGI(LOG_TAG, "%s: %" PRIu32 " transactions, %" PRIu32 " bytes, busy %" PRIu32 " us, mean %" PRIu32 " us (model %" PRIu32 " us), max %" PRIu32 " us",
+                            g_callSiteNames[callSite], totalsPtr->numTransactions, totalsPtr->numDataBytes, totalsPtr->busyMicros,
+                            meanMicros, ledDriverBusModel_transactionMicros(busFreqHz, (uint16_t)meanDataBytes), totalsPtr->maxMicros);
+
+        memset(histogram, 0, sizeof(histogram));
+        for(uint16_t idx = 0; idx < g_profileRingNumRecords; ++idx)
+        {
+            if(g_profileRing[idx].callSite == callSite) ++histogram[getHistogramBin(g_profileRing[idx].durationMicros)];
+        }
+
+        ESP_LOGI(LOG_TAG, "  <%d:%d <%d:%d <%d:%d <%d:%d <%d:%d <%d:%d <%d:%d >=%d:%d",
+                            I2C_PROFILE_HISTOGRAM_BASE_US, histogram[0], I2C_PROFILE_HISTOGRAM_BASE_US << 1, histogram[1],
+                            I2C_PROFILE_HISTOGRAM_BASE_US << 2, histogram[2], I2C_PROFILE_HISTOGRAM_BASE_US << 3, histogram[3],
+                            I2C_PROFILE_HISTOGRAM_BASE_US << 4, histogram[4], I2C_PROFILE_HISTOGRAM_BASE_US << 5, histogram[5],
+                            I2C_PROFILE_HISTOGRAM_BASE_US << 6, histogram[6], I2C_PROFILE_HISTOGRAM_BASE_US << 6, histogram[7]);
+    }
+
+    //For reference, what a full frame would cost under each batching scheme
+    ESP_LOGI(LOG_TAG, "Model full frame: per LED %" PRIu32 " us, per column %" PRIu32 " us, per IC %" PRIu32 " us",
+                        ledDriverBusModel_uniformSchemeMicros(busFreqHz, 48, 3, 48),
+                        ledDriverBusModel_uniformSchemeMicros(busFreqHz, 8, 18, 8),
+                        ledDriverBusModel_uniformSchemeMicros(busFreqHz, 4, 36, 1));
+}
+
+
+
+//---- Public
+void ledDriverProfiler_getTotals(uint8_t callSite, i2cCallSiteTotals_t * totalsPtr)
+{
+    //Copies the running totals for 'callSite' to 'totalsPtr'
+
+    assert(callSite < NUM_I2C_CALL_SITES);
+    assert(totalsPtr != NULL);
+
+    *totalsPtr = g_callSiteTotals[callSite];
+}
+
+
+
+//---- Public
+void ledDriverProfiler_reset(void)
+{
+    memset(g_callSiteTotals, 0, sizeof(g_callSiteTotals));
+    g_profileRingWriteIdx = 0;
+    g_profileRingNumRecords = 0;
+}
+
+
+
+//---- Private
+static uint8_t getHistogramBin(uint32_t durationMicros)
+{
+    uint8_t bin = 0;
+    uint32_t binLimit = I2C_PROFILE_HISTOGRAM_BASE_US;
+
+    while((durationMicros >= binLimit) && (bin < (I2C_PROFILE_NUM_HISTOGRAM_BINS - 1)))
+    {
+        binLimit <<= 1;
+        ++bin;
+    }
+
+    return bin;
+}
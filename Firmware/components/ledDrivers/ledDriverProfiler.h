@@ -0,0 +1,42 @@
+
+//Per call site I2C write profiling for the LED drivers, see 'ledDriverProfiler.c'
+
+//Each caller of 'I2CLedDriverWrite' is profiled separately
+typedef enum
+{
+    i2cCallSiteConfig,
+    i2cCallSiteSingleLed,
+    i2cCallSiteSingleColumn,
+    i2cCallSiteFrame,
+    i2cCallSiteBrightness,
+    i2cCallSiteColourCurrents,
+    NUM_I2C_CALL_SITES
+} ledDriverI2CCallSite_t;
+
+//The most recent transactions are kept for the duration histograms
+#define I2C_PROFILE_RING_NUM_RECORDS        256
+
+//Bin 0 is below 'I2C_PROFILE_HISTOGRAM_BASE_US', each following bin
+//doubles the upper bound, the last bin holds everything above
+#define I2C_PROFILE_NUM_HISTOGRAM_BINS      8
+#define I2C_PROFILE_HISTOGRAM_BASE_US       32
+
+typedef struct
+{
+    uint16_t durationMicros;
+    uint8_t numDataBytes;
+    uint8_t callSite;
+} i2cProfileRecord_t;
+
+typedef struct
+{
+    uint32_t numTransactions;
+    uint32_t numDataBytes;
+    uint32_t busyMicros;
+    uint32_t maxMicros;
+} i2cCallSiteTotals_t;
+
+void ledDriverProfiler_record(uint8_t callSite, uint16_t numDataBytes, uint32_t durationMicros);
+void ledDriverProfiler_dump(uint32_t busFreqHz);
+void ledDriverProfiler_getTotals(uint8_t callSite, i2cCallSiteTotals_t * totalsPtr);
+void ledDriverProfiler_reset(void);
@@ -1,5 +1,12 @@
+#include <string.h>
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "ledDriverPrivates.h"
+#include "ledDriverProfiler.h"
 #include "driver/i2c.h"
 
 #define LOG_TAG                 "LP5862Driver"
@@ -12,15 +19,43 @@
 #define I2C_MASTER_FREQ_HZ      1000000
 #define I2C_MASTER_TIMEOUT_MS   1000
 #define GRID_DEMO_NUM_COLOURS   4
+#define LED_FRAME_RETRY_MS      10
+#define FADE_PERCEIVED_FULL_SCALE   (255 * 16 * 16)     //sqrt(brightness * this) is perceived brightness in 1/16ths
 
 //---- Private ----//
 static inline void toggleDriverLatchPins(void);
 static inline uint8_t getDriverAddressForTargetColumn(uint8_t columnNum);
-static uint8_t I2CLedDriverWrite(uint16_t regAddr, uint8_t *data, uint16_t numBytes, ledDriverICAddr_t deviceAddr, bool isBroadcast);
+static uint16_t integerSqrt(uint32_t value);
+static void fillColumnPwmData(rgbLedColour_t * columnColoursPtr, uint8_t * dataPtr);
+static uint8_t I2CLedDriverWrite(uint16_t regAddr, uint8_t *data, uint16_t numBytes, ledDriverICAddr_t deviceAddr, bool isBroadcast, uint8_t callSite);
 static esp_err_t configureI2CPeripheral(void);
 
 static bool hasModuleBeenInitialized = false;
 
+//Frames for the LED refresh task, created at system level
+QueueHandle_t g_LedFrameQueueHandle;
+
+//A copy of what each driver ICs PWM registers currently hold (indexed by
+//register address - 'PWM_REGISTERS_BASE_ADDR'). New frames are diffed
+//against this so that only registers which have changed are written.
+//Not valid until a full frame has been written, as the state of the
+//drivers is unknown after init.
+static uint8_t g_pwmShadowRegs[NUM_LED_DRIVER_ICS][NUM_8BIT_PWM_REGISTERS_PER_IC];
+static bool g_isPwmShadowValid = false;
+static ledDriverBusStats_t g_busStats;
+
+//Preallocated transmit buffers, one per driver IC plus one for broadcast writes.
+//Each has room for the second address byte plus all of an ICs PWM registers,
+//so no heap operations are needed for any LED refresh.
+#define TX_BUFFER_NUM_BYTES (NUM_8BIT_PWM_REGISTERS_PER_IC + 1)
+#define TX_BUFFER_BROADCAST_IDX NUM_LED_DRIVER_ICS
+static uint8_t g_txBuffers[NUM_LED_DRIVER_ICS + 1][TX_BUFFER_NUM_BYTES];
+
+//The refresh task owns the bus for frame writes, but brightness and current
+//settings may be changed from other tasks. This keeps each write (and its
+//transmit buffer) from being interleaved with another.
+static SemaphoreHandle_t g_i2cWriteMutex = NULL;
+
 //The sequencer grid is made up of 96 switches, arranged into a 6x8 (row x column) matrix.
 
 //Each switch in the grid has its own assosiated RGB LED.
@@ -74,6 +109,9 @@ uint8_t ledDrivers_init(void)
             ESP_LOGE(LOG_TAG, "Error: Fault initializing I2C periperhal");
             return 1;
         }
+
+        g_i2cWriteMutex = xSemaphoreCreateMutex();
+        assert(g_i2cWriteMutex != NULL);
     }
 
 
@@ -112,10 +150,11 @@ uint8_t ledDrivers_init(void)
     data[4] = 0b01010111;
  
     hasModuleBeenInitialized = true;
+    g_isPwmShadowValid = false;
 
     //LP586x has auto register increment on writes so we
     //can write the four registers in one I2C transaction
-    I2CLedDriverWrite(CHIP_ENABLE_REG_ADDR, data, 5, 0, true);
+    I2CLedDriverWrite(CHIP_ENABLE_REG_ADDR, data, 5, 0, true, i2cCallSiteConfig);
 
     return 0;
 }
@@ -172,7 +211,15 @@ uint8_t ledDrivers_writeSingleLed(uint8_t columnNum, uint8_t rowNum, rgbLedColou
     //ESP_LOGI(LOG_TAG, "idx: %d\n", lookupIdx);
     //ESP_LOGI(LOG_TAG, "PWM BASE: %0x\n", ledDriverPwmAddrRGB[lookupIdx]);
 
-    I2CLedDriverWrite(ledDriverPwmAddrRGB[lookupIdx], data, NUM_8BIT_PWM_REGISTES_PER_LED, getDriverAddressForTargetColumn(columnNum), false);
+    if(I2CLedDriverWrite(ledDriverPwmAddrRGB[lookupIdx], data, NUM_8BIT_PWM_REGISTES_PER_LED, getDriverAddressForTargetColumn(columnNum), false, i2cCallSiteSingleLed) != 0)
+    {
+        //Part of the burst may have landed, so the shadow copy can't be trusted
+        g_isPwmShadowValid = false;
+        toggleDriverLatchPins();
+        return 1;
+    }
+
+    memcpy(&g_pwmShadowRegs[columnNum / 2][ledDriverPwmAddrRGB[lookupIdx] - PWM_REGISTERS_BASE_ADDR], data, NUM_8BIT_PWM_REGISTES_PER_LED);
     toggleDriverLatchPins();  //Need to toggle latch pin before PWM data latched to outputs
 
     return 0;
@@ -187,9 +234,7 @@ uint8_t ledDrivers_writeSingleGridColumn(uint8_t columnNum, rgbLedColour_t * col
     assert(columnNum < SYSTEM_NUM_COLUMNS);
 
     uint8_t lookupIdx = 0;
-    uint8_t bufferIdx = 0;
-    rgbLedColour_t adjustedColourArr[SYSTEM_NUM_ROWS] = {0};
-    uint8_t data[SYSTEM_NUM_ROWS * NUM_8BIT_PWM_REGISTES_PER_LED] = {0};
+    uint8_t data[NUM_8BIT_PWM_REGISTERS_PER_COLUMN] = {0};
 
     //PWM register addresses are store in the array 'ledDriverPwmAddrRGB'
     //the code below looks up the BASE address of the three (R,G,B) PWM
@@ -197,38 +242,17 @@ uint8_t ledDrivers_writeSingleGridColumn(uint8_t columnNum, rgbLedColour_t * col
     if((columnNum == 0) || (columnNum % 2 == 0)) lookupIdx = 0;    
     else lookupIdx = SYSTEM_NUM_ROWS * NUM_8BIT_PWM_REGISTES_PER_LED;
 
+    fillColumnPwmData(columnColoursPtr, data);
 
-    //We want to do a single burst write, and rely on the driver IC to auto-increment 
-    //its internal write pointer, which will allow us to send all RGB data for a whole 
-    //column in a single I2C transaction. 
-    
-    //Unfortunately, due to PCB routing this won't work properly unless we manually
-    //re-order the received colour pwm data array, such that a sequential write accross
-    //the drivers interal memory will set the correct colour for each row in the column,
-    //we do this here to hide complexity and simplify the interface.
-    adjustedColourArr[0] = columnColoursPtr[0];
-    adjustedColourArr[1] = columnColoursPtr[5];
-    adjustedColourArr[2] = columnColoursPtr[2];
-    adjustedColourArr[3] = columnColoursPtr[3];
-    adjustedColourArr[4] = columnColoursPtr[4];
-    adjustedColourArr[5] = columnColoursPtr[1];
-
-    //Fill byte buffer with colour data..
-    for(uint8_t rowNum = 0; rowNum < SYSTEM_NUM_ROWS; ++rowNum)
+    if(I2CLedDriverWrite(ledDriverPwmAddrRGB[lookupIdx], data, NUM_8BIT_PWM_REGISTERS_PER_COLUMN, getDriverAddressForTargetColumn(columnNum), false, i2cCallSiteSingleColumn) != 0)
     {
-
-        //Green PWM register
-        data[bufferIdx] = (uint8_t)((adjustedColourArr[rowNum] & 0x00ff00) >> 8);
-        bufferIdx++;
-        //Red PWM register
-        data[bufferIdx] = (uint8_t)((adjustedColourArr[rowNum] & 0xff0000) >> 16);
-        bufferIdx++;
-        //Blue PWM register
-        data[bufferIdx] = (uint8_t)((adjustedColourArr[rowNum] & 0x0000ff));
-        bufferIdx++;
+        //As 'ledDrivers_writeSingleLed'
+        g_isPwmShadowValid = false;
+        toggleDriverLatchPins();
+        return 1;
     }
 
-    I2CLedDriverWrite(ledDriverPwmAddrRGB[lookupIdx], data, (NUM_8BIT_PWM_REGISTES_PER_LED * SYSTEM_NUM_ROWS), getDriverAddressForTargetColumn(columnNum), false);
+    memcpy(&g_pwmShadowRegs[columnNum / 2][ledDriverPwmAddrRGB[lookupIdx] - PWM_REGISTERS_BASE_ADDR], data, NUM_8BIT_PWM_REGISTERS_PER_COLUMN);
     toggleDriverLatchPins();  //Need to toggle latch pin before PWM data latched to outputs
 
     return 0;
@@ -252,25 +276,236 @@ uint8_t ledDrivers_writeEntireGrid(rgbLedColour_t * rgbGridColours)
     assert(hasModuleBeenInitialized == true);
     assert(rgbGridColours != NULL);
 
+    //Each driver IC drives two adjacent columns, and the PWM registers for
+    //both columns are contiguous in the ICs memory (odd column at 0x200,
+    //even column at 0x212). So rather than one burst per column, the new
+    //register image for both columns is built and written as a single burst
+    //per IC (4 transactions for a full frame).
+
+    //The image is diffed against the shadow copy of the driver registers,
+    //only the span of registers from the first to the last changed byte is
+    //written. All ICs are then latched together with a single latch toggle,
+    //so columns never tear and a frame where only one LED has changed costs
+    //one short I2C burst.
+
     //The data in the recieved array is row by row as described
     //above, as the led drivers control the grid leds on a column
     //basis we will need to extract and update each column
     rgbLedColour_t colourCodesForSingleColumn[SYSTEM_NUM_ROWS];
+    uint8_t icData[NUM_8BIT_PWM_REGISTERS_PER_IC];
+    uint8_t * shadowPtr;
+    uint8_t columnNum;
+    uint8_t lookupIdx;
+    uint8_t firstChangedIdx;
+    uint8_t lastChangedIdx;
+    bool hasFrameChanged = false;
+    bool hasWriteFailed = false;
+
+    ++g_busStats.numFrames;
+
+    //For each driver IC
+    for(uint8_t icNum = 0; icNum < NUM_LED_DRIVER_ICS; ++icNum)
+    {
+        //Build the register image for both columns driven by this IC
+        for(uint8_t a = 0; a < 2; ++a)
+        {
+            columnNum = (icNum * 2) + a;
+
+            //Extract colour for each row in the current column
+            for(uint8_t b = 0; b < SYSTEM_NUM_ROWS; ++b)
+            {
+                colourCodesForSingleColumn[b] = rgbGridColours[(b * SYSTEM_NUM_COLUMNS) + columnNum];
+            }
+
+            if(columnNum % 2 == 0) lookupIdx = 0;
+            else lookupIdx = SYSTEM_NUM_ROWS * NUM_8BIT_PWM_REGISTES_PER_LED;
+            fillColumnPwmData(colourCodesForSingleColumn, &icData[ledDriverPwmAddrRGB[lookupIdx] - PWM_REGISTERS_BASE_ADDR]);
+        }
 
-    //For each column in the grid
-    for(uint8_t a = 0; a < SYSTEM_NUM_COLUMNS; ++a)
+        //Find the span of registers that differ from the driver
+        shadowPtr = g_pwmShadowRegs[icNum];
+        firstChangedIdx = NUM_8BIT_PWM_REGISTERS_PER_IC;
+        lastChangedIdx = 0;
+        for(uint8_t idx = 0; idx < NUM_8BIT_PWM_REGISTERS_PER_IC; ++idx)
+        {
+            if(!g_isPwmShadowValid || (icData[idx] != shadowPtr[idx]))
+            {
+                if(firstChangedIdx == NUM_8BIT_PWM_REGISTERS_PER_IC) firstChangedIdx = idx;
+                lastChangedIdx = idx;
+            }
+        }
+
+        //Nothing to do for this IC
+        if(firstChangedIdx == NUM_8BIT_PWM_REGISTERS_PER_IC) continue;
+
+        if(I2CLedDriverWrite((PWM_REGISTERS_BASE_ADDR + firstChangedIdx), &icData[firstChangedIdx], 
+                            ((lastChangedIdx - firstChangedIdx) + 1), getDriverAddressForTargetColumn(icNum * 2), false, i2cCallSiteFrame) == 0)
+        {
+            memcpy(&shadowPtr[firstChangedIdx], &icData[firstChangedIdx], ((lastChangedIdx - firstChangedIdx) + 1));
+        }
+        else hasWriteFailed = true;
+
+        hasFrameChanged = true;
+    }
+
+    //If a write failed, part of the burst may still have landed, so
+    //the driver and the shadow copy can disagree. The shadow is then
+    //invalidated and the next frame is written in full, otherwise
+    //registers matching the stale shadow would never be resent.
+    g_isPwmShadowValid = !hasWriteFailed;
+    if(hasFrameChanged) toggleDriverLatchPins();  //Need to toggle latch pin before PWM data latched to outputs
+
+    return (hasWriteFailed) ? 1 : 0;
+}
+
+
+//---- Public
+void ledDrivers_submitFrame(rgbLedColour_t * rgbGridColours)
+{
+    //As the I2C peripheral is blocking, writing a frame stalls the caller
+    //for the full bus time. Instead the frame is handed to the LED refresh
+    //task and this function returns immediately. The mailbox holds a single
+    //frame, if the task hasn't yet taken the previous frame it is replaced,
+    //so a burst of updates (while scrolling etc) costs one bus transfer.
+
+    assert(g_LedFrameQueueHandle != NULL);
+    assert(rgbGridColours != NULL);
+
+    xQueueOverwrite(g_LedFrameQueueHandle, rgbGridColours);
+}
+
+
+//---- Public
+void ledDrivers_refreshTaskEntryPoint(void * taskParams)
+{
+    //This task owns the I2C bus once running, all grid
+    //updates should then go through 'ledDrivers_submitFrame'.
+
+    assert(hasModuleBeenInitialized == true);
+
+    //If a frame fails to write it is retried (in full, as the shadow copy
+    //is invalidated) unless a newer frame arrives first.
+
+    static ledDriverFrame_t frame;
+    bool isRetryPending = false;
+    TickType_t waitTicks;
+
+    while(1)
     {
-        //Extract colour for each row in the current column
-        for(uint8_t b = 0; b < SYSTEM_NUM_ROWS; ++b)
+        waitTicks = (isRetryPending) ? pdMS_TO_TICKS(LED_FRAME_RETRY_MS) : portMAX_DELAY;
+        if((xQueueReceive(g_LedFrameQueueHandle, &frame, waitTicks) == pdTRUE) || isRetryPending)
         {
-            colourCodesForSingleColumn[b] = rgbGridColours[(b * SYSTEM_NUM_COLUMNS) + a];
+            isRetryPending = (ledDrivers_writeEntireGrid(frame.colours) != 0);
         }
+    }
+}
 
-        //Update the led driver controlling the current column
-        ledDrivers_writeSingleGridColumn(a, colourCodesForSingleColumn);
+
+//---- Public
+void ledDrivers_dumpBusProfile(void)
+{
+    //Logs per call site I2C timings, see 'ledDriverProfiler.c'.
+    //The write mutex is held so the profile isn't changed part way
+    //through, LED updates are held off until the dump completes.
+
+    assert(hasModuleBeenInitialized == true);
+
+    xSemaphoreTake(g_i2cWriteMutex, portMAX_DELAY);
+    ledDriverProfiler_dump(I2C_MASTER_FREQ_HZ);
+    xSemaphoreGive(g_i2cWriteMutex);
+}
+
+
+//---- Public
+void ledDrivers_resetBusProfile(void)
+{
+    assert(hasModuleBeenInitialized == true);
+
+    xSemaphoreTake(g_i2cWriteMutex, portMAX_DELAY);
+    ledDriverProfiler_reset();
+    xSemaphoreGive(g_i2cWriteMutex);
+}
+
+
+//---- Public
+uint8_t ledDrivers_setGlobalBrightness(uint8_t brightness)
+{
+    //The global brightness register scales the output of every LED
+    //on a driver, so rather than rewrite all 144 PWM registers the
+    //whole grid can be dimmed with a single broadcast transaction.
+    //The PWM registers (and the frame shadow copy) are unaffected.
+
+    assert(hasModuleBeenInitialized == true);
+
+    return I2CLedDriverWrite(GLOBAL_BRI_REG_ADDR, &brightness, 1, 0, true, i2cCallSiteBrightness);
+}
+
+
+//---- Public
+uint8_t ledDrivers_setColourCurrents(uint8_t icNum, uint8_t redCurrent, uint8_t greenCurrent, uint8_t blueCurrent)
+{
+    //Sets the output current for the red, green and blue colour groups
+    //(0 -> 127, scaling the max current set in 'ledDrivers_init').
+    //Used to colour balance the LEDs, or correct for differences in
+    //brightness between driver ICs (pass a single IC number 0 -> 3).
+    //Pass 'LED_DRIVER_ALL_ICS' to set every driver with one broadcast.
+
+    assert(hasModuleBeenInitialized == true);
+    assert((icNum < NUM_LED_DRIVER_ICS) || (icNum == LED_DRIVER_ALL_ICS));
+
+    //The three current set registers are sequential, so can be written in one burst
+    uint8_t data[3];
+    data[0] = redCurrent & COLOUR_CURRENT_MAX;
+    data[1] = greenCurrent & COLOUR_CURRENT_MAX;
+    data[2] = blueCurrent & COLOUR_CURRENT_MAX;
+
+    if(icNum == LED_DRIVER_ALL_ICS) return I2CLedDriverWrite(R_CURRENT_SET_REG_ADDR, data, 3, 0, true, i2cCallSiteColourCurrents);
+    return I2CLedDriverWrite(R_CURRENT_SET_REG_ADDR, data, 3, getDriverAddressForTargetColumn(icNum * 2), false, i2cCallSiteColourCurrents);
+}
+
+
+//---- Public
+void ledDrivers_generateFadeCurve(uint8_t * curvePtr, uint16_t numSteps, uint8_t startBrightness, uint8_t endBrightness)
+{
+    //Fills 'curvePtr' with 'numSteps' global brightness values fading from
+    //'startBrightness' to 'endBrightness' (both included). Perceived brightness
+    //is roughly the square root of the register value, so steps are spaced
+    //linearly in that domain and squared, which gives an even looking fade
+    //rather than one that seems to jump at the dim end.
+    //Step the curve with 'ledDrivers_setGlobalBrightness'.
+
+    assert(curvePtr != NULL);
+    assert(numSteps > 0);
+
+    //Perceived brightness is kept in 1/16ths, whole steps lose too much to
+    //rounding (a flat 90 -> 90 fade came out as 89s between the end points)
+    int32_t perceivedStart = integerSqrt((uint32_t)startBrightness * FADE_PERCEIVED_FULL_SCALE);
+    int32_t perceivedEnd = integerSqrt((uint32_t)endBrightness * FADE_PERCEIVED_FULL_SCALE);
+    int32_t perceived;
+
+    if(numSteps == 1)
+    {
+        curvePtr[0] = endBrightness;
+        return;
     }
 
-    return 0;
+    for(uint16_t step = 0; step < numSteps; ++step)
+    {
+        perceived = perceivedStart + (((perceivedEnd - perceivedStart) * step) / (numSteps - 1));
+        curvePtr[step] = (uint8_t)(((perceived * perceived) + (FADE_PERCEIVED_FULL_SCALE / 2)) / FADE_PERCEIVED_FULL_SCALE);
+    }
+
+    //Make sure the end points are exact
+    curvePtr[0] = startBrightness;
+    curvePtr[numSteps - 1] = endBrightness;
+}
+
+
+//---- Public
+void ledDrivers_getBusStats(ledDriverBusStats_t * statsPtr)
+{
+    assert(statsPtr != NULL);
+    memcpy(statsPtr, &g_busStats, sizeof(ledDriverBusStats_t));
 }
 
 
@@ -384,7 +619,7 @@ static esp_err_t configureI2CPeripheral(void)
 
 
 //---- Private
-static uint8_t I2CLedDriverWrite(uint16_t regAddr, uint8_t *data, uint16_t numBytes, ledDriverICAddr_t deviceAddr, bool isBroadcast)
+static uint8_t I2CLedDriverWrite(uint16_t regAddr, uint8_t *data, uint16_t numBytes, ledDriverICAddr_t deviceAddr, bool isBroadcast, uint8_t callSite)
 {
     static uint8_t addrByte0;
     static uint8_t addrByte1;
@@ -395,12 +630,14 @@ static uint8_t I2CLedDriverWrite(uint16_t regAddr, uint8_t *data, uint16_t numBy
     //The LP586X driver requires two address bytes at the start of each I2C write operation (format explained below).
     //The IDF provided I2C functions allow for a single address byte and a data buffer. In order to fulfil the requirement
     //for two address bytes we need an additional byte to the data buffer, so that data[0] becomes the the second address
-    //byte. To do this, we simply allocate a new buffer with space for an extra byte.
+    //byte. To do this, the data is copied into the target ICs preallocated transmit buffer, after the extra byte.
+
+    assert(numBytes < TX_BUFFER_NUM_BYTES);
 
-    uint8_t * writePayload = calloc(numBytes + 1, sizeof(uint8_t)); //TODO: SWAP OUT FOR STATIC ARRAY LATER
-    numBytes++; //The new buffer has an extra byte, so increment numBytes.
+    xSemaphoreTake(g_i2cWriteMutex, portMAX_DELAY);
 
-    assert(writePayload != NULL);
+    uint8_t * writePayload = (isBroadcast) ? g_txBuffers[TX_BUFFER_BROADCAST_IDX] : g_txBuffers[deviceAddr & ~INDEPENDENT_IC_ADDR_BITS];
+    numBytes++; //The buffer has an extra byte, so increment numBytes.
 
     //LP6862 IC Expects addrByte0 to have the following format:
     //Bits 7 -> 3 make up the target chip address (remeber, there are multiple led drivers on the I2C bus)
@@ -446,22 +683,68 @@ static uint8_t I2CLedDriverWrite(uint16_t regAddr, uint8_t *data, uint16_t numBy
         writePayload[a] = data[a - 1];
     }
 
+    int64_t writeStartMicros = esp_timer_get_time();
     err = i2c_master_write_to_device(I2C_MASTER_NUM, addrByte0, writePayload, numBytes, I2C_MASTER_TIMEOUT_MS);
+    uint32_t writeMicros = (uint32_t)(esp_timer_get_time() - writeStartMicros);
+    g_busStats.busyMicros += writeMicros;
+    ledDriverProfiler_record(callSite, (numBytes - 1), writeMicros);
+    ++g_busStats.numTransactions;
+    g_busStats.numBytes += (numBytes + 1);  //Plus addrByte0
+
+    xSemaphoreGive(g_i2cWriteMutex);
 
     if(err != ESP_OK)
     {
         ESP_LOGE(LOG_TAG, "Error: I2C write error detected");
-        free(writePayload);
         return 1;
     }
 
-    free(writePayload);
-
 
     return 0;
 }
 
 
+//---- Private
+static void fillColumnPwmData(rgbLedColour_t * columnColoursPtr, uint8_t * dataPtr)
+{
+    //Fills 'dataPtr' with the PWM register values for a single column,
+    //in the order they sit in the driver ICs memory (see below).
+
+    uint8_t bufferIdx = 0;
+    rgbLedColour_t adjustedColourArr[SYSTEM_NUM_ROWS];
+
+    //We want to do a single burst write, and rely on the driver IC to auto-increment 
+    //its internal write pointer, which will allow us to send all RGB data for a whole 
+    //column in a single I2C transaction. 
+    
+    //Unfortunately, due to PCB routing this won't work properly unless we manually
+    //re-order the received colour pwm data array, such that a sequential write accross
+    //the drivers interal memory will set the correct colour for each row in the column,
+    //we do this here to hide complexity and simplify the interface.
+    adjustedColourArr[0] = columnColoursPtr[0];
+    adjustedColourArr[1] = columnColoursPtr[5];
+    adjustedColourArr[2] = columnColoursPtr[2];
+    adjustedColourArr[3] = columnColoursPtr[3];
+    adjustedColourArr[4] = columnColoursPtr[4];
+    adjustedColourArr[5] = columnColoursPtr[1];
+
+    //Fill byte buffer with colour data..
+    for(uint8_t rowNum = 0; rowNum < SYSTEM_NUM_ROWS; ++rowNum)
+    {
+
+        //Green PWM register
+        dataPtr[bufferIdx] = (uint8_t)((adjustedColourArr[rowNum] & 0x00ff00) >> 8);
+        bufferIdx++;
+        //Red PWM register
+        dataPtr[bufferIdx] = (uint8_t)((adjustedColourArr[rowNum] & 0xff0000) >> 16);
+        bufferIdx++;
+        //Blue PWM register
+        dataPtr[bufferIdx] = (uint8_t)((adjustedColourArr[rowNum] & 0x0000ff));
+        bufferIdx++;
+    }
+}
+
+
 //---- Private
 static inline uint8_t getDriverAddressForTargetColumn(uint8_t columnNum)
 {
@@ -501,6 +784,34 @@ static inline uint8_t getDriverAddressForTargetColumn(uint8_t columnNum)
 }
 
 
+//---- Private
+static uint16_t integerSqrt(uint32_t value)
+{
+    //Digit by digit, two bits of 'value' per bit of the root
+    //RETURNS: floor(sqrt(value))
+    uint32_t root = 0;
+    uint32_t bit = (uint32_t)1 << 30;
+
+    while(bit > value) bit >>= 2;
+
+    while(bit != 0)
+    {
+        if(value >= (root + bit))
+        {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else
+        {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+
+    return (uint16_t)root;
+}
+
+
 //---- Private
 static inline void toggleDriverLatchPins(void)
 {
@@ -513,4 +824,5 @@ static inline void toggleDriverLatchPins(void)
     gpio_set_level(LED_DRIVER_LATCH_IO, true);
     vTaskDelay(pdMS_TO_TICKS(1));
     gpio_set_level(LED_DRIVER_LATCH_IO, false);
+    ++g_busStats.numLatches;
 }
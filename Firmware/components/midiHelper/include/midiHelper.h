@@ -78,6 +78,17 @@ enum metaEventType
 };
 
 
+//A single midi voice event as it appears in a compiled playback
+//event list. Unlike a midi file event (delta-time) the timestamp
+//is absolute, given in milliseconds from the start of the sequence.
+typedef struct
+{
+    uint32_t timestampMs;
+    uint8_t statusByte;
+    uint8_t dataBytes[2];
+} MidiPlaybackEvent;
+
+
 extern const uint8_t MThd_fileHeaderBytes[MIDI_FILE_HEADER_NUM_BYTES];
 extern const uint8_t MTtk_trackHeaderBytes[MIDI_TRACK_HEADER_NUM_BYTES];
 extern const uint8_t endOfTrackBytes[MIDI_END_OF_TRACK_MSG_NUM_BYTES];
@@ -7,6 +7,7 @@
 #include "midiHelper.h"
 
 #define LOG_TAG "MidiHelper"
+#define NUM_BITS_IN_BYTE 8
 
 const uint8_t MThd_fileHeaderBytes[MIDI_FILE_HEADER_NUM_BYTES]   = {0x4D, 0x54, 0x68, 0x64}; //A midi file ALWAYS starts with these four bytes
 const uint8_t MTtk_trackHeaderBytes[MIDI_TRACK_HEADER_NUM_BYTES] = {0x4D, 0x54, 0x72, 0x6B}; //Midi file track data ALWAYS starts with these four bytes
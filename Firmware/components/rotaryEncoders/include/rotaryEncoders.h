@@ -1,6 +1,5 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/queue.h"
 
 enum {
     encoder0_event,
@@ -13,10 +12,13 @@ enum {
     encoder1_ccw
 };
 
-//Queue used to communicate all 
-//events relating to the rotary encoders
-extern QueueHandle_t g_EncodersQueueHandle;
+//Switch presses are posted to the menu tasks input event
+//bus ('inputSourceEncoders'), rotation wakes the menu task
+//and is read with 'rotaryEncoders_takeDelta'
 
 //Module interface
 void rotaryEncoders_init(void);
 void rotaryEncoders_deinit(void);
+int32_t rotaryEncoders_takeDelta(uint8_t encoderNum);
+int32_t rotaryEncoders_takeAcceleratedDelta(uint8_t encoderNum);
+void rotaryEncoders_logDecoderStats(void);
@@ -0,0 +1,120 @@
+#include <stdint.h>
+
+//Quadrature decoding for one encoder, driven by a 16 entry transition table.
+
+//The two phase inputs form a 2-bit state, (PHA1 << 1) | PHA0. Turning clockwise
+//steps through 00 -> 01 -> 11 -> 10 -> 00, counter-clockwise is the reverse.
+//Indexing the table with (previous << 2) | current gives +1 / -1 for a valid step,
+//0 for no change, and invalid when both phases changed at once (an edge was missed
+//or the contacts glitched). Invalid steps are rejected, they add nothing to the count
+//but the state still moves on so the next edge is decoded from where the encoder is.
+
+//Steps are summed into a signed count and a detent is reported each time it reaches
+//'QUADRATURE_STEPS_PER_DETENT' in either direction. Contact bounce (01 -> 00 -> 01..)
+//adds and subtracts in equal measure, so it cancels out rather than being read as
+//a turn in the opposite direction.
+
+//Each detent has one phase state the encoder rests in, taken from the reading at init.
+//The count is resynced to zero whenever the encoder gets back to it. A rejected
+//transition skips two steps without counting them, so the count would otherwise be
+//off by two from then on. At the rest state a count of at least half a detent is
+//reported as one, so a detent with a missed edge in it still registers.
+
+//Nothing here depends on the IDF, so it can be built and run on a host.
+
+#define QUADRATURE_STEPS_PER_DETENT 4
+#define QUADRATURE_STEPS_PER_HALF   (QUADRATURE_STEPS_PER_DETENT / 2)
+
+//The transition table, two bits per entry (00 = none, 01 = +1, 11 = -1, 10 = invalid)
+//packed into a single constant, so a lookup is a shift and mask with no memory access.
+//
+//                  current:  00    01    10    11
+//      previous 00            0    +1    -1     X
+//      previous 01           -1     0     X    +1
+//      previous 10           +1     X     0    -1
+//      previous 11            X    -1    +1     0
+#define QUADRATURE_TRANSITION_TABLE 0x1EC963B4UL
+#define QUADRATURE_STEP_NONE        0
+#define QUADRATURE_STEP_CW          1
+#define QUADRATURE_STEP_INVALID     2
+#define QUADRATURE_STEP_CCW         3
+
+typedef struct
+{
+    uint8_t previousState;
+    uint8_t restState;      //Phase state at a detent
+    int8_t stepCount;
+    uint32_t numInvalid;    //Rejected transitions, for diagnostics
+} QuadratureDecoder;
+
+
+
+//---- Public
+static inline void quadratureDecoder_init(QuadratureDecoder * decoderPtr, uint8_t phaseState)
+{
+    //'phaseState' should be the current (PHA1 << 1) | PHA0 reading,
+    //taken with the encoder resting at a detent (as it is at power up)
+    decoderPtr->previousState = phaseState & 0x03;
+    decoderPtr->restState = phaseState & 0x03;
+    decoderPtr->stepCount = 0;
+    decoderPtr->numInvalid = 0;
+}
+
+
+
+//---- Public
+static inline __attribute__((always_inline)) int8_t quadratureDecoder_update(QuadratureDecoder * decoderPtr, uint8_t phaseState)
+{
+    //Feeds in the latest phase reading, (PHA1 << 1) | PHA0.
+    //Always inlined so it is safe to call from an IRAM ISR.
+    //RETURNS: +1 for a completed clockwise detent, -1 for
+    //a completed counter-clockwise detent, otherwise 0.
+
+    uint8_t transition = (decoderPtr->previousState << 2) | (phaseState & 0x03);
+    uint8_t step = (QUADRATURE_TRANSITION_TABLE >> (transition << 1)) & 0x03;
+    int8_t stepCount;
+
+    decoderPtr->previousState = phaseState & 0x03;
+
+    switch(step)
+    {
+        case QUADRATURE_STEP_CW:
+            ++decoderPtr->stepCount;
+            break;
+
+        case QUADRATURE_STEP_CCW:
+            --decoderPtr->stepCount;
+            break;
+
+        case QUADRATURE_STEP_INVALID:
+            ++decoderPtr->numInvalid;
+            break;
+
+        default:
+            return 0;
+    }
+
+    //Back at a detent, resync the count
+    if((phaseState & 0x03) == decoderPtr->restState)
+    {
+        stepCount = decoderPtr->stepCount;
+        decoderPtr->stepCount = 0;
+
+        if(stepCount >= QUADRATURE_STEPS_PER_HALF) return 1;
+        if(stepCount <= -QUADRATURE_STEPS_PER_HALF) return -1;
+        return 0;
+    }
+
+    if(decoderPtr->stepCount >= QUADRATURE_STEPS_PER_DETENT)
+    {
+        decoderPtr->stepCount = 0;
+        return 1;
+    }
+    else if(decoderPtr->stepCount <= -QUADRATURE_STEPS_PER_DETENT)
+    {
+        decoderPtr->stepCount = 0;
+        return -1;
+    }
+
+    return 0;
+}
@@ -3,6 +3,12 @@
 #include "include/rotaryEncoders.h"
 #include <driver/gpio.h>
 #include "driver/gptimer.h"
+#include "esp_timer.h"
+#include "esp_cpu.h"
+#include "hal/gpio_ll.h"
+#include <stdatomic.h>
+#include "quadratureDecoder.h"
+#include "inputEventBus.h"
 
 #define LOG_TAG                 "rotaryEncoderComponent"
 #define ENCODER0_SW_IO          48      //input pin
@@ -11,14 +17,14 @@
 #define ENCODER0_PHA1_IO        8       //input pin
 #define ENCODER1_PHA0_IO        21      //input pin
 #define ENCODER1_PHA1_IO        14      //input pin
-#define ENCODER_COUNT_PER_REV   4       //Count per revolution
-#define ENCODER_QUEUE_SIZE      10
+#define NUM_ENCODERS            2
 
-//All possible encoder output states
-#define ENCODING_00     0
-#define ENCODING_01     1
-#define ENCODING_10     2
-#define ENCODING_11     3
+//Acceleration, the multiplier rises by one for every 'ENCODER_ACCEL_RATE_STEP'
+//detents per second. The rate is measured from the previous read that had
+//movement, so turning slowly (or starting to turn) is always one to one.
+#define ENCODER_ACCEL_RATE_STEP         25
+#define ENCODER_ACCEL_MAX_MULTIPLIER    16
+#define ENCODER_ACCEL_MIN_WINDOW_US     10000
 
 //Bit masks used to configure pins simultanously
 #define ENCODER_SW_IO_CONFIG_MASK   ((1ULL << ENCODER0_SW_IO) | (1ULL << ENCODER1_SW_IO))
@@ -31,14 +37,7 @@ static void setupEncoderPins(void);
 static void encoderPositionChange_ISR(void * eventParam);
 static void encoderSwitchEvent_ISR(void * eventParam);
 static bool alarmISR(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *param);
-
-//Each encoder requires an instance
-//of this type to track is state
-typedef struct
-{
-    uint8_t ccwCount;
-    uint8_t cwCount;
-} sEncoderCount_t;
+static inline uint8_t readPhaseState(uint8_t encoderNum);
 
 
 //The sequencer has two rotary encoders, each of which has a built in momentary switch.
@@ -56,10 +55,29 @@ typedef struct
 //encoder1_cw   ->  Encoder 1 has been turned in the clockwise direction
 //encoder1_ccw  ->  Encoder 1 has been turned in the counter-clockwise direction
 
+//Switch presses are posted to the menu tasks input event bus, but rotation is not. Each detent is added to a signed
+//per-encoder count by the ISR, which only wakes the menu task, and the count is read (and cleared) with
+//'rotaryEncoders_takeDelta'. However fast the encoder is spun nothing can overflow, and a single read returns every
+//detent since the last (+37 etc). Acceleration is applied on the consumer side by 'rotaryEncoders_takeAcceleratedDelta',
+//keeping the ISR short.
+
+//Rotation is decoded by 'quadratureDecoder.h', a transition table lookup on the previous and current
+//phase states. Transitions where both phases changed at once are rejected rather than guessed at, which
+//is what used to produce the odd step in the wrong direction when the encoder was spun quickly.
+//The cost of the position ISR is measured in CPU cycles, see 'rotaryEncoders_logDecoderStats'.
+
+
+//Detents turned since last read (cw positive), indexed by 'encoderX_event'
+static _Atomic int32_t g_encoderDeltas[NUM_ENCODERS];
 
-//This queue is shared with the host system as an extern and acts
-//to communicate all encoder events from the module to the host system
-QueueHandle_t g_EncodersQueueHandle;
+//Consumer side, time of the last read that had movement
+static int64_t g_lastMovementMicros[NUM_ENCODERS];
+
+//ISR side, decoder state and cost of each phase edge
+static QuadratureDecoder g_quadratureDecoders[NUM_ENCODERS];
+static uint32_t g_decoderNumEdges;
+static uint64_t g_decoderTotalCycles;
+static uint32_t g_decoderMaxCycles;
 
 //A timer is used to provide debouncing
 //of the switches on each of the encoders
@@ -70,10 +88,8 @@ static volatile bool g_isWaitingForDebounceTimer = false;
 //---- Public
 void rotaryEncoders_init(void)
 {
-    //Create queue that module will use to 
-    //communicate all encoder events to the host system
-    g_EncodersQueueHandle = xQueueCreate(ENCODER_QUEUE_SIZE, sizeof(uint8_t));
-    assert(g_EncodersQueueHandle != NULL);
+    //Encoder events are posted to the menu tasks input
+    //event bus, which must be initialised before this
 
     //Attempt configuration of encoder GPIO pins
     setupEncoderPins();
@@ -83,6 +99,71 @@ void rotaryEncoders_init(void)
 }
 
 
+//---- Public
+int32_t rotaryEncoders_takeDelta(uint8_t encoderNum)
+{
+    //Pass 'encoder0_event' or 'encoder1_event'.
+    //RETURNS: The number of detents turned since the last call,
+    //positive for clockwise, negative for counter-clockwise.
+
+    assert(encoderNum < NUM_ENCODERS);
+
+    return atomic_exchange_explicit(&g_encoderDeltas[encoderNum], 0, memory_order_relaxed);
+}
+
+
+//---- Public
+int32_t rotaryEncoders_takeAcceleratedDelta(uint8_t encoderNum)
+{
+    //As 'rotaryEncoders_takeDelta', but the count is scaled up the faster
+    //the encoder is being turned. Use for large ranges (scrolling, values)
+    //where stepping one at a time would take hundreds of detents.
+
+    int32_t delta = rotaryEncoders_takeDelta(encoderNum);
+    int64_t nowMicros;
+    int64_t elapsedMicros;
+    uint32_t detentsPerSecond;
+    uint32_t multiplier;
+
+    if(delta == 0) return 0;
+
+    nowMicros = esp_timer_get_time();
+    elapsedMicros = nowMicros - g_lastMovementMicros[encoderNum];
+    g_lastMovementMicros[encoderNum] = nowMicros;
+    if(elapsedMicros < ENCODER_ACCEL_MIN_WINDOW_US) elapsedMicros = ENCODER_ACCEL_MIN_WINDOW_US;
+
+    detentsPerSecond = (uint32_t)(((int64_t)((delta < 0) ? -delta : delta) * 1000000) / elapsedMicros);
+    multiplier = 1 + (detentsPerSecond / ENCODER_ACCEL_RATE_STEP);
+    if(multiplier > ENCODER_ACCEL_MAX_MULTIPLIER) multiplier = ENCODER_ACCEL_MAX_MULTIPLIER;
+
+    return delta * (int32_t)multiplier;
+}
+
+
+//---- Public
+void rotaryEncoders_logDecoderStats(void)
+{
+    //Logs the cost of decoding each phase edge and the
+    //number of invalid transitions rejected per encoder.
+    //Reads are unguarded, the figures are for diagnostics only.
+
+    uint32_t numEdges = g_decoderNumEdges;
+    uint64_t totalCycles = g_decoderTotalCycles;
+
+    if(numEdges == 0)
+    {
+        ESP_LOGI(LOG_TAG, "No encoder edges recorded");
+        return;
+    }
+
+    ESP_LOGI(LOG_TAG, "Encoder edges: %ld, mean %ld cycles, worst %ld cycles",
+                        numEdges, (uint32_t)(totalCycles / numEdges), g_decoderMaxCycles);
+    ESP_LOGI(LOG_TAG, "Rejected transitions: encoder0 %ld, encoder1 %ld",
+                        g_quadratureDecoders[encoder0_event].numInvalid,
+                        g_quadratureDecoders[encoder1_event].numInvalid);
+}
+
+
 //---- Public
 void rotaryEncoders_deinit(void)
 {
@@ -132,7 +213,11 @@ static void setupEncoderPins(void)
     UIRotaryEncoderPHAPins_conf.pull_up_en = false;
     err |= gpio_config(&UIRotaryEncoderPHAPins_conf);
     assert(err == ESP_OK);
-    
+
+    //Start decoding from wherever the encoders are resting
+    quadratureDecoder_init(&g_quadratureDecoders[encoder0_event], readPhaseState(encoder0_event));
+    quadratureDecoder_init(&g_quadratureDecoders[encoder1_event], readPhaseState(encoder1_event));
+
     err |= gpio_isr_handler_add(ENCODER0_SW_IO, encoderSwitchEvent_ISR, (void*)(&encoder0_eventParam));
     err |= gpio_isr_handler_add(ENCODER1_SW_IO, encoderSwitchEvent_ISR, (void*)(&encoder1_eventParam));
     err |= gpio_isr_handler_add(ENCODER0_PHA0_IO, encoderPositionChange_ISR, (void*)(&encoder0_eventParam));
@@ -179,17 +264,18 @@ static void IRAM_ATTR encoderSwitchEvent_ISR(void * eventParam)
     if(!g_isWaitingForDebounceTimer)
     {
 
-        uint8_t eventType;
+        InputEvent switchEvent = {.source = inputSourceEncoders};
+        BaseType_t isTaskWoken = pdFALSE;
 
         //Determine which encoders switch was pressed
         switch(*(uint8_t*)eventParam)
         {
             case encoder0_event:
-                eventType = encoder0_sw;
+                switchEvent.eventType = encoder0_sw;
                 break;
 
             case encoder1_event:
-                eventType = encoder1_sw;
+                switchEvent.eventType = encoder1_sw;
                 break;
 
             default:
@@ -197,8 +283,9 @@ static void IRAM_ATTR encoderSwitchEvent_ISR(void * eventParam)
                 break;
         }
 
-        //Place the new switch event into the encoder event queue
-        xQueueSendToBackFromISR(g_EncodersQueueHandle, &eventType, pdFALSE);
+        //Post the new switch event to the menu task
+        switchEvent.timestampMicros = (uint32_t)esp_timer_get_time();
+        inputEventBus_postFromISR(inputBusMenu, &switchEvent, &isTaskWoken);
 
         //Handle debounce timer
         g_isWaitingForDebounceTimer = true;
@@ -207,6 +294,8 @@ static void IRAM_ATTR encoderSwitchEvent_ISR(void * eventParam)
         };
         gptimer_set_alarm_action(g_debounceTimerHandle, &alarm_config);
         gptimer_start(g_debounceTimerHandle);
+
+        if(isTaskWoken) portYIELD_FROM_ISR();
     }
 }
 
@@ -214,149 +303,45 @@ static void IRAM_ATTR encoderSwitchEvent_ISR(void * eventParam)
 //---- Private
 static void IRAM_ATTR encoderPositionChange_ISR(void *eventParam)
 {
-    //This interrupt is executed when one of the encoders is rotated
-    //might look like a lot of code but between static variables and
-    //switches it isnt a lot of code that actually gets executed
-
-    static sEncoderCount_t Encoder0Count;
-    static uint8_t encoder0_previousState;
-
-    static sEncoderCount_t Encoder1Count;
-    static uint8_t encoder1_previousState;
+    //This interrupt is executed on every edge of either phase
+    //of an encoder, and adds any completed detent to its count
 
-    sEncoderCount_t * EncoderCountPtr = NULL;
-    uint8_t * previousStatePtr = NULL;
+    uint32_t startCycles = esp_cpu_get_cycle_count();
+    uint8_t encoderNum = *(uint8_t*)eventParam;
+    BaseType_t isTaskWoken = pdFALSE;
+    uint32_t numCycles;
+    int8_t detent;
 
-    uint8_t eventType;
-    uint8_t currentPhaseEncoding;
-
-    //Determine which encoders switch was pressed
-    //and get direct pointer to relevant data
-    switch(*(uint8_t*)eventParam)
+    detent = quadratureDecoder_update(&g_quadratureDecoders[encoderNum], readPhaseState(encoderNum));
+    if(detent != 0)
     {
-        case encoder0_event:
-            EncoderCountPtr = &Encoder0Count;
-            previousStatePtr = &encoder0_previousState;
-            //Get the current state of encoder0 inputs
-            currentPhaseEncoding = ((gpio_get_level(ENCODER0_PHA1_IO) << 1) | gpio_get_level(ENCODER0_PHA0_IO));
-            break;
-
-        case encoder1_event:
-            EncoderCountPtr = &Encoder1Count;
-            previousStatePtr = &encoder1_previousState;
-            //Get the current state of encoder1 inputs
-            currentPhaseEncoding = ((gpio_get_level(ENCODER1_PHA1_IO) << 1) | gpio_get_level(ENCODER1_PHA0_IO));
-            break;
-
-        default:
-            assert(0);
-            break;
+        //Only the count is updated, the menu task is woken to read it
+        atomic_fetch_add_explicit(&g_encoderDeltas[encoderNum], detent, memory_order_relaxed);
+        inputEventBus_wakeFromISR(inputBusMenu, &isTaskWoken);
     }
 
-    //Encoder state machine handling
-    switch (currentPhaseEncoding)
-    {
-        case ENCODING_00: //Both encoder inputs LOW
-            if (*previousStatePtr == ENCODING_10)
-            {
-                EncoderCountPtr->cwCount++;
-                EncoderCountPtr->ccwCount = 0;
-            }
-            else if (*previousStatePtr == ENCODING_01)
-            {
-                EncoderCountPtr->ccwCount++;
-                EncoderCountPtr->cwCount = 0;
-            }
-            break;
-
-        case ENCODING_01: //Encoder PHA0 HIGH only
-            if (*previousStatePtr == ENCODING_00)
-            {
-                EncoderCountPtr->cwCount++;
-                EncoderCountPtr->ccwCount = 0;
-            }
-            else if (*previousStatePtr == ENCODING_11)
-            {
-                EncoderCountPtr->ccwCount++;
-                EncoderCountPtr->cwCount = 0;
-            }
-            break;
-
-        case ENCODING_10: //Encoder PHA1 HIGH only
-            if (*previousStatePtr == ENCODING_11)
-            {
-                EncoderCountPtr->cwCount++;
-                EncoderCountPtr->ccwCount = 0;
-            }
-            else if (*previousStatePtr == ENCODING_00)
-            {
-                EncoderCountPtr->ccwCount++;//Clear count
-                EncoderCountPtr->cwCount = 0;
-            }
-            break;
-
-        case ENCODING_11: //Both encoder inputs HIGH
-            if (*previousStatePtr == ENCODING_01)
-            {
-                EncoderCountPtr->cwCount++;
-                EncoderCountPtr->ccwCount = 0;
-            }
-            else if (*previousStatePtr == ENCODING_10)
-            {
-                EncoderCountPtr->ccwCount++;
-                EncoderCountPtr->cwCount = 0;
-            }
-            break;
-    }
+    //Both encoders share the GPIO ISR, so these are never updated concurrently
+    numCycles = esp_cpu_get_cycle_count() - startCycles;
+    ++g_decoderNumEdges;
+    g_decoderTotalCycles += numCycles;
+    if(numCycles > g_decoderMaxCycles) g_decoderMaxCycles = numCycles;
 
-    //Keep record of previous state of encoder
-    *previousStatePtr = currentPhaseEncoding;
+    if(isTaskWoken) portYIELD_FROM_ISR();
+}
 
-    //Place event in queue if CPR threshold reached
-    if(EncoderCountPtr->cwCount >= ENCODER_COUNT_PER_REV)    
-    {
-        //cw event detected,
-        //determine which encoder
-        switch(*(uint8_t*)eventParam)
-        {
-            case encoder0_event:
-                eventType = encoder0_cw;
-                break;
 
-            case encoder1_event:
-                eventType = encoder1_cw;
-                break;
+//---- Private
+static inline __attribute__((always_inline)) uint8_t readPhaseState(uint8_t encoderNum)
+{
+    //Read straight from the GPIO input register, 'gpio_get_level' isn't IRAM safe
+    //RETURNS: The encoders phase inputs as (PHA1 << 1) | PHA0
 
-            default:
-                assert(0);
-                break;
-        }
-        //Inform system of the event
-        xQueueSendToBackFromISR(g_EncodersQueueHandle, &eventType, pdFALSE);
-        EncoderCountPtr->cwCount = 0; //Clear count
-    }
-    else if(EncoderCountPtr->ccwCount >= ENCODER_COUNT_PER_REV)   
+    if(encoderNum == encoder0_event)
     {
-        //cw event detected,
-        //determine which encoder
-        switch(*(uint8_t*)eventParam)
-        {
-            case encoder0_event:
-                eventType = encoder0_ccw;
-                break;
-
-            case encoder1_event:
-                eventType = encoder1_ccw;
-                break;
-
-            default:
-                assert(0);
-                break;
-        }
-        //Inform system of the event
-        xQueueSendToBackFromISR(g_EncodersQueueHandle, &eventType, pdFALSE);
-        EncoderCountPtr->ccwCount = 0; //Clear count
+        return (gpio_ll_get_level(&GPIO, ENCODER0_PHA1_IO) << 1) | gpio_ll_get_level(&GPIO, ENCODER0_PHA0_IO);
     }
+
+    return (gpio_ll_get_level(&GPIO, ENCODER1_PHA1_IO) << 1) | gpio_ll_get_level(&GPIO, ENCODER1_PHA0_IO);
 }
 
 
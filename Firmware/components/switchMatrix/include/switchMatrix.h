@@ -1,10 +1,29 @@
 
-#define SWITCH_MATRIX_QUEUE_NUM_ITEMS 1
+//The current state of every switch is also available as a 64 bit
+//bitmap (see 'switchMatrix_getKeyStates'), one bit per switch where
+//'1' = held. The macros below build masks for testing the bitmap.
+#define SWITCH_MATRIX_NUM_ROWS              6
+#define SWITCH_MATRIX_NUM_COLUMNS           8
+#define SWITCH_MATRIX_KEY_IDX(COL, ROW)     (((COL) * SWITCH_MATRIX_NUM_ROWS) + (ROW))
+#define SWITCH_MATRIX_KEY_MASK(COL, ROW)    (1ULL << SWITCH_MATRIX_KEY_IDX(COL, ROW))
+#define SWITCH_MATRIX_COLUMN_MASK(COL)      (0x3FULL << SWITCH_MATRIX_KEY_IDX(COL, 0))
+#define SWITCH_MATRIX_ROW_MASK(ROW)         (0x041041041041ULL << (ROW))
 
-typedef struct {
-    uint16_t column;
-    uint16_t row;
-} SwitchMatrixQueueItem;
+//TRUE if every switch in 'CHORD_MASK' is held (others may be held too)
+#define SWITCH_MATRIX_IS_CHORD_HELD(KEY_STATES, CHORD_MASK)    (((KEY_STATES) & (CHORD_MASK)) == (CHORD_MASK))
+//TRUE if exactly the switches in 'CHORD_MASK' are held
+#define SWITCH_MATRIX_IS_ONLY_CHORD_HELD(KEY_STATES, CHORD_MASK) ((KEY_STATES) == (CHORD_MASK))
 
-extern QueueHandle_t g_SwitchMatrixQueueHandle;
-void switchMatrix_TaskEntryPoint(void * taskParams);
\ No newline at end of file
+//A switch held this long generates a hold event (once per press)
+#define SWITCH_MATRIX_HOLD_MS 400
+
+//Debounced switch state changes, switch events are posted to the
+//system tasks input event bus as 'inputSourceSwitchMatrix' events
+enum {
+    switchMatrixPressEvent,
+    switchMatrixReleaseEvent,
+    switchMatrixHoldEvent
+};
+
+void switchMatrix_TaskEntryPoint(void * taskParams);
+uint64_t switchMatrix_getKeyStates(void);
\ No newline at end of file
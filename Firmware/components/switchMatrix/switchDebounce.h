@@ -0,0 +1,53 @@
+#include <stdint.h>
+
+//Per-key debouncing for one column of the switch matrix, using 2-bit vertical counters.
+
+//Each bit position is a separate key (row). A key's debounced state only changes once
+//its raw sample has differed from the debounced state for 'SWITCH_DEBOUNCE_NUM_SAMPLES'
+//consecutive samples, any sample that agrees with the debounced state resets its count.
+//The counter for all keys in the column is held across two bytes (one per counter bit),
+//so all rows are debounced in parallel with a handful of logic operations.
+
+//Nothing here depends on the IDF, so it can be built and run on a host.
+
+#define SWITCH_DEBOUNCE_NUM_SAMPLES 4
+
+typedef struct
+{
+    uint8_t state;      //Debounced key states, 1 = pressed
+    uint8_t count0;     //Low bit of each keys counter
+    uint8_t count1;     //High bit of each keys counter
+} SwitchDebounceColumn;
+
+
+
+//---- Public
+static inline void switchDebounce_init(SwitchDebounceColumn * columnPtr)
+{
+    //Counters start (and are reset) at 3, and
+    //count down to roll over on the fourth sample
+    columnPtr->state = 0;
+    columnPtr->count0 = 0xFF;
+    columnPtr->count1 = 0xFF;
+}
+
+
+
+//---- Public
+static inline __attribute__((always_inline)) uint8_t switchDebounce_update(SwitchDebounceColumn * columnPtr, uint8_t sample)
+{
+    //Feeds in a new raw sample for the column ('1' = switch closed).
+    //Always inlined so it is safe to call from an IRAM ISR.
+    //RETURNS: A mask of keys whose debounced state has just changed,
+    //AND with 'state' for presses, AND with '~state' for releases.
+
+    uint8_t changed = sample ^ columnPtr->state;
+
+    columnPtr->count0 = ~(columnPtr->count0 & changed);
+    columnPtr->count1 = columnPtr->count0 ^ (columnPtr->count1 & changed);
+
+    changed &= columnPtr->count0 & columnPtr->count1;
+    columnPtr->state ^= changed;
+
+    return changed;
+}
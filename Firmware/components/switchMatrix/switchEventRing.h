@@ -0,0 +1,91 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+//A lock-free single producer / single consumer ring of switch events.
+//The producer is the scan ISR, the consumer is the switch matrix task.
+
+//Each side only ever writes its own index, the item is stored before
+//the head index is released (and read before the tail index is released),
+//so no critical section is needed and the ISR never blocks. If the ring
+//is full the new event is counted and dropped, the oldest events are kept.
+
+//Nothing here depends on the IDF, so it can be built and run on a host.
+
+//Must be a power of two
+#define SWITCH_EVENT_RING_NUM_ITEMS     64
+
+typedef struct
+{
+    uint8_t row;
+    uint8_t column;
+    uint8_t eventType;
+    uint32_t timestampMicros;
+} SwitchEventRingItem;
+
+typedef struct
+{
+    SwitchEventRingItem items[SWITCH_EVENT_RING_NUM_ITEMS];
+    atomic_uint head;       //Next slot to write, producer only
+    atomic_uint tail;       //Next slot to read, consumer only
+    uint32_t numDropped;    //Events lost to a full ring, producer only
+} SwitchEventRing;
+
+
+
+//---- Public
+static inline void switchEventRing_init(SwitchEventRing * ringPtr)
+{
+    atomic_init(&ringPtr->head, 0);
+    atomic_init(&ringPtr->tail, 0);
+    ringPtr->numDropped = 0;
+}
+
+
+
+//---- Public
+static inline __attribute__((always_inline)) bool switchEventRing_push(SwitchEventRing * ringPtr, uint8_t row, uint8_t column, uint8_t eventType, uint32_t timestampMicros)
+{
+    //Producer side, always inlined so it is safe to call from an IRAM ISR.
+    //RETURNS: false if the ring was full and the event was dropped.
+
+    unsigned int head = atomic_load_explicit(&ringPtr->head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&ringPtr->tail, memory_order_acquire);
+    SwitchEventRingItem * itemPtr;
+
+    //Indexes run freely and wrap, the difference is the number of items held
+    if((head - tail) >= SWITCH_EVENT_RING_NUM_ITEMS)
+    {
+        ++ringPtr->numDropped;
+        return false;
+    }
+
+    itemPtr = &ringPtr->items[head & (SWITCH_EVENT_RING_NUM_ITEMS - 1)];
+    itemPtr->row = row;
+    itemPtr->column = column;
+    itemPtr->eventType = eventType;
+    itemPtr->timestampMicros = timestampMicros;
+
+    atomic_store_explicit(&ringPtr->head, head + 1, memory_order_release);
+    return true;
+}
+
+
+
+//---- Public
+static inline bool switchEventRing_pop(SwitchEventRing * ringPtr, SwitchEventRingItem * itemPtr)
+{
+    //Consumer side.
+    //RETURNS: false if the ring is empty, otherwise
+    //the oldest event is copied to 'itemPtr'.
+
+    unsigned int tail = atomic_load_explicit(&ringPtr->tail, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&ringPtr->head, memory_order_acquire);
+
+    if(head == tail) return false;
+
+    *itemPtr = ringPtr->items[tail & (SWITCH_EVENT_RING_NUM_ITEMS - 1)];
+
+    atomic_store_explicit(&ringPtr->tail, tail + 1, memory_order_release);
+    return true;
+}
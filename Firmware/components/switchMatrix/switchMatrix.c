@@ -1,11 +1,19 @@
+#include <inttypes.h>
 #include "esp_log.h"
 #include "esp_attr.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include "esp_timer.h"
 #include "ledDrivers.h"
+#include "inputEventBus.h"
 #include "include/switchMatrix.h"
+#include "switchEventRing.h"
+#include "switchDebounce.h"
 #include <driver/gpio.h>
+#include "driver/gptimer.h"
+#include "hal/gpio_ll.h"
+#include "esp_rom_sys.h"
 
 #define LOG_TAG                         "switchMatrix"
 #define KEY_MATRIX_NUM_ROWS             SYSTEM_NUM_ROWS
@@ -14,16 +22,28 @@
 #define KEY_MATRIX_ROW1_IO              41      //Input pin
 #define KEY_MATRIX_ROW2_IO              40      //Input pin
 #define KEY_MATRIX_ROW3_IO              39      //Input pin
-//#define KEY_MATRIX_ROW4_IO              38      //Input pin //temp removed
+#define KEY_MATRIX_ROW4_IO              38      //Input pin
 #define KEY_MATRIX_ROW5_IO              37      //Input pin
 #define KEY_MATRIX_SCAN_CLK_IO          5       //Clock output pin
 #define KEY_MATRIX_COUNTER_RESET_IO     4       //Counter reset output pin
-#define KEY_MATRIX_START_COLUMN         7       
+#define KEY_MATRIX_START_COLUMN         7
+
+//The scan timer ticks once per column. Each tick lowers the counter clock, samples the rows
+//and raises the clock again to move on a column. 8kHz ticks give a 1ms sweep.
+#define KEY_MATRIX_SCAN_TIMER_RES_HZ    1000000
+#define KEY_MATRIX_SCAN_TICK_US         125
+#define KEY_MATRIX_CLOCK_LOW_US         1       //MC14017B minimum clock pulse width, with margin at 3.3V
+
+//How long the task waits for new events before retrying a full bus
+//or checking held switches, also sets the resolution of hold events
+#define KEY_MATRIX_TASK_RETRY_MS        10
+#define KEY_MATRIX_NUM_KEYS             (KEY_MATRIX_NUM_ROWS * KEY_MATRIX_NUM_COLUMNS)
+
+_Static_assert((KEY_MATRIX_NUM_ROWS == SWITCH_MATRIX_NUM_ROWS) && (KEY_MATRIX_NUM_COLUMNS == SWITCH_MATRIX_NUM_COLUMNS), "Key bitmap layout mismatch");
 
 //Bit mask used to configure pins simultaneously
-#define KEY_MATRIX_ROW_IO_CONFIG_MASK (1ULL << KEY_MATRIX_ROW0_IO)
-//|(1ULL << KEY_MATRIX_ROW1_IO)|(1ULL << KEY_MATRIX_ROW2_IO) 
-//(1ULL << KEY_MATRIX_ROW3_IO)|(1ULL << KEY_MATRIX_ROW5_IO)) 
+#define KEY_MATRIX_ROW_IO_CONFIG_MASK ((1ULL << KEY_MATRIX_ROW0_IO) | (1ULL << KEY_MATRIX_ROW1_IO) | (1ULL << KEY_MATRIX_ROW2_IO) | \
+                                       (1ULL << KEY_MATRIX_ROW3_IO) | (1ULL << KEY_MATRIX_ROW4_IO) | (1ULL << KEY_MATRIX_ROW5_IO))
 
 
 //The switch matrix runs as a standalone RTOS task.
@@ -36,84 +56,229 @@
 //As the MC14017B startup state is undefined the MCU manually resets the MC14017B at startup only, which
 //guarantees that the counter will start from output Q0 (the system must always know which output is energized).
 
-//Each row of the switch matrix feeds into an input on the MCU (via schmitt triggers), a logic HIGH state on one of the 
-//switch matrix inputs will trigger an interrupt to fire - the coordinate of the switch being pressed is then derived
-//by considering the column number currently energized at time of interrupt and the row input which generated the interrupt.
-//Switch events are communicated to the host system via a queue, where the grid coordinate of the event is passed to the queue.
+//Each row of the switch matrix feeds into an input on the MCU (via schmitt triggers), a logic HIGH state on one of the
+//switch matrix inputs means the switch at that row, in the column currently energized, is closed.
+
+//The matrix is scanned from a hardware timer ISR. Each column step the ISR samples all six rows of the energized
+//column and feeds them through that columns debounce counters (see 'switchDebounce.h'), then clocks the counter on
+//to the next column. A full sweep takes 1ms, so a press is reported once it has been stable for four sweeps (3 - 4ms),
+//which keeps press to event latency under 10ms even for switches that chatter for several ms (see 'switchDebounceTest.c').
+//Every key is debounced independently, so chords and fast repeated presses are all captured.
+
+//Debounced press and release events are written as (row, column, type, timestamp) into a lock-free ring
+//(see 'switchEventRing.h') and the task is notified. The task forwards them to the system tasks input event bus.
+
+//The task also tracks which switches are held. A release event carries how long the switch was held, and a
+//switch held for 'SWITCH_MATRIX_HOLD_MS' generates a hold event. Held switches are kept in a 48 bit mask with
+//a press timestamp per key, so handling each event is constant time and nothing is allocated. Hold events are
+//only sent for switches the key bitmap (below) still shows held, so a hold never follows its release.
+
+//The scan ISR also keeps the debounced state of every switch in a single 64 bit bitmap (bit 'SWITCH_MATRIX_KEY_IDX'),
+//so the state of the whole grid can be read in one go, and chords tested with bitwise operations. The bitmap is
+//updated as soon as a change is debounced, so it may run slightly ahead of the events on the bus.
+//64 bit atomics aren't lock-free on the ESP32-S3 (the toolchain wraps them in a critical section that isn't ISR
+//safe), so the bitmap is guarded by a spinlock instead. Both sides only hold it to copy the 8 bytes.
 
 //---- IMPORTANT NOTE ----//
-//Due to PCB routing counter outputs Q0 - Q7 are connected to columns C7 - C0  
+//Due to PCB routing counter outputs Q0 - Q7 are connected to columns C7 - C0
 //respectfully, so the columns are scanned through in reverse order (right to left).
 
 
 //---- Private ----//
 static void switchMatrixSetup(void);
-static void switchMatrixKeyPress_ISR(void *param);
+static void setupScanTimer(void);
+static void forwardSwitchEvents(void);
+static void trackHeldKeys(InputEvent * eventPtr);
+static void sendHoldEvents(void);
+static bool switchMatrixScan_ISR(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *param);
+
+
+//Events are passed from the scan ISR to the modules task via this ring
+static SwitchEventRing g_switchEventRing;
+static TaskHandle_t g_switchMatrixTaskHandle = NULL;
+static gptimer_handle_t g_scanTimerHandle = NULL;
 
+//Debounce state for each column, only accessed by the scan ISR
+static SwitchDebounceColumn g_debounceColumns[KEY_MATRIX_NUM_COLUMNS];
 
-//This queue is shared with the host system as an extern and acts
-//to communicate all switch events from the module to the host system
-QueueHandle_t g_SwitchMatrixQueueHandle;
+//Debounced state of every switch, written by the scan ISR only
+static uint64_t g_keyStates = 0;
+static portMUX_TYPE g_keyStatesLock = portMUX_INITIALIZER_UNLOCKED;
 
-//These are used to signal a switch event
-//and row number of that event to the modules task 
-static volatile bool g_switchEventFlagISR;
-static volatile uint8_t g_switchEventRowNumISR;
+//Event taken from the ring but not yet posted to the bus, only accessed by the task
+static InputEvent g_pendingSwitchEvent = {.source = inputSourceSwitchMatrix};
+static bool g_isSwitchEventPending = false;
+
+//Held switches (bit per key index), only accessed by the task
+static uint64_t g_heldKeys = 0;
+static uint64_t g_holdReportedKeys = 0;
+static uint32_t g_keyPressTimestamps[KEY_MATRIX_NUM_KEYS];
+
+//Input pin for each row, in row order
+static const uint8_t g_rowInputPins[KEY_MATRIX_NUM_ROWS] = {
+    KEY_MATRIX_ROW0_IO, KEY_MATRIX_ROW1_IO, KEY_MATRIX_ROW2_IO,
+    KEY_MATRIX_ROW3_IO, KEY_MATRIX_ROW4_IO, KEY_MATRIX_ROW5_IO
+};
 
 
 
 //---- Public
 void switchMatrix_TaskEntryPoint(void * taskParams)
 {
-    uint8_t currentColumn = KEY_MATRIX_START_COLUMN;
-    SwitchMatrixQueueItem SwitchEventQueueItem = {0};
+    uint32_t numDroppedReported = 0;
 
     switchMatrixSetup();
+    setupScanTimer();
 
     while(1)
     {
-        if(g_switchEventFlagISR == true)
-        {   
-            SwitchEventQueueItem.row = g_switchEventRowNumISR;
-            g_switchEventFlagISR = false;
-            SwitchEventQueueItem.column = currentColumn;
-            //Queue item is copied across to queue IDF implmented
-            //queue storage area, item can be overwritten after 'xQueueSend'
-            xQueueSend(g_SwitchMatrixQueueHandle, &SwitchEventQueueItem, 0);
+        //Woken by the scan ISR when it has new events, the timeout
+        //retries any event held back while the bus was full
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(KEY_MATRIX_TASK_RETRY_MS));
+
+        forwardSwitchEvents();
+        sendHoldEvents();
+
+        if(g_switchEventRing.numDropped != numDroppedReported)
+        {
+            numDroppedReported = g_switchEventRing.numDropped;
+            ESP_LOGW(LOG_TAG, "Switch event ring full, %" PRIu32 " events dropped", numDroppedReported);
         }
+    }
+}
+
+
+
+//---- Public
+uint64_t switchMatrix_getKeyStates(void)
+{
+    //RETURNS: The debounced state of all switches, see 'SWITCH_MATRIX_KEY_MASK'.
+    //Safe to call from any task.
+
+    uint64_t keyStates;
+
+    portENTER_CRITICAL(&g_keyStatesLock);
+    keyStates = g_keyStates;
+    portEXIT_CRITICAL(&g_keyStatesLock);
+
+    return keyStates;
+}
 
-        //Increment the decade counter 
-        //by toggling its clock input pin
-        gpio_set_level(KEY_MATRIX_SCAN_CLK_IO, true);
-        vTaskDelay(pdMS_TO_TICKS(30));  //---- Sets switch matrix scan rate and debounces switches ----//
-        gpio_set_level(KEY_MATRIX_SCAN_CLK_IO, false);
 
-        if(currentColumn > 0) currentColumn--; //Cycle through columns sequentially, then wrap around
-        else currentColumn = KEY_MATRIX_START_COLUMN;
+
+//---- Private
+static void forwardSwitchEvents(void)
+{
+    //Forwards captured events to the system task. If the bus is full
+    //the event is kept and sent first on the next pass, the rest
+    //wait in the ring, so events are delayed rather than lost.
+
+    SwitchEventRingItem ringItem;
+
+    while(1)
+    {
+        if(!g_isSwitchEventPending)
+        {
+            if(!switchEventRing_pop(&g_switchEventRing, &ringItem)) break;
+
+            g_pendingSwitchEvent.eventType = ringItem.eventType;
+            g_pendingSwitchEvent.timestampMicros = ringItem.timestampMicros;
+            g_pendingSwitchEvent.switchMatrix.row = ringItem.row;
+            g_pendingSwitchEvent.switchMatrix.column = ringItem.column;
+            trackHeldKeys(&g_pendingSwitchEvent);
+            g_isSwitchEventPending = true;
+        }
+
+        //Event is copied onto the bus, so can be overwritten once posted
+        if(!inputEventBus_post(inputBusSystem, &g_pendingSwitchEvent)) break;
+        g_isSwitchEventPending = false;
     }
 }
 
 
 
 //---- Private
-static void switchMatrixSetup(void)
+static void trackHeldKeys(InputEvent * eventPtr)
 {
-    //These are used as ISR params
-    //to determine row of event
-    static const uint8_t row0 = 0;
-    //static const uint8_t row1 = 1;
-    //static const uint8_t row2 = 2;
-    //static const uint8_t row3 = 3;
-    //static const uint8_t row4 = 4;
-    //static const uint8_t row5 = 5;
+    //Updates the held switches for a press or release event,
+    //and fills in how long the switch was held on release.
+
+    uint8_t keyIdx = SWITCH_MATRIX_KEY_IDX(eventPtr->switchMatrix.column, eventPtr->switchMatrix.row);
+    uint64_t keyMask = (1ULL << keyIdx);
+
+    if(eventPtr->eventType == switchMatrixPressEvent)
+    {
+        g_keyPressTimestamps[keyIdx] = eventPtr->timestampMicros;
+        g_heldKeys |= keyMask;
+        g_holdReportedKeys &= ~keyMask;
+        eventPtr->switchMatrix.heldMicros = 0;
+    }
+    else
+    {
+        eventPtr->switchMatrix.heldMicros = (g_heldKeys & keyMask) ? (eventPtr->timestampMicros - g_keyPressTimestamps[keyIdx]) : 0;
+        g_heldKeys &= ~keyMask;
+        g_holdReportedKeys &= ~keyMask;
+    }
+}
+
+
+
+//---- Private
+static void sendHoldEvents(void)
+{
+    //Sends a hold event for each switch that has just passed the hold
+    //time. Only keys still waiting on a hold event are visited.
+
+    uint64_t pendingKeys = g_heldKeys & ~g_holdReportedKeys;
+    uint32_t nowMicros = (uint32_t)esp_timer_get_time();
+    InputEvent holdEvent = {.source = inputSourceSwitchMatrix, .eventType = switchMatrixHoldEvent};
+    uint8_t keyIdx;
 
+    if(pendingKeys == 0) return;
+
+    //Only switches the scan still sees held. The ISR clears a switch in the bitmap
+    //before queueing its release, so one whose release is still in the ring is
+    //skipped, as is one whose release was lost to a full ring. The bitmap is read
+    //after taking the time, so a release debounced from here on is later than the
+    //hold and is forwarded after it.
+    pendingKeys &= switchMatrix_getKeyStates();
+
+    while(pendingKeys)
+    {
+        keyIdx = __builtin_ctzll(pendingKeys);
+        pendingKeys &= (pendingKeys - 1);
+
+        if((nowMicros - g_keyPressTimestamps[keyIdx]) < (SWITCH_MATRIX_HOLD_MS * 1000)) continue;
+
+        holdEvent.switchMatrix.column = keyIdx / KEY_MATRIX_NUM_ROWS;
+        holdEvent.switchMatrix.row = keyIdx % KEY_MATRIX_NUM_ROWS;
+        holdEvent.timestampMicros = nowMicros;
+        holdEvent.switchMatrix.heldMicros = nowMicros - g_keyPressTimestamps[keyIdx];
+
+        //Bus full, try again on the next pass
+        if(!inputEventBus_post(inputBusSystem, &holdEvent)) break;
+
+        g_holdReportedKeys |= (1ULL << keyIdx);
+    }
+}
+
+
+
+//---- Private
+static void switchMatrixSetup(void)
+{
     gpio_config_t switchMatrixInputPins_conf = {0};
     gpio_config_t counterControlPins_conf = {0};
 
     esp_err_t err = ESP_OK;
 
-    //Configure input pins for the switch matrix
-    switchMatrixInputPins_conf.intr_type = GPIO_INTR_POSEDGE;
+    g_switchMatrixTaskHandle = xTaskGetCurrentTaskHandle();
+    switchEventRing_init(&g_switchEventRing);
+    for(uint8_t column = 0; column < KEY_MATRIX_NUM_COLUMNS; ++column) switchDebounce_init(&g_debounceColumns[column]);
+
+    //Configure input pins for the switch matrix,
+    //these are polled by the scan ISR
+    switchMatrixInputPins_conf.intr_type = GPIO_INTR_DISABLE;
     switchMatrixInputPins_conf.mode = GPIO_MODE_INPUT;
     switchMatrixInputPins_conf.pin_bit_mask = KEY_MATRIX_ROW_IO_CONFIG_MASK;
     switchMatrixInputPins_conf.pull_down_en = false;
@@ -121,14 +286,6 @@ static void switchMatrixSetup(void)
     err |= gpio_config(&switchMatrixInputPins_conf);
     assert(err == ESP_OK);
 
-    err |= gpio_isr_handler_add(KEY_MATRIX_ROW0_IO, switchMatrixKeyPress_ISR, &row0);
-    //err |= gpio_isr_handler_add(KEY_MATRIX_ROW1_IO, switchMatrixKeyPress_ISR, &row1);
-    //err |= gpio_isr_handler_add(KEY_MATRIX_ROW2_IO, switchMatrixKeyPress_ISR, &row2);
-    //err |= gpio_isr_handler_add(KEY_MATRIX_ROW3_IO, switchMatrixKeyPress_ISR, &row3);
-    //err |= gpio_isr_handler_add(KEY_MATRIX_ROW4_IO, switchMatrixKeyPress_ISR, &row4);
-    //err |= gpio_isr_handler_add(KEY_MATRIX_ROW5_IO, switchMatrixKeyPress_ISR, &row5);
-    assert(err == ESP_OK);
-
     //Configure output pins for counter RESET and CLOCK
     counterControlPins_conf.intr_type = GPIO_INTR_DISABLE;
     counterControlPins_conf.mode = GPIO_MODE_OUTPUT;
@@ -140,6 +297,7 @@ static void switchMatrixSetup(void)
 
     //Force counter into known state but toggling
     //its reset pin - this ony happens once at startup
+    err |= gpio_set_level(KEY_MATRIX_SCAN_CLK_IO, false);
     err |= gpio_set_level(KEY_MATRIX_COUNTER_RESET_IO, true);
     vTaskDelay(pdMS_TO_TICKS(10));
     err |= gpio_set_level(KEY_MATRIX_COUNTER_RESET_IO, false);
@@ -147,16 +305,97 @@ static void switchMatrixSetup(void)
 }
 
 
+
+//---- Private
+static void setupScanTimer(void)
+{
+    //The alarm reloads itself, so the scan runs
+    //continuously from here with no task involvement
+
+    esp_err_t err = ESP_OK;
+
+    gptimer_config_t timer_config = {
+        .clk_src = GPTIMER_CLK_SRC_APB,
+        .direction = GPTIMER_COUNT_UP,
+        .resolution_hz = KEY_MATRIX_SCAN_TIMER_RES_HZ,
+    };
+
+    gptimer_event_callbacks_t cbs = {
+        .on_alarm = switchMatrixScan_ISR,
+    };
+
+    gptimer_alarm_config_t alarm_config = {
+        .alarm_count = KEY_MATRIX_SCAN_TICK_US,
+        .reload_count = 0,
+        .flags.auto_reload_on_alarm = true,
+    };
+
+    err |= gptimer_new_timer(&timer_config, &g_scanTimerHandle);
+    err |= gptimer_register_event_callbacks(g_scanTimerHandle, &cbs, NULL);
+    err |= gptimer_enable(g_scanTimerHandle);
+    err |= gptimer_set_alarm_action(g_scanTimerHandle, &alarm_config);
+    err |= gptimer_start(g_scanTimerHandle);
+    assert(err == ESP_OK);
+}
+
+
 //----------------------------------------------------
 //---- MODULE INTERRUPT ROUTINES BELOW THIS POINT ----
 //----------------------------------------------------
 
 
-static void IRAM_ATTR switchMatrixKeyPress_ISR(void *param)
+//---- Private
+static bool IRAM_ATTR switchMatrixScan_ISR(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *param)
 {
-    if(!g_switchEventFlagISR)
+    //The counter only moves on a rising clock edge, so the clock is lowered here
+    //and raised once the rows have been sampled. The rows are always sampled a
+    //full tick after the column was energized.
+
+    static uint8_t currentColumn = KEY_MATRIX_START_COLUMN;
+
+    BaseType_t hasHigherPriorityTaskWoken = pdFALSE;
+    uint8_t sample = 0;
+    uint8_t changed;
+    uint32_t timestampMicros;
+    uint64_t keyStates;
+
+    gpio_ll_set_level(&GPIO, KEY_MATRIX_SCAN_CLK_IO, 0);
+    esp_rom_delay_us(KEY_MATRIX_CLOCK_LOW_US);
+
+    //The 'gpio_ll' functions are used, as the driver functions aren't IRAM safe
+    for(uint8_t row = 0; row < KEY_MATRIX_NUM_ROWS; ++row)
     {
-        g_switchEventRowNumISR = *((uint8_t *)param);
-        g_switchEventFlagISR = true;
+        sample |= (gpio_ll_get_level(&GPIO, g_rowInputPins[row]) << row);
     }
-}
\ No newline at end of file
+
+    changed = switchDebounce_update(&g_debounceColumns[currentColumn], sample);
+
+    if(changed)
+    {
+        timestampMicros = (uint32_t)esp_timer_get_time();
+
+        keyStates = ((uint64_t)g_debounceColumns[currentColumn].state << SWITCH_MATRIX_KEY_IDX(currentColumn, 0));
+
+        portENTER_CRITICAL_ISR(&g_keyStatesLock);
+        g_keyStates = (g_keyStates & ~SWITCH_MATRIX_COLUMN_MASK(currentColumn)) | keyStates;
+        portEXIT_CRITICAL_ISR(&g_keyStatesLock);
+
+        for(uint8_t row = 0; row < KEY_MATRIX_NUM_ROWS; ++row)
+        {
+            if(!(changed & (1 << row))) continue;
+            switchEventRing_push(&g_switchEventRing, row, currentColumn,
+                                (g_debounceColumns[currentColumn].state & (1 << row)) ? switchMatrixPressEvent : switchMatrixReleaseEvent,
+                                timestampMicros);
+        }
+
+        vTaskNotifyGiveFromISR(g_switchMatrixTaskHandle, &hasHigherPriorityTaskWoken);
+    }
+
+    //Energize the next column
+    gpio_ll_set_level(&GPIO, KEY_MATRIX_SCAN_CLK_IO, 1);
+
+    if(currentColumn > 0) currentColumn--; //Cycle through columns sequentially, then wrap around
+    else currentColumn = KEY_MATRIX_START_COLUMN;
+
+    return (hasHigherPriorityTaskWoken == pdTRUE);
+}
@@ -0,0 +1,58 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+#include "inputEvent.h"
+#include "switchMatrix.h"
+#include "gridGestures.h"
+
+
+//This module turns the press, release and hold events from the switch matrix
+//into grid gestures, letting common edits be made straight from the grid rather
+//than through the menu. It keeps no state of its own, which switches are held is
+//read from the switch matrix key bitmap (see 'switchMatrix_getKeyStates'), so
+//each event is handled in constant time and nothing is allocated.
+
+//A press while a switch further left on the same row is held sets the duration of
+//the note at the held switch so it ends on the pressed column (if more than one is
+//held, the leftmost is used). Any other press is a plain press.
+
+//The bitmap may run slightly ahead of the events, a switch whose release is still on
+//its way counts as released already, which is what the user has done.
+
+//Coordinates are as reported by the switch matrix (row 0 -> 5, column 0 -> 7),
+//the caller is responsible for applying any grid row/column offsets.
+
+
+
+//---- Public
+void gridGestures_processSwitchEvent(const InputEvent * switchEventPtr, GridGesture * gesturePtr)
+{
+    assert(switchEventPtr != NULL);
+    assert(switchEventPtr->source == inputSourceSwitchMatrix);
+    assert(gesturePtr != NULL);
+
+    uint8_t column = switchEventPtr->switchMatrix.column;
+    uint8_t row = switchEventPtr->switchMatrix.row;
+    uint64_t heldToLeft;
+    uint8_t anchorKeyIdx;
+
+    gesturePtr->gestureType = gridGestureNone;
+    gesturePtr->column = column;
+    gesturePtr->row = row;
+    gesturePtr->endColumn = column;
+
+    //Release and hold events need no action yet
+    if(switchEventPtr->eventType != switchMatrixPressEvent) return;
+
+    //Switches held on the same row, in the columns left of this one
+    heldToLeft = switchMatrix_getKeyStates() & SWITCH_MATRIX_ROW_MASK(row) & (SWITCH_MATRIX_KEY_MASK(column, 0) - 1);
+
+    if(heldToLeft != 0)
+    {
+        anchorKeyIdx = __builtin_ctzll(heldToLeft);
+        gesturePtr->gestureType = gridGestureSetDuration;
+        gesturePtr->column = anchorKeyIdx / SWITCH_MATRIX_NUM_ROWS;
+    }
+    else gesturePtr->gestureType = gridGesturePress;
+}
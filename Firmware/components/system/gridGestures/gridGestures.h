@@ -0,0 +1,17 @@
+
+//Recognises multi-switch gestures on the sequencer grid, see 'gridGestures.c'
+
+enum {
+    gridGestureNone,            //Event needs no action
+    gridGesturePress,           //A plain press, handle as a normal grid press
+    gridGestureSetDuration      //Held note A + press on B (same row, right of A), set the duration of A to end at B
+};
+
+typedef struct {
+    uint8_t gestureType;
+    uint16_t column;            //Coordinate of the press, or the held switch for 'gridGestureSetDuration'
+    uint8_t row;
+    uint16_t endColumn;         //'gridGestureSetDuration' only, the column the note should end on
+} GridGesture;
+
+void gridGestures_processSwitchEvent(const InputEvent * switchEventPtr, GridGesture * gesturePtr);
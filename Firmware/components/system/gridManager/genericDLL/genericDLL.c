@@ -4,6 +4,7 @@
 #include "esp_heap_caps.h"
 #include "malloc.h"
 #include "memory.h"
+#include "midiHelper.h"
 #include "genericDLL.h"
 
 #define LOG_TAG "genericDLL"
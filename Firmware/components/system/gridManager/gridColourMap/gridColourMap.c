@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <esp_log.h>
+#include "gridColourMap.h"
+
+#define LOG_TAG "gridColourMap"
+
+//Hue is expressed as 0 -> 1535, six 256 step sectors
+//(red -> yellow -> green -> cyan -> blue -> magenta)
+#define HUE_SECTOR_NUM_STEPS    256
+#define HUE_NUM_STEPS           (HUE_SECTOR_NUM_STEPS * 6)
+#define HUE_STEP_PER_CHANNEL    (HUE_NUM_STEPS / COLOUR_MAP_NUM_CHANNELS)
+#define HUE_CHANNEL0_OFFSET     (HUE_SECTOR_NUM_STEPS * 2)  //Channel 0 is green, as before colour mapping
+
+static uint32_t hueToRGB(uint16_t hue);
+
+
+//The LP5862 drivers are configured for exponential PWM scaling (see ledDrivers_init),
+//so the driver itself corrects for the eyes non-linear response. This means
+//brightness levels can be spaced linearly in PWM code and still appear even.
+
+static uint32_t g_colourPalette[COLOUR_MAP_PALETTE_SIZE];
+
+
+
+//---- Public
+void gridColourMap_init(void)
+{
+    uint32_t fullColour;
+    uint32_t red;
+    uint32_t green;
+    uint32_t blue;
+
+    for(uint8_t channel = 0; channel < COLOUR_MAP_NUM_CHANNELS; ++channel)
+    {
+        fullColour = hueToRGB((HUE_CHANNEL0_OFFSET + (channel * HUE_STEP_PER_CHANNEL)) % HUE_NUM_STEPS);
+
+        for(uint8_t level = 0; level < COLOUR_MAP_NUM_LEVELS; ++level)
+        {
+            //Level 0 (lowest velocities) is still visible
+            red   = (((fullColour >> 16) & 0xFF) * (level + 1)) / COLOUR_MAP_NUM_LEVELS;
+            green = (((fullColour >> 8) & 0xFF) * (level + 1)) / COLOUR_MAP_NUM_LEVELS;
+            blue  = ((fullColour & 0xFF) * (level + 1)) / COLOUR_MAP_NUM_LEVELS;
+
+            g_colourPalette[(channel * COLOUR_MAP_NUM_LEVELS) + level] = (red << 16) | (green << 8) | blue;
+        }
+    }
+}
+
+
+
+//---- Public
+uint32_t gridColourMap_getNoteColour(uint8_t statusByte, uint8_t velocity)
+{
+    //RETURNS: The 24-bit RGB colour code for a note
+    //with the given status byte (channel) and velocity.
+
+    return g_colourPalette[((statusByte & 0x0F) * COLOUR_MAP_NUM_LEVELS) + ((velocity & 0x7F) >> COLOUR_MAP_VELOCITY_TO_LEVEL_SHIFT)];
+}
+
+
+
+//---- Private
+static uint32_t hueToRGB(uint16_t hue)
+{
+    //Full saturation, full brightness
+    uint32_t rising = hue % HUE_SECTOR_NUM_STEPS;
+    uint32_t falling = (HUE_SECTOR_NUM_STEPS - 1) - rising;
+
+    switch(hue / HUE_SECTOR_NUM_STEPS)
+    {
+        case 0:  return (0xFF << 16) | (rising << 8);
+        case 1:  return (falling << 16) | (0xFF << 8);
+        case 2:  return (0xFF << 8) | rising;
+        case 3:  return (falling << 8) | 0xFF;
+        case 4:  return (rising << 16) | 0xFF;
+        default: return (0xFF << 16) | falling;
+    }
+}
@@ -0,0 +1,17 @@
+
+//This module maps midi note events to grid LED colours.
+//The midi channel sets the hue and the note velocity sets the brightness.
+
+//All colours are precomputed into a 256 entry palette at init,
+//indexed by: (channel << 4) | (velocity >> 3)
+#define COLOUR_MAP_NUM_CHANNELS         16
+#define COLOUR_MAP_NUM_LEVELS           16
+#define COLOUR_MAP_PALETTE_SIZE         (COLOUR_MAP_NUM_CHANNELS * COLOUR_MAP_NUM_LEVELS)
+#define COLOUR_MAP_VELOCITY_TO_LEVEL_SHIFT 3
+
+//Overlays are ORed over the note colours of the rendered frame
+#define COLOUR_MAP_PLAYHEAD_OVERLAY     0x00303030
+#define COLOUR_MAP_SELECTION_OVERLAY    0x00606060
+
+void gridColourMap_init(void);
+uint32_t gridColourMap_getNoteColour(uint8_t statusByte, uint8_t velocity);
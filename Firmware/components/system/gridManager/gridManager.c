@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <inttypes.h>
 #include "esp_err.h"
 #include "esp_log.h"
 #include "memory.h"
@@ -10,8 +11,10 @@
 #include "freertos/queue.h"
 #include "ledDrivers.h"
 #include "esp_task_wdt.h"
+#include "esp_heap_caps.h"
 #include "midiHelper.h"
 #include "genericDLL/genericDLL.h"
+#include "gridColourMap/gridColourMap.h"
 
 #define LOG_TAG "sequencerGrid"
 #define TEMPO_IN_MICRO 500000
@@ -20,6 +23,10 @@
 
 #define QUATER_NOTE_QUANTIZE 4
 #define NUMBER_NODES_TOTAL 100
+#define GRID_CHECKSUM_FNV_OFFSET_BASIS 2166136261UL
+#define GRID_CHECKSUM_FNV_PRIME 16777619UL
+#define GRID_CHECKSUM_NUM_BYTES_PER_EVENT 6
+#define MAX_NOTE_SPANS_PER_ROW (NUMBER_NODES_TOTAL / 2) //Each note uses two nodes (note-on & note-off)
 
 //Each row represents one of the possible 128 midi notes,
 //Each column of the sequencer represents a unit of step-time
@@ -39,6 +46,38 @@ struct {
 }  g_GridData;
 
 
+//To save walking each rows linked list (and pairing note-ons with
+//note-offs) every time the grid LEDs are rendered, each row keeps a
+//cache of the notes it holds as [startColumn, endColumn) spans, sorted
+//by column. A rows spans are rebuilt whenever that row is edited.
+typedef struct {
+    uint16_t startColumn;
+    uint16_t endColumn;     //Exclusive, the column of the note-off
+    uint32_t rgbColourCode;
+} NoteSpan;
+
+typedef struct {
+    uint16_t numSpans;
+    NoteSpan spans[MAX_NOTE_SPANS_PER_ROW];
+} RowNoteSpans;
+
+//Allocated from PSRAM at init, one entry per grid row
+static RowNoteSpans * g_rowNoteSpansPtr = NULL;
+
+//The playhead column and selected cell are shown by ORing an overlay plane over
+//the rendered note colours. The plane is only rebuilt when the playhead, selection
+//or display window changes, not on every render.
+static struct {
+    uint16_t playheadColumn;
+    uint16_t selectedColumn;
+    uint8_t  selectedRow;
+    uint16_t planeColumnOffset;
+    uint8_t  planeRowOffset;
+    bool     isPlaneStale;
+    uint32_t plane[NUM_SEQUENCER_PHYSICAL_ROWS * NUM_SEQUENCER_PHYSICAL_COLUMNS];
+} g_GridOverlay = {GRID_NO_OVERLAY_COLUMN, GRID_NO_OVERLAY_COLUMN, 0, 0, 0, true, {0}};
+
+
 static uint8_t getNumStepsToNextNoteOnAfterCoordinate(uint16_t columnNum, uint8_t rowNum, uint8_t midiChannel);
 static GridEventNode * getPointerToCorespondingNoteOffEventNode(GridEventNode * nodePtr);
 static GridEventNode * getPointerToNextNoteOnEventInListIfOneExists(GridEventNode * noteOnEventPtr);
@@ -46,6 +85,8 @@ static GridEventNode * getPointerToEventNodeIfExists(uint8_t targetStatusByte, u
 static void addCorrespondingNoteOff(GridEventNode * noteOnNode, uint16_t noteDuration);
 static void generateDeltaTimesForCurrentGrid(void);
 static void freeAllGridData(void);
+static void rebuildRowNoteSpans(uint8_t rowNum);
+static void rebuildOverlayPlane(uint8_t rowOffset, uint16_t columnOffset);
 
 
 
@@ -54,6 +95,10 @@ void gridManager_init(void)
 {
     ledDrivers_init();
     genericDLL_init(NUMBER_NODES_TOTAL);
+    gridColourMap_init();
+
+    g_rowNoteSpansPtr = heap_caps_calloc(TOTAL_MIDI_NOTES, sizeof(RowNoteSpans), MALLOC_CAP_SPIRAM);
+    assert(g_rowNoteSpansPtr != NULL);
     gridManager_resetSequencerGrid(QUATER_NOTE_QUANTIZE);
 }
 
@@ -99,7 +144,7 @@ void gridManager_addNewMidiEventToGrid(MidiEventParams newEventParams)
     //BUT - each event node at that coordinate MUST ALWAYS have a unqiue statusByte.
     //Its the callers responsibility to check that there are no existing event nodes with
     //the same statusByte at the target coordinate, so this is considered a system fault.
-    if(getPointerToEventNodeIfExists(newEventParams.statusByte, newEventParams.gridColumn, newEventParams.gridRow) != NULL) assert(0);
+    if(getPointerToEventNodeIfExists(newEventParams.statusByte, newEventParams.gridRow, newEventParams.gridColumn) != NULL) assert(0);
 
     if((CLEAR_LOWER_NIBBLE(newEventParams.statusByte) == MIDI_NOTE_ON_MSG) && (newEventParams.durationInSteps > 0))
     {
@@ -129,7 +174,7 @@ void gridManager_addNewMidiEventToGrid(MidiEventParams newEventParams)
     newNodePtr->statusByte = newEventParams.statusByte;
     //newNodePtr->durationInSteps = newEventParams.durationInSteps;
     memcpy(&newNodePtr->dataBytes, &newEventParams.dataBytes, MAX_DATA_BYTES);
-    //TODO: ADD RGB COLOUR CODE ASSIGNMENT - CURRENTLY HARDCODED
+    newNodePtr->rgbColourCode = gridColourMap_getNoteColour(newEventParams.statusByte, newEventParams.dataBytes[MIDI_VELOCITY_IDX]);
 
 
     if((g_GridData.gridLinkedListHeadPtrs[newEventParams.gridRow] != NULL) && 
@@ -201,6 +246,8 @@ void gridManager_addNewMidiEventToGrid(MidiEventParams newEventParams)
     {
         addCorrespondingNoteOff(newNodePtr, newEventParams.durationInSteps);
     } 
+
+    rebuildRowNoteSpans(newEventParams.gridRow);
 }
 
 
@@ -245,6 +292,8 @@ void gridManager_removeMidiEventFromGrid(MidiEventParams midiEventParams)
             assert(0);
             break;
     }
+
+    rebuildRowNoteSpans(midiEventParams.gridRow);
 }
 
 
@@ -366,6 +415,7 @@ void gridManager_updateMidiEventParameters(MidiEventParams eventParams)
             //it should be deleted and a new note placed at the desired coordinate.
             //MORE EDITING FEATURES WILL BE ADDED LATER!
             nodeToUpdatePtr->dataBytes[MIDI_VELOCITY_IDX] = eventParams.dataBytes[MIDI_VELOCITY_IDX];
+            nodeToUpdatePtr->rgbColourCode = gridColourMap_getNoteColour(nodeToUpdatePtr->statusByte, nodeToUpdatePtr->dataBytes[MIDI_VELOCITY_IDX]);
 
             //We may also need to update the grid column of the 
             //corresponding note-off message if the note duration
@@ -380,6 +430,7 @@ void gridManager_updateMidiEventParameters(MidiEventParams eventParams)
             break;
     }
 
+    rebuildRowNoteSpans(eventParams.gridRow);
 }
 
 
@@ -403,7 +454,7 @@ void gridManager_printAllLinkedListEventNodesFromBase(uint16_t rowNum)
     {
         ESP_LOGI(LOG_TAG, "Event node position in list: %d", ++nodeCount);
         ESP_LOGI(LOG_TAG, "Event status: %0x", tempNodePtr->statusByte);
-        ESP_LOGI(LOG_TAG, "DeltaTime: %ld", tempNodePtr->deltaTime);
+        ESP_LOGI(LOG_TAG, "DeltaTime: %" PRIu32, tempNodePtr->deltaTime);
         ESP_LOGI(LOG_TAG, "Column: %d", tempNodePtr->column);
         if(tempNodePtr->nextPtr == NULL) break;
         else tempNodePtr = tempNodePtr->nextPtr;
@@ -441,7 +492,7 @@ uint32_t gridManager_gridDataToMidiFile(uint8_t * midiFileBufferPtr, uint32_t bu
     generateMidiFileTemplate(midiFileBufferPtr, g_GridData.sequencerPPQN, 120);
     generateDeltaTimesForCurrentGrid();
 
-    const uint8_t * trackChunkBasePtr = (midiFileBufferPtr + MIDI_FILE_TRACK_HEADER_OFFSET);
+    uint8_t * const trackChunkBasePtr = (midiFileBufferPtr + MIDI_FILE_TRACK_HEADER_OFFSET);
     midiFileBufferPtr += MIDI_FILE_MIDI_EVENTS_OFFSET;
 
     //We're going to process the entire grid one grid coordinate at a time, the amount of grid rows is fixed,
@@ -781,7 +832,163 @@ void gridManager_midiFileToGrid(uint8_t * midiFileBufferPtr, uint32_t bufferSize
     {
         ESP_LOGI(LOG_TAG, "midiFileToGrid SUCCESS, total columns in project: %d", totalColumnCount);
         g_GridData.totalGridColumns = ++totalColumnCount; //Add one to remove zero base
+
+        //Note-offs were added manually while the file was processed, so
+        //spans are only complete now that every event is on the grid
+        for(uint8_t a = 0; a < TOTAL_MIDI_NOTES; ++a) rebuildRowNoteSpans(a);
+    }
+}
+
+
+//---- Public
+uint32_t gridManager_compilePlaybackEventList(MidiPlaybackEvent * eventListPtr, uint32_t maxNumEvents, uint8_t tempoBPM)
+{
+    //This function flattens the current grid data into a list of
+    //playback events, sorted by time. Each event is given an absolute
+    //timestamp (ms from start of sequence) so that the playback stream
+    //can be sent ahead of the playhead without the receiver needing to
+    //reconstruct timing from delta-times.
+
+    //Events that share a grid column are listed with all note-off
+    //events first, so that a note ending on the same step another
+    //starts on the same row is never cut short by the receiver.
+
+    //RETURNS: The number of events written to the event list.
+
+    assert(eventListPtr != NULL);
+    assert(tempoBPM > 0);
+
+    //Each row keeps its own read cursor, so every node in the
+    //grid is only visited once while the list is compiled.
+    GridEventNode * rowCursorPtrs[TOTAL_MIDI_NOTES];
+    GridEventNode * nodePtr = NULL;
+    uint32_t numEvents = 0;
+    uint32_t stepTimeMicros = gridManager_getStepTimeMicros(tempoBPM);
+    uint32_t columnTimestampMs;
+    bool isNoteOffPass;
+
+    memcpy(rowCursorPtrs, g_GridData.gridLinkedListHeadPtrs, sizeof(rowCursorPtrs));
+
+    for(uint16_t currentTargetColumn = 0; currentTargetColumn <= g_GridData.totalGridColumns; ++currentTargetColumn)
+    {
+        columnTimestampMs = ((uint64_t)currentTargetColumn * stepTimeMicros) / 1000;
+
+        //Two passes per column, note-offs first then everything else
+        for(uint8_t pass = 0; pass < 2; ++pass)
+        {
+            isNoteOffPass = (pass == 0);
+
+            for(uint8_t currentRow = 0; currentRow < TOTAL_MIDI_NOTES; ++currentRow)
+            {
+                nodePtr = rowCursorPtrs[currentRow];
+
+                while((nodePtr != NULL) && (nodePtr->column == currentTargetColumn))
+                {
+                    if((CLEAR_LOWER_NIBBLE(nodePtr->statusByte) == MIDI_NOTE_OFF_MSG) == isNoteOffPass)
+                    {
+                        if(numEvents >= maxNumEvents)
+                        {
+                            ESP_LOGE(LOG_TAG, "Error: Playback event list full, sequence truncated");
+                            return numEvents;
+                        }
+
+                        eventListPtr[numEvents].timestampMs = columnTimestampMs;
+                        eventListPtr[numEvents].statusByte = nodePtr->statusByte;
+                        eventListPtr[numEvents].dataBytes[0] = nodePtr->dataBytes[MIDI_NOTE_NUM_IDX];
+                        eventListPtr[numEvents].dataBytes[1] = nodePtr->dataBytes[MIDI_VELOCITY_IDX];
+                        ++numEvents;
+                    }
+                    nodePtr = nodePtr->nextPtr;
+                }
+
+                //The cursor only moves on once both passes for this column are complete
+                if(!isNoteOffPass) rowCursorPtrs[currentRow] = nodePtr;
+            }
+        }
     }
+
+    return numEvents;
+}
+
+
+//---- Public
+uint32_t gridManager_computeGridChecksum(uint32_t * numEventsPtr)
+{
+    //Returns a 32-bit FNV-1a hash over every event node currently
+    //in the grid. The base unit computes the same hash over its own
+    //copy of the project, if the two ever disagree (a lost or out
+    //of order edit delta) the base unit can request a full resync.
+
+    //Nodes are hashed row by row (row 0 first), in linked list order,
+    //using the row, column, status byte and both midi data bytes.
+
+    assert(numEventsPtr != NULL);
+
+    GridEventNode * nodePtr = NULL;
+    uint32_t checksum = GRID_CHECKSUM_FNV_OFFSET_BASIS;
+    uint8_t hashBytes[GRID_CHECKSUM_NUM_BYTES_PER_EVENT];
+    *numEventsPtr = 0;
+
+    for(uint8_t currentRow = 0; currentRow < TOTAL_MIDI_NOTES; ++currentRow)
+    {
+        nodePtr = g_GridData.gridLinkedListHeadPtrs[currentRow];
+        while(nodePtr != NULL)
+        {
+            hashBytes[0] = currentRow;
+            hashBytes[1] = (uint8_t)(nodePtr->column & 0xFF);
+            hashBytes[2] = (uint8_t)(nodePtr->column >> NUM_BITS_IN_BYTE);
+            hashBytes[3] = nodePtr->statusByte;
+            hashBytes[4] = nodePtr->dataBytes[MIDI_NOTE_NUM_IDX];
+            hashBytes[5] = nodePtr->dataBytes[MIDI_VELOCITY_IDX];
+
+            for(uint8_t idx = 0; idx < GRID_CHECKSUM_NUM_BYTES_PER_EVENT; ++idx)
+            {
+                checksum ^= hashBytes[idx];
+                checksum *= GRID_CHECKSUM_FNV_PRIME;
+            }
+
+            ++(*numEventsPtr);
+            nodePtr = nodePtr->nextPtr;
+        }
+    }
+
+    return checksum;
+}
+
+
+//---- Public
+uint16_t gridManager_getTotalGridColumns(void)
+{
+    return g_GridData.totalGridColumns;
+}
+
+
+//---- Public
+uint32_t gridManager_getStepTimeMicros(uint8_t tempoBPM)
+{
+    //RETURNS: The duration of a single grid step (column) in
+    //microseconds, for the given tempo and project quantization.
+    assert(tempoBPM > 0);
+    return (MICROSECONDS_PER_MINUTE * NUM_QUATERS_IN_WHOLE_NOTE) / ((uint32_t)tempoBPM * g_GridData.projectQuantization);
+}
+
+
+//---- Public
+void gridManager_setPlayheadColumn(uint16_t columnNum)
+{
+    //Pass 'GRID_NO_OVERLAY_COLUMN' to hide the playhead
+    g_GridOverlay.playheadColumn = columnNum;
+    g_GridOverlay.isPlaneStale = true;
+}
+
+
+//---- Public
+void gridManager_setSelectedCell(uint16_t columnNum, uint8_t rowNum)
+{
+    //Pass 'GRID_NO_OVERLAY_COLUMN' as the column to clear the selection
+    g_GridOverlay.selectedColumn = columnNum;
+    g_GridOverlay.selectedRow = rowNum;
+    g_GridOverlay.isPlaneStale = true;
 }
 
 
@@ -790,17 +997,16 @@ void gridManager_updateGridLEDs(uint8_t rowOffset, uint16_t columnOffset)
 {
     //This function updates all rgbs leds of the switch matrix 
 
-    GridEventNode * tempNodePtr = NULL;
-    GridEventNode * searchPtr = NULL;
-    bool abortCurrentRow = false;
-    bool runOncePerRow = false;
-    uint16_t numGridSteps = 0;
+    const RowNoteSpans * rowSpansPtr = NULL;
+    uint32_t spanColourCode;
+    const uint16_t lastColumnExclusive = columnOffset + NUM_SEQUENCER_PHYSICAL_COLUMNS;
+    uint16_t firstSpanIdx;
+    uint16_t lowIdx;
+    uint16_t highIdx;
+    uint16_t clippedStart;
+    uint16_t clippedEnd;
     uint8_t relativeRow = 0;
-    uint16_t relativeColumn = 0;
-    rgbLedColour_t gridRGBCodes[48] = {rgb_off};
-
-    bool keepSearchingCurrentRow = false;
-    bool withinNoteDuration = true;
+    rgbLedColour_t gridRGBCodes[NUM_SEQUENCER_PHYSICAL_ROWS * NUM_SEQUENCER_PHYSICAL_COLUMNS] = {rgb_off};
 
     //The pysical sequencer grid is made up of a matrix of switches, where each
     //switch has its own assosiated RGB led, this function handles the setting
@@ -823,124 +1029,61 @@ void gridManager_updateGridLEDs(uint8_t rowOffset, uint16_t columnOffset)
     //Rows:    5 -> (5 + (NUM_SEQUENCER_PHYSICAL_ROWS - 1))
     //Columns: 7 -> (7 + (NUM_SEQUENCER_PHYSICAL_COLUMNS - 1))
 
-    //NOTE: Current version is hardcoded to display channel 0 note only ATM
-    //will add input arguments for channel and other midi event types after v0.1
+    //Rather than walk each rows linked list, the cached note spans for
+    //each row are clipped to the window. The first span that could be
+    //visible is found with a binary search, so the cost of a render
+    //doesn't depend on how far into the project the window is scrolled.
+
+    //Each span carries the colour of its note-on (set from channel and velocity
+    //by the colour map when the note is placed), so no colour decisions are
+    //made here. The playhead and selection overlays are ORed in at the end.
 
     //Range check the number of rows, maybe add limit for columns later
     assert(rowOffset <= ((TOTAL_NUM_VIRTUAL_GRID_ROWS - 1) - (NUM_SEQUENCER_PHYSICAL_ROWS - 1)));
 
-    //Iterate through each grid row that fall within the specified area. Each row 
-    //stores midi events as nodes in a linked list. A row may have zero or more event nodes.
     for(uint8_t rowNum = rowOffset; rowNum < (rowOffset + NUM_SEQUENCER_PHYSICAL_ROWS); ++rowNum)
     { 
-        runOncePerRow = true;
-        abortCurrentRow = false;
+        rowSpansPtr = &g_rowNoteSpansPtr[rowNum];
 
-        //We only need to do further processing for the 
-        //current row if has midi events allocated to it 
-        if(g_GridData.gridLinkedListHeadPtrs[rowNum] != NULL)
+        //Find the first span which ends after the window starts
+        lowIdx = 0;
+        highIdx = rowSpansPtr->numSpans;
+        while(lowIdx < highIdx)
         {
-            //A NULL pointer here indcates a system fault
-            assert(g_GridData.gridLinkedListTailPtrs[rowNum] != NULL);
-
-            //If the column of the last event node in the current rows list is LESS 
-            //than the columnOffset no further processing is required for the current row
-            if(g_GridData.gridLinkedListTailPtrs[rowNum]->column >= columnOffset)
-            {
-                //Grab a direct ptr to current rows linked list
-                tempNodePtr = g_GridData.gridLinkedListHeadPtrs[rowNum];
-
-                do
-                {
-                    keepSearchingCurrentRow = false;
-
-                    //These conditionals are used to catch a condition where a note-on and note-off
-                    //pair exist before and after (respectively) the area of the virtual grid to be displayed,
-                    //without these a condition where an entire row should be illuminated, but isnt can occur.
-                    if(CLEAR_LOWER_NIBBLE(tempNodePtr->statusByte) == MIDI_NOTE_ON_MSG) withinNoteDuration = true;
-                    else if(CLEAR_LOWER_NIBBLE(tempNodePtr->statusByte) == MIDI_NOTE_OFF_MSG) withinNoteDuration = false;
-
-                    if((tempNodePtr->column >= columnOffset) && (tempNodePtr->column < (columnOffset + NUM_SEQUENCER_PHYSICAL_COLUMNS)))
-                    {
-                        //We reach here if the current node falls
-                        //within the grid area that we want to display
-
-                        //remove offset to get zero base hardware column num
-                        relativeColumn = tempNodePtr->column - columnOffset;
-            
-                        if((CLEAR_LOWER_NIBBLE(tempNodePtr->statusByte) == MIDI_NOTE_OFF_MSG) && (runOncePerRow))
-                        {
-                            //We only get here when the first event node within the area to be displayed is a note off event
-                            //while note-off events are not themselves displayed, if the relativeColumn is greater than zero
-                            //it means we have an existing note duration that overruns into the target window.
-                            //Any grid steps that are a note duration overrun must be displayed.
-
-                            numGridSteps = tempNodePtr->column - columnOffset;
-                            runOncePerRow = false;
-
-                            for(uint8_t a = 0; a < numGridSteps; ++a)
-                            {
-                                //Set the colour of the grid coordinates that make up the note duration overrun
-                                gridRGBCodes[0 + (relativeRow * NUM_SEQUENCER_PHYSICAL_COLUMNS) + a] = rgb_green;
-                                //if((relativeColumn + a) > NUM_SEQUENCER_PHYSICAL_COLUMNS) break;
-                            }
-                        }
-                        else if(CLEAR_LOWER_NIBBLE(tempNodePtr->statusByte) == MIDI_NOTE_ON_MSG)
-                        {
-                            //A note-on event has been found within the target window
-                            //we must now find the duration of that note off event in steps
-
-                            //Search for and get pointer to corresponding note-off
-                            searchPtr = getPointerToCorespondingNoteOffEventNode(tempNodePtr);
-                            if(searchPtr != NULL) 
-                            {
-                                //We get here if the corresponding note-off to 
-                                //the current note-on event has been found to exist
-                                numGridSteps = searchPtr->column - tempNodePtr->column;
-
-                            }
-                            else
-                            {
-                                assert(0);  //A missing note-off is a system fault
-                            } 
-
-                            for(uint8_t a = 0; a < numGridSteps; ++a)
-                            {
-                                //Set the colour of the grid coordinates that make up the current notes duration
-                                if((relativeColumn + a) > (NUM_SEQUENCER_PHYSICAL_COLUMNS - 1)) break;
-                                gridRGBCodes[relativeColumn + (relativeRow * NUM_SEQUENCER_PHYSICAL_COLUMNS) + a] = rgb_green;
-                            }
+            firstSpanIdx = (lowIdx + highIdx) / 2;
+            if(rowSpansPtr->spans[firstSpanIdx].endColumn <= columnOffset) lowIdx = firstSpanIdx + 1;
+            else highIdx = firstSpanIdx;
+        }
 
-                            tempNodePtr = searchPtr;
-                        }
-                    }
+        //Clip each span that starts before the window ends
+        for(uint16_t spanIdx = lowIdx; spanIdx < rowSpansPtr->numSpans; ++spanIdx)
+        {
+            if(rowSpansPtr->spans[spanIdx].startColumn >= lastColumnExclusive) break;
 
-                    if(tempNodePtr->nextPtr !=  NULL) //If there are more nodes in the current rows list
-                    {
-                        //If the column number of the next node doesnt exceed the maximum
-                        //area we can display then we need to update tempNodePtr and keep searching
-                        if(tempNodePtr->nextPtr->column < (columnOffset + NUM_SEQUENCER_PHYSICAL_COLUMNS))
-                        {
-                            tempNodePtr = tempNodePtr->nextPtr;
-                            keepSearchingCurrentRow = true;
-                        }
-                        else if(withinNoteDuration)
-                        {
-                            for(uint8_t a = 0; a < NUM_SEQUENCER_PHYSICAL_COLUMNS; ++a)
-                            {
-                                //Light all steps in the row
-                                gridRGBCodes[0 + (relativeRow * NUM_SEQUENCER_PHYSICAL_COLUMNS) + a] = rgb_green;
-                            }
-                        }
-                    }
+            clippedStart = (rowSpansPtr->spans[spanIdx].startColumn > columnOffset) ? rowSpansPtr->spans[spanIdx].startColumn : columnOffset;
+            clippedEnd = (rowSpansPtr->spans[spanIdx].endColumn < lastColumnExclusive) ? rowSpansPtr->spans[spanIdx].endColumn : lastColumnExclusive;
+            spanColourCode = rowSpansPtr->spans[spanIdx].rgbColourCode;
 
-                }while(keepSearchingCurrentRow);
+            for(uint16_t column = clippedStart; column < clippedEnd; ++column)
+            {
+                //Set the colour of the grid coordinates that make up the note duration
+                gridRGBCodes[(relativeRow * NUM_SEQUENCER_PHYSICAL_COLUMNS) + (column - columnOffset)] = (rgbLedColour_t)spanColourCode;
             }
         }
         ++relativeRow; //Increment zero offset hardware row
     }
 
-    ledDrivers_writeEntireGrid(gridRGBCodes);
+    if(g_GridOverlay.isPlaneStale || (g_GridOverlay.planeRowOffset != rowOffset) || (g_GridOverlay.planeColumnOffset != columnOffset))
+    {
+        rebuildOverlayPlane(rowOffset, columnOffset);
+    }
+
+    for(uint8_t a = 0; a < (NUM_SEQUENCER_PHYSICAL_ROWS * NUM_SEQUENCER_PHYSICAL_COLUMNS); ++a)
+    {
+        gridRGBCodes[a] = (rgbLedColour_t)(gridRGBCodes[a] | g_GridOverlay.plane[a]);
+    }
+
+    ledDrivers_submitFrame(gridRGBCodes);
 }
 
 
@@ -966,6 +1109,76 @@ static void freeAllGridData(void)
     for(uint8_t a = 0; a < TOTAL_MIDI_NOTES; ++a)
     {   
         genericDLL_freeEntireLinkedList(&g_GridData.gridLinkedListHeadPtrs[a], &g_GridData.gridLinkedListTailPtrs[a]);
+        g_rowNoteSpansPtr[a].numSpans = 0;
+    }
+}
+
+
+//---- Private
+static void rebuildOverlayPlane(uint8_t rowOffset, uint16_t columnOffset)
+{
+    //Rebuilds the overlay plane for the current display window, the
+    //playhead lights its whole column, the selection a single cell.
+
+    memset(g_GridOverlay.plane, 0, sizeof(g_GridOverlay.plane));
+
+    if((g_GridOverlay.playheadColumn >= columnOffset) && (g_GridOverlay.playheadColumn < (columnOffset + NUM_SEQUENCER_PHYSICAL_COLUMNS)))
+    {
+        for(uint8_t row = 0; row < NUM_SEQUENCER_PHYSICAL_ROWS; ++row)
+        {
+            g_GridOverlay.plane[(row * NUM_SEQUENCER_PHYSICAL_COLUMNS) + (g_GridOverlay.playheadColumn - columnOffset)] |= COLOUR_MAP_PLAYHEAD_OVERLAY;
+        }
+    }
+
+    if((g_GridOverlay.selectedColumn >= columnOffset) && (g_GridOverlay.selectedColumn < (columnOffset + NUM_SEQUENCER_PHYSICAL_COLUMNS)) &&
+       (g_GridOverlay.selectedRow >= rowOffset) && (g_GridOverlay.selectedRow < (rowOffset + NUM_SEQUENCER_PHYSICAL_ROWS)))
+    {
+        g_GridOverlay.plane[((g_GridOverlay.selectedRow - rowOffset) * NUM_SEQUENCER_PHYSICAL_COLUMNS) + (g_GridOverlay.selectedColumn - columnOffset)] |= COLOUR_MAP_SELECTION_OVERLAY;
+    }
+
+    g_GridOverlay.planeRowOffset = rowOffset;
+    g_GridOverlay.planeColumnOffset = columnOffset;
+    g_GridOverlay.isPlaneStale = false;
+}
+
+
+//---- Private
+static void rebuildRowNoteSpans(uint8_t rowNum)
+{
+    //Walks the rows linked list and records each note-on/note-off
+    //pair as a span. Notes on the same row never overlap, so each
+    //note-off simply closes the most recent note-on. A note-on
+    //without a note-off yet (while a midi file is being loaded)
+    //is left out, the spans are rebuilt once loading completes.
+
+    assert(rowNum < TOTAL_MIDI_NOTES);
+
+    RowNoteSpans * rowSpansPtr = &g_rowNoteSpansPtr[rowNum];
+    GridEventNode * nodePtr = g_GridData.gridLinkedListHeadPtrs[rowNum];
+    uint16_t openStartColumn = 0;
+    uint32_t openColourCode = 0;
+    bool isNoteOpen = false;
+
+    rowSpansPtr->numSpans = 0;
+
+    while(nodePtr != NULL)
+    {
+        if(CLEAR_LOWER_NIBBLE(nodePtr->statusByte) == MIDI_NOTE_ON_MSG)
+        {
+            openStartColumn = nodePtr->column;
+            openColourCode = nodePtr->rgbColourCode;
+            isNoteOpen = true;
+        }
+        else if((CLEAR_LOWER_NIBBLE(nodePtr->statusByte) == MIDI_NOTE_OFF_MSG) && isNoteOpen)
+        {
+            assert(rowSpansPtr->numSpans < MAX_NOTE_SPANS_PER_ROW);
+            rowSpansPtr->spans[rowSpansPtr->numSpans].startColumn = openStartColumn;
+            rowSpansPtr->spans[rowSpansPtr->numSpans].endColumn = nodePtr->column;
+            rowSpansPtr->spans[rowSpansPtr->numSpans].rgbColourCode = openColourCode;
+            ++rowSpansPtr->numSpans;
+            isNoteOpen = false;
+        }
+        nodePtr = nodePtr->nextPtr;
     }
 }
 
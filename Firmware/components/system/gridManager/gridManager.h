@@ -24,6 +24,8 @@
 
 #define MAX_DATA_BYTES 4
 #define NUM_OCTAVES 8
+#define MICROSECONDS_PER_MINUTE 60000000UL
+#define GRID_NO_OVERLAY_COLUMN 0xFFFF
 
 typedef struct 
 {
@@ -55,6 +57,12 @@ void gridManager_removeMidiEventFromGrid(MidiEventParams midiEventParams);
 void gridManager_addNewMidiEventToGrid(MidiEventParams newEventParams);
 void gridManager_midiFileToGrid(uint8_t * midiFileBufferPtr, uint32_t bufferSize);
 uint32_t gridManager_gridDataToMidiFile(uint8_t * midiFileBufferPtr, uint32_t bufferSize);
+uint32_t gridManager_compilePlaybackEventList(MidiPlaybackEvent * eventListPtr, uint32_t maxNumEvents, uint8_t tempoBPM);
+uint32_t gridManager_computeGridChecksum(uint32_t * numEventsPtr);
+uint16_t gridManager_getTotalGridColumns(void);
+uint32_t gridManager_getStepTimeMicros(uint8_t tempoBPM);
+void gridManager_setPlayheadColumn(uint16_t columnNum);
+void gridManager_setSelectedCell(uint16_t columnNum, uint8_t rowNum);
 void gridManager_updateGridLEDs(uint8_t rowOffset, uint16_t columnOffset);
 void gridManager_printAllLinkedListEventNodesFromBase(uint16_t midiNoteNum);
 void gridManager_resetSequencerGrid(uint8_t quantizationSetting);
@@ -1,9 +1,11 @@
+#include <string.h>
 #include "esp_log.h"
 #include "include/system.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
 #include "freertos/queue.h"
+#include "inputEventBus.h"
 #include "guiMenu.h"
 #include "switchMatrix.h"
 #include "rotaryEncoders.h"
@@ -12,6 +14,9 @@
 #include "fileSys.h"
 #include "midiHelper.h"
 #include "gridManager/gridManager.h"
+#include "gridGestures/gridGestures.h"
+#include "ledDrivers.h"
+#include "esp_timer.h"
 
 #define LOG_TAG "systemComponent"
 
@@ -20,14 +25,41 @@
 #define BLE_CLIENT_TASK_STACK_SIZE      8192
 #define GUI_MENU_TASK_STACK_SIZE        8192
 #define MATRIX_SCANNER_TASK_STACK_SIZE  4096
+#define LED_REFRESH_TASK_STACK_SIZE     4096
 
 #define GUI_MENU_TASK_PRIORITY          2
 #define GRID_MANAGER_TASK_PRIORIRY      1
 #define BLE_CLIENT_TASK_PRIORITY        1
+#define LED_REFRESH_TASK_PRIORITY       2
+#define SYSTEM_TASK_PRIORITY            3
 #define FILE_BUFFER_SIZE                1024 * 1024         //1MB (8MB available on this part)
+#define PLAYBACK_EVENT_LIST_MAX_EVENTS  4096
+#define DEFAULT_PROJECT_TEMPO           120
+#define GRID_CHECKSUM_PERIOD_MS         2000
+#define INPUT_LATENCY_LOG_INTERVAL      256     //Grid refreshes between latency reports
+
+
+//Note parameter changes from the menu arrive as a stream while the user scrubs
+//a value, within a batch only the latest value of each is applied, see
+//'applyPendingNoteEdit'
+typedef struct
+{
+    uint8_t hasVelocity : 1;
+    uint8_t hasDuration : 1;
+    uint8_t velocity;
+    uint8_t durationInSteps;
+    uint16_t numCommands;       //Commands folded into this edit
+} PendingNoteEdit;
 
 
 static void initRTOSTasks(void * menuParams, void * switchMatrixParams, void * bleParams);
+static bool sendGridEditDeltaToBle(uint8_t editType, MidiEventParams * eventParamsPtr);
+static void sendGridCoordinateParamsToMenu(MidiEventParams * eventParamsPtr);
+static void playbackTickCallback(void * args);
+static void stopPlayhead(ledDriverBusStats_t * busStatsAtStartPtr, int64_t playbackStartMicros);
+static void recordInputLatency(uint32_t wakeMicros, uint32_t ledSubmitMicros, bool hasInput, uint32_t oldestInputMicros);
+static void logInputLatency(void);
+static bool applyPendingNoteEdit(PendingNoteEdit * pendingEditPtr, MidiEventParams * eventParamsPtr, bool * isResyncPendingPtr);
 
 
 //This type will act as a container for all 
@@ -46,6 +78,17 @@ typedef struct
 //holding the midi file data relating to the current project.
 uint8_t * g_midiFileBufferPtr = NULL;
 
+//These pointers are also allocated memory from PSRAM at system startup.
+//Before playback starts the grid data is compiled into a list of
+//timestamped events, which the BLE client streams to the base unit.
+//The BLE client reads the list for as long as it streams it, so each
+//start compiles into the other list and hands that one over instead.
+//The BLE client moves off the old list as soon as it takes the new
+//one from its queue, well within the time it takes to start playback
+//again from the menu (an upload holds up the queue, but no list is
+//streamed during one), so the list written to is never being read.
+MidiPlaybackEvent * g_playbackEventListPtrs[2] = {NULL, NULL};
+
 
 
 
@@ -67,6 +110,33 @@ static StaticTask_t g_SwitchMatrixTaskBuffer;
 static StackType_t g_SwitchMatrixTaskStack[MATRIX_SCANNER_TASK_STACK_SIZE];
 
 
+//LED refresh RTOS task
+static TaskHandle_t g_LedRefreshTaskHandle;
+static StaticTask_t g_LedRefreshTaskBuffer;
+static StackType_t g_LedRefreshTaskStack[LED_REFRESH_TASK_STACK_SIZE];
+
+
+//Time taken from the system task waking (and from the input itself) to the
+//grid LED frame being submitted, see 'recordInputLatency'
+typedef struct
+{
+    uint32_t numRefreshes;
+    uint32_t wakeToLedTotalMicros;
+    uint32_t wakeToLedMaxMicros;
+    uint32_t numInputRefreshes;
+    uint32_t inputToLedTotalMicros;
+    uint32_t inputToLedMaxMicros;
+} InputLatencyStats;
+
+static InputLatencyStats g_inputLatencyStats;
+
+
+//The playback tick fires once per grid step (sequencer column) during playback,
+//it wakes the system task which then moves the playhead on the grid LEDs.
+static esp_timer_handle_t g_playbackTickTimer;
+static volatile uint32_t g_playbackStepCount = 0;
+
+
 
 
 
@@ -75,14 +145,37 @@ static StackType_t g_SwitchMatrixTaskStack[MATRIX_SCANNER_TASK_STACK_SIZE];
 void system_EntryPoint(void)
 {
     uint8_t operatingMode = 0;
-    MenuQueueItem menuInputEvent;
-    SwitchMatrixQueueItem swMatrixEvent;
+    InputEvent inputEvent;
+    GridGesture gridGesture;
     MidiEventParams midiEventParams;
     ProjectParameters projectParams = {0};
 
     bool isGridActive = false;
     bool hasEncoderInput = false;
     bool hasGridInput = false;
+    uint32_t numPlaybackEvents = 0;
+    uint8_t playbackEventListIdx = 0;
+    HostToBleQueueItem bleQueueItem = {0};
+    uint8_t bleResponse = 0;
+    uint32_t midiFileNumBytes = 0;
+    bool isUploadActive = false;
+    bool isResyncPending = false;
+    TickType_t lastChecksumTick = 0;
+    TickType_t waitTicks;
+    bool isGridRefreshNeeded = false;
+    bool hasInputForRefresh = false;
+    uint32_t wakeMicros = 0;
+    uint32_t oldestInputMicros = 0;
+    bool isPlaybackActive = false;
+    uint32_t playheadStep = 0;
+    uint32_t stepTimeMicros = 0;
+    int64_t playbackStartMicros = 0;
+    ledDriverBusStats_t busStatsAtStart;
+    PendingNoteEdit pendingNoteEdit = {0};
+    esp_timer_create_args_t playbackTickTimerArgs = {
+        .callback = playbackTickCallback,
+        .name = "playbackTick"
+    };
 
     //Allocate midi file buffer from PSRAM
     g_midiFileBufferPtr = heap_caps_malloc(FILE_BUFFER_SIZE, MALLOC_CAP_SPIRAM);
@@ -90,128 +183,295 @@ void system_EntryPoint(void)
     //Keep a read-only record of the file cache base address
     const uint8_t * const midiFileBufferBASEPtr = g_midiFileBufferPtr;
 
+    //Allocate both playback event lists from PSRAM
+    for(uint8_t idx = 0; idx < 2; ++idx)
+    {
+        g_playbackEventListPtrs[idx] = heap_caps_malloc(PLAYBACK_EVENT_LIST_MAX_EVENTS * sizeof(MidiPlaybackEvent), MALLOC_CAP_SPIRAM);
+        assert(g_playbackEventListPtrs[idx] != NULL);
+    }
+
     //Initialize and mount the file system
     FileSysPublicData FileSysInfo = fileSys_init();
     assert(*FileSysInfo.isPartitionMountedPtr == true);
     
+    //All input to this task and the menu task arrives on the input event
+    //buses, so they must be ready before any producer is started
+    inputEventBus_init();
+    inputEventBus_setConsumer(inputBusSystem);
+
     //Initialize sub-modules
     IPSDisplay_init();
     rotaryEncoders_init();
     gridManager_init();
 
-    //Update system task priority
-    vTaskPrioritySet(NULL, 1);
+    //The task only runs when it has work to do, so it can run above the
+    //menu and LED refresh tasks and handle input as soon as it arrives
+    vTaskPrioritySet(NULL, SYSTEM_TASK_PRIORITY);
+
+    ESP_ERROR_CHECK(esp_timer_create(&playbackTickTimerArgs, &g_playbackTickTimer));
 
     //Now we want to initialize the RTOS tasks and assosiated
     //queues that make up the various system runtime processes.
     initRTOSTasks(&FileSysInfo, NULL, NULL);
-
+    wakeMicros = (uint32_t)esp_timer_get_time();
 
     while (1)
     {
-        if(xQueueReceive(g_MenuToSystemQueueHandle, &menuInputEvent, 0) == pdTRUE)
+        //Handle everything posted since the last pass in one batch. Edits only
+        //flag that the grid LEDs need refreshing, the frame is rendered and
+        //submitted once at the end, however many events were handled.
+        while(inputEventBus_take(inputBusSystem, &inputEvent))
+        {
+            if(!hasInputForRefresh)
+            {
+                //Events are taken oldest first
+                hasInputForRefresh = true;
+                oldestInputMicros = inputEvent.timestampMicros;
+            }
+
+            //Anything other than a note parameter change may read or move the
+            //note being edited, so the pending edit has to land before it
+            if((inputEvent.source != inputSourceMenu) ||
+               ((inputEvent.eventType != menuCmdSetNoteVelocity) && (inputEvent.eventType != menuCmdSetNoteDuration)))
+            {
+                if(applyPendingNoteEdit(&pendingNoteEdit, &midiEventParams, &isResyncPending)) isGridRefreshNeeded = true;
+            }
+
+            if(inputEvent.source == inputSourceMenu)
+            {
+                switch(inputEvent.eventType)
+                {
+                    case menuCmdSaveProject:
+                        ESP_LOGI(LOG_TAG, "Save current project");
+                        //uint32_t fileSize = gridManager_gridDataToMidiFile(midiFileBufferBASEPtr, FILE_BUFFER_SIZE);
+                        //fileSys_writeFile(char * c, midiFileBufferBASEPtr, fileSize, true);
+                        break;
+
+                    case menuCmdSetNoteVelocity:
+                        //Latest value wins, applied once the batch is drained
+                        pendingNoteEdit.hasVelocity = 1;
+                        pendingNoteEdit.velocity = inputEvent.payload[0];
+                        ++pendingNoteEdit.numCommands;
+                        break;
+
+                    case menuCmdSetNoteDuration:
+                        pendingNoteEdit.hasDuration = 1;
+                        pendingNoteEdit.durationInSteps = inputEvent.payload[0];
+                        ++pendingNoteEdit.numCommands;
+                        break;
+
+                    case menuCmdNewProject:
+                        ESP_LOGI(LOG_TAG, "Initialize new project params");
+                        //strcpy(projectParams.fileName, );
+                        //projectParams.projectTempo =
+                        //projectParams.quantization =
+                        //projectParams.gridDisplayColumnOffset = 0;
+                        //projectParams.gridDisplayRowOffset =
+                        break;
+
+                    case menuCmdLoadProject:
+                        ESP_LOGI(LOG_TAG, "Load project");
+                        //strcpy(projectParams.fileName, );
+                        //uint32_t fileSize = fileSys_readFile(projectParams.fileName, midiFileBufferBASEPtr, 0, true);
+                        //gridManager_midiFileToGrid(midiFileBufferBASEPtr, fileSize);
+                        break;
+
+                    case menuCmdStartPlayback:
+                        ESP_LOGI(LOG_TAG, "Start playback");
+                        //Never recompile the list the BLE client may still be streaming
+                        playbackEventListIdx ^= 1;
+                        numPlaybackEvents = gridManager_compilePlaybackEventList(g_playbackEventListPtrs[playbackEventListIdx], PLAYBACK_EVENT_LIST_MAX_EVENTS,
+                                                                (projectParams.projectTempo != 0) ? projectParams.projectTempo : DEFAULT_PROJECT_TEMPO);
+                        bleQueueItem.opcode = startPlayback;
+                        bleQueueItem.dataPtr = (uint8_t *)g_playbackEventListPtrs[playbackEventListIdx];
+                        bleQueueItem.dataLength = numPlaybackEvents * sizeof(MidiPlaybackEvent);
+                        xQueueSend(g_HostToBleQueueHandle, &bleQueueItem, 0);
+
+                        //Start the playhead, one tick per grid step
+                        stepTimeMicros = gridManager_getStepTimeMicros((projectParams.projectTempo != 0) ? projectParams.projectTempo : DEFAULT_PROJECT_TEMPO);
+                        g_playbackStepCount = 0;
+                        playheadStep = 0;
+                        gridManager_setPlayheadColumn(0);
+                        isGridRefreshNeeded = true;
+                        ledDrivers_getBusStats(&busStatsAtStart);
+                        ledDrivers_resetBusProfile();
+                        memset(&g_inputLatencyStats, 0, sizeof(g_inputLatencyStats));
+                        playbackStartMicros = esp_timer_get_time();
+                        if(isPlaybackActive) esp_timer_stop(g_playbackTickTimer);
+                        esp_timer_start_periodic(g_playbackTickTimer, stepTimeMicros);
+                        isPlaybackActive = true;
+                        break;
+
+                    case menuCmdStopPlayback:
+                        ESP_LOGI(LOG_TAG, "Stop playback");
+                        bleQueueItem.opcode = stopPlayback;
+                        bleQueueItem.dataPtr = NULL;
+                        bleQueueItem.dataLength = 0;
+                        xQueueSend(g_HostToBleQueueHandle, &bleQueueItem, 0);
+                        if(isPlaybackActive)
+                        {
+                            stopPlayhead(&busStatsAtStart, playbackStartMicros);
+                            isGridRefreshNeeded = true;
+                        }
+                        isPlaybackActive = false;
+                        break;
+
+
+                    default:
+                        assert(0);
+                        break;
+                }
+            }
+            else if(inputEvent.source == inputSourceSwitchMatrix)
+            {
+                gridGestures_processSwitchEvent(&inputEvent, &gridGesture);
+
+                if(gridGesture.gestureType == gridGesturePress)
+                {
+                    //We eneter here when the grid is active and a switch
+                    //within the grid has been pressed we must now retreive
+                    //details for the grid coordinate.
+                    midiEventParams = gridManager_getNoteParamsIfCoordinateFallsWithinExistingNoteDuration(gridGesture.column,  (gridGesture.row + 0x34), 0);
+
+                    if(midiEventParams.statusByte == 0)
+                    {
+                        //We eneter here when the midi event params retireved
+                        //from the grid manager show that there is no pre-existing
+                        //event at the grid coordinate pressed by the user.
+                        //We need to load default settings for the midi event
+                        //type and channel currently being edited.
+                        //NOTE: CURRENTLY ONLY SUPPORT CHANNEL 0 AND MIDI NOTE EVENTS.
+
+                        midiEventParams.gridColumn = gridGesture.column;
+                        midiEventParams.gridRow = (gridGesture.row + 0x34);
+                        midiEventParams.statusByte = 0x90; //sort later
+                        midiEventParams.durationInSteps = 1;
+                        midiEventParams.dataBytes[MIDI_NOTE_NUM_IDX] = (gridGesture.row + 0x34);
+                        midiEventParams.dataBytes[MIDI_VELOCITY_IDX] = 127;
+                        gridManager_addNewMidiEventToGrid(midiEventParams);
+                        if(!sendGridEditDeltaToBle(gridEditAdd, &midiEventParams)) isResyncPending = true;
+                    }
+
+                    //Highlight the pressed coordinate while it is being edited
+                    gridManager_setSelectedCell(gridGesture.column, (gridGesture.row + 0x34));
+                    isGridRefreshNeeded = true;
+
+                    //Send the coordinate parameters to menu to be displayed
+                    sendGridCoordinateParamsToMenu(&midiEventParams);
+                }
+                else if(gridGesture.gestureType == gridGestureSetDuration)
+                {
+                    //A note is held and a switch further along the same row
+                    //has been pressed, stretch/shrink the note to end there
+                    midiEventParams = gridManager_getNoteParamsIfCoordinateFallsWithinExistingNoteDuration(gridGesture.column,  (gridGesture.row + 0x34), 0);
+
+                    if(midiEventParams.statusByte != 0)
+                    {
+                        midiEventParams.durationInSteps = (gridGesture.endColumn - midiEventParams.gridColumn) + 1;
+
+                        //Can't overlap the next note on the row
+                        if((midiEventParams.stepsToNext != 0) && (midiEventParams.durationInSteps > midiEventParams.stepsToNext))
+                        {
+                            midiEventParams.durationInSteps = midiEventParams.stepsToNext;
+                        }
+
+                        gridManager_updateMidiEventParameters(midiEventParams);
+                        if(!sendGridEditDeltaToBle(gridEditUpdate, &midiEventParams)) isResyncPending = true;
+                        isGridRefreshNeeded = true;
+                        sendGridCoordinateParamsToMenu(&midiEventParams);
+                    }
+                }
+            }
+        }
+
+        //One grid update and one BLE delta for however many
+        //note parameter changes were posted in this batch
+        if(applyPendingNoteEdit(&pendingNoteEdit, &midiEventParams, &isResyncPending)) isGridRefreshNeeded = true;
+
+        while(xQueueReceive(g_BleToHostQueueHandle, &bleResponse, 0) == pdTRUE)
+        {
+            if(bleResponse == bleResyncRequested)
+            {
+                //The base units copy of the project has drifted from
+                //ours, the only way to recover is a full file transfer.
+                ESP_LOGI(LOG_TAG, "Base unit requested resync");
+                isResyncPending = true;
+            }
+            else if(bleResponse == bleUploadFinished)
+            {
+                isUploadActive = false;
+            }
+            else if(bleResponse == bleUploadFailed)
+            {
+                //Whatever part of the file did arrive can't be used, send it all
+                //again. If the connection was lost the base unit asks for a
+                //resync once it is back, so there is no point retrying now.
+                ESP_LOGW(LOG_TAG, "File upload failed");
+                isUploadActive = false;
+                if(isConnectedToTargetDevice) isResyncPending = true;
+            }
+        }
+
+        //The BLE client reads the file buffer while it uploads, so it can only be
+        //rebuilt once any earlier upload is over. Edits made in the meantime go
+        //out as deltas after the upload, so nothing is lost by waiting.
+        if(isResyncPending && !isUploadActive)
         {
-            vTaskPrioritySet(NULL, 3);
-            switch(menuInputEvent.eventOpcode)
+            midiFileNumBytes = gridManager_gridDataToMidiFile(g_midiFileBufferPtr, FILE_BUFFER_SIZE);
+            bleQueueItem.opcode = 0x55;
+            bleQueueItem.dataPtr = g_midiFileBufferPtr;
+            bleQueueItem.dataLength = midiFileNumBytes;
+            if(xQueueSend(g_HostToBleQueueHandle, &bleQueueItem, 0) == pdTRUE)
             {
-                //NOTE: Literals will be replaced with enumerations later
-
-                case 1: 
-                    ESP_LOGI(LOG_TAG, "Save current project");
-                    //uint32_t fileSize = gridManager_gridDataToMidiFile(midiFileBufferBASEPtr, FILE_BUFFER_SIZE);
-                    //fileSys_writeFile(char * c, midiFileBufferBASEPtr, fileSize, true);
-                    break;
-
-                case 2:
-                    ESP_LOGI(LOG_TAG, "Updated note velocity");
-                    midiEventParams.dataBytes[MIDI_VELOCITY_IDX] = menuInputEvent.payload[0];
-                    gridManager_updateMidiEventParameters(midiEventParams);
-                    break;
-
-                case 3:
-                    ESP_LOGI(LOG_TAG, "Updated note duration");
-                    midiEventParams.durationInSteps = menuInputEvent.payload[0];
-                    gridManager_updateMidiEventParameters(midiEventParams);
-                    gridManager_updateGridLEDs(0x34,0);
-                    break;
-
-                case 4:
-                    ESP_LOGI(LOG_TAG, "Initialize new project params");
-                    //strcpy(projectParams.fileName, );
-                    //projectParams.projectTempo =
-                    //projectParams.quantization =
-                    //projectParams.gridDisplayColumnOffset = 0;
-                    //projectParams.gridDisplayRowOffset =
-                    break;
-
-                case 5:
-                    ESP_LOGI(LOG_TAG, "Load project");
-                    //strcpy(projectParams.fileName, );
-                    //uint32_t fileSize = fileSys_readFile(projectParams.fileName, midiFileBufferBASEPtr, 0, true);
-                    //gridManager_midiFileToGrid(midiFileBufferBASEPtr, fileSize);
-                    break;
-
-                case 6: 
-                    ESP_LOGI(LOG_TAG, "Start playback");
-                    break;
-
-                case 7: 
-                    ESP_LOGI(LOG_TAG, "Stop playback");
-                    break;
-
-
-                default:
-                    assert(0);
-                    break;
+                isUploadActive = true;
+                isResyncPending = false;
             }
-            vTaskPrioritySet(NULL, 1);
         }
 
 
-        if(xQueueReceive(g_SwitchMatrixQueueHandle, &swMatrixEvent, 0) == pdTRUE)
+        //Periodically send a checksum of the full event list, this lets
+        //the base unit detect if any edit deltas were lost or misapplied
+        if(isConnectedToTargetDevice && ((xTaskGetTickCount() - lastChecksumTick) >= pdMS_TO_TICKS(GRID_CHECKSUM_PERIOD_MS)))
         {
-            vTaskPrioritySet(NULL, 3);
-            //We eneter here when the grid is active and a switch
-            //within the grid has been pressed we must now retreive
-            //details for the grid coordinate.
-            midiEventParams = gridManager_getNoteParamsIfCoordinateFallsWithinExistingNoteDuration(swMatrixEvent.column,  (swMatrixEvent.row + 0x34), 0);
+            lastChecksumTick = xTaskGetTickCount();
+            bleQueueItem.opcode = sendGridChecksum;
+            bleQueueItem.dataPtr = NULL;
+            bleQueueItem.gridChecksum = gridManager_computeGridChecksum(&bleQueueItem.dataLength);
+            xQueueSend(g_HostToBleQueueHandle, &bleQueueItem, 0);
+        }
 
-            if(midiEventParams.statusByte == 0)
+        if(isPlaybackActive && (playheadStep != g_playbackStepCount))
+        {
+            //Only the playhead has moved, so the diffed LED write
+            //only touches the registers of the old and new columns
+            playheadStep = g_playbackStepCount;
+            if(playheadStep > gridManager_getTotalGridColumns())
             {
-                //We eneter here when the midi event params retireved
-                //from the grid manager show that there is no pre-existing
-                //event at the grid coordinate pressed by the user.
-                //We need to load default settings for the midi event
-                //type and channel currently being edited.
-                //NOTE: CURRENTLY ONLY SUPPORT CHANNEL 0 AND MIDI NOTE EVENTS.
-
-                midiEventParams.gridColumn = swMatrixEvent.column;
-                midiEventParams.gridRow = (swMatrixEvent.row + 0x34);
-                midiEventParams.statusByte = 0x90; //sort later
-                midiEventParams.durationInSteps = 1;
-                midiEventParams.dataBytes[MIDI_NOTE_NUM_IDX] = (swMatrixEvent.row + 0x34);
-                midiEventParams.dataBytes[MIDI_VELOCITY_IDX] = 127;
-                gridManager_addNewMidiEventToGrid(midiEventParams);
-                gridManager_updateGridLEDs(0x34,0);
+                stopPlayhead(&busStatsAtStart, playbackStartMicros);
+                isPlaybackActive = false;
             }
+            else gridManager_setPlayheadColumn(playheadStep);
+            isGridRefreshNeeded = true;
+        }
 
-            //We need to let the menu task know that a grid coordinate
-            //has been pressed and send the event params for that coord
-            MenuQueueItem txMenuQueueItem = {
-                .eventOpcode = 5, 
-                .payload[0] = midiEventParams.statusByte,
-                .payload[1] = midiEventParams.dataBytes[MIDI_NOTE_NUM_IDX],
-                .payload[2] = midiEventParams.dataBytes[MIDI_VELOCITY_IDX],
-                .payload[3] = midiEventParams.durationInSteps,
-                .payload[4] = ((midiEventParams.stepsToNext == 0) ? 128 : (midiEventParams.stepsToNext))
-            };
-
-            //Send the coordinate parameters to menu to be displayed
-            xQueueSend(g_SystemToMenuQueueHandle, &txMenuQueueItem, 0);
-            vTaskPrioritySet(NULL, 1);
+        if(isGridRefreshNeeded)
+        {
+            gridManager_updateGridLEDs(0x34,0);
+            recordInputLatency(wakeMicros, (uint32_t)esp_timer_get_time(), hasInputForRefresh, oldestInputMicros);
         }
+        isGridRefreshNeeded = false;
+        hasInputForRefresh = false;
 
-        vTaskDelay(pdMS_TO_TICKS(30));
+        //Block until input is posted, the playback tick fires or BLE has a
+        //response. While connected, also wake for the next grid checksum
+        waitTicks = portMAX_DELAY;
+        if(isConnectedToTargetDevice)
+        {
+            waitTicks = pdMS_TO_TICKS(GRID_CHECKSUM_PERIOD_MS) - (xTaskGetTickCount() - lastChecksumTick);
+            if(waitTicks > pdMS_TO_TICKS(GRID_CHECKSUM_PERIOD_MS)) waitTicks = 0;
+        }
+        inputEventBus_wait(inputBusSystem, waitTicks);
+        wakeMicros = (uint32_t)esp_timer_get_time();
     }
 
     assert(0);
@@ -220,30 +480,186 @@ void system_EntryPoint(void)
 
 
 
+//---- Private
+static void playbackTickCallback(void * args)
+{
+    //Runs in the esp_timer task, so just record the step
+    //and leave the LED update to the system task.
+    ++g_playbackStepCount;
+    inputEventBus_wake(inputBusSystem);
+}
+
+
+//---- Private
+static void stopPlayhead(ledDriverBusStats_t * busStatsAtStartPtr, int64_t playbackStartMicros)
+{
+    ledDriverBusStats_t busStats;
+    uint32_t elapsedMicros = (uint32_t)(esp_timer_get_time() - playbackStartMicros);
+
+    //The caller refreshes the grid LEDs
+    esp_timer_stop(g_playbackTickTimer);
+    gridManager_setPlayheadColumn(GRID_NO_OVERLAY_COLUMN);
+
+    //Report how much of the playback time the LED bus was busy for
+    ledDrivers_getBusStats(&busStats);
+    ESP_LOGI(LOG_TAG, "LED bus during playback: %ld frames, %ld transactions, %ld bytes, busy %ld of %ld us (%ld%%)",
+                        (busStats.numFrames - busStatsAtStartPtr->numFrames), (busStats.numTransactions - busStatsAtStartPtr->numTransactions),
+                        (busStats.numBytes - busStatsAtStartPtr->numBytes), (busStats.busyMicros - busStatsAtStartPtr->busyMicros), elapsedMicros,
+                        (elapsedMicros != 0) ? (uint32_t)(((uint64_t)(busStats.busyMicros - busStatsAtStartPtr->busyMicros) * 100) / elapsedMicros) : 0);
+    ledDrivers_dumpBusProfile();
+    logInputLatency();
+}
+
+
+//---- Private
+static void recordInputLatency(uint32_t wakeMicros, uint32_t ledSubmitMicros, bool hasInput, uint32_t oldestInputMicros)
+{
+    //Called each time the grid LED frame is submitted. The wake latency covers
+    //handling the whole batch and rendering, the input latency also includes
+    //the time spent in the switch matrix debounce and the input event bus.
+
+    uint32_t wakeToLedMicros = ledSubmitMicros - wakeMicros;
+    uint32_t inputToLedMicros = ledSubmitMicros - oldestInputMicros;
+
+    ++g_inputLatencyStats.numRefreshes;
+    g_inputLatencyStats.wakeToLedTotalMicros += wakeToLedMicros;
+    if(wakeToLedMicros > g_inputLatencyStats.wakeToLedMaxMicros) g_inputLatencyStats.wakeToLedMaxMicros = wakeToLedMicros;
+
+    if(hasInput)
+    {
+        ++g_inputLatencyStats.numInputRefreshes;
+        g_inputLatencyStats.inputToLedTotalMicros += inputToLedMicros;
+        if(inputToLedMicros > g_inputLatencyStats.inputToLedMaxMicros) g_inputLatencyStats.inputToLedMaxMicros = inputToLedMicros;
+    }
+
+    if(g_inputLatencyStats.numRefreshes >= INPUT_LATENCY_LOG_INTERVAL)
+    {
+        logInputLatency();
+        memset(&g_inputLatencyStats, 0, sizeof(g_inputLatencyStats));
+    }
+}
+
+
+//---- Private
+static void logInputLatency(void)
+{
+    InputLatencyStats * statsPtr = &g_inputLatencyStats;
+
+    if(statsPtr->numRefreshes == 0) return;
+
+    ESP_LOGI(LOG_TAG, "Grid refreshes: %ld, wake to LED mean %ld us, worst %ld us",
+                        statsPtr->numRefreshes, (statsPtr->wakeToLedTotalMicros / statsPtr->numRefreshes), statsPtr->wakeToLedMaxMicros);
+
+    if(statsPtr->numInputRefreshes == 0) return;
+
+    ESP_LOGI(LOG_TAG, "Input refreshes: %ld, input to LED mean %ld us, worst %ld us",
+                        statsPtr->numInputRefreshes, (statsPtr->inputToLedTotalMicros / statsPtr->numInputRefreshes), statsPtr->inputToLedMaxMicros);
+}
+
+
+//---- Private
+static void sendGridCoordinateParamsToMenu(MidiEventParams * eventParamsPtr)
+{
+    //We need to let the menu task know that a grid coordinate
+    //has been pressed and send the event params for that coord
+    InputEvent txMenuMessage = {
+        .source = inputSourceSystem,
+        .eventType = systemMsgNoteParams,
+        .timestampMicros = (uint32_t)esp_timer_get_time(),
+        .payload[NOTE_PARAMS_STATUS_IDX] = eventParamsPtr->statusByte,
+        .payload[NOTE_PARAMS_NOTE_NUM_IDX] = eventParamsPtr->dataBytes[MIDI_NOTE_NUM_IDX],
+        .payload[NOTE_PARAMS_VELOCITY_IDX] = eventParamsPtr->dataBytes[MIDI_VELOCITY_IDX],
+        .payload[NOTE_PARAMS_DURATION_IDX] = eventParamsPtr->durationInSteps,
+        .payload[NOTE_PARAMS_MAX_DURATION_IDX] = ((eventParamsPtr->stepsToNext == 0) ? 128 : (eventParamsPtr->stepsToNext))
+    };
+
+    if(!inputEventBus_post(inputBusMenu, &txMenuMessage)) ESP_LOGE(LOG_TAG, "Error: Menu input bus full, grid coordinate dropped");
+}
+
+
+//---- Private
+static bool applyPendingNoteEdit(PendingNoteEdit * pendingEditPtr, MidiEventParams * eventParamsPtr, bool * isResyncPendingPtr)
+{
+    //Applies the latest velocity/duration posted by the menu to the note
+    //currently being edited, then clears the pending edit. However many
+    //commands were folded in, the grid and base unit see a single update.
+    //'isResyncPendingPtr' is set if the update couldn't be sent to the base unit.
+    //RETURNS: true if an edit was applied and the grid LEDs need refreshing.
+
+    if(pendingEditPtr->numCommands == 0) return false;
+
+    if(pendingEditPtr->hasVelocity) eventParamsPtr->dataBytes[MIDI_VELOCITY_IDX] = pendingEditPtr->velocity;
+    if(pendingEditPtr->hasDuration) eventParamsPtr->durationInSteps = pendingEditPtr->durationInSteps;
+
+    ESP_LOGI(LOG_TAG, "Updated note params, %d commands coalesced", pendingEditPtr->numCommands);
+    gridManager_updateMidiEventParameters(*eventParamsPtr);
+    if(!sendGridEditDeltaToBle(gridEditUpdate, eventParamsPtr)) *isResyncPendingPtr = true;
+
+    memset(pendingEditPtr, 0, sizeof(PendingNoteEdit));
+    return true;     //Note colour follows velocity
+}
+
+
+//---- Private
+static bool sendGridEditDeltaToBle(uint8_t editType, MidiEventParams * eventParamsPtr)
+{
+    //Rather than re-send the whole project file after every
+    //edit, only the edit itself is sent to the base unit.
+    //RETURNS: false if the delta couldn't be queued. The base unit has then
+    //missed an edit and needs the whole project file sent again (a resync),
+    //rather than waiting for the next checksum mismatch to find out.
+
+    if(!isConnectedToTargetDevice) return true;
+
+    HostToBleQueueItem bleQueueItem = {
+        .opcode = sendGridEditDelta,
+        .editDelta.editType = editType,
+        .editDelta.gridColumn = eventParamsPtr->gridColumn,
+        .editDelta.gridRow = eventParamsPtr->gridRow,
+        .editDelta.statusByte = eventParamsPtr->statusByte,
+        .editDelta.dataBytes[0] = eventParamsPtr->dataBytes[MIDI_NOTE_NUM_IDX],
+        .editDelta.dataBytes[1] = eventParamsPtr->dataBytes[MIDI_VELOCITY_IDX],
+        .editDelta.durationInSteps = eventParamsPtr->durationInSteps
+    };
+
+    if(xQueueSend(g_HostToBleQueueHandle, &bleQueueItem, 0) != pdTRUE)
+    {
+        ESP_LOGW(LOG_TAG, "BLE queue full, grid edit delta dropped, resync pending");
+        return false;
+    }
+
+    return true;
+}
+
+
+
+
 static void initRTOSTasks(void * menuParams, void * switchMatrixParams, void * bleParams)
 {
 
     //--------------------------------------------------
     //---------------- MENU INTERFACE ------------------
     //--------------------------------------------------
-    g_MenuToSystemQueueHandle = xQueueCreate(1, sizeof(MenuQueueItem));
-    g_SystemToMenuQueueHandle = xQueueCreate(1, sizeof(MenuQueueItem));
-    assert(g_MenuToSystemQueueHandle != NULL);
-
     g_GUIMenuTaskHandle = xTaskCreateStaticPinnedToCore(guiMenu_entryPoint, "guiMenu", GUI_MENU_TASK_STACK_SIZE,
                                                         menuParams, 2, g_GUIMenuTaskStack, &g_GUIMenuTaskBuffer, 0);
 
     //--------------------------------------------------
     //------------- SWITCH MATRIX TASK -----------------
     //--------------------------------------------------
-    g_SwitchMatrixQueueHandle = xQueueCreate(SWITCH_MATRIX_QUEUE_NUM_ITEMS, sizeof(SwitchMatrixQueueItem));
-    assert(g_SwitchMatrixQueueHandle != NULL);
-
     g_SwitchMatrixTaskHandle = xTaskCreateStaticPinnedToCore(switchMatrix_TaskEntryPoint, "switchMatrixTask", MATRIX_SCANNER_TASK_STACK_SIZE,
                                                             switchMatrixParams, 1, g_SwitchMatrixTaskStack, &g_SwitchMatrixTaskBuffer, 0);
 
     //vTaskSuspend(g_SwitchMatrixTaskHandle);
 
+    //--------------------------------------------------
+    //--------------- LED REFRESH TASK -----------------
+    //--------------------------------------------------
+    g_LedFrameQueueHandle = xQueueCreate(LED_FRAME_QUEUE_NUM_ITEMS, sizeof(ledDriverFrame_t));
+    assert(g_LedFrameQueueHandle != NULL);
+
+    g_LedRefreshTaskHandle = xTaskCreateStaticPinnedToCore(ledDrivers_refreshTaskEntryPoint, "ledRefreshTask", LED_REFRESH_TASK_STACK_SIZE,
+                                                            NULL, LED_REFRESH_TASK_PRIORITY, g_LedRefreshTaskStack, &g_LedRefreshTaskBuffer, 0);
+
     //--------------------------------------------------
     //-------------- BLUETOOTH TASK --------------------
     //--------------------------------------------------
@@ -0,0 +1,270 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "host/ble_hs.h"
+#include "bleLinkPolicy.h"
+#include "hostTest.h"
+
+
+//Unit tests and a benchmark for the link policy, run against a mock GAP layer.
+//The mock records every request made to the peer and can be told to refuse
+//one, the way NimBLE does while an earlier procedure is still in progress.
+
+#define TEST_CONN_HANDLE    1
+#define BENCH_NUM_ITERATIONS 1000000
+
+
+typedef struct
+{
+    uint32_t numPreferredMtuCalls;
+    uint32_t numExchangeMtuCalls;
+    uint32_t numUpdateParamsCalls;
+    uint32_t numSetDataLenCalls;
+    uint32_t numSetPhyCalls;
+    uint32_t numCallsInCritical;    //GAP calls made with a spinlock held
+    uint16_t preferredMtu;
+    struct ble_gap_upd_params lastUpdateParams;
+    uint16_t lastTxOctets;
+    uint16_t lastTxTimeUs;
+    uint8_t lastPhyMask;
+    int updateParamsRetVal;         //Returned by the next 'ble_gap_update_params' calls
+    struct ble_gap_conn_desc connDesc;
+} MockGap;
+
+static MockGap g_mockGap;
+
+
+//---- Mock GAP layer
+int ble_att_set_preferred_mtu(uint16_t mtu)
+{
+    if(g_hostCriticalNesting != 0) ++g_mockGap.numCallsInCritical;
+    ++g_mockGap.numPreferredMtuCalls;
+    g_mockGap.preferredMtu = mtu;
+    return 0;
+}
+
+int ble_gattc_exchange_mtu(uint16_t conn_handle, void * cb, void * cb_arg)
+{
+    if(g_hostCriticalNesting != 0) ++g_mockGap.numCallsInCritical;
+    ++g_mockGap.numExchangeMtuCalls;
+    return 0;
+}
+
+int ble_gap_update_params(uint16_t conn_handle, const struct ble_gap_upd_params * params)
+{
+    if(g_hostCriticalNesting != 0) ++g_mockGap.numCallsInCritical;
+    ++g_mockGap.numUpdateParamsCalls;
+    if(g_mockGap.updateParamsRetVal != 0) return g_mockGap.updateParamsRetVal;
+    g_mockGap.lastUpdateParams = *params;
+    return 0;
+}
+
+int ble_gap_set_data_len(uint16_t conn_handle, uint16_t tx_octets, uint16_t tx_time)
+{
+    if(g_hostCriticalNesting != 0) ++g_mockGap.numCallsInCritical;
+    ++g_mockGap.numSetDataLenCalls;
+    g_mockGap.lastTxOctets = tx_octets;
+    g_mockGap.lastTxTimeUs = tx_time;
+    return 0;
+}
+
+int ble_gap_set_prefered_le_phy(uint16_t conn_handle, uint8_t tx_phys_mask, uint8_t rx_phys_mask, uint16_t phy_opts)
+{
+    if(g_hostCriticalNesting != 0) ++g_mockGap.numCallsInCritical;
+    ++g_mockGap.numSetPhyCalls;
+    g_mockGap.lastPhyMask = tx_phys_mask;
+    return 0;
+}
+
+int ble_gap_conn_find(uint16_t handle, struct ble_gap_conn_desc * out_desc)
+{
+    if(g_hostCriticalNesting != 0) ++g_mockGap.numCallsInCritical;
+    if(handle != TEST_CONN_HANDLE) return BLE_HS_ENOTCONN;
+    *out_desc = g_mockGap.connDesc;
+    return 0;
+}
+
+
+static void mockGap_reset(void)
+{
+    memset(&g_mockGap, 0, sizeof(g_mockGap));
+    g_mockGap.connDesc.conn_handle = TEST_CONN_HANDLE;
+}
+
+
+static void mockGap_completeConnUpdate(void)
+{
+    //The peer accepts whatever was last requested
+    g_mockGap.connDesc.conn_itvl = g_mockGap.lastUpdateParams.itvl_max;
+    g_mockGap.connDesc.conn_latency = g_mockGap.lastUpdateParams.latency;
+    g_mockGap.connDesc.supervision_timeout = g_mockGap.lastUpdateParams.supervision_timeout;
+    bleLinkPolicy_onConnParamsUpdated(TEST_CONN_HANDLE);
+}
+
+
+
+
+static void testSelectParams(void)
+{
+    const BleLinkParams * bulkPtr = bleLinkPolicy_selectParams(bleLinkModeBulkUpload);
+    const BleLinkParams * livePtr = bleLinkPolicy_selectParams(bleLinkModeLivePlayback);
+
+    HOST_TEST_CHECK(bleLinkPolicy_selectParams(bleLinkModeNone) == NULL);
+    HOST_TEST_CHECK((bulkPtr != NULL) && (livePtr != NULL));
+
+    //Exact units of 1.25ms, 7.5ms is 6 units
+    HOST_TEST_CHECK((livePtr->connIntervalMin == 6) && (livePtr->connIntervalMax == 6));
+    HOST_TEST_CHECK((bulkPtr->connIntervalMin == 12) && (bulkPtr->connIntervalMax == 24));
+    HOST_TEST_CHECK(bulkPtr->connIntervalMax > livePtr->connIntervalMax);
+    HOST_TEST_CHECK((livePtr->supervisionTimeout == 200) && (bulkPtr->supervisionTimeout == 400));
+    HOST_TEST_CHECK((bulkPtr->preferredPhyMask == BLE_GAP_LE_PHY_2M_MASK) && (livePtr->preferredPhyMask == BLE_GAP_LE_PHY_2M_MASK));
+    HOST_TEST_CHECK((bulkPtr->dataLenTxOctets == BLE_LINK_MAX_TX_OCTETS) && (livePtr->dataLenTxOctets == BLE_LINK_MAX_TX_OCTETS));
+}
+
+
+static void testConnectAndModeChanges(void)
+{
+    BleLinkState linkState;
+
+    mockGap_reset();
+    bleLinkPolicy_onConnect(TEST_CONN_HANDLE);
+    bleLinkPolicy_getLinkState(&linkState);
+
+    //Largest MTU asked for once, the link starts in live playback
+    HOST_TEST_CHECK((g_mockGap.numPreferredMtuCalls == 1) && (g_mockGap.preferredMtu == BLE_LINK_MAX_MTU));
+    HOST_TEST_CHECK(g_mockGap.numExchangeMtuCalls == 1);
+    HOST_TEST_CHECK(linkState.mtu == 23);
+    HOST_TEST_CHECK(linkState.linkMode == bleLinkModeLivePlayback);
+    HOST_TEST_CHECK((g_mockGap.numUpdateParamsCalls == 1) && (g_mockGap.lastUpdateParams.itvl_max == 6));
+    HOST_TEST_CHECK((g_mockGap.numSetDataLenCalls == 1) && (g_mockGap.lastTxOctets == BLE_LINK_MAX_TX_OCTETS));
+    HOST_TEST_CHECK((g_mockGap.numSetPhyCalls == 1) && (g_mockGap.lastPhyMask == BLE_GAP_LE_PHY_2M_MASK));
+
+    //Already in this mode, nothing is sent to the peer
+    bleLinkPolicy_setMode(TEST_CONN_HANDLE, bleLinkModeLivePlayback);
+    HOST_TEST_CHECK(g_mockGap.numUpdateParamsCalls == 1);
+
+    bleLinkPolicy_setMode(TEST_CONN_HANDLE, bleLinkModeBulkUpload);
+    bleLinkPolicy_getLinkState(&linkState);
+    HOST_TEST_CHECK(linkState.linkMode == bleLinkModeBulkUpload);
+    HOST_TEST_CHECK((g_mockGap.numUpdateParamsCalls == 2) && (g_mockGap.lastUpdateParams.itvl_min == 12) && (g_mockGap.lastUpdateParams.itvl_max == 24));
+
+    //Negotiated values are recorded as the events arrive
+    mockGap_completeConnUpdate();
+    bleLinkPolicy_onMtuUpdated(247);
+    bleLinkPolicy_onPhyUpdated(2, 2);
+    bleLinkPolicy_onDataLenChanged(251, 2120, 251, 2120);
+    bleLinkPolicy_getLinkState(&linkState);
+    HOST_TEST_CHECK((linkState.connInterval == 24) && (linkState.supervisionTimeout == 400));
+    HOST_TEST_CHECK(linkState.mtu == 247);
+    HOST_TEST_CHECK((linkState.txPhy == 2) && (linkState.rxPhy == 2));
+    HOST_TEST_CHECK((linkState.dataLenTxOctets == 251) && (linkState.dataLenTxTimeUs == 2120));
+    HOST_TEST_CHECK((linkState.dataLenRxOctets == 251) && (linkState.dataLenRxTimeUs == 2120));
+
+    bleLinkPolicy_onDisconnect();
+    bleLinkPolicy_getLinkState(&linkState);
+    HOST_TEST_CHECK((linkState.linkMode == bleLinkModeNone) && (linkState.mtu == 0) && (linkState.dataLenTxOctets == 0));
+    HOST_TEST_CHECK(g_hostCriticalNesting == 0);
+    HOST_TEST_CHECK(g_mockGap.numCallsInCritical == 0);
+}
+
+
+static void testRefusedRequestIsRetried(void)
+{
+    BleLinkState linkState;
+
+    mockGap_reset();
+    bleLinkPolicy_onConnect(TEST_CONN_HANDLE);
+
+    //The connect time update is still in progress when the upload starts
+    g_mockGap.updateParamsRetVal = BLE_HS_EALREADY;
+    bleLinkPolicy_setMode(TEST_CONN_HANDLE, bleLinkModeBulkUpload);
+    bleLinkPolicy_getLinkState(&linkState);
+    HOST_TEST_CHECK(linkState.linkMode == bleLinkModeLivePlayback);
+    HOST_TEST_CHECK(g_mockGap.numUpdateParamsCalls == 2);
+
+    //Once it completes the bulk upload mode is requested again
+    g_mockGap.updateParamsRetVal = 0;
+    g_mockGap.connDesc.conn_itvl = 6;
+    bleLinkPolicy_onConnParamsUpdated(TEST_CONN_HANDLE);
+    bleLinkPolicy_getLinkState(&linkState);
+    HOST_TEST_CHECK(linkState.linkMode == bleLinkModeBulkUpload);
+    HOST_TEST_CHECK((g_mockGap.numUpdateParamsCalls == 3) && (g_mockGap.lastUpdateParams.itvl_max == 24));
+
+    //That update completing doesn't trigger any more requests
+    mockGap_completeConnUpdate();
+    HOST_TEST_CHECK(g_mockGap.numUpdateParamsCalls == 3);
+
+    //Asking for the mode it is already trying to reach, after a refusal, tries again
+    g_mockGap.updateParamsRetVal = BLE_HS_EALREADY;
+    bleLinkPolicy_setMode(TEST_CONN_HANDLE, bleLinkModeLivePlayback);
+    g_mockGap.updateParamsRetVal = 0;
+    bleLinkPolicy_setMode(TEST_CONN_HANDLE, bleLinkModeLivePlayback);
+    bleLinkPolicy_getLinkState(&linkState);
+    HOST_TEST_CHECK(linkState.linkMode == bleLinkModeLivePlayback);
+    HOST_TEST_CHECK(g_mockGap.numUpdateParamsCalls == 5);
+
+    //Events for another connection are ignored
+    g_mockGap.connDesc.conn_itvl = 99;
+    bleLinkPolicy_onConnParamsUpdated(TEST_CONN_HANDLE + 1);
+    bleLinkPolicy_getLinkState(&linkState);
+    HOST_TEST_CHECK(linkState.connInterval != 99);
+
+    bleLinkPolicy_onDisconnect();
+    HOST_TEST_CHECK(g_hostCriticalNesting == 0);
+    HOST_TEST_CHECK(g_mockGap.numCallsInCritical == 0);
+}
+
+
+static void benchmarkPolicy(void)
+{
+    BleLinkState linkState;
+    uint64_t startNanos;
+    uint64_t modeChangeNanos;
+    uint64_t getStateNanos;
+    uint64_t selectNanos;
+    volatile uint32_t sink = 0;
+
+    mockGap_reset();
+    bleLinkPolicy_onConnect(TEST_CONN_HANDLE);
+
+    startNanos = hostTest_getNanos();
+    for(uint32_t a = 0; a < BENCH_NUM_ITERATIONS; ++a)
+    {
+        bleLinkPolicy_setMode(TEST_CONN_HANDLE, (a & 1) ? bleLinkModeLivePlayback : bleLinkModeBulkUpload);
+    }
+    modeChangeNanos = hostTest_getNanos() - startNanos;
+
+    startNanos = hostTest_getNanos();
+    for(uint32_t a = 0; a < BENCH_NUM_ITERATIONS; ++a)
+    {
+        bleLinkPolicy_getLinkState(&linkState);
+        sink += linkState.mtu;
+    }
+    getStateNanos = hostTest_getNanos() - startNanos;
+
+    startNanos = hostTest_getNanos();
+    for(uint32_t a = 0; a < BENCH_NUM_ITERATIONS; ++a)
+    {
+        sink += bleLinkPolicy_selectParams((a & 1) + bleLinkModeBulkUpload)->connIntervalMax;
+    }
+    selectNanos = hostTest_getNanos() - startNanos;
+
+    printf("mode change: %.1f ns, get link state: %.1f ns, select params: %.1f ns (%u GAP requests)\n",
+           (double)modeChangeNanos / BENCH_NUM_ITERATIONS, (double)getStateNanos / BENCH_NUM_ITERATIONS,
+           (double)selectNanos / BENCH_NUM_ITERATIONS, g_mockGap.numUpdateParamsCalls + g_mockGap.numSetDataLenCalls + g_mockGap.numSetPhyCalls);
+
+    HOST_TEST_CHECK(g_mockGap.numUpdateParamsCalls == (BENCH_NUM_ITERATIONS + 1));
+    bleLinkPolicy_onDisconnect();
+}
+
+
+int main(void)
+{
+    testSelectParams();
+    testConnectAndModeChanges();
+    testRefusedRequestIsRetried();
+    benchmarkPolicy();
+    return hostTest_finish("bleLinkPolicyTest");
+}
@@ -0,0 +1,275 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bleLzss.h"
+#include "hostTest.h"
+
+
+//Round trip tests and a ratio / throughput benchmark for the upload compressor.
+//Files are packetized exactly as 'buildUploadPacketMbuf' (bleCentral.c) does it,
+//including the raw fallback, then unpacked by a decoder written from the format
+//description in bleLzss.h (the base units side of the link).
+
+#define UPLOAD_HEADER_NUM_BYTES     2       //BLE_TX_HEADER_NUM_BYTES
+#define UPLOAD_MAX_DATA_NUM_BYTES   510     //BLE_TX_MAX_DATA_NUM_BYTES
+#define BENCH_MIN_NANOS             100000000ull
+#define RANDOM_FILE_NUM_BYTES       300000
+
+
+typedef struct
+{
+    uint32_t numPackets;
+    uint32_t numRawPackets;
+    uint32_t numWireBytes;      //Header + payload, as written to the characteristic
+} UploadResult;
+
+
+static BleLzssEncoder g_encoder;
+static uint8_t g_packets[(RANDOM_FILE_NUM_BYTES * 2)];
+static uint16_t g_packetNumBytes[RANDOM_FILE_NUM_BYTES];
+
+
+static void packetizeUpload(const uint8_t * srcPtr, uint32_t srcNumBytes, UploadResult * resultPtr)
+{
+    //Packets are laid end to end in 'g_packets', payload sizes in 'g_packetNumBytes'
+    uint8_t * packetPtr = g_packets;
+    uint32_t packetSrcStartIdx;
+    uint32_t rawNumBytes;
+    uint16_t payloadNumBytes;
+
+    memset(resultPtr, 0, sizeof(UploadResult));
+    bleLzss_initEncoder(&g_encoder, srcPtr, srcNumBytes);
+
+    while(g_encoder.srcIdx < srcNumBytes)
+    {
+        packetSrcStartIdx = g_encoder.srcIdx;
+        packetPtr[0] = 0x01;    //Compressed
+        payloadNumBytes = bleLzss_encodeChunk(&g_encoder, &packetPtr[UPLOAD_HEADER_NUM_BYTES], UPLOAD_MAX_DATA_NUM_BYTES);
+
+        rawNumBytes = srcNumBytes - packetSrcStartIdx;
+        if(rawNumBytes > UPLOAD_MAX_DATA_NUM_BYTES) rawNumBytes = UPLOAD_MAX_DATA_NUM_BYTES;
+        if(bleLzss_isRawPacketBetter(payloadNumBytes, (g_encoder.srcIdx - packetSrcStartIdx), rawNumBytes))
+        {
+            packetPtr[0] = 0x00;
+            memcpy(&packetPtr[UPLOAD_HEADER_NUM_BYTES], &srcPtr[packetSrcStartIdx], rawNumBytes);
+            payloadNumBytes = rawNumBytes;
+            bleLzss_skipTo(&g_encoder, packetSrcStartIdx + rawNumBytes);
+            ++resultPtr->numRawPackets;
+        }
+
+        g_packetNumBytes[resultPtr->numPackets++] = payloadNumBytes;
+        resultPtr->numWireBytes += UPLOAD_HEADER_NUM_BYTES + payloadNumBytes;
+        packetPtr += UPLOAD_HEADER_NUM_BYTES + payloadNumBytes;
+    }
+}
+
+
+static bool decodeUpload(uint32_t numPackets, uint8_t * dstPtr, uint32_t dstMaxNumBytes, uint32_t * dstNumBytesPtr)
+{
+    //RETURNS: false if the stream is malformed
+    const uint8_t * packetPtr = g_packets;
+    const uint8_t * payloadPtr;
+    uint32_t dstIdx = 0;
+    uint16_t payloadIdx;
+    uint16_t payloadNumBytes;
+    uint8_t flagByte;
+    uint32_t matchOffset;
+    uint32_t matchLength;
+
+    for(uint32_t packet = 0; packet < numPackets; ++packet)
+    {
+        payloadPtr = &packetPtr[UPLOAD_HEADER_NUM_BYTES];
+        payloadNumBytes = g_packetNumBytes[packet];
+
+        if((packetPtr[0] & 0x01) == 0)
+        {
+            if((dstIdx + payloadNumBytes) > dstMaxNumBytes) return false;
+            memcpy(&dstPtr[dstIdx], payloadPtr, payloadNumBytes);
+            dstIdx += payloadNumBytes;
+        }
+        else
+        {
+            payloadIdx = 0;
+            while(payloadIdx < payloadNumBytes)
+            {
+                flagByte = payloadPtr[payloadIdx++];
+                for(uint8_t item = 0; (item < BLE_LZSS_ITEMS_PER_GROUP) && (payloadIdx < payloadNumBytes); ++item)
+                {
+                    if(flagByte & (1 << item))
+                    {
+                        if(dstIdx >= dstMaxNumBytes) return false;
+                        dstPtr[dstIdx++] = payloadPtr[payloadIdx++];
+                        continue;
+                    }
+
+                    if((payloadIdx + 2) > payloadNumBytes) return false;
+                    matchOffset = (((uint32_t)payloadPtr[payloadIdx] << BLE_LZSS_OFFSET_HIGH_SHIFT) | (payloadPtr[payloadIdx + 1] >> BLE_LZSS_OFFSET_LOW_SHIFT)) + 1;
+                    matchLength = (payloadPtr[payloadIdx + 1] & BLE_LZSS_LENGTH_MASK) + BLE_LZSS_MIN_MATCH_NUM_BYTES;
+                    payloadIdx += 2;
+                    if((matchOffset > dstIdx) || ((dstIdx + matchLength) > dstMaxNumBytes)) return false;
+
+                    //Byte at a time, a match may overlap its own output
+                    for(uint32_t a = 0; a < matchLength; ++a, ++dstIdx) dstPtr[dstIdx] = dstPtr[dstIdx - matchOffset];
+                }
+            }
+        }
+        packetPtr += UPLOAD_HEADER_NUM_BYTES + payloadNumBytes;
+    }
+
+    *dstNumBytesPtr = dstIdx;
+    return true;
+}
+
+
+static uint32_t writeVarLen(uint8_t * dstPtr, uint32_t value)
+{
+    uint8_t bytes[4];
+    uint32_t numBytes = 0;
+
+    do
+    {
+        bytes[numBytes++] = value & 0x7F;
+        value >>= 7;
+    } while(value != 0);
+
+    for(uint32_t a = 0; a < numBytes; ++a) dstPtr[a] = bytes[numBytes - 1 - a] | ((a != (numBytes - 1)) ? 0x80 : 0);
+    return numBytes;
+}
+
+
+static uint32_t buildProjectFile(uint8_t * dstPtr, uint32_t numColumns)
+{
+    //A format 0 file as the grid manager writes it, notes placed at random
+    //across a 48 row grid, each a step long with one of two velocities
+    static const uint8_t header[] = {'M','T','h','d', 0,0,0,6, 0,0, 0,1, 0,96, 'M','T','r','k', 0,0,0,0};
+    uint32_t randomState = 0xC0FFEE;
+    uint32_t idx = sizeof(header);
+    uint32_t lastTick = 0;
+    uint8_t noteNums[48];
+    uint8_t numNotes;
+
+    memcpy(dstPtr, header, sizeof(header));
+
+    for(uint32_t column = 0; column < numColumns; ++column)
+    {
+        numNotes = 0;
+        for(uint8_t row = 0; row < 48; ++row)
+        {
+            if((hostTest_random(&randomState) % 8) == 0) noteNums[numNotes++] = 36 + row;
+        }
+        if(numNotes == 0) continue;
+
+        for(uint8_t a = 0; a < numNotes; ++a)
+        {
+            idx += writeVarLen(&dstPtr[idx], (a == 0) ? ((column * 24) - lastTick) : 0);
+            dstPtr[idx++] = 0x90;
+            dstPtr[idx++] = noteNums[a];
+            dstPtr[idx++] = ((hostTest_random(&randomState) % 4) == 0) ? 100 : 127;
+        }
+        for(uint8_t a = 0; a < numNotes; ++a)
+        {
+            idx += writeVarLen(&dstPtr[idx], (a == 0) ? 24 : 0);
+            dstPtr[idx++] = 0x80;
+            dstPtr[idx++] = noteNums[a];
+            dstPtr[idx++] = 0;
+        }
+        lastTick = (column * 24) + 24;
+    }
+
+    dstPtr[idx++] = 0x00;
+    dstPtr[idx++] = 0xFF;
+    dstPtr[idx++] = 0x2F;
+    dstPtr[idx++] = 0x00;
+    return idx;
+}
+
+
+static uint32_t loadFile(const char * pathPtr, uint8_t * dstPtr, uint32_t dstMaxNumBytes)
+{
+    FILE * filePtr = fopen(pathPtr, "rb");
+    uint32_t numBytes;
+
+    if(filePtr == NULL) return 0;
+    numBytes = (uint32_t)fread(dstPtr, 1, dstMaxNumBytes, filePtr);
+    fclose(filePtr);
+    return numBytes;
+}
+
+
+static void runDataSet(const char * namePtr, const uint8_t * srcPtr, uint32_t srcNumBytes, uint8_t * decodedPtr)
+{
+    UploadResult result;
+    uint32_t decodedNumBytes = 0;
+    uint32_t rawWireBytes = srcNumBytes + (((srcNumBytes + UPLOAD_MAX_DATA_NUM_BYTES - 1) / UPLOAD_MAX_DATA_NUM_BYTES) * UPLOAD_HEADER_NUM_BYTES);
+    uint64_t startNanos;
+    uint64_t encodeNanos;
+    uint64_t decodeNanos;
+    uint32_t numEncodeRuns = 0;
+    uint32_t numDecodeRuns = 0;
+
+    startNanos = hostTest_getNanos();
+    do
+    {
+        packetizeUpload(srcPtr, srcNumBytes, &result);
+        ++numEncodeRuns;
+    } while((hostTest_getNanos() - startNanos) < BENCH_MIN_NANOS);
+    encodeNanos = (hostTest_getNanos() - startNanos) / numEncodeRuns;
+
+    startNanos = hostTest_getNanos();
+    do
+    {
+        HOST_TEST_CHECK(decodeUpload(result.numPackets, decodedPtr, srcNumBytes, &decodedNumBytes));
+        ++numDecodeRuns;
+    } while((hostTest_getNanos() - startNanos) < BENCH_MIN_NANOS);
+    decodeNanos = (hostTest_getNanos() - startNanos) / numDecodeRuns;
+
+    printf("%-22s %8u %8u %8u %8u %7.3f %9.1f %9.1f\n", namePtr, srcNumBytes, result.numWireBytes, result.numPackets, result.numRawPackets,
+           (double)result.numWireBytes / rawWireBytes, (srcNumBytes * 1000.0) / encodeNanos, (srcNumBytes * 1000.0) / decodeNanos);
+
+    //Lossless, and never more on the air than an uncompressed upload
+    HOST_TEST_CHECK(decodedNumBytes == srcNumBytes);
+    HOST_TEST_CHECK(memcmp(decodedPtr, srcPtr, srcNumBytes) == 0);
+    HOST_TEST_CHECK(result.numWireBytes <= rawWireBytes);
+}
+
+
+int main(void)
+{
+    uint8_t * srcPtr = malloc(RANDOM_FILE_NUM_BYTES);
+    uint8_t * decodedPtr = malloc(RANDOM_FILE_NUM_BYTES);
+    uint32_t randomState = 0x5EED;
+    uint32_t srcNumBytes;
+    UploadResult result;
+
+    printf("%-22s %8s %8s %8s %8s %7s %9s %9s\n", "data set", "bytes", "on air", "packets", "raw", "ratio", "enc MB/s", "dec MB/s");
+
+    srcNumBytes = loadFile(LZSS_PROJECT_FILE_PATH, srcPtr, RANDOM_FILE_NUM_BYTES);
+    HOST_TEST_CHECK(srcNumBytes != 0);
+    if(srcNumBytes != 0) runDataSet("output.mid", srcPtr, srcNumBytes, decodedPtr);
+
+    srcNumBytes = buildProjectFile(srcPtr, 1024);
+    runDataSet("1024 column project", srcPtr, srcNumBytes, decodedPtr);
+    packetizeUpload(srcPtr, srcNumBytes, &result);
+    HOST_TEST_CHECK(result.numWireBytes < ((srcNumBytes * 3) / 4));
+
+    for(uint32_t a = 0; a < RANDOM_FILE_NUM_BYTES; ++a) srcPtr[a] = (uint8_t)hostTest_random(&randomState);
+    runDataSet("random", srcPtr, RANDOM_FILE_NUM_BYTES, decodedPtr);
+    packetizeUpload(srcPtr, RANDOM_FILE_NUM_BYTES, &result);
+    HOST_TEST_CHECK(result.numRawPackets == result.numPackets);
+
+    //Compressible and incompressible runs back to back, matches
+    //have to reach back across raw packets into compressed ones
+    srcNumBytes = buildProjectFile(srcPtr, 256);
+    for(uint32_t a = srcNumBytes; a < (srcNumBytes + 4096); ++a) srcPtr[a] = (uint8_t)hostTest_random(&randomState);
+    memcpy(&srcPtr[srcNumBytes + 4096], srcPtr, srcNumBytes);
+    runDataSet("project/random/project", srcPtr, (srcNumBytes * 2) + 4096, decodedPtr);
+
+    memset(srcPtr, 0, RANDOM_FILE_NUM_BYTES);
+    runDataSet("zeros", srcPtr, RANDOM_FILE_NUM_BYTES, decodedPtr);
+
+    free(srcPtr);
+    free(decodedPtr);
+    return hostTest_finish("bleLzssBench");
+}
@@ -0,0 +1,306 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "midiHelper.h"
+#include "bleMidiPacket.h"
+#include "hostTest.h"
+
+
+//Simulates the BLE client event stream (bleCentral.c state 5) end to end, from
+//the compiled event list to the base unit scheduling each event by its BLE-MIDI
+//timestamp, and measures how late events are played.
+
+//Sender: runs once per RTOS tick, sends every event due within the lookahead
+//window, as many events per packet as the MTU allows. Writes fail while the
+//controllers ACL buffers are full, the rest is retried on the next pass.
+//Link: queued packets only go out at connection events, a few per event.
+//Errors are injected as missed connection events (the packets wait for the
+//next one) and as jitter in when the sender task wakes.
+//Receiver: rebuilds the full timestamp from the 13 bit packet timestamp and
+//its own clock, then plays the event at that time, or on arrival if late.
+
+#define SIM_STEP_MICROS             250
+#define SIM_TICK_MICROS             1000        //CONFIG_FREERTOS_HZ = 1000
+#define SIM_LOOKAHEAD_MS            40          //BLE_MIDI_STREAM_LOOKAHEAD_MS
+#define SIM_ACL_BUF_COUNT           20          //CONFIG_BT_NIMBLE_ACL_BUF_COUNT
+#define SIM_MAX_PACKET_NUM_BYTES    512
+#define SIM_CLOCK_AT_START_MS       7000        //Sender clock at stream start, so the 13 bit timestamps wrap
+#define SIM_STREAM_START_MS         (SIM_CLOCK_AT_START_MS + SIM_LOOKAHEAD_MS)
+#define SIM_STEP_MS                 125         //16th notes at 120 BPM
+#define SIM_NUM_STEPS               192         //24 seconds, the timestamps wrap twice
+#define SIM_MAX_EVENTS              4096
+#define SIM_TIMESTAMP_MODULUS       (BLE_MIDI_TIMESTAMP_MASK + 1)
+
+
+typedef struct
+{
+    const char * namePtr;
+    uint32_t connIntervalMicros;
+    uint16_t mtu;
+    uint8_t maxPacketsPerConnEvent;
+    uint8_t missedConnEventPercent;
+    uint32_t maxTaskJitterMicros;
+    bool isExpectedOnTime;
+} SimScenario;
+
+
+typedef struct
+{
+    uint8_t bytes[SIM_MAX_PACKET_NUM_BYTES];
+    uint16_t numBytes;
+} SimPacket;
+
+
+typedef struct
+{
+    uint32_t numPackets;
+    uint32_t numEventsReceived;
+    uint32_t numEventsLate;
+    uint32_t numWriteRetries;
+    uint32_t numTimestampErrors;
+    uint32_t numContentErrors;
+    uint64_t totalLateMicros;
+    uint32_t maxLateMicros;
+    uint32_t minLeadMicros;
+} SimResult;
+
+
+static MidiPlaybackEvent g_events[SIM_MAX_EVENTS];
+static uint32_t g_numEvents = 0;
+
+static SimPacket g_aclQueue[SIM_ACL_BUF_COUNT];
+static uint32_t g_aclQueueHead = 0;
+static uint32_t g_aclQueueNumItems = 0;
+
+
+static const SimScenario g_scenarios[] =
+{
+    //name                          interval  mtu  pkts/evt  missed%  jitter   on time
+    {"7.5ms, MTU 247",              7500,     247, 6,        0,       0,       true},
+    {"15ms, MTU 247",               15000,    247, 6,        0,       0,       true},
+    {"30ms, MTU 247",               30000,    247, 6,        0,       0,       true},
+    {"30ms, MTU 23",                30000,    23,  4,        0,       0,       false},
+    {"7.5ms, 5% missed",            7500,     247, 6,        5,       2000,    false},
+    {"15ms, 10% missed",            15000,    247, 6,        10,      2000,    false},
+    {"30ms, 10% missed",            30000,    247, 6,        10,      3000,    false},
+    {"30ms, MTU 23, 10% missed",    30000,    23,  4,        10,      3000,    false},
+};
+
+
+static void addEvent(uint32_t timestampMs, uint8_t statusByte, uint8_t dataByte0, uint8_t dataByte1)
+{
+    if(g_numEvents >= SIM_MAX_EVENTS) return;
+    g_events[g_numEvents].timestampMs = timestampMs;
+    g_events[g_numEvents].statusByte = statusByte;
+    g_events[g_numEvents].dataBytes[0] = dataByte0;
+    g_events[g_numEvents].dataBytes[1] = dataByte1;
+    ++g_numEvents;
+}
+
+
+static void buildEventList(void)
+{
+    //A busy project across all 16 channels, with a large chord on every bar
+    //line and the odd single data byte message (program change)
+    uint32_t randomState = 0x1234567;
+    uint16_t noteOffAtStep[16][128];    //Step + 1, zero when the note is not playing
+    uint8_t numNotes;
+    uint8_t channel;
+    uint8_t noteNum;
+
+    memset(noteOffAtStep, 0, sizeof(noteOffAtStep));
+    g_numEvents = 0;
+
+    for(uint32_t step = 0; step < SIM_NUM_STEPS; ++step)
+    {
+        for(channel = 0; channel < 16; ++channel)
+        {
+            for(noteNum = 0; noteNum < 128; ++noteNum)
+            {
+                if(noteOffAtStep[channel][noteNum] == (step + 1))
+                {
+                    addEvent(step * SIM_STEP_MS, 0x80 | channel, noteNum, 0);
+                    noteOffAtStep[channel][noteNum] = 0;
+                }
+            }
+        }
+
+        if((step % 16) == 0) addEvent(step * SIM_STEP_MS, 0xC0 | (step / 16 % 16), (uint8_t)step, 0);
+
+        numNotes = ((step % 16) == 0) ? 12 : (hostTest_random(&randomState) % 6);
+        for(uint8_t a = 0; a < numNotes; ++a)
+        {
+            channel = hostTest_random(&randomState) % 16;
+            noteNum = 36 + (hostTest_random(&randomState) % 48);
+            if(noteOffAtStep[channel][noteNum] != 0) continue;
+            addEvent(step * SIM_STEP_MS, 0x90 | channel, noteNum, 100);
+            noteOffAtStep[channel][noteNum] = (uint16_t)(step + 2 + (hostTest_random(&randomState) % 4));
+        }
+    }
+}
+
+
+static bool queuePacket(const uint8_t * packetPtr, uint16_t numBytes)
+{
+    //Stands in for 'ble_gattc_write_no_rsp_flat', which fails when out of buffers
+    SimPacket * slotPtr;
+
+    if(g_aclQueueNumItems >= SIM_ACL_BUF_COUNT) return false;
+    slotPtr = &g_aclQueue[(g_aclQueueHead + g_aclQueueNumItems) % SIM_ACL_BUF_COUNT];
+    memcpy(slotPtr->bytes, packetPtr, numBytes);
+    slotPtr->numBytes = numBytes;
+    ++g_aclQueueNumItems;
+    return true;
+}
+
+
+static void receivePacket(const SimPacket * packetPtr, uint32_t arrivalMicros, uint32_t * nextEventIdxPtr, SimResult * resultPtr)
+{
+    //Both units run from their own millisecond clock, which are assumed to
+    //agree, 'arrivalMicros' is the time since the stream was started
+    uint32_t receiverNowMs = SIM_CLOCK_AT_START_MS + (arrivalMicros / 1000);
+    uint16_t packetIdx = 1;
+    uint16_t timestamp13;
+    int32_t timestampDiffMs;
+    uint32_t playAtMs;
+    uint32_t expectedMicros;
+    uint32_t playMicros;
+    const MidiPlaybackEvent * expectedPtr;
+    uint8_t headerBits = packetPtr->bytes[0] & BLE_MIDI_TIMESTAMP_HIGH_MASK;
+    uint8_t numDataBytes;
+
+    HOST_TEST_CHECK((packetPtr->bytes[0] & 0xC0) == BLE_MIDI_HEADER_BYTE_FLAG);
+    ++resultPtr->numPackets;
+
+    while(packetIdx < packetPtr->numBytes)
+    {
+        HOST_TEST_CHECK(packetPtr->bytes[packetIdx] & BLE_MIDI_TIMESTAMP_BYTE_FLAG);
+        timestamp13 = ((uint16_t)headerBits << BLE_MIDI_TIMESTAMP_HIGH_SHIFT) | (packetPtr->bytes[packetIdx++] & BLE_MIDI_TIMESTAMP_LOW_MASK);
+
+        //The nearest time to 'now' with these low 13 bits
+        timestampDiffMs = (int32_t)((timestamp13 + SIM_TIMESTAMP_MODULUS - (receiverNowMs % SIM_TIMESTAMP_MODULUS)) % SIM_TIMESTAMP_MODULUS);
+        if(timestampDiffMs >= (SIM_TIMESTAMP_MODULUS / 2)) timestampDiffMs -= SIM_TIMESTAMP_MODULUS;
+        playAtMs = (uint32_t)((int32_t)receiverNowMs + timestampDiffMs);
+
+        if(*nextEventIdxPtr >= g_numEvents)
+        {
+            ++resultPtr->numContentErrors;
+            return;
+        }
+        expectedPtr = &g_events[(*nextEventIdxPtr)++];
+        numDataBytes = ((expectedPtr->statusByte & 0xF0) == 0xC0 || (expectedPtr->statusByte & 0xF0) == 0xD0) ? 1 : 2;
+
+        if(playAtMs != (SIM_STREAM_START_MS + expectedPtr->timestampMs)) ++resultPtr->numTimestampErrors;
+        if((packetPtr->bytes[packetIdx] != expectedPtr->statusByte) ||
+           (packetPtr->bytes[packetIdx + 1] != expectedPtr->dataBytes[0]) ||
+           ((numDataBytes == 2) && (packetPtr->bytes[packetIdx + 2] != expectedPtr->dataBytes[1])))
+        {
+            ++resultPtr->numContentErrors;
+        }
+        packetIdx += 1 + numDataBytes;
+
+        //Played at its timestamp, or straight away if it arrived too late
+        expectedMicros = (SIM_LOOKAHEAD_MS + expectedPtr->timestampMs) * 1000;
+        playMicros = (arrivalMicros > expectedMicros) ? arrivalMicros : expectedMicros;
+        if(playMicros > expectedMicros)
+        {
+            ++resultPtr->numEventsLate;
+            resultPtr->totalLateMicros += playMicros - expectedMicros;
+            if((playMicros - expectedMicros) > resultPtr->maxLateMicros) resultPtr->maxLateMicros = playMicros - expectedMicros;
+        }
+        else if((expectedMicros - arrivalMicros) < resultPtr->minLeadMicros)
+        {
+            resultPtr->minLeadMicros = expectedMicros - arrivalMicros;
+        }
+        ++resultPtr->numEventsReceived;
+    }
+}
+
+
+static void runScenario(const SimScenario * scenarioPtr, SimResult * resultPtr)
+{
+    uint32_t randomState = 0xBADC0DE;
+    uint8_t packet[SIM_MAX_PACKET_NUM_BYTES];
+    uint16_t packetNumBytes;
+    uint16_t maxPacketNumBytes = scenarioPtr->mtu - 3;
+    uint32_t nextEventIdx = 0;
+    uint32_t numEventsEncoded;
+    uint32_t receiveIdx = 0;
+    uint32_t nextTaskWakeMicros = 0;
+    uint32_t nextConnEventMicros = scenarioPtr->connIntervalMicros;
+    uint32_t lastEventMicros = g_events[g_numEvents - 1].timestampMs * 1000;
+    uint32_t nowMs;
+
+    memset(resultPtr, 0, sizeof(SimResult));
+    resultPtr->minLeadMicros = UINT32_MAX;
+    g_aclQueueHead = 0;
+    g_aclQueueNumItems = 0;
+
+    for(uint32_t nowMicros = 0; (receiveIdx < g_numEvents) && (nowMicros < (lastEventMicros + 2000000)); nowMicros += SIM_STEP_MICROS)
+    {
+        if(nowMicros >= nextTaskWakeMicros)
+        {
+            //As bleCentral.c state 5
+            nowMs = SIM_CLOCK_AT_START_MS + (nowMicros / 1000);
+            while(nextEventIdx < g_numEvents)
+            {
+                packetNumBytes = bleMidi_encodeEventPacket(packet, maxPacketNumBytes, &g_events[nextEventIdx], (g_numEvents - nextEventIdx),
+                                                           SIM_STREAM_START_MS, ((nowMs + SIM_LOOKAHEAD_MS) - SIM_STREAM_START_MS), &numEventsEncoded);
+                if(packetNumBytes == 0) break;
+                if(!queuePacket(packet, packetNumBytes))
+                {
+                    ++resultPtr->numWriteRetries;
+                    break;
+                }
+                nextEventIdx += numEventsEncoded;
+            }
+
+            nextTaskWakeMicros += SIM_TICK_MICROS;
+            if(scenarioPtr->maxTaskJitterMicros != 0) nextTaskWakeMicros += hostTest_random(&randomState) % scenarioPtr->maxTaskJitterMicros;
+        }
+
+        if(nowMicros >= nextConnEventMicros)
+        {
+            if((hostTest_random(&randomState) % 100) >= scenarioPtr->missedConnEventPercent)
+            {
+                for(uint8_t a = 0; (a < scenarioPtr->maxPacketsPerConnEvent) && (g_aclQueueNumItems != 0); ++a)
+                {
+                    receivePacket(&g_aclQueue[g_aclQueueHead], nowMicros, &receiveIdx, resultPtr);
+                    g_aclQueueHead = (g_aclQueueHead + 1) % SIM_ACL_BUF_COUNT;
+                    --g_aclQueueNumItems;
+                }
+            }
+            nextConnEventMicros += scenarioPtr->connIntervalMicros;
+        }
+    }
+}
+
+
+int main(void)
+{
+    SimResult result;
+
+    buildEventList();
+    printf("%u events over %u ms, lookahead %u ms\n", g_numEvents, g_events[g_numEvents - 1].timestampMs, SIM_LOOKAHEAD_MS);
+    printf("%-28s %8s %8s %8s %8s %10s %10s %10s\n", "scenario", "packets", "retries", "late", "late %", "avg late", "max late", "min lead");
+
+    for(uint32_t idx = 0; idx < (sizeof(g_scenarios) / sizeof(g_scenarios[0])); ++idx)
+    {
+        runScenario(&g_scenarios[idx], &result);
+
+        printf("%-28s %8u %8u %8u %7.2f%% %8.2fms %8.2fms %8.2fms\n", g_scenarios[idx].namePtr, result.numPackets, result.numWriteRetries,
+               result.numEventsLate, (100.0 * result.numEventsLate) / g_numEvents,
+               result.numEventsLate ? (result.totalLateMicros / 1000.0) / result.numEventsLate : 0.0,
+               result.maxLateMicros / 1000.0, (result.minLeadMicros == UINT32_MAX) ? 0.0 : result.minLeadMicros / 1000.0);
+
+        //Whatever the link does, every event arrives once, in order, intact
+        //and with a timestamp the receiver can place exactly
+        HOST_TEST_CHECK(result.numEventsReceived == g_numEvents);
+        HOST_TEST_CHECK(result.numTimestampErrors == 0);
+        HOST_TEST_CHECK(result.numContentErrors == 0);
+        if(g_scenarios[idx].isExpectedOnTime) HOST_TEST_CHECK(result.numEventsLate == 0);
+    }
+
+    return hostTest_finish("bleMidiStreamSim");
+}
@@ -0,0 +1,380 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "ipsDisplay.h"
+#include "ipsDisplayPrivate.h"
+#include "frameBuffer.h"
+#include "systemTextFont/include/Font32.h"
+#include "hostTest.h"
+
+
+//Draws into a screen sized framebuffer the way the display driver does (fills,
+//lines and rectangle outlines are all solid fills) and checks the dirty
+//rectangles the drawing leaves behind: which ones merge, which are kept solid,
+//the order they come out in and the SPI bytes a flush of them costs. The last
+//frame is written out as 'frameBufferTest.ppm' (in the directory ctest runs the
+//test from) so it can be looked at.
+
+//A menu page (a cleared screen with text over it) is then flushed to a stand in
+//for the panel's memory, applying each dirty rect in the order a flush takes
+//them. Solid rects are filled with their colour, as 'flushSolidRect' sends them,
+//the rest are copied from the framebuffer. The panel must end up matching the
+//framebuffer, with the clear sent as one solid rect.
+
+#define SCREEN_NUM_PIXELS       (SCREEN_NUM_X_PIXELS * SCREEN_NUM_Y_PIXELS)
+#define PPM_FILE_PATH           "frameBufferTest.ppm"
+
+static uint16_t g_pixels[SCREEN_NUM_PIXELS];
+static uint16_t g_panelPixels[SCREEN_NUM_PIXELS];
+static FrameBuffer g_frameBuffer;
+
+
+
+static FrameBufferRect makeRect(uint16_t xStart, uint16_t yStart, uint16_t xEnd, uint16_t yEnd)
+{
+    FrameBufferRect rect = {.xStart = xStart, .yStart = yStart, .xEnd = xEnd, .yEnd = yEnd};
+    return rect;
+}
+
+
+static bool isSameRect(const FrameBufferRect * aPtr, const FrameBufferRect * bPtr)
+{
+    return ((aPtr->xStart == bPtr->xStart) && (aPtr->yStart == bPtr->yStart) && (aPtr->xEnd == bPtr->xEnd) && (aPtr->yEnd == bPtr->yEnd));
+}
+
+
+static void drawRectOutline(const FrameBufferRect * rectPtr, uint8_t linePx, ScreenColour colour)
+{
+    //As 'IPSDisplay_drawRectangleToScreen', two vertical then two horizontal lines
+    FrameBufferRect line;
+
+    line = makeRect(rectPtr->xStart, rectPtr->yStart, rectPtr->xStart + (linePx - 1), rectPtr->yEnd);
+    frameBuffer_fillRect(&g_frameBuffer, &line, colour);
+    line = makeRect(rectPtr->xEnd - (linePx - 1), rectPtr->yStart, rectPtr->xEnd, rectPtr->yEnd);
+    frameBuffer_fillRect(&g_frameBuffer, &line, colour);
+    line = makeRect(rectPtr->xStart, rectPtr->yStart, rectPtr->xEnd, rectPtr->yStart + (linePx - 1));
+    frameBuffer_fillRect(&g_frameBuffer, &line, colour);
+    line = makeRect(rectPtr->xStart, rectPtr->yEnd - (linePx - 1), rectPtr->xEnd, rectPtr->yEnd);
+    frameBuffer_fillRect(&g_frameBuffer, &line, colour);
+}
+
+
+static uint16_t drawText(const char * textPtr, uint16_t xStart, uint16_t yStart, ScreenColour colour)
+{
+    //As 'IPSDisplay_drawLineOfTextToScreen', each character is decoded from the
+    //run length encoded font into the framebuffer and marks its own area dirty.
+    //RETURNS: The width of the text in pixels.
+
+    FrameBufferRect drawArea;
+    uint16_t totalWidth = 0;
+    uint16_t pixelIdx;
+    uint16_t numPixels;
+    uint8_t charTableIdx;
+    uint8_t width;
+    uint8_t charColumn;
+    uint8_t charRow;
+    uint8_t rleIdx;
+    uint16_t pixelColour;
+
+    for(const char * charPtr = textPtr; *charPtr != '\0'; ++charPtr)
+    {
+        charTableIdx = *charPtr - 32;
+        width = widtbl_f32[charTableIdx];
+        numPixels = width * chr_hgt_f32;
+        pixelIdx = 0;
+        charColumn = 0;
+        charRow = 0;
+        rleIdx = 0;
+
+        do
+        {
+            pixelColour = (chrtbl_f32[charTableIdx][rleIdx] & 0x80) ? frameBuffer_toWireOrder(colour) : frameBuffer_toWireOrder(screenColourBlack);
+            for(uint8_t pixelNum = 0; (pixelNum <= (chrtbl_f32[charTableIdx][rleIdx] & 0x7F)) && (pixelIdx < numPixels); ++pixelNum)
+            {
+                if(((xStart + charColumn) < SCREEN_NUM_X_PIXELS) && ((yStart + charRow) < SCREEN_NUM_Y_PIXELS))
+                {
+                    *frameBuffer_getPixelPtr(&g_frameBuffer, (xStart + charColumn), (yStart + charRow)) = pixelColour;
+                }
+
+                ++pixelIdx;
+                if(++charColumn == width)
+                {
+                    charColumn = 0;
+                    ++charRow;
+                }
+            }
+            ++rleIdx;
+        } while(pixelIdx < numPixels);
+
+        drawArea = makeRect(xStart, yStart, xStart + (width - 1), yStart + (chr_hgt_f32 - 1));
+        if(frameBuffer_clipRect(&g_frameBuffer, &drawArea)) frameBuffer_markDirty(&g_frameBuffer, &drawArea);
+
+        xStart += width + SPACE_BETWEEN_CHARS_IN_PIXELS;
+        totalWidth += width + SPACE_BETWEEN_CHARS_IN_PIXELS;
+    }
+
+    return totalWidth;
+}
+
+
+static uint32_t takeAllDirtyRects(uint32_t * numRectsPtr, uint32_t * numSolidPtr)
+{
+    //Empties the list as a flush would.
+    //RETURNS: The SPI bytes the flush would have sent.
+
+    FrameBufferDirtyRect dirtyRect;
+    uint32_t numBytes = 0;
+
+    *numRectsPtr = 0;
+    *numSolidPtr = 0;
+    while(frameBuffer_takeDirtyRect(&g_frameBuffer, &dirtyRect))
+    {
+        numBytes += frameBuffer_getRectNumSPIBytes(&dirtyRect.rect);
+        ++*numRectsPtr;
+        if(dirtyRect.isSolid) ++*numSolidPtr;
+    }
+    return numBytes;
+}
+
+
+static void testFills(void)
+{
+    FrameBufferRect screen = makeRect(0, 0, SCREEN_NUM_X_PIXELS - 1, SCREEN_NUM_Y_PIXELS - 1);
+    FrameBufferRect offScreen = makeRect(SCREEN_NUM_X_PIXELS - 10, SCREEN_NUM_Y_PIXELS - 10, SCREEN_NUM_X_PIXELS + 10, SCREEN_NUM_Y_PIXELS + 10);
+    FrameBufferRect clipped = makeRect(SCREEN_NUM_X_PIXELS - 10, SCREEN_NUM_Y_PIXELS - 10, SCREEN_NUM_X_PIXELS - 1, SCREEN_NUM_Y_PIXELS - 1);
+    FrameBufferRect inside = makeRect(100, 100, 120, 120);
+    FrameBufferDirtyRect dirtyRect;
+    uint32_t numRects;
+    uint32_t numSolid;
+
+    frameBuffer_init(&g_frameBuffer, g_pixels, SCREEN_NUM_X_PIXELS, SCREEN_NUM_Y_PIXELS);
+    HOST_TEST_CHECK(!frameBuffer_takeDirtyRect(&g_frameBuffer, &dirtyRect));
+
+    //Pixels are stored byte swapped, ready for the wire
+    frameBuffer_fillRect(&g_frameBuffer, &screen, 0x1234);
+    HOST_TEST_CHECK(g_pixels[0] == 0x3412);
+    HOST_TEST_CHECK(g_pixels[SCREEN_NUM_PIXELS - 1] == 0x3412);
+    HOST_TEST_CHECK(g_frameBuffer.numDirtyRects == 1);
+    HOST_TEST_CHECK(g_frameBuffer.dirtyRects[0].isSolid && (g_frameBuffer.dirtyRects[0].solidColour == 0x3412));
+
+    //A fill inside a solid rect is kept as its own solid rect, and flushed after it
+    frameBuffer_fillRect(&g_frameBuffer, &inside, screenColourWhite);
+    HOST_TEST_CHECK(g_frameBuffer.numDirtyRects == 2);
+    HOST_TEST_CHECK(takeAllDirtyRects(&numRects, &numSolid) == (frameBuffer_getRectNumSPIBytes(&screen) + frameBuffer_getRectNumSPIBytes(&inside)));
+    HOST_TEST_CHECK((numRects == 2) && (numSolid == 2));
+
+    //Clipped to the screen, and nothing at all when wholly off it
+    frameBuffer_fillRect(&g_frameBuffer, &offScreen, screenColourWhite);
+    HOST_TEST_CHECK((g_frameBuffer.numDirtyRects == 1) && isSameRect(&g_frameBuffer.dirtyRects[0].rect, &clipped));
+    offScreen = makeRect(SCREEN_NUM_X_PIXELS, 0, SCREEN_NUM_X_PIXELS + 5, 5);
+    frameBuffer_fillRect(&g_frameBuffer, &offScreen, screenColourWhite);
+    HOST_TEST_CHECK(g_frameBuffer.numDirtyRects == 1);
+
+    //A later fill that covers it swallows it
+    frameBuffer_fillRect(&g_frameBuffer, &screen, screenColourBlack);
+    HOST_TEST_CHECK((g_frameBuffer.numDirtyRects == 1) && isSameRect(&g_frameBuffer.dirtyRects[0].rect, &screen));
+    HOST_TEST_CHECK(takeAllDirtyRects(&numRects, &numSolid) == (FRAME_BUFFER_WINDOW_NUM_BYTES + (SCREEN_NUM_PIXELS * sizeof(uint16_t))));
+}
+
+
+static void testLinesAndOutlines(void)
+{
+    //Two overlapping rectangle outlines, 2px lines. Solid lines are never
+    //merged, so each outline is four rects and the flush sends the pixels
+    //where they overlap twice.
+
+    FrameBufferRect outerRect = makeRect(20, 20, 179, 139);
+    FrameBufferRect innerRect = makeRect(100, 80, 259, 199);
+    uint32_t expectedNumBytes = 0;
+    uint32_t numRects;
+    uint32_t numSolid;
+
+    frameBuffer_init(&g_frameBuffer, g_pixels, SCREEN_NUM_X_PIXELS, SCREEN_NUM_Y_PIXELS);
+    drawRectOutline(&outerRect, px2, screenColourWhite);
+    drawRectOutline(&innerRect, px2, screenColourWhite);
+    HOST_TEST_CHECK(g_frameBuffer.numDirtyRects == 8);
+
+    for(uint8_t idx = 0; idx < g_frameBuffer.numDirtyRects; ++idx)
+    {
+        HOST_TEST_CHECK(g_frameBuffer.dirtyRects[idx].isSolid);
+        expectedNumBytes += frameBuffer_getRectNumSPIBytes(&g_frameBuffer.dirtyRects[idx].rect);
+    }
+
+    //Each outline, a window per line plus its pixels (corners sent twice)
+    HOST_TEST_CHECK(expectedNumBytes == (8 * FRAME_BUFFER_WINDOW_NUM_BYTES) + (2 * 2 * sizeof(uint16_t) * ((160 * 2) + (120 * 2))));
+    HOST_TEST_CHECK(takeAllDirtyRects(&numRects, &numSolid) == expectedNumBytes);
+    HOST_TEST_CHECK((numRects == 8) && (numSolid == 8));
+
+    //Drawn where the outlines cross
+    HOST_TEST_CHECK(g_pixels[(20 * SCREEN_NUM_X_PIXELS) + 100] == frameBuffer_toWireOrder(screenColourWhite));
+    HOST_TEST_CHECK(g_pixels[(80 * SCREEN_NUM_X_PIXELS) + 178] == frameBuffer_toWireOrder(screenColourWhite));
+}
+
+
+static void testMerges(void)
+{
+    FrameBufferRect first = makeRect(10, 10, 29, 35);
+    FrameBufferRect nextTo = makeRect(31, 10, 50, 35);          //1px gap, as between characters
+    FrameBufferRect farAway = makeRect(200, 150, 219, 175);
+    FrameBufferRect within = makeRect(15, 15, 40, 30);
+    FrameBufferRect solidOver = makeRect(0, 0, 60, 40);
+    FrameBufferRect merged = makeRect(10, 10, 50, 35);
+    FrameBufferRect rect;
+    uint32_t numRects;
+    uint32_t numSolid;
+
+    frameBuffer_init(&g_frameBuffer, g_pixels, SCREEN_NUM_X_PIXELS, SCREEN_NUM_Y_PIXELS);
+
+    //Neighbours merge, a rect far away costs less as its own window
+    frameBuffer_markDirty(&g_frameBuffer, &first);
+    frameBuffer_markDirty(&g_frameBuffer, &nextTo);
+    frameBuffer_markDirty(&g_frameBuffer, &farAway);
+    HOST_TEST_CHECK(g_frameBuffer.numDirtyRects == 2);
+    HOST_TEST_CHECK(isSameRect(&g_frameBuffer.dirtyRects[0].rect, &merged) || isSameRect(&g_frameBuffer.dirtyRects[1].rect, &merged));
+
+    //Inside one already there, nothing to add
+    frameBuffer_markDirty(&g_frameBuffer, &within);
+    HOST_TEST_CHECK(g_frameBuffer.numDirtyRects == 2);
+
+    //A solid fill over the merged rect replaces it
+    frameBuffer_fillRect(&g_frameBuffer, &solidOver, screenColourBlack);
+    HOST_TEST_CHECK(g_frameBuffer.numDirtyRects == 2);
+
+    //Text drawn over the solid fill is kept apart from it, and flushed after
+    frameBuffer_markDirty(&g_frameBuffer, &within);
+    HOST_TEST_CHECK(g_frameBuffer.numDirtyRects == 3);
+    HOST_TEST_CHECK(takeAllDirtyRects(&numRects, &numSolid) == (frameBuffer_getRectNumSPIBytes(&solidOver) +
+                                                               frameBuffer_getRectNumSPIBytes(&farAway) + frameBuffer_getRectNumSPIBytes(&within)));
+    HOST_TEST_CHECK((numRects == 3) && (numSolid == 1));
+
+    //A full list folds the next rect into the one that grows the least
+    for(uint8_t idx = 0; idx < FRAME_BUFFER_MAX_DIRTY_RECTS; ++idx)
+    {
+        rect = makeRect(idx * 40, (idx & 1) * 200, (idx * 40) + 9, ((idx & 1) * 200) + 9);
+        frameBuffer_fillRect(&g_frameBuffer, &rect, screenColourWhite);
+    }
+    HOST_TEST_CHECK(g_frameBuffer.numDirtyRects == FRAME_BUFFER_MAX_DIRTY_RECTS);
+    rect = makeRect(12, 2, 14, 4);
+    frameBuffer_markDirty(&g_frameBuffer, &rect);
+    HOST_TEST_CHECK(g_frameBuffer.numDirtyRects == FRAME_BUFFER_MAX_DIRTY_RECTS);
+    rect = makeRect(0, 0, 14, 9);
+    HOST_TEST_CHECK(isSameRect(&g_frameBuffer.dirtyRects[0].rect, &rect) && !g_frameBuffer.dirtyRects[0].isSolid);
+    HOST_TEST_CHECK(takeAllDirtyRects(&numRects, &numSolid) ==
+                    ((FRAME_BUFFER_MAX_DIRTY_RECTS * FRAME_BUFFER_WINDOW_NUM_BYTES) + ((((FRAME_BUFFER_MAX_DIRTY_RECTS - 1) * 100) + 150) * sizeof(uint16_t))));
+    HOST_TEST_CHECK((numRects == FRAME_BUFFER_MAX_DIRTY_RECTS) && (numSolid == (FRAME_BUFFER_MAX_DIRTY_RECTS - 1)));
+}
+
+
+static void flushToPanel(uint32_t * numRectsPtr, uint32_t * numSolidPtr, FrameBufferDirtyRect * firstDirtyRectPtr)
+{
+    //Applies every dirty rect to the panel, in the order a flush takes them
+
+    FrameBufferDirtyRect dirtyRect;
+    uint16_t * panelRowPtr;
+    uint16_t rowWidth;
+
+    *numRectsPtr = 0;
+    *numSolidPtr = 0;
+    while(frameBuffer_takeDirtyRect(&g_frameBuffer, &dirtyRect))
+    {
+        if(*numRectsPtr == 0) *firstDirtyRectPtr = dirtyRect;
+        ++*numRectsPtr;
+        if(dirtyRect.isSolid) ++*numSolidPtr;
+
+        rowWidth = (dirtyRect.rect.xEnd - dirtyRect.rect.xStart) + 1;
+        for(uint16_t y = dirtyRect.rect.yStart; y <= dirtyRect.rect.yEnd; ++y)
+        {
+            panelRowPtr = &g_panelPixels[((uint32_t)y * SCREEN_NUM_X_PIXELS) + dirtyRect.rect.xStart];
+            if(dirtyRect.isSolid)
+            {
+                for(uint16_t x = 0; x < rowWidth; ++x) panelRowPtr[x] = dirtyRect.solidColour;
+            }
+            else memcpy(panelRowPtr, frameBuffer_getPixelPtr(&g_frameBuffer, dirtyRect.rect.xStart, y), rowWidth * sizeof(uint16_t));
+        }
+    }
+}
+
+
+static void testClearThenText(void)
+{
+    //A menu page: clear the screen and draw a title, then a highlight bar
+    //behind the selected item (after the title), then the items over it
+
+    FrameBufferRect screen = makeRect(0, 0, SCREEN_NUM_X_PIXELS - 1, SCREEN_NUM_Y_PIXELS - 1);
+    FrameBufferRect highlight = makeRect(0, 90, SCREEN_NUM_X_PIXELS - 1, 90 + chr_hgt_f32 + 3);
+    FrameBufferDirtyRect firstDirtyRect = {0};
+    uint32_t randomState = 0x1F3D;
+    uint32_t numRects;
+    uint32_t numSolid;
+    uint16_t titleWidth;
+
+    //Whatever the panel showed before
+    for(uint32_t idx = 0; idx < SCREEN_NUM_PIXELS; ++idx) g_panelPixels[idx] = (uint16_t)hostTest_random(&randomState);
+
+    //As 'IPSDisplay_fillScreenWithColour'
+    frameBuffer_init(&g_frameBuffer, g_pixels, SCREEN_NUM_X_PIXELS, SCREEN_NUM_Y_PIXELS);
+    frameBuffer_fillRect(&g_frameBuffer, &screen, screenColourBlack);
+    titleWidth = drawText("Velocity", 10, 10, screenColourWhite);
+
+    //The characters of a line merge into one rect
+    HOST_TEST_CHECK(g_frameBuffer.numDirtyRects == 2);
+    HOST_TEST_CHECK((g_frameBuffer.dirtyRects[1].rect.xStart == 10) && (g_frameBuffer.dirtyRects[1].rect.xEnd < (10 + titleWidth)));
+
+    frameBuffer_fillRect(&g_frameBuffer, &highlight, screenColourWhite);
+    drawText("Note 64", 10, 92, screenColourWhite);
+    drawText("Step 12", 10, 150, screenColourWhite);
+
+    flushToPanel(&numRects, &numSolid, &firstDirtyRect);
+
+    //The clear goes out first as a single solid rect, the
+    //highlight next, then a rect per line of text
+    HOST_TEST_CHECK(firstDirtyRect.isSolid && isSameRect(&firstDirtyRect.rect, &screen));
+    HOST_TEST_CHECK(firstDirtyRect.solidColour == frameBuffer_toWireOrder(screenColourBlack));
+    HOST_TEST_CHECK((numRects == 5) && (numSolid == 2));
+    HOST_TEST_CHECK(memcmp(g_panelPixels, g_pixels, sizeof(g_pixels)) == 0);
+}
+
+
+static void testWritePPM(void)
+{
+    FrameBufferRect screen = makeRect(0, 0, SCREEN_NUM_X_PIXELS - 1, SCREEN_NUM_Y_PIXELS - 1);
+    FrameBufferRect outline = makeRect(40, 40, SCREEN_NUM_X_PIXELS - 41, SCREEN_NUM_Y_PIXELS - 41);
+    char header[32];
+    uint8_t rgb[3];
+    long numHeaderBytes;
+    long numFileBytes;
+    FILE * filePtr;
+
+    frameBuffer_init(&g_frameBuffer, g_pixels, SCREEN_NUM_X_PIXELS, SCREEN_NUM_Y_PIXELS);
+    frameBuffer_fillRect(&g_frameBuffer, &screen, screenColourBlack);
+    drawRectOutline(&outline, px4, screenColourWhite);
+    HOST_TEST_CHECK(frameBuffer_writePPM(&g_frameBuffer, PPM_FILE_PATH));
+
+    filePtr = fopen(PPM_FILE_PATH, "rb");
+    HOST_TEST_CHECK(filePtr != NULL);
+    if(filePtr == NULL) return;
+
+    numHeaderBytes = snprintf(header, sizeof(header), "P6\n%d %d\n255\n", SCREEN_NUM_X_PIXELS, SCREEN_NUM_Y_PIXELS);
+    fseek(filePtr, 0, SEEK_END);
+    numFileBytes = ftell(filePtr);
+    HOST_TEST_CHECK(numFileBytes == (numHeaderBytes + (SCREEN_NUM_PIXELS * 3)));
+
+    //The panel inverts colours, so the black fill is black in the image and the outline white
+    fseek(filePtr, numHeaderBytes, SEEK_SET);
+    HOST_TEST_CHECK((fread(rgb, 1, sizeof(rgb), filePtr) == sizeof(rgb)) && (rgb[0] == 0) && (rgb[1] == 0) && (rgb[2] == 0));
+    fseek(filePtr, numHeaderBytes + ((((40 * SCREEN_NUM_X_PIXELS) + 40)) * 3), SEEK_SET);
+    HOST_TEST_CHECK((fread(rgb, 1, sizeof(rgb), filePtr) == sizeof(rgb)) && (rgb[0] == 0xF8) && (rgb[1] == 0xFC) && (rgb[2] == 0xF8));
+    fclose(filePtr);
+}
+
+
+int main(void)
+{
+    testFills();
+    testLinesAndOutlines();
+    testMerges();
+    testClearThenText();
+    testWritePPM();
+    return hostTest_finish("frameBufferTest");
+}
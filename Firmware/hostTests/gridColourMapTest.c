@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "driver/i2c.h"
+#include "ledDrivers.h"
+#include "midiHelper.h"
+#include "gridManager.h"
+#include "gridColourMap/gridColourMap.h"
+#include "hostTest.h"
+
+
+//Tests the note colour palette, then renders a grid through gridManager and
+//the LED driver (on the mock I2C bus) to check a colour change only resends
+//the cells it touches.
+
+#define GRID_ROW                64
+#define NUM_VELOCITIES          128
+
+typedef struct
+{
+    uint8_t red;
+    uint8_t green;
+    uint8_t blue;
+} TestRGB;
+
+
+
+static TestRGB splitColour(uint32_t colour)
+{
+    TestRGB rgb = {(uint8_t)(colour >> 16), (uint8_t)(colour >> 8), (uint8_t)colour};
+    return rgb;
+}
+
+
+static void testPalette(void)
+{
+    uint32_t fullColours[COLOUR_MAP_NUM_CHANNELS];
+    uint32_t colour;
+    uint32_t lastColour;
+    TestRGB rgb;
+    TestRGB lastRgb;
+    bool isMonotonic = true;
+    bool isAlwaysVisible = true;
+    bool isSameForLevel = true;
+    bool areHuesDistinct = true;
+
+    gridColourMap_init();
+
+    //Channel 0 keeps the green every note used to be
+    HOST_TEST_CHECK(gridColourMap_getNoteColour(0x90, 127) == 0x0000FF00);
+
+    for(uint8_t channel = 0; channel < COLOUR_MAP_NUM_CHANNELS; ++channel)
+    {
+        lastColour = 0;
+        for(uint8_t velocity = 0; velocity < NUM_VELOCITIES; ++velocity)
+        {
+            colour = gridColourMap_getNoteColour(0x90 | channel, velocity);
+            rgb = splitColour(colour);
+            lastRgb = splitColour(lastColour);
+
+            //Brighter (or the same) in every component as velocity rises
+            if((velocity > 0) && ((rgb.red < lastRgb.red) || (rgb.green < lastRgb.green) || (rgb.blue < lastRgb.blue))) isMonotonic = false;
+            if(colour == 0) isAlwaysVisible = false;
+            if((colour & 0xFF000000) != 0) isAlwaysVisible = false;
+
+            //Velocities in the same level share a colour
+            if(((velocity & ((1 << COLOUR_MAP_VELOCITY_TO_LEVEL_SHIFT) - 1)) != 0) && (colour != lastColour)) isSameForLevel = false;
+            lastColour = colour;
+        }
+        fullColours[channel] = lastColour;
+    }
+
+    for(uint8_t a = 0; a < COLOUR_MAP_NUM_CHANNELS; ++a)
+    {
+        for(uint8_t b = a + 1; b < COLOUR_MAP_NUM_CHANNELS; ++b)
+        {
+            if(fullColours[a] == fullColours[b]) areHuesDistinct = false;
+        }
+    }
+
+    HOST_TEST_CHECK(isMonotonic);
+    HOST_TEST_CHECK(isAlwaysVisible);
+    HOST_TEST_CHECK(isSameForLevel);
+    HOST_TEST_CHECK(areHuesDistinct);
+
+    //Only the channel nibble of the status byte matters, and velocity is 7 bit
+    HOST_TEST_CHECK(gridColourMap_getNoteColour(0x83, 100) == gridColourMap_getNoteColour(0x93, 100));
+    HOST_TEST_CHECK(gridColourMap_getNoteColour(0x95, 0x80 | 20) == gridColourMap_getNoteColour(0x95, 20));
+
+    //Each channel fully saturated at full velocity, one component is always at max
+    for(uint8_t channel = 0; channel < COLOUR_MAP_NUM_CHANNELS; ++channel)
+    {
+        rgb = splitColour(fullColours[channel]);
+        HOST_TEST_CHECK((rgb.red == 0xFF) || (rgb.green == 0xFF) || (rgb.blue == 0xFF));
+    }
+}
+
+
+static MidiEventParams makeNote(uint16_t column, uint8_t channel, uint8_t velocity, uint8_t numSteps)
+{
+    MidiEventParams params = {0};
+    params.gridRow = GRID_ROW;
+    params.gridColumn = column;
+    params.statusByte = 0x90 | channel;
+    params.dataBytes[0] = GRID_ROW;
+    params.dataBytes[1] = velocity;
+    params.durationInSteps = numSteps;
+    return params;
+}
+
+
+static uint32_t renderAndWrite(uint32_t * numBytesPtr)
+{
+    //Renders the window at column 0, then writes the frame as the refresh task would.
+    //RETURNS: The number of I2C transactions the frame cost.
+
+    static ledDriverFrame_t frame;
+    I2cMockStats before = g_i2cMockStats;
+
+    gridManager_updateGridLEDs(GRID_ROW, 0);
+    HOST_TEST_CHECK(xQueueReceive(g_LedFrameQueueHandle, &frame, 0) == pdTRUE);
+    HOST_TEST_CHECK(ledDrivers_writeEntireGrid(frame.colours) == 0);
+
+    *numBytesPtr = g_i2cMockStats.numBytes - before.numBytes;
+    return g_i2cMockStats.numTransactions - before.numTransactions;
+}
+
+
+static void testOnlyChangedCellsResent(void)
+{
+    MidiEventParams note;
+    uint32_t numBytes;
+
+    g_LedFrameQueueHandle = xQueueCreate(1, sizeof(ledDriverFrame_t));
+    i2cMock_reset();
+    gridManager_init();
+
+    gridManager_addNewMidiEventToGrid(makeNote(0, 0, 100, 2));
+    gridManager_addNewMidiEventToGrid(makeNote(4, 9, 40, 1));
+    HOST_TEST_CHECK(renderAndWrite(&numBytes) == 4);    //First frame goes out in full
+
+    //Velocity change on a one step note, a single LED's registers are resent
+    note = makeNote(4, 9, 120, 1);
+    gridManager_updateMidiEventParameters(note);
+    HOST_TEST_CHECK(renderAndWrite(&numBytes) == 1);
+    HOST_TEST_CHECK(numBytes <= (3 + 2));
+
+    //Same colour again, nothing to send
+    HOST_TEST_CHECK(renderAndWrite(&numBytes) == 0);
+
+    //The playhead overlay touches one column, so one driver IC
+    gridManager_setPlayheadColumn(6);
+    HOST_TEST_CHECK(renderAndWrite(&numBytes) == 1);
+    gridManager_setPlayheadColumn(GRID_NO_OVERLAY_COLUMN);
+    HOST_TEST_CHECK(renderAndWrite(&numBytes) == 1);
+
+    //Selecting the two step note's first cell
+    gridManager_setSelectedCell(0, GRID_ROW);
+    HOST_TEST_CHECK(renderAndWrite(&numBytes) == 1);
+    HOST_TEST_CHECK(numBytes <= (3 + 2));
+}
+
+
+int main(void)
+{
+    testPalette();
+    testOnlyChangedCellsResent();
+    return hostTest_finish("gridColourMapTest");
+}
@@ -0,0 +1,271 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "ledDrivers.h"
+#include "midiHelper.h"
+#include "gridManager.h"
+#include "gridColourMap/gridColourMap.h"
+#include "hostTest.h"
+
+
+//Benchmarks 'gridManager_updateGridLEDs' (which clips the cached per row
+//note spans to the display window) at random scroll positions across a
+//1024 column project, against a render that walks each visible rows
+//notes from the start of the project, as the grid was rendered before the
+//span cache. Every render is also checked against that walk, including
+//after notes are added, removed and edited.
+
+//The firmware node pool holds 100 event nodes (two per note), which
+//caps the project at 49 notes. 48 are spread over six adjacent rows
+//so every visible row has notes to clip at any scroll position.
+
+#define PROJECT_NUM_COLUMNS     1024
+#define PROJECT_FIRST_ROW       60
+#define PROJECT_NUM_ROWS        6
+#define PROJECT_NOTES_PER_ROW   8
+#define NOTE_SPACING_COLUMNS    (PROJECT_NUM_COLUMNS / PROJECT_NOTES_PER_ROW)
+#define GRID_NUM_CELLS          (NUM_SEQUENCER_PHYSICAL_ROWS * NUM_SEQUENCER_PHYSICAL_COLUMNS)
+#define MAX_ROW_OFFSET          (PROJECT_FIRST_ROW + PROJECT_NUM_ROWS - 1)
+#define MIN_ROW_OFFSET          (PROJECT_FIRST_ROW - NUM_SEQUENCER_PHYSICAL_ROWS + 1)
+#define NUM_CHECKED_RENDERS     20000
+#define NUM_TIMED_RENDERS       1000000
+
+typedef struct
+{
+    bool isPresent;
+    uint16_t startColumn;
+    uint16_t endColumn;
+    uint8_t statusByte;
+    uint8_t velocity;
+} BenchNote;
+
+static BenchNote g_notes[PROJECT_NUM_ROWS][PROJECT_NOTES_PER_ROW];
+static rgbLedColour_t g_submittedFrame[GRID_NUM_CELLS];
+static uint32_t g_numSubmittedFrames = 0;
+
+
+//---- LED driver stand-ins, the rendered frame is kept for checking
+uint8_t ledDrivers_init(void)
+{
+    return 0;
+}
+
+void ledDrivers_submitFrame(rgbLedColour_t * rgbGridColours)
+{
+    memcpy(g_submittedFrame, rgbGridColours, sizeof(g_submittedFrame));
+    ++g_numSubmittedFrames;
+}
+
+
+
+
+static MidiEventParams getNoteParams(uint8_t rowIdx, uint8_t noteIdx)
+{
+    const BenchNote * notePtr = &g_notes[rowIdx][noteIdx];
+    MidiEventParams params = {0};
+
+    params.gridRow = PROJECT_FIRST_ROW + rowIdx;
+    params.gridColumn = notePtr->startColumn;
+    params.statusByte = notePtr->statusByte;
+    params.dataBytes[0] = PROJECT_FIRST_ROW + rowIdx;
+    params.dataBytes[1] = notePtr->velocity;
+    params.durationInSteps = notePtr->endColumn - notePtr->startColumn;
+    return params;
+}
+
+
+static void buildProject(void)
+{
+    uint32_t randomState = 0xC0FFEE;
+
+    for(uint8_t rowIdx = 0; rowIdx < PROJECT_NUM_ROWS; ++rowIdx)
+    {
+        for(uint8_t noteIdx = 0; noteIdx < PROJECT_NOTES_PER_ROW; ++noteIdx)
+        {
+            BenchNote * notePtr = &g_notes[rowIdx][noteIdx];
+            notePtr->startColumn = (noteIdx * NOTE_SPACING_COLUMNS) + (hostTest_random(&randomState) % 64);
+            notePtr->endColumn = notePtr->startColumn + 1 + (hostTest_random(&randomState) % 64);
+            notePtr->statusByte = 0x90 | (hostTest_random(&randomState) & 0x0F);
+            notePtr->velocity = 1 + (hostTest_random(&randomState) % 127);
+            notePtr->isPresent = true;
+
+            gridManager_addNewMidiEventToGrid(getNoteParams(rowIdx, noteIdx));
+        }
+    }
+}
+
+
+static void renderByWalkingNotes(uint8_t rowOffset, uint16_t columnOffset, rgbLedColour_t * framePtr)
+{
+    //Each visible row is walked from the start of the project
+    memset(framePtr, 0, GRID_NUM_CELLS * sizeof(rgbLedColour_t));
+
+    for(uint8_t relativeRow = 0; relativeRow < NUM_SEQUENCER_PHYSICAL_ROWS; ++relativeRow)
+    {
+        int32_t rowIdx = (int32_t)(rowOffset + relativeRow) - PROJECT_FIRST_ROW;
+        if((rowIdx < 0) || (rowIdx >= PROJECT_NUM_ROWS)) continue;
+
+        for(uint8_t noteIdx = 0; noteIdx < PROJECT_NOTES_PER_ROW; ++noteIdx)
+        {
+            const BenchNote * notePtr = &g_notes[rowIdx][noteIdx];
+            if(!notePtr->isPresent) continue;
+
+            for(uint16_t column = notePtr->startColumn; column < notePtr->endColumn; ++column)
+            {
+                if((column < columnOffset) || (column >= (columnOffset + NUM_SEQUENCER_PHYSICAL_COLUMNS))) continue;
+                framePtr[(relativeRow * NUM_SEQUENCER_PHYSICAL_COLUMNS) + (column - columnOffset)] =
+                    (rgbLedColour_t)gridColourMap_getNoteColour(notePtr->statusByte, notePtr->velocity);
+            }
+        }
+    }
+}
+
+
+static uint32_t checkRandomRenders(uint32_t * randomStatePtr)
+{
+    //RETURNS: The number of renders that didn't match
+    static const rgbLedColour_t emptyFrame[GRID_NUM_CELLS] = {rgb_off};
+    rgbLedColour_t expected[GRID_NUM_CELLS];
+    uint32_t numMismatches = 0;
+    uint32_t numEmptyFrames = 0;
+    uint8_t rowOffset;
+    uint16_t columnOffset;
+
+    for(uint32_t renderNum = 0; renderNum < NUM_CHECKED_RENDERS; ++renderNum)
+    {
+        rowOffset = MIN_ROW_OFFSET + (hostTest_random(randomStatePtr) % (MAX_ROW_OFFSET - MIN_ROW_OFFSET + 1));
+        columnOffset = hostTest_random(randomStatePtr) % (PROJECT_NUM_COLUMNS - NUM_SEQUENCER_PHYSICAL_COLUMNS + 1);
+
+        gridManager_updateGridLEDs(rowOffset, columnOffset);
+        renderByWalkingNotes(rowOffset, columnOffset, expected);
+        if(memcmp(expected, g_submittedFrame, sizeof(expected)) != 0) ++numMismatches;
+        if(memcmp(emptyFrame, g_submittedFrame, sizeof(emptyFrame)) == 0) ++numEmptyFrames;
+    }
+
+    //Most windows should have something in them to compare
+    HOST_TEST_CHECK(numEmptyFrames < ((NUM_CHECKED_RENDERS * 3) / 4));
+    return numMismatches;
+}
+
+
+static void testRendersMatch(void)
+{
+    uint32_t randomState = 0x2468ACE;
+    MidiEventParams params;
+
+    HOST_TEST_CHECK(checkRandomRenders(&randomState) == 0);
+
+    //Remove a note from every row
+    for(uint8_t rowIdx = 0; rowIdx < PROJECT_NUM_ROWS; ++rowIdx)
+    {
+        uint8_t noteIdx = (rowIdx * 3) % PROJECT_NOTES_PER_ROW;
+        if(!g_notes[rowIdx][noteIdx].isPresent) continue;
+        gridManager_removeMidiEventFromGrid(getNoteParams(rowIdx, noteIdx));
+        g_notes[rowIdx][noteIdx].isPresent = false;
+    }
+    HOST_TEST_CHECK(checkRandomRenders(&randomState) == 0);
+
+    //Change the velocity and length of a note in every row
+    for(uint8_t rowIdx = 0; rowIdx < PROJECT_NUM_ROWS; ++rowIdx)
+    {
+        uint8_t noteIdx = ((rowIdx * 3) + 1) % PROJECT_NOTES_PER_ROW;
+        if(!g_notes[rowIdx][noteIdx].isPresent) continue;
+        g_notes[rowIdx][noteIdx].velocity = 127 - g_notes[rowIdx][noteIdx].velocity;
+        g_notes[rowIdx][noteIdx].endColumn = g_notes[rowIdx][noteIdx].startColumn + 60;
+        params = getNoteParams(rowIdx, noteIdx);
+        gridManager_updateMidiEventParameters(params);
+    }
+    HOST_TEST_CHECK(checkRandomRenders(&randomState) == 0);
+
+    //Put the removed notes back, in the middle of their rows
+    for(uint8_t rowIdx = 0; rowIdx < PROJECT_NUM_ROWS; ++rowIdx)
+    {
+        uint8_t noteIdx = (rowIdx * 3) % PROJECT_NOTES_PER_ROW;
+        if(g_notes[rowIdx][noteIdx].isPresent || (g_notes[rowIdx][noteIdx].endColumn == 0)) continue;
+        gridManager_addNewMidiEventToGrid(getNoteParams(rowIdx, noteIdx));
+        g_notes[rowIdx][noteIdx].isPresent = true;
+    }
+    HOST_TEST_CHECK(checkRandomRenders(&randomState) == 0);
+}
+
+
+static void testOverlays(void)
+{
+    rgbLedColour_t expected[GRID_NUM_CELLS];
+    const uint16_t columnOffset = 500;
+
+    gridManager_setPlayheadColumn(columnOffset + 2);
+    gridManager_setSelectedCell(columnOffset + 5, PROJECT_FIRST_ROW + 1);
+    gridManager_updateGridLEDs(PROJECT_FIRST_ROW, columnOffset);
+    renderByWalkingNotes(PROJECT_FIRST_ROW, columnOffset, expected);
+
+    for(uint8_t row = 0; row < NUM_SEQUENCER_PHYSICAL_ROWS; ++row)
+    {
+        expected[(row * NUM_SEQUENCER_PHYSICAL_COLUMNS) + 2] |= COLOUR_MAP_PLAYHEAD_OVERLAY;
+    }
+    expected[(1 * NUM_SEQUENCER_PHYSICAL_COLUMNS) + 5] |= COLOUR_MAP_SELECTION_OVERLAY;
+    HOST_TEST_CHECK(memcmp(expected, g_submittedFrame, sizeof(expected)) == 0);
+
+    //Scrolled away, neither overlay is in view
+    gridManager_updateGridLEDs(PROJECT_FIRST_ROW, columnOffset + 100);
+    renderByWalkingNotes(PROJECT_FIRST_ROW, columnOffset + 100, expected);
+    HOST_TEST_CHECK(memcmp(expected, g_submittedFrame, sizeof(expected)) == 0);
+
+    gridManager_setPlayheadColumn(GRID_NO_OVERLAY_COLUMN);
+    gridManager_setSelectedCell(GRID_NO_OVERLAY_COLUMN, 0);
+}
+
+
+static void benchmarkRenders(void)
+{
+    static uint16_t columnOffsets[4096];
+    static uint8_t rowOffsets[4096];
+    rgbLedColour_t frame[GRID_NUM_CELLS];
+    uint32_t randomState = 0x13579BDF;
+    volatile uint32_t sink = 0;
+    uint64_t startNanos;
+    uint64_t cachedNanos;
+    uint64_t walkNanos;
+
+    for(uint32_t idx = 0; idx < 4096; ++idx)
+    {
+        rowOffsets[idx] = MIN_ROW_OFFSET + (hostTest_random(&randomState) % (MAX_ROW_OFFSET - MIN_ROW_OFFSET + 1));
+        columnOffsets[idx] = hostTest_random(&randomState) % (PROJECT_NUM_COLUMNS - NUM_SEQUENCER_PHYSICAL_COLUMNS + 1);
+    }
+
+    startNanos = hostTest_getNanos();
+    for(uint32_t renderNum = 0; renderNum < NUM_TIMED_RENDERS; ++renderNum)
+    {
+        gridManager_updateGridLEDs(rowOffsets[renderNum & 4095], columnOffsets[renderNum & 4095]);
+        sink += g_submittedFrame[renderNum % GRID_NUM_CELLS];
+    }
+    cachedNanos = hostTest_getNanos() - startNanos;
+
+    startNanos = hostTest_getNanos();
+    for(uint32_t renderNum = 0; renderNum < NUM_TIMED_RENDERS; ++renderNum)
+    {
+        renderByWalkingNotes(rowOffsets[renderNum & 4095], columnOffsets[renderNum & 4095], frame);
+        sink += frame[renderNum % GRID_NUM_CELLS];
+    }
+    walkNanos = hostTest_getNanos() - startNanos;
+
+    printf("%u column project, random scroll positions:\n", PROJECT_NUM_COLUMNS);
+    printf("  span cache  %10.0f renders/sec (%.0f ns per render)\n", 1e9 * NUM_TIMED_RENDERS / cachedNanos, (double)cachedNanos / NUM_TIMED_RENDERS);
+    printf("  note walk   %10.0f renders/sec (%.0f ns per render)\n", 1e9 * NUM_TIMED_RENDERS / walkNanos, (double)walkNanos / NUM_TIMED_RENDERS);
+}
+
+
+int main(void)
+{
+    gridManager_init();
+    buildProject();
+
+    testRendersMatch();
+    testOverlays();
+    benchmarkRenders();
+
+    return hostTest_finish("gridRenderBench");
+}
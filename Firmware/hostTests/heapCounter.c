@@ -0,0 +1,53 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include "heapCounter.h"
+
+//Linked with '-Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free'
+//so every heap operation made by the code under test (other than from the
+//C library itself) is counted before being passed on.
+
+//printf can allocate on first use, so a test should read the count before
+//printing anything.
+
+volatile uint32_t g_heapCounterNumOps = 0;
+
+void * __real_malloc(size_t numBytes);
+void * __real_calloc(size_t numItems, size_t itemNumBytes);
+void * __real_realloc(void * ptr, size_t numBytes);
+void __real_free(void * ptr);
+
+
+
+//---- Public
+void * __wrap_malloc(size_t numBytes)
+{
+    ++g_heapCounterNumOps;
+    return __real_malloc(numBytes);
+}
+
+
+
+//---- Public
+void * __wrap_calloc(size_t numItems, size_t itemNumBytes)
+{
+    ++g_heapCounterNumOps;
+    return __real_calloc(numItems, itemNumBytes);
+}
+
+
+
+//---- Public
+void * __wrap_realloc(void * ptr, size_t numBytes)
+{
+    ++g_heapCounterNumOps;
+    return __real_realloc(ptr, numBytes);
+}
+
+
+
+//---- Public
+void __wrap_free(void * ptr)
+{
+    ++g_heapCounterNumOps;
+    __real_free(ptr);
+}
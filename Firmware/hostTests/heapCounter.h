@@ -0,0 +1,11 @@
+//Counts heap operations made by a test, see 'heapCounter.c'
+
+#include <stdint.h>
+
+//Volatile, as the compiler assumes malloc and free leave other globals alone
+extern volatile uint32_t g_heapCounterNumOps;
+
+static inline void heapCounter_reset(void)
+{
+    g_heapCounterNumOps = 0;
+}
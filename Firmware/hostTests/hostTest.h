@@ -0,0 +1,58 @@
+//Shared helpers for the host tests. Each test is a plain executable that ctest
+//runs, a failed check is reported and counted rather than aborting so a single
+//run shows every failure, the exit code then gives ctest the result.
+
+//Benchmarks print their figures alongside the checks, timings come from the
+//host so they are only useful for before/after comparisons on the same machine.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+
+static uint32_t g_hostTestNumChecks = 0;
+static uint32_t g_hostTestNumFailures = 0;
+
+#define HOST_TEST_CHECK(condition)                                                      \
+    do {                                                                                \
+        ++g_hostTestNumChecks;                                                          \
+        if(!(condition))                                                                \
+        {                                                                               \
+            ++g_hostTestNumFailures;                                                    \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #condition);                 \
+        }                                                                               \
+    } while(0)
+
+
+
+//---- Public
+static inline uint64_t hostTest_getNanos(void)
+{
+    struct timespec timeNow;
+    clock_gettime(CLOCK_MONOTONIC, &timeNow);
+    return ((uint64_t)timeNow.tv_sec * 1000000000ull) + (uint64_t)timeNow.tv_nsec;
+}
+
+
+
+//---- Public
+static inline uint32_t hostTest_random(uint32_t * statePtr)
+{
+    //xorshift32, so every run sees the same 'random' input
+    uint32_t x = *statePtr;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *statePtr = x;
+    return x;
+}
+
+
+
+//---- Public
+static inline int hostTest_finish(const char * testNamePtr)
+{
+    printf("%s: %u checks, %u failed\n", testNamePtr, g_hostTestNumChecks, g_hostTestNumFailures);
+    return (g_hostTestNumFailures == 0) ? 0 : 1;
+}
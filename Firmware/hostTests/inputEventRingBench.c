@@ -0,0 +1,316 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include "inputEvent.h"
+#include "inputEventRing.h"
+#include "hostTest.h"
+
+
+//Runs the input event ring with pthreads standing in for the tasks and ISRs.
+//Producers push and then wake the consumer, the consumer takes every event
+//and then blocks until woken again, as 'inputEventBus' does on the device.
+//The task notification is stood in for by a counter under a mutex, taken
+//and cleared in one go like 'ulTaskNotifyTake(pdTRUE, ..)'.
+
+//Reported:
+//  ring only   - push plus pop on one thread, the cost without any wakeups.
+//  throughput  - producers pushing flat out, each event stamped with its
+//                producer and sequence so the consumer can check nothing
+//                is lost, duplicated or reordered between any two events
+//                from the same producer.
+//  latency     - one producer posting at intervals, from the post to the
+//                consumer taking the event. Measured for a consumer that
+//                blocks until woken, and one that polls every
+//                'POLL_INTERVAL_MICROS', as the system and menu tasks did.
+
+//Timings depend on the host (and how many cores it has), they are for
+//comparing before and after a change on the same machine.
+
+#define RING_ONLY_NUM_EVENTS        10000000
+#define MAX_NUM_PRODUCERS           3
+#define EVENTS_PER_PRODUCER         200000
+#define LATENCY_NUM_EVENTS          100
+#define LATENCY_INTERVAL_MICROS     1000
+#define POLL_INTERVAL_MICROS        30000
+
+//Where the test data is kept in the event payload
+#define PAYLOAD_PRODUCER_IDX        0
+#define PAYLOAD_SEQUENCE_IDX        1       //uint32_t
+#define PAYLOAD_POST_NANOS_IDX      2       //uint64_t, latency only
+
+typedef struct
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t condition;
+    uint32_t value;
+} HostNotification;
+
+typedef struct
+{
+    InputEventRing ring;
+    HostNotification notification;
+    bool isConsumerPolling;
+    uint32_t numFullRetries[MAX_NUM_PRODUCERS];
+} BenchBus;
+
+typedef struct
+{
+    BenchBus * busPtr;
+    uint8_t producerId;
+} ProducerArgs;
+
+static BenchBus g_bus;
+
+
+
+static void notificationGive(HostNotification * notificationPtr)
+{
+    pthread_mutex_lock(&notificationPtr->mutex);
+    ++notificationPtr->value;
+    pthread_cond_signal(&notificationPtr->condition);
+    pthread_mutex_unlock(&notificationPtr->mutex);
+}
+
+
+static void notificationTake(HostNotification * notificationPtr)
+{
+    pthread_mutex_lock(&notificationPtr->mutex);
+    while(notificationPtr->value == 0) pthread_cond_wait(&notificationPtr->condition, &notificationPtr->mutex);
+    notificationPtr->value = 0;
+    pthread_mutex_unlock(&notificationPtr->mutex);
+}
+
+
+static void sleepMicros(uint32_t micros)
+{
+    struct timespec duration = {.tv_sec = micros / 1000000, .tv_nsec = (long)(micros % 1000000) * 1000};
+    nanosleep(&duration, NULL);
+}
+
+
+static void busInit(BenchBus * busPtr, bool isConsumerPolling)
+{
+    inputEventRing_init(&busPtr->ring);
+    pthread_mutex_init(&busPtr->notification.mutex, NULL);
+    pthread_cond_init(&busPtr->notification.condition, NULL);
+    busPtr->notification.value = 0;
+    busPtr->isConsumerPolling = isConsumerPolling;
+    memset(busPtr->numFullRetries, 0, sizeof(busPtr->numFullRetries));
+}
+
+
+static void busDeinit(BenchBus * busPtr)
+{
+    pthread_mutex_destroy(&busPtr->notification.mutex);
+    pthread_cond_destroy(&busPtr->notification.condition);
+}
+
+
+static void busPost(BenchBus * busPtr, uint8_t producerId, const InputEvent * eventPtr)
+{
+    //As 'inputEventBus_post', but waits for room rather than dropping
+    //the event, so the consumer can account for every one of them
+
+    while(!inputEventRing_push(&busPtr->ring, eventPtr))
+    {
+        ++busPtr->numFullRetries[producerId];
+        sched_yield();
+    }
+
+    if(!busPtr->isConsumerPolling) notificationGive(&busPtr->notification);
+}
+
+
+static void * throughputProducer(void * argPtr)
+{
+    ProducerArgs * argsPtr = (ProducerArgs *)argPtr;
+    InputEvent event = {.source = inputSourceSwitchMatrix};
+
+    event.payload[PAYLOAD_PRODUCER_IDX] = argsPtr->producerId;
+    for(uint32_t sequence = 0; sequence < EVENTS_PER_PRODUCER; ++sequence)
+    {
+        memcpy(&event.payload[PAYLOAD_SEQUENCE_IDX], &sequence, sizeof(sequence));
+        busPost(argsPtr->busPtr, argsPtr->producerId, &event);
+    }
+
+    return NULL;
+}
+
+
+static void testRingOnly(void)
+{
+    static InputEventRing ring;
+    InputEvent event = {.source = inputSourceMenu};
+    InputEvent takenEvent;
+    bool isEveryEventTaken = true;
+    uint64_t startNanos;
+    uint64_t elapsedNanos;
+
+    inputEventRing_init(&ring);
+
+    startNanos = hostTest_getNanos();
+    for(uint32_t idx = 0; idx < RING_ONLY_NUM_EVENTS; ++idx)
+    {
+        event.eventType = (uint8_t)idx;
+        inputEventRing_push(&ring, &event);
+        if(!inputEventRing_pop(&ring, &takenEvent) || (takenEvent.eventType != (uint8_t)idx)) isEveryEventTaken = false;
+    }
+    elapsedNanos = hostTest_getNanos() - startNanos;
+
+    HOST_TEST_CHECK(isEveryEventTaken);
+    HOST_TEST_CHECK(atomic_load(&ring.numDropped) == 0);
+    printf("Ring only: %.2f ns per push and pop\n", (double)elapsedNanos / RING_ONLY_NUM_EVENTS);
+}
+
+
+static void testThroughput(uint8_t numProducers)
+{
+    pthread_t producerThreads[MAX_NUM_PRODUCERS];
+    ProducerArgs producerArgs[MAX_NUM_PRODUCERS];
+    uint32_t nextSequence[MAX_NUM_PRODUCERS] = {0};
+    uint32_t numExpected = numProducers * EVENTS_PER_PRODUCER;
+    uint32_t numTaken = 0;
+    uint32_t numPasses = 0;
+    uint32_t numFullRetries = 0;
+    bool isInOrder = true;
+    InputEvent event;
+    uint32_t sequence;
+    uint8_t producerId;
+    uint64_t startNanos;
+    uint64_t elapsedNanos;
+
+    busInit(&g_bus, false);
+
+    startNanos = hostTest_getNanos();
+    for(uint8_t idx = 0; idx < numProducers; ++idx)
+    {
+        producerArgs[idx] = (ProducerArgs){.busPtr = &g_bus, .producerId = idx};
+        pthread_create(&producerThreads[idx], NULL, throughputProducer, &producerArgs[idx]);
+    }
+
+    //The consumer, take everything then block until woken
+    while(numTaken < numExpected)
+    {
+        ++numPasses;
+        while(inputEventRing_pop(&g_bus.ring, &event))
+        {
+            producerId = event.payload[PAYLOAD_PRODUCER_IDX];
+            memcpy(&sequence, &event.payload[PAYLOAD_SEQUENCE_IDX], sizeof(sequence));
+
+            if((producerId >= numProducers) || (sequence != nextSequence[producerId])) isInOrder = false;
+            else ++nextSequence[producerId];
+            ++numTaken;
+        }
+
+        if(numTaken < numExpected) notificationTake(&g_bus.notification);
+    }
+    elapsedNanos = hostTest_getNanos() - startNanos;
+
+    for(uint8_t idx = 0; idx < numProducers; ++idx)
+    {
+        pthread_join(producerThreads[idx], NULL);
+        numFullRetries += g_bus.numFullRetries[idx];
+    }
+
+    HOST_TEST_CHECK(isInOrder);
+    HOST_TEST_CHECK(numTaken == numExpected);
+    HOST_TEST_CHECK(!inputEventRing_pop(&g_bus.ring, &event));
+    HOST_TEST_CHECK(atomic_load(&g_bus.ring.numDropped) == numFullRetries);
+
+    printf("Throughput, %u producer(s): %.2f M events/s, %.1f events per pass, ring full %u times\n",
+           numProducers, (numExpected * 1000.0) / elapsedNanos, (double)numTaken / numPasses, numFullRetries);
+
+    busDeinit(&g_bus);
+}
+
+
+static void * latencyProducer(void * argPtr)
+{
+    ProducerArgs * argsPtr = (ProducerArgs *)argPtr;
+    InputEvent event = {.source = inputSourceEncoders};
+    uint64_t postNanos;
+
+    for(uint32_t idx = 0; idx < LATENCY_NUM_EVENTS; ++idx)
+    {
+        sleepMicros(LATENCY_INTERVAL_MICROS);
+        postNanos = hostTest_getNanos();
+        memcpy(&event.payload[PAYLOAD_POST_NANOS_IDX], &postNanos, sizeof(postNanos));
+        busPost(argsPtr->busPtr, argsPtr->producerId, &event);
+    }
+
+    return NULL;
+}
+
+
+static int compareNanos(const void * aPtr, const void * bPtr)
+{
+    uint64_t a = *(const uint64_t *)aPtr;
+    uint64_t b = *(const uint64_t *)bPtr;
+    return (a > b) - (a < b);
+}
+
+
+static uint64_t testLatency(bool isConsumerPolling)
+{
+    //RETURNS: The mean latency in ns
+
+    static uint64_t latencyNanos[LATENCY_NUM_EVENTS];
+    pthread_t producerThread;
+    ProducerArgs producerArgs = {.busPtr = &g_bus, .producerId = 0};
+    uint32_t numTaken = 0;
+    uint64_t totalNanos = 0;
+    uint64_t postNanos;
+    InputEvent event;
+
+    busInit(&g_bus, isConsumerPolling);
+    pthread_create(&producerThread, NULL, latencyProducer, &producerArgs);
+
+    while(numTaken < LATENCY_NUM_EVENTS)
+    {
+        while(inputEventRing_pop(&g_bus.ring, &event))
+        {
+            memcpy(&postNanos, &event.payload[PAYLOAD_POST_NANOS_IDX], sizeof(postNanos));
+            latencyNanos[numTaken] = hostTest_getNanos() - postNanos;
+            totalNanos += latencyNanos[numTaken];
+            ++numTaken;
+        }
+
+        if(numTaken == LATENCY_NUM_EVENTS) break;
+
+        if(isConsumerPolling) sleepMicros(POLL_INTERVAL_MICROS);
+        else notificationTake(&g_bus.notification);
+    }
+
+    pthread_join(producerThread, NULL);
+    HOST_TEST_CHECK(atomic_load(&g_bus.ring.numDropped) == 0);
+
+    qsort(latencyNanos, LATENCY_NUM_EVENTS, sizeof(latencyNanos[0]), compareNanos);
+    printf("Latency, %-8s consumer: mean %8.1f us, median %8.1f us, max %8.1f us\n",
+           isConsumerPolling ? "polling" : "blocking", (totalNanos / 1000.0) / LATENCY_NUM_EVENTS,
+           latencyNanos[LATENCY_NUM_EVENTS / 2] / 1000.0, latencyNanos[LATENCY_NUM_EVENTS - 1] / 1000.0);
+
+    busDeinit(&g_bus);
+    return totalNanos / LATENCY_NUM_EVENTS;
+}
+
+
+int main(void)
+{
+    uint64_t blockingNanos;
+    uint64_t pollingNanos;
+
+    testRingOnly();
+    testThroughput(1);
+    testThroughput(MAX_NUM_PRODUCERS);
+
+    blockingNanos = testLatency(false);
+    pollingNanos = testLatency(true);
+    HOST_TEST_CHECK(blockingNanos < pollingNanos);
+
+    return hostTest_finish("inputEventRingBench");
+}
@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "driver/i2c.h"
+#include "ledDrivers.h"
+#include "ledDriverBusModel.h"
+#include "ledDriverProfiler.h"
+#include "hostTest.h"
+
+
+//Costs a full grid frame written per LED, per column and per driver IC with
+//the bus model, then makes each of those writes through the LED driver on the
+//mock I2C bus (see 'stubs/i2cMock.c') and checks the profiler's totals for
+//each call site against what the mock saw. The mock moves the simulated time
+//on by the model for every write, so the busy time the profiler records must
+//match the model exactly.
+
+#define TEST_BUS_FREQ_HZ        1000000     //As 'I2C_MASTER_FREQ_HZ' in 'ledDrivers.c'
+#define GRID_NUM_CELLS          (SYSTEM_NUM_ROWS * SYSTEM_NUM_COLUMNS)
+#define NUM_DRIVER_ICS          (SYSTEM_NUM_COLUMNS / 2)
+#define REGS_PER_LED            3
+#define REGS_PER_COLUMN         (REGS_PER_LED * SYSTEM_NUM_ROWS)
+#define REGS_PER_IC             (REGS_PER_COLUMN * 2)
+#define MOCK_ADDRESS_NUM_BYTES  2           //Counted by the mock as well as the data
+
+typedef struct
+{
+    const char * namePtr;
+    uint8_t callSite;
+    uint16_t numTransactions;
+    uint16_t numDataBytesPerTransaction;
+    uint16_t numLatches;
+} WriteScheme;
+
+static const WriteScheme g_schemes[] = {
+    {"per LED",     i2cCallSiteSingleLed,       GRID_NUM_CELLS,     REGS_PER_LED,       GRID_NUM_CELLS},
+    {"per column",  i2cCallSiteSingleColumn,    SYSTEM_NUM_COLUMNS, REGS_PER_COLUMN,    SYSTEM_NUM_COLUMNS},
+    {"per IC",      i2cCallSiteFrame,           NUM_DRIVER_ICS,     REGS_PER_IC,        1},
+};
+
+#define NUM_SCHEMES (sizeof(g_schemes) / sizeof(g_schemes[0]))
+
+
+
+static void testModel(void)
+{
+    static const uint32_t busFreqsHz[] = {100000, 400000, 1000000};
+    uint16_t transactionNumBytes[REGS_PER_IC];
+    uint32_t schemeMicros[NUM_SCHEMES];
+    bool isMonotonic = true;
+
+    //Three bytes at 400kHz, 2 start/stop bits plus 5 bytes of 9 bits is 47 bits, 117.5us rounded up
+    HOST_TEST_CHECK(ledDriverBusModel_transactionMicros(400000, 3) == (118 + BUS_MODEL_TRANSACTION_OVERHEAD_US));
+
+    for(uint16_t numBytes = 1; numBytes < REGS_PER_IC; ++numBytes)
+    {
+        if(ledDriverBusModel_transactionMicros(TEST_BUS_FREQ_HZ, numBytes + 1) <= ledDriverBusModel_transactionMicros(TEST_BUS_FREQ_HZ, numBytes)) isMonotonic = false;
+    }
+    HOST_TEST_CHECK(isMonotonic);
+
+    //A uniform scheme costs the same as listing every transaction
+    for(uint16_t idx = 0; idx < REGS_PER_IC; ++idx) transactionNumBytes[idx] = REGS_PER_LED;
+    HOST_TEST_CHECK(ledDriverBusModel_schemeMicros(TEST_BUS_FREQ_HZ, transactionNumBytes, REGS_PER_IC, 2) ==
+                    ledDriverBusModel_uniformSchemeMicros(TEST_BUS_FREQ_HZ, REGS_PER_IC, REGS_PER_LED, 2));
+    HOST_TEST_CHECK(ledDriverBusModel_schemeMicros(TEST_BUS_FREQ_HZ, NULL, 0, 1) == BUS_MODEL_LATCH_OVERHEAD_US);
+
+    printf("Model, full frame:\n");
+    for(uint8_t freqIdx = 0; freqIdx < (sizeof(busFreqsHz) / sizeof(busFreqsHz[0])); ++freqIdx)
+    {
+        for(uint8_t schemeIdx = 0; schemeIdx < NUM_SCHEMES; ++schemeIdx)
+        {
+            const WriteScheme * schemePtr = &g_schemes[schemeIdx];
+            schemeMicros[schemeIdx] = ledDriverBusModel_uniformSchemeMicros(busFreqsHz[freqIdx], schemePtr->numTransactions,
+                                                                            schemePtr->numDataBytesPerTransaction, schemePtr->numLatches);
+        }
+
+        //Fewer, larger writes always win, the fixed overhead dominates
+        HOST_TEST_CHECK((schemeMicros[2] < schemeMicros[1]) && (schemeMicros[1] < schemeMicros[0]));
+        printf("  %4u kHz: per LED %5u us, per column %5u us, per IC %5u us\n", busFreqsHz[freqIdx] / 1000,
+               schemeMicros[0], schemeMicros[1], schemeMicros[2]);
+    }
+}
+
+
+static void writeScheme(const WriteScheme * schemePtr, const rgbLedColour_t * coloursPtr)
+{
+    //Writes every LED in the grid the way 'schemePtr' describes.
+    //Column data is stored row by row, as a frame is.
+
+    static rgbLedColour_t frame[GRID_NUM_CELLS];
+    rgbLedColour_t columnColours[SYSTEM_NUM_ROWS];
+
+    memcpy(frame, coloursPtr, sizeof(frame));
+
+    switch(schemePtr->callSite)
+    {
+        case i2cCallSiteSingleLed:
+            for(uint8_t col = 0; col < SYSTEM_NUM_COLUMNS; ++col)
+            {
+                for(uint8_t row = 0; row < SYSTEM_NUM_ROWS; ++row)
+                {
+                    HOST_TEST_CHECK(ledDrivers_writeSingleLed(col, row, frame[(row * SYSTEM_NUM_COLUMNS) + col]) == 0);
+                }
+            }
+            break;
+
+        case i2cCallSiteSingleColumn:
+            for(uint8_t col = 0; col < SYSTEM_NUM_COLUMNS; ++col)
+            {
+                for(uint8_t row = 0; row < SYSTEM_NUM_ROWS; ++row) columnColours[row] = frame[(row * SYSTEM_NUM_COLUMNS) + col];
+                HOST_TEST_CHECK(ledDrivers_writeSingleGridColumn(col, columnColours) == 0);
+            }
+            break;
+
+        default:
+            HOST_TEST_CHECK(ledDrivers_writeEntireGrid(frame) == 0);
+            break;
+    }
+}
+
+
+static void testProfilerAgainstMock(void)
+{
+    rgbLedColour_t colours[GRID_NUM_CELLS];
+    i2cCallSiteTotals_t totals;
+    I2cMockStats before;
+    uint32_t numTransactions;
+    uint32_t numDataBytes;
+
+    i2cMock_reset();
+    ledDrivers_init();
+    ledDrivers_resetBusProfile();
+
+    printf("Profiled, full frame at %u kHz:\n", TEST_BUS_FREQ_HZ / 1000);
+
+    for(uint8_t schemeIdx = 0; schemeIdx < NUM_SCHEMES; ++schemeIdx)
+    {
+        const WriteScheme * schemePtr = &g_schemes[schemeIdx];
+
+        //Every register byte differs from the last scheme's frame, so the
+        //frame write can't skip any of it against the shadow copy
+        for(uint16_t cell = 0; cell < GRID_NUM_CELLS; ++cell) colours[cell] = (rgbLedColour_t)(0x010101 * (1 + schemeIdx + (cell * NUM_SCHEMES)));
+
+        before = g_i2cMockStats;
+        writeScheme(schemePtr, colours);
+        numTransactions = g_i2cMockStats.numTransactions - before.numTransactions;
+        numDataBytes = (g_i2cMockStats.numBytes - before.numBytes) - (numTransactions * MOCK_ADDRESS_NUM_BYTES);
+
+        ledDriverProfiler_getTotals(schemePtr->callSite, &totals);
+
+        HOST_TEST_CHECK(numTransactions == schemePtr->numTransactions);
+        HOST_TEST_CHECK(numDataBytes == (uint32_t)(schemePtr->numTransactions * schemePtr->numDataBytesPerTransaction));
+        HOST_TEST_CHECK((g_i2cMockStats.numLatches - before.numLatches) == schemePtr->numLatches);
+        HOST_TEST_CHECK(totals.numTransactions == numTransactions);
+        HOST_TEST_CHECK(totals.numDataBytes == numDataBytes);
+        HOST_TEST_CHECK(totals.busyMicros == ledDriverBusModel_uniformSchemeMicros(TEST_BUS_FREQ_HZ, schemePtr->numTransactions,
+                                                                                   schemePtr->numDataBytesPerTransaction, 0));
+        HOST_TEST_CHECK(totals.maxMicros == ledDriverBusModel_transactionMicros(TEST_BUS_FREQ_HZ, schemePtr->numDataBytesPerTransaction));
+
+        printf("  %-10s %2u transactions %4u bytes, busy %5u us, max %4u us\n", schemePtr->namePtr,
+               totals.numTransactions, totals.numDataBytes, totals.busyMicros, totals.maxMicros);
+    }
+
+    //Only the call sites used have totals
+    ledDriverProfiler_getTotals(i2cCallSiteBrightness, &totals);
+    HOST_TEST_CHECK(totals.numTransactions == 0);
+
+    ledDrivers_dumpBusProfile();
+    ledDrivers_resetBusProfile();
+    ledDriverProfiler_getTotals(i2cCallSiteFrame, &totals);
+    HOST_TEST_CHECK((totals.numTransactions == 0) && (totals.busyMicros == 0));
+}
+
+
+int main(void)
+{
+    testModel();
+    testProfilerAgainstMock();
+    return hostTest_finish("ledBusModelTest");
+}
@@ -0,0 +1,410 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "driver/i2c.h"
+#include "ledDrivers.h"
+#include "heapCounter.h"
+#include "hostTest.h"
+
+
+//Runs the LED driver module against a mock I2C bus (see 'stubs/i2cMock.c').
+//Each frame written is checked against a model of where every LED's PWM
+//registers sit in the LP5862 register maps, worked out here independently
+//of the driver's own lookup tables. The bytes, transactions and latches
+//each frame costs are printed for a set of typical edits.
+
+//Heap operations are counted (see 'heapCounter.c'), no LED refresh should make any.
+
+//Fade curves are checked for exact end points, direction and even spacing
+//in perceived brightness, and the brightness and colour current setters
+//for which drivers' registers they land in.
+
+#define GRID_NUM_CELLS          (SYSTEM_NUM_ROWS * SYSTEM_NUM_COLUMNS)
+#define RANDOM_NUM_FRAMES       5000
+#define HEAP_TEST_NUM_FRAMES    1000
+#define TEST_REGS_PER_LED       3
+#define TEST_REGS_PER_COLUMN    (TEST_REGS_PER_LED * SYSTEM_NUM_ROWS)
+#define TEST_REGS_PER_IC        (TEST_REGS_PER_COLUMN * 2)
+#define TEST_GLOBAL_BRI_REG     0x005
+#define TEST_R_CURRENT_REG      0x009
+#define FADE_MAX_NUM_STEPS      256
+
+//The PCB routing swaps rows 1 and 5 in the driver register order
+static const uint8_t g_rowToSlot[SYSTEM_NUM_ROWS] = {0, 5, 2, 3, 4, 1};
+
+
+typedef struct
+{
+    rgbLedColour_t colours[GRID_NUM_CELLS];
+} TestFrame;
+
+
+
+static bool doDriversHoldFrame(const TestFrame * framePtr)
+{
+    //Even columns sit at 0x212, odd columns at 0x200, three
+    //registers (green, red, blue) per LED in slot order
+    for(uint8_t col = 0; col < SYSTEM_NUM_COLUMNS; ++col)
+    {
+        for(uint8_t row = 0; row < SYSTEM_NUM_ROWS; ++row)
+        {
+            rgbLedColour_t colour = framePtr->colours[(row * SYSTEM_NUM_COLUMNS) + col];
+            uint16_t regAddr = ((col % 2 == 0) ? 0x212 : 0x200) + (g_rowToSlot[row] * TEST_REGS_PER_LED);
+            const uint8_t * regsPtr = &g_i2cMockRegs[col / 2][regAddr];
+
+            if((regsPtr[0] != (uint8_t)(colour >> 8)) || (regsPtr[1] != (uint8_t)(colour >> 16)) || (regsPtr[2] != (uint8_t)colour))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+
+static void writeFrameAndReport(const char * editNamePtr, TestFrame * framePtr)
+{
+    I2cMockStats before = g_i2cMockStats;
+    uint64_t startMicros = g_hostMicros;
+
+    HOST_TEST_CHECK(ledDrivers_writeEntireGrid(framePtr->colours) == 0);
+    HOST_TEST_CHECK(doDriversHoldFrame(framePtr));
+
+    printf("  %-24s %2u transactions %4u bytes %u latches %5u us\n", editNamePtr,
+           g_i2cMockStats.numTransactions - before.numTransactions, g_i2cMockStats.numBytes - before.numBytes,
+           g_i2cMockStats.numLatches - before.numLatches, (uint32_t)(g_hostMicros - startMicros));
+}
+
+
+static void setCell(TestFrame * framePtr, uint8_t row, uint8_t col, rgbLedColour_t colour)
+{
+    framePtr->colours[(row * SYSTEM_NUM_COLUMNS) + col] = colour;
+}
+
+
+
+
+static void testTypicalEdits(void)
+{
+    TestFrame frame = {0};
+    I2cMockStats before;
+
+    i2cMock_reset();
+    ledDrivers_init();
+    HOST_TEST_CHECK(g_i2cMockStats.numTransactions == 1);   //Config, one broadcast
+
+    printf("Bus cost per frame for typical edits:\n");
+
+    //State of the drivers is unknown after init, so the first frame is sent in full
+    for(uint8_t col = 0; col < SYSTEM_NUM_COLUMNS; col += 3) setCell(&frame, 2, col, rgb_green);
+    before = g_i2cMockStats;
+    writeFrameAndReport("first frame", &frame);
+    HOST_TEST_CHECK((g_i2cMockStats.numTransactions - before.numTransactions) == 4);
+    HOST_TEST_CHECK((g_i2cMockStats.numBytes - before.numBytes) == (4 * (TEST_REGS_PER_IC + 2)));
+    HOST_TEST_CHECK((g_i2cMockStats.numLatches - before.numLatches) == 1);
+
+    //Nothing changed, nothing is sent and there is no latch
+    before = g_i2cMockStats;
+    writeFrameAndReport("unchanged", &frame);
+    HOST_TEST_CHECK((g_i2cMockStats.numTransactions == before.numTransactions) && (g_i2cMockStats.numLatches == before.numLatches));
+
+    before = g_i2cMockStats;
+    setCell(&frame, 4, 5, rgb_pink);
+    writeFrameAndReport("single note added", &frame);
+    HOST_TEST_CHECK((g_i2cMockStats.numTransactions - before.numTransactions) == 1);
+    HOST_TEST_CHECK((g_i2cMockStats.numBytes - before.numBytes) == (TEST_REGS_PER_LED + 2));
+
+    before = g_i2cMockStats;
+    setCell(&frame, 4, 5, rgb_red);
+    writeFrameAndReport("note velocity changed", &frame);
+    HOST_TEST_CHECK((g_i2cMockStats.numBytes - before.numBytes) <= (TEST_REGS_PER_LED + 2));
+
+    //Spans two driver ICs
+    before = g_i2cMockStats;
+    for(uint8_t col = 2; col < 6; ++col) setCell(&frame, 1, col, rgb_orange);
+    writeFrameAndReport("4 step note added", &frame);
+    HOST_TEST_CHECK((g_i2cMockStats.numTransactions - before.numTransactions) == 2);
+
+    before = g_i2cMockStats;
+    for(uint8_t row = 0; row < SYSTEM_NUM_ROWS; ++row) setCell(&frame, row, 3, rgb_purple);
+    writeFrameAndReport("playhead column drawn", &frame);
+    HOST_TEST_CHECK((g_i2cMockStats.numTransactions - before.numTransactions) == 1);
+    HOST_TEST_CHECK((g_i2cMockStats.numLatches - before.numLatches) == 1);
+
+    //Everything moves one column left
+    before = g_i2cMockStats;
+    for(uint8_t row = 0; row < SYSTEM_NUM_ROWS; ++row)
+    {
+        memmove(&frame.colours[row * SYSTEM_NUM_COLUMNS], &frame.colours[(row * SYSTEM_NUM_COLUMNS) + 1], (SYSTEM_NUM_COLUMNS - 1) * sizeof(rgbLedColour_t));
+        setCell(&frame, row, SYSTEM_NUM_COLUMNS - 1, rgb_off);
+    }
+    writeFrameAndReport("scrolled one column", &frame);
+    HOST_TEST_CHECK((g_i2cMockStats.numTransactions - before.numTransactions) <= 4);
+
+    before = g_i2cMockStats;
+    memset(&frame, 0, sizeof(frame));
+    writeFrameAndReport("grid cleared", &frame);
+    HOST_TEST_CHECK((g_i2cMockStats.numLatches - before.numLatches) == 1);
+}
+
+
+static void testFailedWritesRecover(void)
+{
+    TestFrame frameA = {0};
+    TestFrame frameB;
+
+    i2cMock_reset();
+    ledDrivers_init();
+
+    setCell(&frameA, 0, 0, rgb_red);
+    HOST_TEST_CHECK(ledDrivers_writeEntireGrid(frameA.colours) == 0);
+    HOST_TEST_CHECK(doDriversHoldFrame(&frameA));
+
+    //Half of the burst lands before the write fails, the caller is told
+    frameB = frameA;
+    for(uint8_t row = 0; row < SYSTEM_NUM_ROWS; ++row) setCell(&frameB, row, 0, rgb_yellow);
+    setCell(&frameB, 0, 1, rgb_yellow);
+    i2cMock_failNextWrite(TEST_REGS_PER_COLUMN / 2);
+    HOST_TEST_CHECK(ledDrivers_writeEntireGrid(frameB.colours) != 0);
+    HOST_TEST_CHECK(g_i2cMockStats.numFailedWrites == 1);
+
+    //Going back to the frame the shadow copy last held must still fix the
+    //registers the failed burst changed
+    HOST_TEST_CHECK(ledDrivers_writeEntireGrid(frameA.colours) == 0);
+    HOST_TEST_CHECK(doDriversHoldFrame(&frameA));
+
+    //A failed single LED write leaves the grid recoverable the same way
+    i2cMock_failNextWrite(1);
+    HOST_TEST_CHECK(ledDrivers_writeSingleLed(0, 0, rgb_blue) != 0);
+    HOST_TEST_CHECK(ledDrivers_writeEntireGrid(frameA.colours) == 0);
+    HOST_TEST_CHECK(doDriversHoldFrame(&frameA));
+
+    i2cMock_failNextWrite(4);
+    HOST_TEST_CHECK(ledDrivers_writeSingleGridColumn(0, &frameB.colours[0]) != 0);
+    HOST_TEST_CHECK(ledDrivers_writeEntireGrid(frameA.colours) == 0);
+    HOST_TEST_CHECK(doDriversHoldFrame(&frameA));
+}
+
+
+static void testRandomEdits(void)
+{
+    //Small random edits, with some writes failing part way through.
+    //After every frame that succeeds the drivers must match it.
+
+    static const rgbLedColour_t colours[] = {rgb_off, rgb_red, rgb_green, rgb_blue, rgb_orange, rgb_yellow, rgb_purple, rgb_cyan, rgb_pink};
+    TestFrame frame = {0};
+    uint32_t randomState = 0x1234567;
+    uint32_t numMismatches = 0;
+    uint32_t numFailedFrames = 0;
+    uint32_t numEdits;
+
+    i2cMock_reset();
+    ledDrivers_init();
+
+    for(uint32_t frameNum = 0; frameNum < RANDOM_NUM_FRAMES; ++frameNum)
+    {
+        numEdits = hostTest_random(&randomState) % 4;
+        for(uint32_t a = 0; a < numEdits; ++a)
+        {
+            frame.colours[hostTest_random(&randomState) % GRID_NUM_CELLS] = colours[hostTest_random(&randomState) % (sizeof(colours) / sizeof(colours[0]))];
+        }
+
+        if((hostTest_random(&randomState) % 64) == 0)
+        {
+            i2cMock_failNextWrite(hostTest_random(&randomState) % TEST_REGS_PER_IC);
+        }
+
+        if(ledDrivers_writeEntireGrid(frame.colours) != 0)
+        {
+            ++numFailedFrames;
+            continue;
+        }
+
+        if(!doDriversHoldFrame(&frame)) ++numMismatches;
+    }
+
+    printf("%u random frames, %u failed writes, %u mismatches\n", RANDOM_NUM_FRAMES, numFailedFrames, numMismatches);
+    HOST_TEST_CHECK(numFailedFrames > 0);
+    HOST_TEST_CHECK(numMismatches == 0);
+}
+
+
+static void testNoHeapOperations(void)
+{
+    TestFrame frameA;
+    TestFrame frameB;
+    uint32_t numHeapOps;
+    void * volatile testPtr;
+
+    //Make sure the counter is actually hooked up
+    heapCounter_reset();
+    testPtr = malloc(1);
+    free(testPtr);
+    HOST_TEST_CHECK(g_heapCounterNumOps == 2);
+
+    i2cMock_reset();
+    ledDrivers_init();
+
+    for(uint32_t idx = 0; idx < GRID_NUM_CELLS; ++idx)
+    {
+        frameA.colours[idx] = rgb_red;
+        frameB.colours[idx] = rgb_cyan;
+    }
+
+    //Every frame differs from the last in every register, so each is a full grid refresh
+    heapCounter_reset();
+    for(uint32_t frameNum = 0; frameNum < HEAP_TEST_NUM_FRAMES; ++frameNum)
+    {
+        ledDrivers_writeEntireGrid((frameNum & 1) ? frameB.colours : frameA.colours);
+        ledDrivers_writeSingleGridColumn(frameNum % SYSTEM_NUM_COLUMNS, frameA.colours);
+        ledDrivers_writeSingleLed(frameNum % SYSTEM_NUM_COLUMNS, frameNum % SYSTEM_NUM_ROWS, rgb_pink);
+    }
+    numHeapOps = g_heapCounterNumOps;
+
+    printf("%u full grid refreshes, %u transactions, %u heap operations\n", HEAP_TEST_NUM_FRAMES, g_i2cMockStats.numTransactions, numHeapOps);
+    HOST_TEST_CHECK(g_i2cMockStats.numTransactions >= (HEAP_TEST_NUM_FRAMES * 4));
+    HOST_TEST_CHECK(numHeapOps == 0);
+}
+
+
+static void checkFadeCurve(uint16_t numSteps, uint8_t startBrightness, uint8_t endBrightness)
+{
+    //Perceived brightness is taken as sqrt(value * 255), the curve should step
+    //through it evenly. Each step must be within one register value of the
+    //ideal, a closer fit isn't possible near black where the register steps are coarse.
+
+    uint8_t curve[FADE_MAX_NUM_STEPS];
+    bool isInOrder = true;
+    bool isEven = true;
+    double perceivedStart = sqrt(startBrightness * 255.0);
+    double perceivedEnd = sqrt(endBrightness * 255.0);
+    double ideal;
+
+    ledDrivers_generateFadeCurve(curve, numSteps, startBrightness, endBrightness);
+    HOST_TEST_CHECK(curve[numSteps - 1] == endBrightness);
+    if(numSteps == 1) return;
+    HOST_TEST_CHECK(curve[0] == startBrightness);
+
+    for(uint16_t step = 1; step < numSteps; ++step)
+    {
+        if((endBrightness >= startBrightness) && (curve[step] < curve[step - 1])) isInOrder = false;
+        if((endBrightness < startBrightness) && (curve[step] > curve[step - 1])) isInOrder = false;
+
+        ideal = perceivedStart + (((perceivedEnd - perceivedStart) * step) / (numSteps - 1));
+        if(fabs(curve[step] - ((ideal * ideal) / 255.0)) > 1.0) isEven = false;
+    }
+
+    HOST_TEST_CHECK(isInOrder);
+    HOST_TEST_CHECK(isEven);
+}
+
+
+static void testFadeCurves(void)
+{
+    uint8_t curve[FADE_MAX_NUM_STEPS];
+    uint32_t numDimSteps = 0;
+
+    checkFadeCurve(64, 255, 0);
+    checkFadeCurve(64, 0, 255);
+    checkFadeCurve(FADE_MAX_NUM_STEPS, 255, 0);
+    checkFadeCurve(10, 200, 20);
+    checkFadeCurve(7, 3, 250);
+    checkFadeCurve(16, 90, 90);
+    checkFadeCurve(2, 255, 0);
+    checkFadeCurve(1, 255, 40);
+
+    for(uint16_t numSteps = 2; numSteps <= FADE_MAX_NUM_STEPS; numSteps += 31)
+    {
+        for(uint16_t start = 0; start < 256; start += 17)
+        {
+            for(uint16_t end = 0; end < 256; end += 15) checkFadeCurve(numSteps, start, end);
+        }
+    }
+
+    //A straight line fade would spend a quarter of its steps below quarter
+    //brightness, the perceptual curve spends about half of them there
+    ledDrivers_generateFadeCurve(curve, 64, 255, 0);
+    for(uint16_t step = 0; step < 64; ++step)
+    {
+        if(curve[step] < 64) ++numDimSteps;
+    }
+    HOST_TEST_CHECK(numDimSteps >= 28);
+
+    ledDrivers_generateFadeCurve(curve, 2, 10, 200);
+    HOST_TEST_CHECK((curve[0] == 10) && (curve[1] == 200));
+    ledDrivers_generateFadeCurve(curve, 1, 10, 200);
+    HOST_TEST_CHECK(curve[0] == 200);
+}
+
+
+static void testBrightnessAndCurrents(void)
+{
+    TestFrame frame = {0};
+    uint8_t curve[32];
+    I2cMockStats before;
+    bool isEveryIcSet = true;
+
+    i2cMock_reset();
+    ledDrivers_init();
+
+    for(uint32_t idx = 0; idx < GRID_NUM_CELLS; idx += 5) frame.colours[idx] = rgb_orange;
+    HOST_TEST_CHECK(ledDrivers_writeEntireGrid(frame.colours) == 0);
+
+    //Each step of a fade is one broadcast, landing in every driver, with no latch
+    ledDrivers_generateFadeCurve(curve, 32, 255, 0);
+    before = g_i2cMockStats;
+    for(uint8_t step = 0; step < 32; ++step)
+    {
+        HOST_TEST_CHECK(ledDrivers_setGlobalBrightness(curve[step]) == 0);
+        for(uint8_t ic = 0; ic < I2C_MOCK_NUM_DEVICES; ++ic)
+        {
+            if(g_i2cMockRegs[ic][TEST_GLOBAL_BRI_REG] != curve[step]) isEveryIcSet = false;
+        }
+    }
+    HOST_TEST_CHECK(isEveryIcSet);
+    HOST_TEST_CHECK((g_i2cMockStats.numTransactions - before.numTransactions) == 32);
+    HOST_TEST_CHECK((g_i2cMockStats.numBytes - before.numBytes) == (32 * (1 + 2)));
+    HOST_TEST_CHECK(g_i2cMockStats.numLatches == before.numLatches);
+
+    //The PWM registers and the frame shadow copy are left alone by a fade
+    HOST_TEST_CHECK(doDriversHoldFrame(&frame));
+    before = g_i2cMockStats;
+    HOST_TEST_CHECK(ledDrivers_writeEntireGrid(frame.colours) == 0);
+    HOST_TEST_CHECK(g_i2cMockStats.numTransactions == before.numTransactions);
+
+    //Every driver in one burst, currents are 7 bit
+    before = g_i2cMockStats;
+    HOST_TEST_CHECK(ledDrivers_setColourCurrents(LED_DRIVER_ALL_ICS, 100, 0xFF, 20) == 0);
+    HOST_TEST_CHECK((g_i2cMockStats.numTransactions - before.numTransactions) == 1);
+    for(uint8_t ic = 0; ic < I2C_MOCK_NUM_DEVICES; ++ic)
+    {
+        HOST_TEST_CHECK(g_i2cMockRegs[ic][TEST_R_CURRENT_REG] == 100);
+        HOST_TEST_CHECK(g_i2cMockRegs[ic][TEST_R_CURRENT_REG + 1] == 0x7F);
+        HOST_TEST_CHECK(g_i2cMockRegs[ic][TEST_R_CURRENT_REG + 2] == 20);
+    }
+
+    //A single driver, the others keep what they had
+    HOST_TEST_CHECK(ledDrivers_setColourCurrents(2, 60, 61, 62) == 0);
+    for(uint8_t ic = 0; ic < I2C_MOCK_NUM_DEVICES; ++ic)
+    {
+        HOST_TEST_CHECK(g_i2cMockRegs[ic][TEST_R_CURRENT_REG] == ((ic == 2) ? 60 : 100));
+        HOST_TEST_CHECK(g_i2cMockRegs[ic][TEST_R_CURRENT_REG + 2] == ((ic == 2) ? 62 : 20));
+    }
+}
+
+
+int main(void)
+{
+    testTypicalEdits();
+    testFailedWritesRecover();
+    testRandomEdits();
+    testNoHeapOperations();
+    testFadeCurves();
+    testBrightnessAndCurrents();
+    return hostTest_finish("ledDriversTest");
+}
@@ -0,0 +1,244 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "driver/i2c.h"
+#include "ledDrivers.h"
+#include "hostTest.h"
+
+
+//Simulates the system task handling a stream of inputs that each redraw the
+//grid, with LED frames written two ways:
+//  synchronous - the system task writes each frame itself, as it used to,
+//                and is stalled for the whole bus transfer and latch.
+//  mailbox     - the system task calls 'ledDrivers_submitFrame' and the LED
+//                refresh task writes whatever frame is latest once the bus
+//                is free, so a burst of frames is coalesced.
+
+//Time is simulated, the mock I2C bus moves it on by what the bus model
+//predicts for each write and the latch delays move it on by their ticks.
+//Rendering a frame is taken as free in both cases, so the figures are
+//purely what the LED writes cost. Reported for each scenario:
+//  system latency  - from an input arriving to the system task being free
+//                    to take the next one (how long input is held up).
+//  display latency - from an input arriving to a frame including it
+//                    being latched on the drivers.
+
+//The refresh task body can't be run as is (it waits forever on the
+//mailbox), so it is stepped here with the same receive and write.
+
+#define SIM_MAX_NUM_INPUTS      256
+#define SCROLL_PATTERN_COLUMNS  64
+
+typedef struct
+{
+    const char * namePtr;
+    uint32_t numInputs;
+    uint32_t inputIntervalMicros;
+    bool isScrolling;           //Each input moves the view, otherwise it edits one cell
+} Scenario;
+
+typedef struct
+{
+    uint32_t maxSystemMicros;
+    uint64_t totalSystemMicros;
+    uint32_t maxDisplayMicros;
+    uint64_t totalDisplayMicros;
+    uint32_t numFrameWrites;
+    uint8_t finalRegs[I2C_MOCK_NUM_DEVICES][I2C_MOCK_NUM_REGS];
+} SimResult;
+
+static ledDriverFrame_t g_inputFrames[SIM_MAX_NUM_INPUTS];
+static uint64_t g_inputMicros[SIM_MAX_NUM_INPUTS];
+
+
+
+static rgbLedColour_t getPatternColour(uint8_t row, uint32_t absColumn)
+{
+    static const rgbLedColour_t colours[] = {rgb_red, rgb_green, rgb_blue, rgb_orange, rgb_purple};
+    uint32_t column = absColumn % SCROLL_PATTERN_COLUMNS;
+    if(((column + (row * 5)) % 7) < 3) return colours[(column / 4 + row) % 5];
+    return rgb_off;
+}
+
+
+static void buildInputs(const Scenario * scenarioPtr)
+{
+    //One frame per input, as gridManager would render it
+    ledDriverFrame_t frame;
+
+    for(uint8_t row = 0; row < SYSTEM_NUM_ROWS; ++row)
+    {
+        for(uint8_t col = 0; col < SYSTEM_NUM_COLUMNS; ++col) frame.colours[(row * SYSTEM_NUM_COLUMNS) + col] = getPatternColour(row, col);
+    }
+
+    for(uint32_t inputIdx = 0; inputIdx < scenarioPtr->numInputs; ++inputIdx)
+    {
+        if(scenarioPtr->isScrolling)
+        {
+            for(uint8_t row = 0; row < SYSTEM_NUM_ROWS; ++row)
+            {
+                for(uint8_t col = 0; col < SYSTEM_NUM_COLUMNS; ++col) frame.colours[(row * SYSTEM_NUM_COLUMNS) + col] = getPatternColour(row, col + inputIdx + 1);
+            }
+        }
+        else
+        {
+            frame.colours[(inputIdx * 7) % (SYSTEM_NUM_ROWS * SYSTEM_NUM_COLUMNS)] = (inputIdx & 1) ? rgb_cyan : rgb_pink;
+        }
+
+        g_inputFrames[inputIdx] = frame;
+        g_inputMicros[inputIdx] = (uint64_t)inputIdx * scenarioPtr->inputIntervalMicros;
+    }
+}
+
+
+static void recordLatency(uint32_t * maxPtr, uint64_t * totalPtr, uint64_t latencyMicros)
+{
+    if(latencyMicros > *maxPtr) *maxPtr = (uint32_t)latencyMicros;
+    *totalPtr += latencyMicros;
+}
+
+
+static void startSim(void)
+{
+    i2cMock_reset();
+    g_hostMicros = 0;
+    ledDrivers_init();
+}
+
+
+static void runSynchronous(const Scenario * scenarioPtr, SimResult * resultPtr)
+{
+    uint64_t systemFreeMicros = 0;
+    uint32_t numTransactionsAtStart;
+
+    memset(resultPtr, 0, sizeof(SimResult));
+    startSim();
+    numTransactionsAtStart = g_i2cMockStats.numTransactions;
+
+    for(uint32_t inputIdx = 0; inputIdx < scenarioPtr->numInputs; ++inputIdx)
+    {
+        //Waits for the system task to finish with the last input
+        g_hostMicros = (g_inputMicros[inputIdx] > systemFreeMicros) ? g_inputMicros[inputIdx] : systemFreeMicros;
+        ledDrivers_writeEntireGrid(g_inputFrames[inputIdx].colours);
+        ++resultPtr->numFrameWrites;
+        systemFreeMicros = g_hostMicros;
+
+        recordLatency(&resultPtr->maxSystemMicros, &resultPtr->totalSystemMicros, systemFreeMicros - g_inputMicros[inputIdx]);
+        recordLatency(&resultPtr->maxDisplayMicros, &resultPtr->totalDisplayMicros, systemFreeMicros - g_inputMicros[inputIdx]);
+    }
+
+    HOST_TEST_CHECK(g_i2cMockStats.numTransactions > numTransactionsAtStart);
+    memcpy(resultPtr->finalRegs, g_i2cMockRegs, sizeof(g_i2cMockRegs));
+}
+
+
+static void stepRefreshTask(uint64_t untilMicros, uint64_t * refreshFreeMicrosPtr, uint32_t * newestSubmittedIdxPtr, uint32_t * numDisplayedPtr, SimResult * resultPtr)
+{
+    //Writes frames from the mailbox until the bus would still be busy at 'untilMicros'.
+    //A frame includes every input up to the one that submitted it.
+
+    static ledDriverFrame_t frame;
+    uint32_t frameInputIdx;
+
+    while(uxQueueMessagesWaiting(g_LedFrameQueueHandle) != 0)
+    {
+        //The frame waiting is the newest submitted, it can't be taken before then
+        frameInputIdx = *newestSubmittedIdxPtr;
+        g_hostMicros = (*refreshFreeMicrosPtr > g_inputMicros[frameInputIdx]) ? *refreshFreeMicrosPtr : g_inputMicros[frameInputIdx];
+        if(g_hostMicros >= untilMicros) return;
+
+        HOST_TEST_CHECK(xQueueReceive(g_LedFrameQueueHandle, &frame, 0) == pdTRUE);
+        ledDrivers_writeEntireGrid(frame.colours);
+        ++resultPtr->numFrameWrites;
+        *refreshFreeMicrosPtr = g_hostMicros;
+
+        while(*numDisplayedPtr <= frameInputIdx)
+        {
+            recordLatency(&resultPtr->maxDisplayMicros, &resultPtr->totalDisplayMicros, g_hostMicros - g_inputMicros[*numDisplayedPtr]);
+            ++*numDisplayedPtr;
+        }
+    }
+}
+
+
+static void runMailbox(const Scenario * scenarioPtr, SimResult * resultPtr)
+{
+    uint64_t refreshFreeMicros = 0;
+    uint64_t submitStartMicros;
+    uint32_t newestSubmittedIdx = 0;
+    uint32_t numDisplayed = 0;
+
+    memset(resultPtr, 0, sizeof(SimResult));
+    startSim();
+
+    for(uint32_t inputIdx = 0; inputIdx < scenarioPtr->numInputs; ++inputIdx)
+    {
+        //The refresh task runs alongside, it gets through whatever it can before this input
+        stepRefreshTask(g_inputMicros[inputIdx], &refreshFreeMicros, &newestSubmittedIdx, &numDisplayed, resultPtr);
+
+        g_hostMicros = g_inputMicros[inputIdx];
+        submitStartMicros = g_hostMicros;
+        ledDrivers_submitFrame(g_inputFrames[inputIdx].colours);
+        newestSubmittedIdx = inputIdx;
+
+        recordLatency(&resultPtr->maxSystemMicros, &resultPtr->totalSystemMicros, g_hostMicros - submitStartMicros);
+    }
+
+    stepRefreshTask(UINT64_MAX, &refreshFreeMicros, &newestSubmittedIdx, &numDisplayed, resultPtr);
+    HOST_TEST_CHECK(numDisplayed == scenarioPtr->numInputs);
+    memcpy(resultPtr->finalRegs, g_i2cMockRegs, sizeof(g_i2cMockRegs));
+}
+
+
+static void printResult(const char * modeNamePtr, const Scenario * scenarioPtr, const SimResult * resultPtr)
+{
+    printf("  %-12s system latency mean %6.0f max %6u us, display latency mean %6.0f max %6u us, %3u frame writes\n", modeNamePtr,
+           (double)resultPtr->totalSystemMicros / scenarioPtr->numInputs, resultPtr->maxSystemMicros,
+           (double)resultPtr->totalDisplayMicros / scenarioPtr->numInputs, resultPtr->maxDisplayMicros, resultPtr->numFrameWrites);
+}
+
+
+static void runScenario(const Scenario * scenarioPtr)
+{
+    static SimResult synchronous;
+    static SimResult mailbox;
+
+    assert(scenarioPtr->numInputs <= SIM_MAX_NUM_INPUTS);
+    buildInputs(scenarioPtr);
+
+    runSynchronous(scenarioPtr, &synchronous);
+    runMailbox(scenarioPtr, &mailbox);
+
+    printf("%s (%u inputs, every %u us):\n", scenarioPtr->namePtr, scenarioPtr->numInputs, scenarioPtr->inputIntervalMicros);
+    printResult("synchronous", scenarioPtr, &synchronous);
+    printResult("mailbox", scenarioPtr, &mailbox);
+
+    //Both end with the last frame on the drivers
+    HOST_TEST_CHECK(memcmp(synchronous.finalRegs, mailbox.finalRegs, sizeof(mailbox.finalRegs)) == 0);
+
+    //Submitting never stalls the system task, and frames are never written more often than before
+    HOST_TEST_CHECK(mailbox.maxSystemMicros == 0);
+    HOST_TEST_CHECK(synchronous.maxSystemMicros > 0);
+    HOST_TEST_CHECK(mailbox.numFrameWrites <= synchronous.numFrameWrites);
+    HOST_TEST_CHECK(mailbox.maxDisplayMicros <= synchronous.maxDisplayMicros);
+}
+
+
+int main(void)
+{
+    static const Scenario scenarios[] = {
+        {"Encoder scroll burst", 48, 3000, true},
+        {"Fast scroll", 200, 1000, true},
+        {"Note edits", 20, 150000, false},
+        {"Held key repeat", 60, 2000, false},
+    };
+
+    g_LedFrameQueueHandle = xQueueCreate(LED_FRAME_QUEUE_NUM_ITEMS, sizeof(ledDriverFrame_t));
+
+    for(uint32_t idx = 0; idx < (sizeof(scenarios) / sizeof(scenarios[0])); ++idx) runScenario(&scenarios[idx]);
+
+    return hostTest_finish("ledRefreshSim");
+}
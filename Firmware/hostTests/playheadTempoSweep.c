@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "driver/i2c.h"
+#include "ledDrivers.h"
+#include "midiHelper.h"
+#include "gridManager.h"
+#include "hostTest.h"
+
+
+//Sweeps the playback tempo and moves the playhead across the grid the way the
+//system task does on each playback tick: set the playhead column, render the
+//window and write the frame to the LED drivers (on the mock I2C bus). Each
+//tempo plays the same short project at 16th note steps, the playhead crosses
+//the visible columns and then moves off the end of the window.
+
+//Time is simulated, each step starts at its tick and the mock I2C bus moves
+//time on by what the bus model predicts for each write. Reported per tempo:
+//the I2C transactions, bytes and busy time per step, and how much of the
+//playback time the LED bus was busy for. The bus traffic of a step doesn't
+//depend on the tempo, so the busy share rises in proportion to it.
+
+#define SIXTEENTH_NOTE_QUANTIZE 16          //As passed to 'gridManager_resetSequencerGrid'
+#define SWEEP_MIN_TEMPO_BPM     60
+#define SWEEP_MAX_TEMPO_BPM     240
+#define SWEEP_TEMPO_STEP_BPM    20
+#define SWEEP_NUM_STEPS         (NUM_SEQUENCER_PHYSICAL_COLUMNS + 1)
+#define GRID_ROW_OFFSET         0x34        //As the system task renders
+#define PROJECT_NUM_COLUMNS     16
+#define MOCK_ADDRESS_NUM_BYTES  2
+
+typedef struct
+{
+    uint32_t numTransactions;
+    uint32_t numBytes;
+    uint32_t busyMicros;
+    uint32_t maxStepTransactions;
+    uint32_t maxStepBusyMicros;
+    uint32_t numOverruns;           //Steps where the bus was still busy at the next tick
+} SweepResult;
+
+
+
+static MidiEventParams makeNote(uint16_t column, uint8_t row, uint8_t velocity, uint8_t numSteps)
+{
+    MidiEventParams params = {0};
+    params.gridRow = row;
+    params.gridColumn = column;
+    params.statusByte = 0x90;
+    params.dataBytes[0] = row;
+    params.dataBytes[1] = velocity;
+    params.durationInSteps = numSteps;
+    return params;
+}
+
+
+static void renderAndWrite(void)
+{
+    static ledDriverFrame_t frame;
+
+    gridManager_updateGridLEDs(GRID_ROW_OFFSET, 0);
+    HOST_TEST_CHECK(xQueueReceive(g_LedFrameQueueHandle, &frame, 0) == pdTRUE);
+    HOST_TEST_CHECK(ledDrivers_writeEntireGrid(frame.colours) == 0);
+}
+
+
+static void loadProject(void)
+{
+    //A few notes in the visible window, so the playhead
+    //passes over both lit and unlit cells
+    gridManager_resetSequencerGrid(SIXTEENTH_NOTE_QUANTIZE);
+    for(uint16_t column = 0; column < PROJECT_NUM_COLUMNS; column += 3)
+    {
+        gridManager_addNewMidiEventToGrid(makeNote(column, GRID_ROW_OFFSET + (column % NUM_SEQUENCER_PHYSICAL_ROWS), 40 + (column * 5), 2));
+    }
+}
+
+
+static void runTempo(uint8_t tempoBPM, SweepResult * resultPtr)
+{
+    uint32_t stepTimeMicros = gridManager_getStepTimeMicros(tempoBPM);
+    ledDriverBusStats_t busStatsAtStart;
+    ledDriverBusStats_t busStatsAtStep;
+    ledDriverBusStats_t busStats;
+    I2cMockStats mockStatsAtStart;
+    uint64_t playbackStartMicros;
+    uint32_t stepTransactions;
+    uint32_t stepBusyMicros;
+
+    memset(resultPtr, 0, sizeof(SweepResult));
+
+    //The grid as it is before playback starts
+    gridManager_setPlayheadColumn(GRID_NO_OVERLAY_COLUMN);
+    renderAndWrite();
+
+    ledDrivers_getBusStats(&busStatsAtStart);
+    mockStatsAtStart = g_i2cMockStats;
+    playbackStartMicros = g_hostMicros;
+
+    for(uint32_t step = 0; step < SWEEP_NUM_STEPS; ++step)
+    {
+        //Each step starts on its tick, unless the last write is still going
+        uint64_t tickMicros = playbackStartMicros + ((uint64_t)step * stepTimeMicros);
+        if(g_hostMicros > tickMicros) ++resultPtr->numOverruns;
+        else g_hostMicros = tickMicros;
+
+        ledDrivers_getBusStats(&busStatsAtStep);
+        gridManager_setPlayheadColumn(step);
+        renderAndWrite();
+        ledDrivers_getBusStats(&busStats);
+
+        stepTransactions = busStats.numTransactions - busStatsAtStep.numTransactions;
+        stepBusyMicros = busStats.busyMicros - busStatsAtStep.busyMicros;
+        if(stepTransactions > resultPtr->maxStepTransactions) resultPtr->maxStepTransactions = stepTransactions;
+        if(stepBusyMicros > resultPtr->maxStepBusyMicros) resultPtr->maxStepBusyMicros = stepBusyMicros;
+    }
+
+    ledDrivers_getBusStats(&busStats);
+    resultPtr->numTransactions = busStats.numTransactions - busStatsAtStart.numTransactions;
+    resultPtr->numBytes = busStats.numBytes - busStatsAtStart.numBytes;
+    resultPtr->busyMicros = busStats.busyMicros - busStatsAtStart.busyMicros;
+
+    //The bus stats agree with what the mock saw
+    HOST_TEST_CHECK(resultPtr->numTransactions == (g_i2cMockStats.numTransactions - mockStatsAtStart.numTransactions));
+    HOST_TEST_CHECK(resultPtr->numBytes == (g_i2cMockStats.numBytes - mockStatsAtStart.numBytes));
+}
+
+
+static void testTempoSweep(void)
+{
+    SweepResult result;
+    SweepResult firstResult = {0};
+    uint32_t playbackMicros;
+    uint32_t busyPermille;
+    uint32_t lastBusyPermille = 0;
+    bool isTrafficSame = true;
+    bool isBusyRising = true;
+
+    g_LedFrameQueueHandle = xQueueCreate(1, sizeof(ledDriverFrame_t));
+    i2cMock_reset();
+    g_hostMicros = 0;
+    gridManager_init();
+    loadProject();
+
+    printf("Playhead at 16th notes, %u steps:\n", SWEEP_NUM_STEPS);
+
+    for(uint16_t tempoBPM = SWEEP_MIN_TEMPO_BPM; tempoBPM <= SWEEP_MAX_TEMPO_BPM; tempoBPM += SWEEP_TEMPO_STEP_BPM)
+    {
+        runTempo((uint8_t)tempoBPM, &result);
+        playbackMicros = SWEEP_NUM_STEPS * gridManager_getStepTimeMicros((uint8_t)tempoBPM);
+        busyPermille = (uint32_t)(((uint64_t)result.busyMicros * 1000) / playbackMicros);
+
+        //The playhead only touches the old and new columns, so at most two driver ICs
+        HOST_TEST_CHECK(result.maxStepTransactions <= 2);
+        HOST_TEST_CHECK(result.numBytes >= (result.numTransactions * MOCK_ADDRESS_NUM_BYTES));
+        HOST_TEST_CHECK(result.numOverruns == 0);
+
+        if(tempoBPM == SWEEP_MIN_TEMPO_BPM) firstResult = result;
+        else if((result.numTransactions != firstResult.numTransactions) || (result.numBytes != firstResult.numBytes) ||
+                (result.busyMicros != firstResult.busyMicros)) isTrafficSame = false;
+        if(busyPermille < lastBusyPermille) isBusyRising = false;
+        lastBusyPermille = busyPermille;
+
+        printf("  %3u BPM: step %6u us, per step %.2f transactions %5.1f bytes busy %6.1f us (max %4u us), bus busy %u.%u%%\n",
+               tempoBPM, gridManager_getStepTimeMicros((uint8_t)tempoBPM),
+               (double)result.numTransactions / SWEEP_NUM_STEPS, (double)result.numBytes / SWEEP_NUM_STEPS,
+               (double)result.busyMicros / SWEEP_NUM_STEPS, result.maxStepBusyMicros, busyPermille / 10, busyPermille % 10);
+    }
+
+    HOST_TEST_CHECK(isTrafficSame);
+    HOST_TEST_CHECK(isBusyRising);
+    HOST_TEST_CHECK(firstResult.numTransactions > 0);
+}
+
+
+int main(void)
+{
+    testTempoSweep();
+    return hostTest_finish("playheadTempoSweep");
+}
@@ -0,0 +1,191 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "quadratureDecoder.h"
+#include "hostTest.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+
+//Feeds recorded phase sequences through the quadrature decoder. Each trace is
+//the phase state, (PHA1 << 1) | PHA0, read by the position ISR on each edge,
+//as captured from the menu encoders. Checked for each: the detents reported,
+//the transitions rejected, and that the count is back to zero at the detent.
+
+//Then random walks (bounce and reversals) and fast spins with a missed edge
+//per detent are checked against where the encoder actually ended up, and the
+//decoder is benchmarked per edge.
+
+#define TRACE_MAX_NUM_EDGES     32
+#define REST_STATE              0
+#define WALK_NUM_STEPS          100000
+#define SPIN_NUM_DETENTS        10000
+#define BENCH_NUM_EDGES         10000000
+
+typedef struct
+{
+    const char * namePtr;
+    uint8_t numEdges;
+    uint8_t phaseStates[TRACE_MAX_NUM_EDGES];
+    int32_t numDetents;         //Clockwise positive
+    uint32_t numInvalid;
+} PhaseTrace;
+
+static const PhaseTrace g_traces[] = {
+    {"slow cw",                 12, {1, 3, 2, 0, 1, 3, 2, 0, 1, 3, 2, 0},               3,  0},
+    {"slow ccw",                8,  {2, 3, 1, 0, 2, 3, 1, 0},                           -2, 0},
+    {"cw with bounce",          10, {1, 0, 1, 3, 1, 3, 2, 3, 2, 0},                     1,  0},
+    {"bounce at rest",          6,  {1, 0, 1, 0, 2, 0},                                 0,  0},
+    {"half turn and back",      4,  {1, 3, 1, 0},                                       0,  0},
+    {"reversal",                8,  {1, 3, 2, 0, 2, 3, 1, 0},                           0,  0},
+    {"fast cw, missed edge",    7,  {1, 2, 0, 1, 3, 2, 0},                              2,  1},
+    {"fast ccw, missed edge",   7,  {2, 1, 0, 2, 3, 1, 0},                              -2, 1},
+    {"fast cw, missed rest",    7,  {1, 3, 2, 1, 3, 2, 0},                              2,  1},
+    {"glitch at rest",          2,  {3, 0},                                             0,  2},
+    {"glitch then slow cw",     15, {1, 2, 0, 1, 3, 2, 0, 1, 3, 2, 0, 1, 3, 2, 0},      4,  1},
+};
+
+#define NUM_TRACES (sizeof(g_traces) / sizeof(g_traces[0]))
+
+//Phase state at each step of a detent, clockwise
+static const uint8_t g_cwPhaseStates[QUADRATURE_STEPS_PER_DETENT] = {0, 1, 3, 2};
+
+
+
+static inline uint64_t getCycleCount(void)
+{
+    //The time stamp counter where there is one, otherwise only ns are reported
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+
+static void testTraces(void)
+{
+    QuadratureDecoder decoder;
+    int32_t numDetents;
+
+    for(uint32_t traceIdx = 0; traceIdx < NUM_TRACES; ++traceIdx)
+    {
+        const PhaseTrace * tracePtr = &g_traces[traceIdx];
+        bool isCorrect;
+
+        quadratureDecoder_init(&decoder, REST_STATE);
+        numDetents = 0;
+        for(uint8_t edge = 0; edge < tracePtr->numEdges; ++edge) numDetents += quadratureDecoder_update(&decoder, tracePtr->phaseStates[edge]);
+
+        isCorrect = (numDetents == tracePtr->numDetents) && (decoder.numInvalid == tracePtr->numInvalid);
+        if(decoder.previousState == REST_STATE) isCorrect = isCorrect && (decoder.stepCount == 0);
+        HOST_TEST_CHECK(isCorrect);
+
+        printf("  %-22s %3d detents, %u rejected%s\n", tracePtr->namePtr, numDetents, decoder.numInvalid, isCorrect ? "" : " WRONG");
+    }
+}
+
+
+static void testRandomWalk(void)
+{
+    //Valid steps only, in random directions. Whenever the encoder is
+    //at a detent the detents reported must match how far it has moved.
+
+    QuadratureDecoder decoder;
+    uint32_t randomState = 0x0E4C;
+    int32_t position = 0;       //In steps
+    int32_t numDetents = 0;
+    bool isTracking = true;
+
+    quadratureDecoder_init(&decoder, REST_STATE);
+
+    for(uint32_t step = 0; step < WALK_NUM_STEPS; ++step)
+    {
+        position += (hostTest_random(&randomState) & 1) ? 1 : -1;
+        numDetents += quadratureDecoder_update(&decoder, g_cwPhaseStates[position & (QUADRATURE_STEPS_PER_DETENT - 1)]);
+
+        if(((position & (QUADRATURE_STEPS_PER_DETENT - 1)) == 0) && (numDetents != (position / QUADRATURE_STEPS_PER_DETENT))) isTracking = false;
+    }
+
+    HOST_TEST_CHECK(isTracking);
+    HOST_TEST_CHECK(decoder.numInvalid == 0);
+}
+
+
+static void testFastSpin(int8_t direction)
+{
+    //Every detent has one of its edges missed, at a random step, as happens
+    //when the encoder is spun faster than the ISR can keep up. The edge into
+    //the rest state is always seen, a rejected transition has no direction
+    //so the count can only be trusted once the encoder is back at a detent.
+
+    QuadratureDecoder decoder;
+    uint32_t randomState = (direction > 0) ? 0x5F1D : 0x5F1E;
+    int32_t position = 0;
+    int32_t numDetents = 0;
+    uint8_t missedStep;
+
+    quadratureDecoder_init(&decoder, REST_STATE);
+
+    for(uint32_t detent = 0; detent < SPIN_NUM_DETENTS; ++detent)
+    {
+        missedStep = hostTest_random(&randomState) % (QUADRATURE_STEPS_PER_DETENT - 1);
+        for(uint8_t step = 0; step < QUADRATURE_STEPS_PER_DETENT; ++step)
+        {
+            position += direction;
+            if(step == missedStep) continue;
+            numDetents += quadratureDecoder_update(&decoder, g_cwPhaseStates[position & (QUADRATURE_STEPS_PER_DETENT - 1)]);
+        }
+    }
+
+    HOST_TEST_CHECK(numDetents == (direction * SPIN_NUM_DETENTS));
+    HOST_TEST_CHECK(decoder.numInvalid == SPIN_NUM_DETENTS);
+    HOST_TEST_CHECK(decoder.stepCount == 0);
+}
+
+
+static void benchUpdate(void)
+{
+    QuadratureDecoder decoder;
+    uint32_t randomState = 0xB3C4;
+    volatile int32_t detentSink = 0;
+    uint8_t phaseStates[256];
+    int32_t position = 0;
+    uint64_t startNanos;
+    uint64_t startCycles;
+    uint64_t elapsedNanos;
+    uint64_t elapsedCycles;
+
+    //Mostly clockwise with bounce and the odd missed edge
+    for(uint32_t idx = 0; idx < sizeof(phaseStates); ++idx)
+    {
+        uint32_t random = hostTest_random(&randomState) & 0x0F;
+        position += (random < 11) ? 1 : ((random < 15) ? -1 : 2);
+        phaseStates[idx] = g_cwPhaseStates[position & (QUADRATURE_STEPS_PER_DETENT - 1)];
+    }
+    quadratureDecoder_init(&decoder, REST_STATE);
+
+    startNanos = hostTest_getNanos();
+    startCycles = getCycleCount();
+    for(uint32_t idx = 0; idx < BENCH_NUM_EDGES; ++idx) detentSink += quadratureDecoder_update(&decoder, phaseStates[idx & 0xFF]);
+    elapsedCycles = getCycleCount() - startCycles;
+    elapsedNanos = hostTest_getNanos() - startNanos;
+
+    printf("quadratureDecoder_update: %.2f ns per edge", (double)elapsedNanos / BENCH_NUM_EDGES);
+    if(elapsedCycles != 0) printf(", %.1f cycles per edge", (double)elapsedCycles / BENCH_NUM_EDGES);
+    printf(", %u rejected\n", decoder.numInvalid);
+}
+
+
+int main(void)
+{
+    printf("Recorded traces:\n");
+    testTraces();
+    testRandomWalk();
+    testFastSpin(1);
+    testFastSpin(-1);
+    benchUpdate();
+    return hostTest_finish("quadratureDecoderTest");
+}
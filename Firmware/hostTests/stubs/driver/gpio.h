@@ -0,0 +1,24 @@
+//Host stand-in for the IDF GPIO driver, backed by the mock in 'i2cMock.c'
+//(which counts the LED driver latch pin toggles).
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+typedef enum { GPIO_INTR_DISABLE } gpio_int_type_t;
+typedef enum { GPIO_MODE_INPUT, GPIO_MODE_OUTPUT } gpio_mode_t;
+typedef enum { GPIO_PULLUP_DISABLE, GPIO_PULLUP_ENABLE } gpio_pullup_t;
+
+typedef struct
+{
+    uint64_t pin_bit_mask;
+    gpio_mode_t mode;
+    bool pull_up_en;
+    bool pull_down_en;
+    gpio_int_type_t intr_type;
+} gpio_config_t;
+
+esp_err_t gpio_config(const gpio_config_t * configPtr);
+esp_err_t gpio_set_level(uint32_t gpioNum, uint32_t level);
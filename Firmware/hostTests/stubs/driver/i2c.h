@@ -0,0 +1,48 @@
+//Host stand-in for the IDF I2C master driver. There is no bus, writes go to
+//a mock of the LP5862 register maps (see 'i2cMock.c') which counts bytes and
+//transactions, moves the simulated time on by what the bus model predicts
+//and can be told to fail writes part way through.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "driver/gpio.h"
+
+typedef enum { I2C_MODE_MASTER } i2c_mode_t;
+
+typedef struct
+{
+    i2c_mode_t mode;
+    int sda_io_num;
+    int scl_io_num;
+    gpio_pullup_t sda_pullup_en;
+    gpio_pullup_t scl_pullup_en;
+    struct { uint32_t clk_speed; } master;
+} i2c_config_t;
+
+esp_err_t i2c_param_config(int i2cNum, const i2c_config_t * configPtr);
+esp_err_t i2c_driver_install(int i2cNum, i2c_mode_t mode, uint32_t slaveRxBufNumBytes, uint32_t slaveTxBufNumBytes, int intrFlags);
+esp_err_t i2c_master_write_to_device(int i2cNum, uint8_t deviceAddr, const uint8_t * writeBufferPtr, uint32_t writeNumBytes, TickType_t waitTicks);
+
+
+//---- Mock interface ----//
+#define I2C_MOCK_NUM_DEVICES        4
+#define I2C_MOCK_NUM_REGS           0x240   //Covers the LP5862 PWM registers
+#define I2C_MOCK_BROADCAST_ADDR     0x15
+#define I2C_MOCK_DEVICE_ADDR_BASE   0x10
+
+typedef struct
+{
+    uint32_t numTransactions;
+    uint32_t numBytes;          //Including both address bytes, as 'ledDriverBusStats_t'
+    uint32_t numFailedWrites;
+    uint32_t numLatches;
+} I2cMockStats;
+
+extern uint8_t g_i2cMockRegs[I2C_MOCK_NUM_DEVICES][I2C_MOCK_NUM_REGS];
+extern I2cMockStats g_i2cMockStats;
+
+void i2cMock_reset(void);
+void i2cMock_failNextWrite(uint16_t numDataBytesLanded);
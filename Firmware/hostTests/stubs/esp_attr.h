@@ -0,0 +1,5 @@
+//Host stand-in, there is no IRAM on the host
+
+#pragma once
+
+#define IRAM_ATTR
@@ -0,0 +1,20 @@
+//Host stand-in, every capability comes from the normal heap
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define MALLOC_CAP_SPIRAM   (1 << 10)
+#define MALLOC_CAP_DMA      (1 << 3)
+#define MALLOC_CAP_8BIT     (1 << 2)
+
+static inline void * heap_caps_malloc(size_t numBytes, uint32_t caps)
+{
+    return malloc(numBytes);
+}
+
+static inline void * heap_caps_calloc(size_t numItems, size_t itemNumBytes, uint32_t caps)
+{
+    return calloc(numItems, itemNumBytes);
+}
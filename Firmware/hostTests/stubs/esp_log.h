@@ -0,0 +1,15 @@
+//Host stand-in for the IDF logging macros. Errors and warnings are
+//printed, as a test may be checking for them, the rest are never
+//printed but still compiled, so their arguments are format checked
+//and variables only used for logging don't warn as unused.
+
+#pragma once
+
+#include <stdio.h>
+#include <assert.h>     //Some sources get assert through the IDF headers
+
+#define ESP_LOGE(tag, format, ...) printf("E (%s) " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) printf("W (%s) " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) do { if(0) printf(format, ##__VA_ARGS__); } while(0)
+#define ESP_LOGD(tag, format, ...) do { if(0) printf(format, ##__VA_ARGS__); } while(0)
+#define ESP_LOGV(tag, format, ...) do { if(0) printf(format, ##__VA_ARGS__); } while(0)
@@ -0,0 +1,9 @@
+//Host stand-in, busy waits are too short to matter to the simulated time
+
+#pragma once
+
+#include <stdint.h>
+
+static inline void esp_rom_delay_us(uint32_t micros)
+{
+}
@@ -0,0 +1,3 @@
+//Host stand-in, there is no task watchdog on the host
+
+#pragma once
@@ -0,0 +1,12 @@
+//Host stand-in, the time comes from the simulated clock (see freertos/FreeRTOS.h)
+
+#pragma once
+
+#include <stdint.h>
+
+extern uint64_t g_hostMicros;
+
+static inline int64_t esp_timer_get_time(void)
+{
+    return (int64_t)g_hostMicros;
+}
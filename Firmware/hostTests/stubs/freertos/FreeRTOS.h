@@ -0,0 +1,42 @@
+//Host stand-in for the parts of FreeRTOS the host tested sources use.
+//The tests are single threaded, so critical sections only count their
+//nesting, which lets a test check they are balanced and what is (or
+//isn't) called from inside one.
+
+#pragma once
+
+//Nothing blocks, time only moves when something on the host says it has
+//taken some, see 'g_hostMicros'.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+
+typedef uint32_t TickType_t;
+typedef long BaseType_t;
+typedef void * TaskHandle_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define portMAX_DELAY 0xFFFFFFFF
+#define pdMS_TO_TICKS(X) (X)         //CONFIG_FREERTOS_HZ is 1000
+#define portTICK_PERIOD_MS 1
+
+//The simulated time, read by 'esp_timer_get_time' and moved on by
+//'vTaskDelay' and the mock I2C bus
+extern uint64_t g_hostMicros;
+
+typedef struct
+{
+    uint32_t owner;
+    uint32_t count;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED {0, 0}
+
+extern int32_t g_hostCriticalNesting;
+
+#define portENTER_CRITICAL(muxPtr)      do { ++(muxPtr)->count; ++g_hostCriticalNesting; } while(0)
+#define portEXIT_CRITICAL(muxPtr)       do { --(muxPtr)->count; --g_hostCriticalNesting; } while(0)
+#define portENTER_CRITICAL_ISR(muxPtr)  portENTER_CRITICAL(muxPtr)
+#define portEXIT_CRITICAL_ISR(muxPtr)   portEXIT_CRITICAL(muxPtr)
@@ -0,0 +1,12 @@
+//Host stand-in, see FreeRTOS.h. Queues are a plain copy-in/copy-out
+//FIFO, a receive with nothing queued fails rather than blocking.
+
+#pragma once
+
+typedef struct HostQueue * QueueHandle_t;
+
+QueueHandle_t xQueueCreate(uint32_t numItems, uint32_t itemNumBytes);
+BaseType_t xQueueSend(QueueHandle_t queue, const void * itemPtr, TickType_t waitTicks);
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void * itemPtr);
+BaseType_t xQueueReceive(QueueHandle_t queue, void * itemPtr, TickType_t waitTicks);
+uint32_t uxQueueMessagesWaiting(QueueHandle_t queue);
@@ -0,0 +1,10 @@
+//Host stand-in, see FreeRTOS.h. The tests are single threaded, so a mutex
+//only checks it is never taken twice and is always given back.
+
+#pragma once
+
+typedef struct HostMutex * SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t mutex, TickType_t waitTicks);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t mutex);
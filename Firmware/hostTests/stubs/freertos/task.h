@@ -0,0 +1,17 @@
+//Host stand-in, see FreeRTOS.h
+
+#pragma once
+
+#define taskENTER_CRITICAL(muxPtr)  portENTER_CRITICAL(muxPtr)
+#define taskEXIT_CRITICAL(muxPtr)   portEXIT_CRITICAL(muxPtr)
+
+//Returns straight away, after moving the simulated time on
+void vTaskDelay(TickType_t numTicks);
+
+//There is one task on the host, its notifications are only counted.
+//'ulTaskNotifyTake' never blocks, if nothing has been given it moves
+//the simulated time on by the timeout, as if it had waited it out.
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t * taskWokenPtr);
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t waitTicks);
@@ -0,0 +1,168 @@
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+//Critical section nesting across every spinlock, see FreeRTOS.h
+int32_t g_hostCriticalNesting = 0;
+
+uint64_t g_hostMicros = 0;
+
+//Notification value of the one host task
+static uint32_t g_hostTaskNotifyValue = 0;
+
+struct HostQueue
+{
+    uint32_t numItems;
+    uint32_t itemNumBytes;
+    uint32_t readIdx;
+    uint32_t numQueued;
+    uint8_t * itemsPtr;
+};
+
+struct HostMutex
+{
+    bool isTaken;
+};
+
+
+
+//---- Public
+void vTaskDelay(TickType_t numTicks)
+{
+    g_hostMicros += (uint64_t)numTicks * portTICK_PERIOD_MS * 1000;
+}
+
+
+
+//---- Public
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return &g_hostTaskNotifyValue;
+}
+
+
+
+//---- Public
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    assert(task == &g_hostTaskNotifyValue);
+    ++g_hostTaskNotifyValue;
+    return pdTRUE;
+}
+
+
+
+//---- Public
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t * taskWokenPtr)
+{
+    xTaskNotifyGive(task);
+    if(taskWokenPtr != NULL) *taskWokenPtr = pdTRUE;
+}
+
+
+
+//---- Public
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t waitTicks)
+{
+    uint32_t value = g_hostTaskNotifyValue;
+
+    if(value == 0)
+    {
+        if(waitTicks != portMAX_DELAY) vTaskDelay(waitTicks);
+        return 0;
+    }
+
+    g_hostTaskNotifyValue = (clearOnExit) ? 0 : (value - 1);
+    return value;
+}
+
+
+
+//---- Public
+QueueHandle_t xQueueCreate(uint32_t numItems, uint32_t itemNumBytes)
+{
+    QueueHandle_t queue = calloc(1, sizeof(struct HostQueue));
+    assert(queue != NULL);
+    queue->numItems = numItems;
+    queue->itemNumBytes = itemNumBytes;
+    queue->itemsPtr = calloc(numItems, itemNumBytes);
+    assert(queue->itemsPtr != NULL);
+    return queue;
+}
+
+
+
+//---- Public
+BaseType_t xQueueSend(QueueHandle_t queue, const void * itemPtr, TickType_t waitTicks)
+{
+    if(queue->numQueued == queue->numItems) return pdFALSE;
+    memcpy(&queue->itemsPtr[((queue->readIdx + queue->numQueued) % queue->numItems) * queue->itemNumBytes], itemPtr, queue->itemNumBytes);
+    ++queue->numQueued;
+    return pdTRUE;
+}
+
+
+
+//---- Public
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void * itemPtr)
+{
+    //As FreeRTOS, only meant for single item queues
+    assert(queue->numItems == 1);
+    memcpy(queue->itemsPtr, itemPtr, queue->itemNumBytes);
+    queue->readIdx = 0;
+    queue->numQueued = 1;
+    return pdTRUE;
+}
+
+
+
+//---- Public
+BaseType_t xQueueReceive(QueueHandle_t queue, void * itemPtr, TickType_t waitTicks)
+{
+    if(queue->numQueued == 0) return pdFALSE;
+    memcpy(itemPtr, &queue->itemsPtr[queue->readIdx * queue->itemNumBytes], queue->itemNumBytes);
+    queue->readIdx = (queue->readIdx + 1) % queue->numItems;
+    --queue->numQueued;
+    return pdTRUE;
+}
+
+
+
+//---- Public
+uint32_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    return queue->numQueued;
+}
+
+
+
+//---- Public
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    SemaphoreHandle_t mutex = calloc(1, sizeof(struct HostMutex));
+    assert(mutex != NULL);
+    return mutex;
+}
+
+
+
+//---- Public
+BaseType_t xSemaphoreTake(SemaphoreHandle_t mutex, TickType_t waitTicks)
+{
+    assert(!mutex->isTaken);
+    mutex->isTaken = true;
+    return pdTRUE;
+}
+
+
+
+//---- Public
+BaseType_t xSemaphoreGive(SemaphoreHandle_t mutex)
+{
+    assert(mutex->isTaken);
+    mutex->isTaken = false;
+    return pdTRUE;
+}
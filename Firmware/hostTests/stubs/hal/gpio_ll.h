@@ -0,0 +1,17 @@
+//Host stand-in for the IDF GPIO low level functions used from ISRs.
+//Not implemented here, a test that needs them models the hardware
+//on the pins itself (see 'switchMatrixSim.c').
+
+#pragma once
+
+#include <stdint.h>
+
+typedef struct
+{
+    uint32_t unused;
+} gpio_dev_t;
+
+extern gpio_dev_t GPIO;
+
+int gpio_ll_get_level(gpio_dev_t * hw, uint32_t gpioNum);
+void gpio_ll_set_level(gpio_dev_t * hw, uint32_t gpioNum, uint32_t level);
@@ -0,0 +1,40 @@
+//Host stand-in for the NimBLE host API, just the GAP / GATT calls made by
+//bleLinkPolicy. There is no radio, each test provides these functions as
+//a mock GAP layer that records the requests and returns what it is told.
+
+#pragma once
+
+#include <stdint.h>
+
+#define BLE_HS_EALREADY             2
+#define BLE_HS_ENOTCONN             7
+
+#define BLE_GAP_LE_PHY_1M_MASK      0x01
+#define BLE_GAP_LE_PHY_2M_MASK      0x02
+#define BLE_GAP_LE_PHY_CODED_MASK   0x04
+#define BLE_GAP_LE_PHY_CODED_ANY    0
+
+struct ble_gap_upd_params
+{
+    uint16_t itvl_min;
+    uint16_t itvl_max;
+    uint16_t latency;
+    uint16_t supervision_timeout;
+    uint16_t min_ce_len;
+    uint16_t max_ce_len;
+};
+
+struct ble_gap_conn_desc
+{
+    uint16_t conn_handle;
+    uint16_t conn_itvl;
+    uint16_t conn_latency;
+    uint16_t supervision_timeout;
+};
+
+int ble_att_set_preferred_mtu(uint16_t mtu);
+int ble_gattc_exchange_mtu(uint16_t conn_handle, void * cb, void * cb_arg);
+int ble_gap_update_params(uint16_t conn_handle, const struct ble_gap_upd_params * params);
+int ble_gap_set_data_len(uint16_t conn_handle, uint16_t tx_octets, uint16_t tx_time);
+int ble_gap_set_prefered_le_phy(uint16_t conn_handle, uint8_t tx_phys_mask, uint8_t rx_phys_mask, uint16_t phy_opts);
+int ble_gap_conn_find(uint16_t handle, struct ble_gap_conn_desc * out_desc);
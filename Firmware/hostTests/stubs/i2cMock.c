@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "driver/i2c.h"
+#include "ledDriverBusModel.h"
+
+//Stands in for the I2C bus and the four LP5862 drivers on it. Each driver
+//is a flat register map, written the way the real part auto increments
+//through it. A broadcast write lands in every driver.
+
+#define LATCH_IO 7
+
+uint8_t g_i2cMockRegs[I2C_MOCK_NUM_DEVICES][I2C_MOCK_NUM_REGS];
+I2cMockStats g_i2cMockStats;
+
+static uint32_t g_busFreqHz = 0;
+static uint32_t g_latchLevel = 0;
+static bool g_isFailNextWrite = false;
+static uint16_t g_failNumDataBytesLanded = 0;
+
+
+
+//---- Public
+void i2cMock_reset(void)
+{
+    memset(g_i2cMockRegs, 0, sizeof(g_i2cMockRegs));
+    memset(&g_i2cMockStats, 0, sizeof(g_i2cMockStats));
+    g_isFailNextWrite = false;
+}
+
+
+
+//---- Public
+void i2cMock_failNextWrite(uint16_t numDataBytesLanded)
+{
+    //The next write is NACKed after 'numDataBytesLanded'
+    //register bytes have already been written
+    g_isFailNextWrite = true;
+    g_failNumDataBytesLanded = numDataBytesLanded;
+}
+
+
+
+//---- Public
+esp_err_t i2c_param_config(int i2cNum, const i2c_config_t * configPtr)
+{
+    g_busFreqHz = configPtr->master.clk_speed;
+    return ESP_OK;
+}
+
+
+
+//---- Public
+esp_err_t i2c_driver_install(int i2cNum, i2c_mode_t mode, uint32_t slaveRxBufNumBytes, uint32_t slaveTxBufNumBytes, int intrFlags)
+{
+    return ESP_OK;
+}
+
+
+
+//---- Public
+esp_err_t i2c_master_write_to_device(int i2cNum, uint8_t deviceAddr, const uint8_t * writeBufferPtr, uint32_t writeNumBytes, TickType_t waitTicks)
+{
+    //'deviceAddr' is the LP5862 first address byte, chip address in
+    //bits 7 -> 2 and register address bits 9 -> 8 in bits 1 -> 0.
+    //'writeBufferPtr[0]' is register address bits 7 -> 0.
+
+    assert(g_busFreqHz != 0);
+    assert(writeNumBytes >= 1);
+
+    uint8_t chipAddr = deviceAddr >> 2;
+    uint16_t regAddr = (uint16_t)(((deviceAddr & 0x03) << 8) | writeBufferPtr[0]);
+    uint32_t numDataBytes = writeNumBytes - 1;
+    bool isFailing = g_isFailNextWrite;
+
+    assert((chipAddr == I2C_MOCK_BROADCAST_ADDR) || ((chipAddr & ~0x03) == I2C_MOCK_DEVICE_ADDR_BASE));
+    assert((regAddr + numDataBytes) <= I2C_MOCK_NUM_REGS);
+
+    if(isFailing)
+    {
+        g_isFailNextWrite = false;
+        if(g_failNumDataBytesLanded < numDataBytes) numDataBytes = g_failNumDataBytesLanded;
+        ++g_i2cMockStats.numFailedWrites;
+    }
+
+    for(uint8_t device = 0; device < I2C_MOCK_NUM_DEVICES; ++device)
+    {
+        if((chipAddr != I2C_MOCK_BROADCAST_ADDR) && (chipAddr != (I2C_MOCK_DEVICE_ADDR_BASE | device))) continue;
+        memcpy(&g_i2cMockRegs[device][regAddr], &writeBufferPtr[1], numDataBytes);
+    }
+
+    ++g_i2cMockStats.numTransactions;
+    g_i2cMockStats.numBytes += writeNumBytes + 1;
+    g_hostMicros += ledDriverBusModel_transactionMicros(g_busFreqHz, (uint16_t)(writeNumBytes - 1));
+
+    return (isFailing) ? ESP_FAIL : ESP_OK;
+}
+
+
+
+//---- Public
+esp_err_t gpio_config(const gpio_config_t * configPtr)
+{
+    return ESP_OK;
+}
+
+
+
+//---- Public
+esp_err_t gpio_set_level(uint32_t gpioNum, uint32_t level)
+{
+    if((gpioNum == LATCH_IO) && level && !g_latchLevel) ++g_i2cMockStats.numLatches;
+    if(gpioNum == LATCH_IO) g_latchLevel = level;
+    return ESP_OK;
+}
@@ -0,0 +1,225 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "switchDebounce.h"
+#include "hostTest.h"
+
+
+//Feeds recorded bounce traces through the switch debounce counters. Each trace
+//is the contact transitions of one key stroke, as captured on a scope from the
+//grid switches, and is sampled the way the scan ISR samples it, once per sweep
+//(every 'SWEEP_MICROS'), at every scan tick phase within the sweep.
+
+//Checked for each trace: a stroke gives exactly one press and one release, a
+//glitch or brushed key gives nothing, press and release latency from the first
+//contact change stays under 'MAX_LATENCY_MICROS', and every row of a column
+//is debounced on its own when all six see different traces at once.
+
+#define COLUMN_NUM_BITS         8       //One key per bit of a column
+#define SWEEP_MICROS            1000    //Eight columns, one per scan tick
+#define SCAN_TICK_MICROS        125
+#define MAX_LATENCY_MICROS      10000
+#define TRACE_MAX_NUM_EDGES     16
+#define TRACE_END_MICROS        200000
+#define BENCH_NUM_UPDATES       10000000
+
+typedef struct
+{
+    const char * namePtr;
+    uint32_t pressMicros;                       //First contact change
+    uint8_t numPressEdges;
+    uint16_t pressEdges[TRACE_MAX_NUM_EDGES];   //Offsets from 'pressMicros', closed, open, closed ...
+    uint32_t releaseMicros;
+    uint8_t numReleaseEdges;
+    uint16_t releaseEdges[TRACE_MAX_NUM_EDGES]; //Offsets from 'releaseMicros', open, closed, open ...
+    bool isStroke;                              //Otherwise should be rejected
+} BounceTrace;
+
+typedef struct
+{
+    uint32_t numPresses;
+    uint32_t numReleases;
+    uint32_t pressLatencyMicros;
+    uint32_t releaseLatencyMicros;
+} TraceResult;
+
+static const BounceTrace g_traces[] = {
+    {"clean",                   10000, 1, {0},                                      60000, 1, {0},                                      true},
+    {"short press bounce",      10000, 5, {0, 180, 260, 520, 610},                  60000, 3, {0, 90, 140},                             true},
+    {"long press chatter",      10000, 11, {0, 120, 300, 410, 900, 1100, 1500, 1700, 2300, 2600, 3100},
+                                                                                    80000, 7, {0, 400, 800, 1300, 1900, 2100, 2800},    true},
+    {"slow release chatter",    10000, 3, {0, 60, 150},                             40000, 13, {0, 300, 700, 900, 1600, 2000, 2600, 2900, 3500, 3700, 4100, 4300, 4700}, true},
+    {"fast tap",                10000, 3, {0, 100, 200},                            22000, 3, {0, 150, 300},                            true},
+    {"held long",               10000, 5, {0, 200, 350, 600, 700},                  160000, 5, {0, 250, 450, 800, 950},                 true},
+    {"glitch",                  10000, 1, {0},                                      10300, 1, {0},                                      false},
+    {"brushed",                 10000, 5, {0, 400, 900, 1300, 1700},                12500, 3, {0, 200, 500},                            false},
+};
+
+#define NUM_TRACES (sizeof(g_traces) / sizeof(g_traces[0]))
+
+
+
+static bool isTraceClosed(const BounceTrace * tracePtr, uint32_t micros)
+{
+    bool isClosed = false;
+
+    for(uint8_t edge = 0; edge < tracePtr->numPressEdges; ++edge)
+    {
+        if(micros >= (tracePtr->pressMicros + tracePtr->pressEdges[edge])) isClosed = !(edge & 1);
+    }
+    for(uint8_t edge = 0; edge < tracePtr->numReleaseEdges; ++edge)
+    {
+        if(micros >= (tracePtr->releaseMicros + tracePtr->releaseEdges[edge])) isClosed = (edge & 1);
+    }
+
+    return isClosed;
+}
+
+
+static void runTraces(const BounceTrace * rowTracePtrs[COLUMN_NUM_BITS], uint32_t phaseMicros, TraceResult results[COLUMN_NUM_BITS])
+{
+    //Samples up to eight traces, one per row bit, through one column
+    SwitchDebounceColumn column;
+    uint8_t sample;
+    uint8_t changed;
+
+    switchDebounce_init(&column);
+
+    for(uint32_t micros = phaseMicros; micros < TRACE_END_MICROS; micros += SWEEP_MICROS)
+    {
+        sample = 0;
+        for(uint8_t row = 0; row < COLUMN_NUM_BITS; ++row)
+        {
+            if((rowTracePtrs[row] != NULL) && isTraceClosed(rowTracePtrs[row], micros)) sample |= (1 << row);
+        }
+
+        changed = switchDebounce_update(&column, sample);
+
+        for(uint8_t row = 0; row < COLUMN_NUM_BITS; ++row)
+        {
+            if(!(changed & (1 << row))) continue;
+
+            if(column.state & (1 << row))
+            {
+                if(results[row].numPresses++ == 0) results[row].pressLatencyMicros = micros - rowTracePtrs[row]->pressMicros;
+            }
+            else
+            {
+                if(results[row].numReleases++ == 0) results[row].releaseLatencyMicros = micros - rowTracePtrs[row]->releaseMicros;
+            }
+        }
+    }
+}
+
+
+static void testEachTrace(void)
+{
+    const BounceTrace * rowTracePtrs[COLUMN_NUM_BITS] = {0};
+    TraceResult results[COLUMN_NUM_BITS];
+    uint32_t maxPressLatency;
+    uint32_t maxReleaseLatency;
+    uint32_t totalPressLatency;
+    uint32_t numPhases;
+
+    printf("Latency over every scan phase:\n");
+
+    for(uint32_t traceIdx = 0; traceIdx < NUM_TRACES; ++traceIdx)
+    {
+        const BounceTrace * tracePtr = &g_traces[traceIdx];
+        maxPressLatency = 0;
+        maxReleaseLatency = 0;
+        totalPressLatency = 0;
+        numPhases = 0;
+
+        for(uint32_t phase = 0; phase < SWEEP_MICROS; phase += SCAN_TICK_MICROS)
+        {
+            rowTracePtrs[0] = tracePtr;
+            memset(results, 0, sizeof(results));
+            runTraces(rowTracePtrs, phase, results);
+
+            if(tracePtr->isStroke)
+            {
+                HOST_TEST_CHECK(results[0].numPresses == 1);
+                HOST_TEST_CHECK(results[0].numReleases == 1);
+                HOST_TEST_CHECK(results[0].pressLatencyMicros <= MAX_LATENCY_MICROS);
+                HOST_TEST_CHECK(results[0].releaseLatencyMicros <= MAX_LATENCY_MICROS);
+                if(results[0].pressLatencyMicros > maxPressLatency) maxPressLatency = results[0].pressLatencyMicros;
+                if(results[0].releaseLatencyMicros > maxReleaseLatency) maxReleaseLatency = results[0].releaseLatencyMicros;
+                totalPressLatency += results[0].pressLatencyMicros;
+                ++numPhases;
+            }
+            else
+            {
+                HOST_TEST_CHECK((results[0].numPresses == 0) && (results[0].numReleases == 0));
+            }
+        }
+
+        if(tracePtr->isStroke)
+        {
+            printf("  %-22s press mean %5u max %5u us, release max %5u us\n", tracePtr->namePtr,
+                   totalPressLatency / numPhases, maxPressLatency, maxReleaseLatency);
+        }
+        else
+        {
+            printf("  %-22s rejected\n", tracePtr->namePtr);
+        }
+    }
+}
+
+
+static void testRowsIndependent(void)
+{
+    //Six rows of one column see different traces at the same time,
+    //each must get exactly what it gets when debounced alone
+
+    const BounceTrace * rowTracePtrs[COLUMN_NUM_BITS] = {0};
+    const BounceTrace * aloneTracePtrs[COLUMN_NUM_BITS] = {0};
+    TraceResult together[COLUMN_NUM_BITS];
+    TraceResult alone[COLUMN_NUM_BITS];
+
+    for(uint32_t firstTrace = 0; firstTrace < NUM_TRACES; ++firstTrace)
+    {
+        for(uint8_t row = 0; row < 6; ++row) rowTracePtrs[row] = &g_traces[(firstTrace + row) % NUM_TRACES];
+
+        memset(together, 0, sizeof(together));
+        runTraces(rowTracePtrs, 0, together);
+
+        for(uint8_t row = 0; row < 6; ++row)
+        {
+            aloneTracePtrs[0] = rowTracePtrs[row];
+            memset(alone, 0, sizeof(alone));
+            runTraces(aloneTracePtrs, 0, alone);
+            HOST_TEST_CHECK(memcmp(&together[row], &alone[0], sizeof(TraceResult)) == 0);
+        }
+    }
+}
+
+
+static void benchUpdate(void)
+{
+    SwitchDebounceColumn column;
+    uint32_t randomState = 0xDEB0;
+    volatile uint8_t changedSink = 0;
+    uint8_t samples[256];
+    uint64_t startNanos;
+    uint64_t elapsedNanos;
+
+    for(uint32_t idx = 0; idx < sizeof(samples); ++idx) samples[idx] = (uint8_t)hostTest_random(&randomState) & 0x3F;
+    switchDebounce_init(&column);
+
+    startNanos = hostTest_getNanos();
+    for(uint32_t idx = 0; idx < BENCH_NUM_UPDATES; ++idx) changedSink ^= switchDebounce_update(&column, samples[idx & 0xFF]);
+    elapsedNanos = hostTest_getNanos() - startNanos;
+
+    printf("switchDebounce_update: %.2f ns per column (6 keys)\n", (double)elapsedNanos / BENCH_NUM_UPDATES);
+}
+
+
+int main(void)
+{
+    testEachTrace();
+    testRowsIndependent();
+    benchUpdate();
+    return hostTest_finish("switchDebounceTest");
+}
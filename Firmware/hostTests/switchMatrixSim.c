@@ -0,0 +1,503 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hostTest.h"
+
+
+//Runs the switch matrix module against a simulated matrix. The simulation
+//models the MC14017B counter (clocked and reset by the module, output Qn
+//energizing column 7 - n) and the contacts of all 48 switches, which bounce
+//for up to 'SIM_BOUNCE_MAX_MICROS' on every press and release.
+
+//The module source is included here, so its scan ISR can be fired from the
+//simulated timer and its task stepped as it would run, the task entry point
+//itself never returns. Time is simulated, one scan tick per ISR call.
+
+//Every scenario checks that no press or release is lost or duplicated, that
+//each event lands on the right row and column, and that presses are reported
+//within 'SIM_MAX_LATENCY_MICROS' of the contacts closing. Hold events are
+//checked to come once per long press and never after their release, and the
+//system side runs every event through 'gridGestures' as the system task does,
+//so gestures are checked against the live key bitmap.
+
+#include "switchMatrix.c"
+#include "gridGestures.h"
+
+#define SIM_MAX_NUM_CONTACT_CHANGES     4096
+#define SIM_MAX_NUM_EVENTS              1024
+#define SIM_BOUNCE_MAX_MICROS           1500
+#define SIM_MAX_LATENCY_MICROS          10000
+#define SIM_NUM_DRUM_TAPS               40
+
+typedef struct
+{
+    uint32_t micros;
+    uint8_t keyIdx;
+    bool isClosed;
+} ContactChange;
+
+//Simulated hardware
+gpio_dev_t GPIO;
+static gptimer_alarm_cb_t g_scanAlarmCallback = NULL;
+static uint8_t g_counterOutput = 0;
+static uint32_t g_counterClockLevel = 0;
+static uint64_t g_closedContacts = 0;
+
+static ContactChange g_contactChanges[SIM_MAX_NUM_CONTACT_CHANGES];
+static uint32_t g_numContactChanges = 0;
+static uint32_t g_nextContactChange = 0;
+static uint32_t g_pressMicros[KEY_MATRIX_NUM_KEYS];
+static uint32_t g_bounceRandomState = 0x5EED1234;
+
+//Events taken off the system bus
+static InputEvent g_events[SIM_MAX_NUM_EVENTS];
+static GridGesture g_gestures[SIM_MAX_NUM_EVENTS];
+static uint32_t g_numEvents = 0;
+static uint32_t g_numHoldEvents = 0;
+static InputEvent g_lastHoldEvent;
+static uint32_t g_maxLatencyMicros = 0;
+
+
+
+//---- Simulated hardware
+int gpio_ll_get_level(gpio_dev_t * hw, uint32_t gpioNum)
+{
+    uint8_t column = KEY_MATRIX_START_COLUMN - g_counterOutput;
+
+    for(uint8_t row = 0; row < KEY_MATRIX_NUM_ROWS; ++row)
+    {
+        if(g_rowInputPins[row] == gpioNum) return (g_closedContacts & SWITCH_MATRIX_KEY_MASK(column, row)) ? 1 : 0;
+    }
+
+    assert(0);
+    return 0;
+}
+
+void gpio_ll_set_level(gpio_dev_t * hw, uint32_t gpioNum, uint32_t level)
+{
+    //Q8 is tied to the counters reset, so it goes from Q7 straight back to Q0
+    assert(gpioNum == KEY_MATRIX_SCAN_CLK_IO);
+    if(level && !g_counterClockLevel) g_counterOutput = (g_counterOutput + 1) % KEY_MATRIX_NUM_COLUMNS;
+    g_counterClockLevel = level;
+}
+
+esp_err_t gpio_config(const gpio_config_t * configPtr)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(uint32_t gpioNum, uint32_t level)
+{
+    if((gpioNum == KEY_MATRIX_COUNTER_RESET_IO) && level) g_counterOutput = 0;
+    if(gpioNum == KEY_MATRIX_SCAN_CLK_IO) g_counterClockLevel = level;
+    return ESP_OK;
+}
+
+esp_err_t gptimer_new_timer(const gptimer_config_t * configPtr, gptimer_handle_t * timerPtr)
+{
+    HOST_TEST_CHECK((1000000 / configPtr->resolution_hz) == 1);
+    *timerPtr = (gptimer_handle_t)&g_scanAlarmCallback;
+    return ESP_OK;
+}
+
+esp_err_t gptimer_register_event_callbacks(gptimer_handle_t timer, const gptimer_event_callbacks_t * cbsPtr, void * userData)
+{
+    g_scanAlarmCallback = cbsPtr->on_alarm;
+    return ESP_OK;
+}
+
+esp_err_t gptimer_enable(gptimer_handle_t timer)
+{
+    return ESP_OK;
+}
+
+esp_err_t gptimer_set_alarm_action(gptimer_handle_t timer, const gptimer_alarm_config_t * configPtr)
+{
+    HOST_TEST_CHECK(configPtr->alarm_count == KEY_MATRIX_SCAN_TICK_US);
+    HOST_TEST_CHECK(configPtr->flags.auto_reload_on_alarm);
+    return ESP_OK;
+}
+
+esp_err_t gptimer_start(gptimer_handle_t timer)
+{
+    return ESP_OK;
+}
+
+
+
+static void addContactChange(uint32_t micros, uint8_t keyIdx, bool isClosed)
+{
+    assert(g_numContactChanges < SIM_MAX_NUM_CONTACT_CHANGES);
+    g_contactChanges[g_numContactChanges].micros = micros;
+    g_contactChanges[g_numContactChanges].keyIdx = keyIdx;
+    g_contactChanges[g_numContactChanges].isClosed = isClosed;
+    ++g_numContactChanges;
+}
+
+
+static void addBouncingEdge(uint32_t micros, uint8_t keyIdx, bool isClosed)
+{
+    //The contacts chatter for a while before settling at 'isClosed'
+    uint32_t bounceMicros = micros;
+    uint32_t numBounces = hostTest_random(&g_bounceRandomState) % 4;
+
+    for(uint32_t bounce = 0; bounce < numBounces; ++bounce)
+    {
+        addContactChange(bounceMicros, keyIdx, isClosed);
+        bounceMicros += 50 + (hostTest_random(&g_bounceRandomState) % 300);
+        addContactChange(bounceMicros, keyIdx, !isClosed);
+        bounceMicros += 50 + (hostTest_random(&g_bounceRandomState) % 100);
+    }
+    assert((bounceMicros - micros) <= SIM_BOUNCE_MAX_MICROS);
+    addContactChange(bounceMicros, keyIdx, isClosed);
+}
+
+
+static void addKeyStroke(uint32_t pressMicros, uint32_t releaseMicros, uint8_t keyIdx)
+{
+    addBouncingEdge(pressMicros, keyIdx, true);
+    addBouncingEdge(releaseMicros, keyIdx, false);
+}
+
+
+static int compareContactChanges(const void * aPtr, const void * bPtr)
+{
+    const ContactChange * a = aPtr;
+    const ContactChange * b = bPtr;
+    if(a->micros != b->micros) return (a->micros < b->micros) ? -1 : 1;
+    return (a->keyIdx < b->keyIdx) ? -1 : 1;
+}
+
+
+static void takeSystemEvents(void)
+{
+    //Stands in for the system task
+    InputEvent event;
+    uint8_t keyIdx;
+
+    while(inputEventBus_take(inputBusSystem, &event))
+    {
+        HOST_TEST_CHECK(event.source == inputSourceSwitchMatrix);
+        if(event.eventType == switchMatrixHoldEvent)
+        {
+            ++g_numHoldEvents;
+            g_lastHoldEvent = event;
+            continue;
+        }
+
+        keyIdx = SWITCH_MATRIX_KEY_IDX(event.switchMatrix.column, event.switchMatrix.row);
+        if((event.eventType == switchMatrixPressEvent) && ((event.timestampMicros - g_pressMicros[keyIdx]) > g_maxLatencyMicros))
+        {
+            g_maxLatencyMicros = event.timestampMicros - g_pressMicros[keyIdx];
+        }
+
+        assert(g_numEvents < SIM_MAX_NUM_EVENTS);
+        gridGestures_processSwitchEvent(&event, &g_gestures[g_numEvents]);
+        g_events[g_numEvents++] = event;
+    }
+}
+
+
+static void runSim(uint32_t untilMicros, uint32_t taskStalledUntilMicros)
+{
+    //Runs the scan, the switch matrix task (unless stalled) and
+    //the system task, until the simulated time reaches 'untilMicros'
+
+    static uint64_t nextTaskRetryMicros = 0;
+    bool isTaskWoken;
+
+    qsort(&g_contactChanges[g_nextContactChange], g_numContactChanges - g_nextContactChange, sizeof(ContactChange), compareContactChanges);
+
+    while(g_hostMicros < untilMicros)
+    {
+        while((g_nextContactChange < g_numContactChanges) && (g_contactChanges[g_nextContactChange].micros <= g_hostMicros))
+        {
+            const ContactChange * changePtr = &g_contactChanges[g_nextContactChange++];
+            uint64_t keyMask = (1ULL << changePtr->keyIdx);
+
+            if(changePtr->isClosed && !(g_closedContacts & keyMask)) g_pressMicros[changePtr->keyIdx] = (uint32_t)g_hostMicros;
+            g_closedContacts = (changePtr->isClosed) ? (g_closedContacts | keyMask) : (g_closedContacts & ~keyMask);
+        }
+
+        g_scanAlarmCallback(g_scanTimerHandle, NULL, NULL);
+
+        //As the task loop, woken by the ISR or by its retry timeout
+        if(g_hostMicros >= taskStalledUntilMicros)
+        {
+            isTaskWoken = (ulTaskNotifyTake(pdTRUE, 0) != 0);
+            if(isTaskWoken || (g_hostMicros >= nextTaskRetryMicros))
+            {
+                forwardSwitchEvents();
+                sendHoldEvents();
+                nextTaskRetryMicros = g_hostMicros + (KEY_MATRIX_TASK_RETRY_MS * 1000);
+            }
+        }
+
+        takeSystemEvents();
+        g_hostMicros += KEY_MATRIX_SCAN_TICK_US;
+    }
+}
+
+
+static void startScenario(const char * namePtr)
+{
+    printf("%s\n", namePtr);
+    g_numEvents = 0;
+    g_numHoldEvents = 0;
+    g_maxLatencyMicros = 0;
+}
+
+
+static void checkKeyStrokes(uint8_t keyIdx, uint32_t numStrokes)
+{
+    //Each stroke of the key is exactly one press followed by one release
+    uint32_t numPresses = 0;
+    uint32_t numReleases = 0;
+    bool isInOrder = true;
+
+    for(uint32_t idx = 0; idx < g_numEvents; ++idx)
+    {
+        if(SWITCH_MATRIX_KEY_IDX(g_events[idx].switchMatrix.column, g_events[idx].switchMatrix.row) != keyIdx) continue;
+
+        if(g_events[idx].eventType == switchMatrixPressEvent)
+        {
+            if(numPresses != numReleases) isInOrder = false;
+            ++numPresses;
+        }
+        else
+        {
+            if(numPresses != (numReleases + 1)) isInOrder = false;
+            ++numReleases;
+        }
+    }
+
+    HOST_TEST_CHECK(numPresses == numStrokes);
+    HOST_TEST_CHECK(numReleases == numStrokes);
+    HOST_TEST_CHECK(isInOrder);
+}
+
+
+static void testEveryKeyMapped(void)
+{
+    uint32_t startMicros = (uint32_t)g_hostMicros;
+    bool isMapped = true;
+    bool areStatesRight = true;
+
+    startScenario("Each key pressed alone");
+
+    for(uint8_t keyIdx = 0; keyIdx < KEY_MATRIX_NUM_KEYS; ++keyIdx)
+    {
+        addKeyStroke(startMicros + (keyIdx * 60000), startMicros + (keyIdx * 60000) + 30000, keyIdx);
+    }
+
+    for(uint8_t keyIdx = 0; keyIdx < KEY_MATRIX_NUM_KEYS; ++keyIdx)
+    {
+        //Half way through each press only that key is held
+        runSim(startMicros + (keyIdx * 60000) + 20000, 0);
+        if(switchMatrix_getKeyStates() != (1ULL << keyIdx)) areStatesRight = false;
+    }
+    runSim(startMicros + (KEY_MATRIX_NUM_KEYS * 60000), 0);
+
+    HOST_TEST_CHECK(g_numEvents == (KEY_MATRIX_NUM_KEYS * 2));
+    for(uint32_t idx = 0; idx < g_numEvents; ++idx)
+    {
+        if(g_events[idx].switchMatrix.column != ((idx / 2) / KEY_MATRIX_NUM_ROWS)) isMapped = false;
+        if(g_events[idx].switchMatrix.row != ((idx / 2) % KEY_MATRIX_NUM_ROWS)) isMapped = false;
+        if(g_events[idx].eventType != ((idx & 1) ? switchMatrixReleaseEvent : switchMatrixPressEvent)) isMapped = false;
+    }
+    HOST_TEST_CHECK(isMapped);
+    HOST_TEST_CHECK(areStatesRight);
+    HOST_TEST_CHECK(switchMatrix_getKeyStates() == 0);
+    HOST_TEST_CHECK(g_maxLatencyMicros <= SIM_MAX_LATENCY_MICROS);
+    printf("  %u events, max press latency %u us\n", g_numEvents, g_maxLatencyMicros);
+}
+
+
+static void testFullChord(void)
+{
+    uint32_t startMicros = (uint32_t)g_hostMicros;
+
+    startScenario("All 48 keys pressed at once");
+
+    for(uint8_t keyIdx = 0; keyIdx < KEY_MATRIX_NUM_KEYS; ++keyIdx) addKeyStroke(startMicros, startMicros + 100000, keyIdx);
+
+    runSim(startMicros + 50000, 0);
+    HOST_TEST_CHECK(switchMatrix_getKeyStates() == ((1ULL << KEY_MATRIX_NUM_KEYS) - 1));
+    HOST_TEST_CHECK(g_numEvents == KEY_MATRIX_NUM_KEYS);
+
+    runSim(startMicros + 150000, 0);
+    HOST_TEST_CHECK(switchMatrix_getKeyStates() == 0);
+    HOST_TEST_CHECK(g_numEvents == (KEY_MATRIX_NUM_KEYS * 2));
+    for(uint8_t keyIdx = 0; keyIdx < KEY_MATRIX_NUM_KEYS; ++keyIdx) checkKeyStrokes(keyIdx, 1);
+
+    HOST_TEST_CHECK(g_switchEventRing.numDropped == 0);
+    HOST_TEST_CHECK(g_numHoldEvents == 0);
+    HOST_TEST_CHECK(g_maxLatencyMicros <= SIM_MAX_LATENCY_MICROS);
+    printf("  %u events, max press latency %u us\n", g_numEvents, g_maxLatencyMicros);
+}
+
+
+static void testFingerDrumming(void)
+{
+    //Four fingers in different rows and columns, each tapping
+    //every 24ms (held for 10ms), staggered by 6ms
+
+    static const uint8_t drumKeys[] = {3, 17, 30, 44};
+    uint32_t startMicros = (uint32_t)g_hostMicros;
+    uint32_t tapMicros;
+
+    startScenario("Finger drumming on four keys");
+
+    for(uint8_t finger = 0; finger < sizeof(drumKeys); ++finger)
+    {
+        for(uint32_t tap = 0; tap < SIM_NUM_DRUM_TAPS; ++tap)
+        {
+            tapMicros = startMicros + (finger * 6000) + (tap * 24000);
+            addKeyStroke(tapMicros, tapMicros + 10000, drumKeys[finger]);
+        }
+    }
+
+    runSim(startMicros + (SIM_NUM_DRUM_TAPS * 24000) + 50000, 0);
+
+    for(uint8_t finger = 0; finger < sizeof(drumKeys); ++finger) checkKeyStrokes(drumKeys[finger], SIM_NUM_DRUM_TAPS);
+    HOST_TEST_CHECK(g_numEvents == (sizeof(drumKeys) * SIM_NUM_DRUM_TAPS * 2));
+    HOST_TEST_CHECK(g_switchEventRing.numDropped == 0);
+    HOST_TEST_CHECK(g_maxLatencyMicros <= SIM_MAX_LATENCY_MICROS);
+    printf("  %u events, max press latency %u us\n", g_numEvents, g_maxLatencyMicros);
+}
+
+
+static void testTaskStalled(void)
+{
+    //The task is kept from running while 20 keys are struck, the
+    //events wait in the ring and are all forwarded once it runs
+    uint32_t startMicros = (uint32_t)g_hostMicros;
+    uint32_t numDroppedAtStart = g_switchEventRing.numDropped;
+
+    startScenario("Task stalled for 60ms");
+
+    for(uint8_t keyIdx = 0; keyIdx < 20; ++keyIdx)
+    {
+        addKeyStroke(startMicros + (keyIdx * 1000), startMicros + (keyIdx * 1000) + 20000, keyIdx * 2);
+    }
+
+    runSim(startMicros + 60000, startMicros + 60000);
+    HOST_TEST_CHECK(g_numEvents == 0);
+    runSim(startMicros + 80000, 0);
+
+    HOST_TEST_CHECK(g_numEvents == 40);
+    for(uint8_t keyIdx = 0; keyIdx < 20; ++keyIdx) checkKeyStrokes(keyIdx * 2, 1);
+    HOST_TEST_CHECK(g_switchEventRing.numDropped == numDroppedAtStart);
+
+    //More than the ring holds, the newest events are counted and dropped
+    startScenario("Task stalled for 200ms, every key struck");
+    startMicros = (uint32_t)g_hostMicros;
+
+    for(uint8_t keyIdx = 0; keyIdx < KEY_MATRIX_NUM_KEYS; ++keyIdx)
+    {
+        addKeyStroke(startMicros + (keyIdx * 2000), startMicros + (keyIdx * 2000) + 20000, keyIdx);
+    }
+
+    runSim(startMicros + 200000, startMicros + 200000);
+    runSim(startMicros + 220000, 0);
+
+    HOST_TEST_CHECK(g_numEvents == SWITCH_EVENT_RING_NUM_ITEMS);
+    HOST_TEST_CHECK((g_switchEventRing.numDropped - numDroppedAtStart) == ((KEY_MATRIX_NUM_KEYS * 2) - SWITCH_EVENT_RING_NUM_ITEMS));
+    printf("  %u events forwarded, %u dropped\n", g_numEvents, g_switchEventRing.numDropped - numDroppedAtStart);
+}
+
+
+static void testHoldEvents(void)
+{
+    uint32_t startMicros = (uint32_t)g_hostMicros;
+    uint8_t keyIdx = SWITCH_MATRIX_KEY_IDX(3, 4);
+
+    startScenario("Key held for 600ms");
+
+    addKeyStroke(startMicros, startMicros + 600000, keyIdx);
+    runSim(startMicros + 650000, 0);
+
+    checkKeyStrokes(keyIdx, 1);
+    HOST_TEST_CHECK(g_numHoldEvents == 1);
+    HOST_TEST_CHECK(SWITCH_MATRIX_KEY_IDX(g_lastHoldEvent.switchMatrix.column, g_lastHoldEvent.switchMatrix.row) == keyIdx);
+    HOST_TEST_CHECK(g_lastHoldEvent.switchMatrix.heldMicros >= (SWITCH_MATRIX_HOLD_MS * 1000));
+    HOST_TEST_CHECK(g_lastHoldEvent.switchMatrix.heldMicros < ((SWITCH_MATRIX_HOLD_MS + KEY_MATRIX_TASK_RETRY_MS) * 1000));
+    HOST_TEST_CHECK((g_events[1].switchMatrix.heldMicros > 595000) && (g_events[1].switchMatrix.heldMicros < 605000));
+
+    //Released just short of the hold time, with the task held up until after it. The
+    //ISR debounces the release into the ring between the task forwarding events and
+    //checking for holds, no hold may be sent for a key whose release is on its way.
+    startScenario("Key released just before the hold time, task held up");
+    startMicros = (uint32_t)g_hostMicros;
+
+    addKeyStroke(startMicros, startMicros + ((SWITCH_MATRIX_HOLD_MS - 5) * 1000), keyIdx);
+    runSim(startMicros + 300000, 0);
+    runSim(startMicros + ((SWITCH_MATRIX_HOLD_MS + 20) * 1000), startMicros + ((SWITCH_MATRIX_HOLD_MS + 20) * 1000));
+
+    sendHoldEvents();
+    takeSystemEvents();
+    HOST_TEST_CHECK(g_numHoldEvents == 0);
+
+    runSim(g_hostMicros + 20000, 0);
+    checkKeyStrokes(keyIdx, 1);
+    HOST_TEST_CHECK(g_numHoldEvents == 0);
+    HOST_TEST_CHECK(g_events[1].switchMatrix.heldMicros < (SWITCH_MATRIX_HOLD_MS * 1000));
+}
+
+
+static void testGestures(void)
+{
+    //Hold row 2 column 1, then press column 5 on the same row (sets the duration),
+    //column 0 (left of the held key) and row 3 column 6 (another row), both plain presses
+    uint32_t startMicros = (uint32_t)g_hostMicros;
+
+    startScenario("Duration gesture");
+
+    addKeyStroke(startMicros, startMicros + 200000, SWITCH_MATRIX_KEY_IDX(1, 2));
+    addKeyStroke(startMicros + 40000, startMicros + 60000, SWITCH_MATRIX_KEY_IDX(5, 2));
+    addKeyStroke(startMicros + 80000, startMicros + 100000, SWITCH_MATRIX_KEY_IDX(0, 2));
+    addKeyStroke(startMicros + 120000, startMicros + 140000, SWITCH_MATRIX_KEY_IDX(6, 3));
+    runSim(startMicros + 250000, 0);
+
+    HOST_TEST_CHECK(g_numEvents == 8);
+    HOST_TEST_CHECK((g_events[0].eventType == switchMatrixPressEvent) && (g_gestures[0].gestureType == gridGesturePress));
+    HOST_TEST_CHECK((g_events[1].eventType == switchMatrixPressEvent) && (g_gestures[1].gestureType == gridGestureSetDuration));
+    HOST_TEST_CHECK((g_gestures[1].column == 1) && (g_gestures[1].row == 2) && (g_gestures[1].endColumn == 5));
+    HOST_TEST_CHECK(g_gestures[2].gestureType == gridGestureNone);
+    HOST_TEST_CHECK((g_gestures[3].gestureType == gridGesturePress) && (g_gestures[3].column == 0));
+    HOST_TEST_CHECK(g_gestures[4].gestureType == gridGestureNone);
+    HOST_TEST_CHECK((g_gestures[5].gestureType == gridGesturePress) && (g_gestures[5].column == 6) && (g_gestures[5].row == 3));
+    HOST_TEST_CHECK(g_gestures[7].gestureType == gridGestureNone);
+
+    //Once the held key is released the same press is a plain press again
+    startScenario("Press after the held key is released");
+    startMicros = (uint32_t)g_hostMicros;
+    addKeyStroke(startMicros, startMicros + 20000, SWITCH_MATRIX_KEY_IDX(5, 2));
+    runSim(startMicros + 40000, 0);
+    HOST_TEST_CHECK((g_numEvents == 2) && (g_gestures[0].gestureType == gridGesturePress));
+}
+
+
+int main(void)
+{
+    inputEventBus_init();
+    switchMatrixSetup();
+    setupScanTimer();
+    HOST_TEST_CHECK(g_scanAlarmCallback != NULL);
+
+    //Let the debounce settle with nothing pressed
+    runSim(g_hostMicros + 20000, 0);
+    HOST_TEST_CHECK(g_numEvents == 0);
+
+    testEveryKeyMapped();
+    testFullChord();
+    testFingerDrumming();
+    testTaskStalled();
+    testHoldEvents();
+    testGestures();
+
+    HOST_TEST_CHECK(g_hostCriticalNesting == 0);
+    return hostTest_finish("switchMatrixSim");
+}